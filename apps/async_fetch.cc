@@ -0,0 +1,97 @@
+#include "async.hh"
+
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <span>
+#include <string>
+
+using namespace std;
+using namespace std::chrono;
+
+// Fetch the same URL many times at once, with one coroutine per request, all on one thread
+
+namespace {
+
+struct Totals
+{
+  size_t ok;     // responses with status 200
+  size_t other;  // responses with any other status
+  size_t failed; // requests that threw (e.g. the connection was refused or reset)
+  size_t bytes;  // response bytes, headers included
+};
+
+Task<> fetch( AsyncRuntime& runtime, const Address& server, const string& request, Totals& totals )
+{
+  try {
+    AsyncStream stream = co_await AsyncStream::connect( runtime, server );
+    co_await stream.write( request );
+
+    string response;
+    string buffer;
+    while ( not stream.eof() ) {
+      buffer.clear();
+      co_await stream.read( buffer );
+      response += buffer;
+    }
+
+    totals.bytes += response.size();
+    if ( response.starts_with( "HTTP/1.1 200" ) or response.starts_with( "HTTP/1.0 200" ) ) {
+      ++totals.ok;
+    } else {
+      ++totals.other;
+    }
+  } catch ( const exception& e ) {
+    if ( totals.failed++ == 0 ) {
+      cerr << "First failed request: " << e.what() << "\n";
+    }
+  }
+}
+
+} // namespace
+
+int main( int argc, char* argv[] )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort(); // For sticklers: don't try to access argv[0] if argc <= 0.
+    }
+
+    auto args = span( argv, argc );
+
+    if ( argc != 3 and argc != 4 ) {
+      cerr << "Usage: " << args.front() << " HOST PATH [COUNT]\n";
+      cerr << "\tExample: " << args.front() << " stanford.edu /class/cs144 1000\n";
+      return EXIT_FAILURE;
+    }
+
+    const string host { args[1] };
+    const string path { args[2] };
+    const size_t count = argc == 4 ? stoul( args[3] ) : 1000;
+
+    signal( SIGPIPE, SIG_IGN ); // NOLINT(*-err33-c)
+
+    const Address server { host, "http" };
+    const string request = "GET " + path + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n\r\n";
+
+    AsyncRuntime runtime;
+    Totals totals {};
+    const auto start = steady_clock::now();
+    for ( size_t i = 0; i < count; ++i ) {
+      runtime.spawn( fetch( runtime, server, request, totals ) );
+    }
+    runtime.run();
+    const auto elapsed = duration_cast<duration<double>>( steady_clock::now() - start );
+
+    cout << totals.ok << " OK, " << totals.other << " other, " << totals.failed << " failed; " << totals.bytes
+         << " bytes in " << fixed << setprecision( 3 ) << elapsed.count() << " s ("
+         << setprecision( 0 ) << static_cast<double>( count ) / elapsed.count() << " requests/s)\n";
+  } catch ( const exception& e ) {
+    cerr << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -7,8 +7,12 @@
 #include "tcp_minnow_socket_impl.hh"
 #include "tcp_over_ip.hh"
 
+#include <algorithm>
 #include <cstdlib>
+#include <deque>
 #include <iostream>
+#include <optional>
+#include <sys/eventfd.h>
 #include <thread>
 #include <utility>
 
@@ -55,6 +59,26 @@ optional<EthernetFrame> maybe_receive_frame( FileDescriptor& fd )
   return frame;
 }
 
+// Parse a frame received whole (splitting it as maybe_receive_frame's readv would)
+optional<EthernetFrame> parse_frame( string_view datagram )
+{
+  vector<string> strs;
+  strs.reserve( 4 );
+  for ( const size_t length : { EthernetHeader::LENGTH, IPv4Header::LENGTH, TCPSegment::HEADER_LENGTH } ) {
+    const size_t taken = min( length, datagram.size() );
+    strs.emplace_back( datagram.substr( 0, taken ) );
+    datagram.remove_prefix( taken );
+  }
+  strs.emplace_back( datagram );
+
+  EthernetFrame frame;
+  if ( not parse( frame, move( strs ) ) ) {
+    return {};
+  }
+
+  return frame;
+}
+
 inline pair<FileDescriptor, FileDescriptor> make_socket_pair()
 {
   array<int, 2> fds {};
@@ -106,6 +130,7 @@ public:
   }
   void write( const TCPMessage& msg ) { _interface.send_datagram( wrap_tcp_in_ip( msg ), _next_hop ); }
   void tick( const size_t ms_since_last_tick ) { _interface.tick( ms_since_last_tick ); }
+  optional<uint64_t> next_deadline() const { return _interface.next_deadline(); }
   NetworkInterface& interface() { return _interface; }
 
   FileDescriptor& fd() { return sender_->sockets.first; }
@@ -158,13 +183,18 @@ void program_body( bool is_client, const string& bounce_host, const string& boun
   class FramesOut : public NetworkInterface::OutputPort
   {
   public:
-    queue<EthernetFrame> frames {};
+    deque<EthernetFrame> frames {};
     void transmit( const NetworkInterface& n [[maybe_unused]], const EthernetFrame& x ) override
     {
-      frames.push( clone( x ) );
+      frames.push_back( clone( x ) );
     }
   };
 
+  // Frames to and from the bouncer move in batches, one recvmmsg/sendmmsg for each
+  constexpr size_t FRAME_BATCH_SIZE = 64;
+  vector<string> inbound_datagrams( FRAME_BATCH_SIZE );
+  vector<vector<Ref<string>>> outbound_datagrams;
+
   auto router_to_host = make_shared<FramesOut>();
   auto router_to_internet = make_shared<FramesOut>();
 
@@ -206,6 +236,7 @@ void program_body( bool is_client, const string& bounce_host, const string& boun
                                      : TCPSocketEndToEnd { Address { "172.16.0.100" }, Address { "172.16.0.1" } };
 
   atomic<bool> exit_flag {};
+  FileDescriptor exit_event { CheckSystemCall( "eventfd", ::eventfd( 0, EFD_CLOEXEC ) ) }; // wakes the network
 
   /* set up the network */
   thread network_thread( [&]() {
@@ -236,46 +267,74 @@ void program_body( bool is_client, const string& bounce_host, const string& boun
             cerr << "     Router->host:     " << summary( f->frames.front() ) << "\n";
           }
           sock.adapter().frame_fd().write( serialize( f->frames.front() ) );
-          f->frames.pop();
+          f->frames.pop_front();
         },
         [&] { return not router_to_host->frames.empty(); } );
 
-      // Frames from router to Internet
+      // Frames from router to Internet (every queued frame at once)
       event_loop.add_rule(
         "frames from router to Internet",
         internet_socket,
         Direction::Out,
         [&] {
           auto& f = router_to_internet;
-          if ( debug ) {
-            cerr << "     Router->Internet: " << summary( f->frames.front() ) << "\n";
+          outbound_datagrams.clear();
+          for ( const auto& frame : f->frames ) {
+            if ( debug ) {
+              cerr << "     Router->Internet: " << summary( frame ) << "\n";
+            }
+            outbound_datagrams.push_back( serialize( frame ) ); // (may refer to the frame, still queued)
           }
-          internet_socket.write( serialize( f->frames.front() ) );
-          f->frames.pop();
+          const size_t sent = internet_socket.send_batch( outbound_datagrams );
+          f->frames.erase( f->frames.begin(), f->frames.begin() + static_cast<ptrdiff_t>( sent ) );
         },
         [&] { return not router_to_internet->frames.empty(); } );
 
-      // Frames from Internet to router
+      // Frames from Internet to router (as many as are waiting, routed together)
       event_loop.add_rule( "frames from Internet to router", internet_socket, Direction::In, [&] {
-        auto frame_opt = maybe_receive_frame( internet_socket );
-        if ( not frame_opt ) {
-          return;
-        }
-        EthernetFrame frame = move( frame_opt.value() );
-        if ( debug ) {
-          cerr << "     Internet->router: " << summary( frame ) << "\n";
+        const size_t received = internet_socket.recv_batch( inbound_datagrams );
+        for ( size_t i = 0; i < received; ++i ) {
+          auto frame_opt = parse_frame( inbound_datagrams[i] );
+          if ( not frame_opt ) {
+            continue;
+          }
+          EthernetFrame frame = move( frame_opt.value() );
+          if ( debug ) {
+            cerr << "     Internet->router: " << summary( frame ) << "\n";
+          }
+          router.interface( internet_side )->recv_frame( move( frame ) );
         }
-        router.interface( internet_side )->recv_frame( move( frame ) );
         router.route();
       } );
 
+      // Time to quit
+      event_loop.add_rule( "exit", exit_event, Direction::In, [&] {
+        string count;
+        exit_event.read( count );
+      } );
+
+      auto last_tick = timestamp_ms();
+      EventLoop::TimerId wakeup {};
       while ( true ) {
-        if ( EventLoop::Result::Exit == event_loop.wait_next_event( 10 ) ) {
+        // wake up when one of the router's interfaces next has something to expire (not on a fixed tick)
+        event_loop.cancel_timer( wakeup );
+        wakeup = {};
+        optional<uint64_t> deadline = router.interface( host_side )->next_deadline();
+        if ( const auto internet_deadline = router.interface( internet_side )->next_deadline() ) {
+          deadline = min( deadline.value_or( internet_deadline.value() ), internet_deadline.value() );
+        }
+        if ( deadline.has_value() ) {
+          wakeup = event_loop.add_timer( deadline.value(), [] {} );
+        }
+
+        if ( EventLoop::Result::Exit == event_loop.wait_next_event( -1 ) ) {
           cerr << "Exiting...\n";
           return;
         }
-        router.interface( host_side )->tick( 10 );
-        router.interface( internet_side )->tick( 10 );
+        const auto now = timestamp_ms();
+        router.interface( host_side )->tick( now - last_tick );
+        router.interface( internet_side )->tick( now - last_tick );
+        last_tick = now;
 
         if ( exit_flag ) {
           return;
@@ -302,6 +361,8 @@ void program_body( bool is_client, const string& bounce_host, const string& boun
 
   cerr << "Exiting... ";
   exit_flag = true;
+  const uint64_t one = 1;
+  exit_event.write( { reinterpret_cast<const char*>( &one ), sizeof( one ) } ); // NOLINT(*-reinterpret-cast)
   network_thread.join();
   cerr << "done.\n";
 }
@@ -0,0 +1,173 @@
+#include "address.hh"
+#include "ethernet_frame.hh"
+#include "exception.hh"
+#include "helpers.hh"
+#include "network_interface.hh"
+#include "socket.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <linux/if_ether.h>
+#include <memory>
+#include <poll.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+// Measure how many Ethernet frames per second go from one network interface (e.g. one end of a veth pair)
+// to a NetworkInterface reading the other, with ordinary send and recv calls and with memory-mapped rings.
+// (See scripts/veth-bench.sh, which runs this inside a network namespace of its own.)
+
+namespace {
+
+constexpr size_t BATCH_SIZE = 64;                // frames the sender hands the kernel at a time
+constexpr size_t PAYLOAD_SIZE = 18;              // UDP header and data: a 60-byte frame, the Ethernet minimum
+constexpr uint8_t PROTO_UDP = 17;
+constexpr EthernetAddress RECEIVER_ETHERNET_ADDRESS = { 0x02, 0, 0, 0, 0, 0x02 };
+const Address receiver_ip_address { "10.144.0.2" };
+
+class DiscardPort : public NetworkInterface::OutputPort
+{
+public:
+  void transmit( const NetworkInterface& /* sender */, const EthernetFrame& /* frame */ ) override {}
+};
+
+EthernetFrame make_frame()
+{
+  InternetDatagram dgram;
+  dgram.header.len = IPv4Header::LENGTH + PAYLOAD_SIZE;
+  dgram.header.proto = PROTO_UDP;
+  dgram.header.src = Address { "10.144.0.1" }.ipv4_numeric();
+  dgram.header.dst = receiver_ip_address.ipv4_numeric();
+  dgram.header.compute_checksum();
+  dgram.payload.emplace_back( string( PAYLOAD_SIZE, 'x' ) );
+
+  EthernetFrame frame;
+  frame.header.dst = RECEIVER_ETHERNET_ADDRESS;
+  frame.header.src = { 0x02, 0, 0, 0, 0, 0x01 };
+  frame.header.type = EthernetHeader::TYPE_IPv4;
+  frame.payload.emplace_back( concat( serialize( dgram ) ) );
+  return frame;
+}
+
+struct Result
+{
+  double frames_per_second; // handed to the NetworkInterface as IPv4 datagrams
+  double syscalls_per_frame;
+};
+
+// Send frames out of `tx_interface` until told to stop, `BATCH_SIZE` at a time
+void send_frames( const string& tx_interface, const bool rings, const atomic<bool>& stop )
+{
+  PacketSocket socket { SOCK_RAW, 0 }; // (protocol 0: this socket receives nothing)
+  if ( rings ) {
+    socket.map_rings( {}, PacketSocket::RingConfig {} );
+  }
+  socket.bind_interface( tx_interface );
+
+  const vector<vector<Ref<string>>> batch( BATCH_SIZE, serialize( make_frame() ) );
+  while ( not stop.load( memory_order_relaxed ) ) {
+    if ( rings ) {
+      if ( socket.send_ring( batch ) == 0 ) {
+        this_thread::yield(); // the ring is full of frames the kernel has yet to send
+      }
+    } else {
+      socket.send_batch( batch );
+    }
+  }
+}
+
+// Hand each frame arriving on `rx_interface` to a NetworkInterface for `seconds`
+Result receive_frames( const string& tx_interface, const string& rx_interface, const bool rings, const int seconds )
+{
+  PacketSocket socket { SOCK_RAW, htons( ETH_P_ALL ) };
+  if ( rings ) {
+    socket.map_rings( PacketSocket::RingConfig {} );
+  }
+  socket.bind_interface( rx_interface );
+
+  NetworkInterface interface {
+    "receiver", make_shared<DiscardPort>(), RECEIVER_ETHERNET_ADDRESS, receiver_ip_address };
+  uint64_t datagrams = 0;
+  const auto deliver = [&]( EthernetFrame&& frame ) {
+    interface.recv_frame( move( frame ) );
+    datagrams += interface.datagrams_received().size();
+    interface.datagrams_received() = {};
+  };
+
+  atomic<bool> stop {};
+  thread sender { send_frames, tx_interface, rings, cref( stop ) };
+
+  const auto start = steady_clock::now();
+  const auto deadline = start + std::chrono::seconds { seconds };
+  uint64_t syscalls = 0; // by the receiver
+  if ( rings ) {
+    while ( steady_clock::now() < deadline ) {
+      const size_t frames = socket.recv_ring( [&]( const string_view view ) {
+        EthernetFrame frame;
+        if ( parse( frame, vector<string> { string { view } } ) ) { // (the one copy out of the ring)
+          deliver( move( frame ) );
+        }
+      } );
+      if ( frames == 0 ) {
+        pollfd pfd { socket.fd_num(), POLLIN, 0 };
+        CheckSystemCall( "poll", ::poll( &pfd, 1, 10 ) );
+        ++syscalls;
+      }
+    }
+  } else {
+    Address source { "0.0.0.0" };
+    string payload;
+    while ( steady_clock::now() < deadline ) {
+      socket.recv( source, payload );
+      ++syscalls;
+      EthernetFrame frame;
+      if ( parse( frame, vector<string> { move( payload ) } ) ) {
+        deliver( move( frame ) );
+      }
+    }
+  }
+  const auto elapsed = duration_cast<duration<double>>( steady_clock::now() - start );
+
+  stop = true;
+  sender.join();
+
+  const auto frames = static_cast<double>( datagrams );
+  return { .frames_per_second = frames / elapsed.count(),
+           .syscalls_per_frame = datagrams ? static_cast<double>( syscalls ) / frames : 0 };
+}
+
+} // namespace
+
+int main( int argc, char* argv[] )
+{
+  try {
+    if ( argc != 3 and argc != 4 ) {
+      cerr << "Usage: " << argv[0] << " TX_INTERFACE RX_INTERFACE [SECONDS]\n";
+      return EXIT_FAILURE;
+    }
+    const string tx_interface { argv[1] };
+    const string rx_interface { argv[2] };
+    const int seconds = argc == 4 ? stoi( argv[3] ) : 3;
+
+    cerr.setstate( ios::badbit ); // (quiet the NetworkInterface's DEBUG output)
+    for ( const bool rings : { false, true } ) {
+      const Result result = receive_frames( tx_interface, rx_interface, rings, seconds );
+      cout << setw( 26 ) << ( rings ? "TPACKET_V3 rings: " : "sendmmsg and recv: " ) << fixed
+           << setprecision( 0 ) << setw( 10 ) << result.frames_per_second << " frames/s, " << setprecision( 3 )
+           << result.syscalls_per_frame << " receive syscalls/frame\n";
+    }
+  } catch ( const exception& e ) {
+    cerr.clear();
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
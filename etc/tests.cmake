@@ -45,6 +45,7 @@ ttest(recv_reorder)
 ttest(recv_reorder_more)
 ttest(recv_close)
 ttest(recv_special)
+ttest(recv_autotune)
 
 ttest(send_connect)
 ttest(send_transmit)
@@ -58,6 +59,18 @@ ttest(net_interface)
 
 ttest(router)
 
+ttest(tcp_listener)
+ttest(sharded_stack)
+
+ttest(tun_read_batch)
+ttest(tun_offload)
+ttest(tcp_over_udp)
+ttest(receive_coalescing)
+ttest(checksum)
+ttest(parser)
+
+ttest(async_runtime)
+
 ttest(no_skip)
 
 add_custom_target (check0 COMMAND ${CMAKE_CTEST_COMMAND} --output-on-failure --stop-on-failure --timeout 15 -R 'webget|^byte_stream_|^no_skip')
@@ -94,3 +107,23 @@ set_tests_properties(${compile_name_opt} PROPERTIES FIXTURES_SETUP compile_opt)
 
 stest(byte_stream_speed_test)
 stest(reassembler_speed_test)
+stest(connection_table_speed_test)
+stest(tcp_accept_speed_test)
+stest(syn_flood_speed_test)
+stest(sharded_stack_speed_test)
+stest(work_stealing_speed_test)
+stest(eventloop_speed_test)
+stest(minnow_socket_speed_test)
+stest(timer_speed_test)
+stest(io_uring_speed_test)
+stest(udp_router_speed_test)
+stest(router_forwarding_speed_test)
+stest(udp_minnow_speed_test)
+stest(loopback_speed_test)
+stest(tcp_peer_speed_test)
+stest(tcp_transmit_speed_test)
+stest(tcp_gro_speed_test)
+stest(tcp_gso_speed_test)
+stest(checksum_speed_test)
+stest(parse_speed_test)
+stest(tcp_checksum_speed_test)
@@ -0,0 +1,40 @@
+#!/bin/bash
+
+# Measure raw-frame throughput (apps/packet_bench) across a veth pair in a network namespace of its own
+
+NETNS=minnow-bench
+VETH_TX=veth-tx
+VETH_RX=veth-rx
+
+show_usage () {
+    echo "Usage: $0 [build directory] [seconds]"
+    exit 1
+}
+
+[ "$#" -gt 2 ] && show_usage
+BUILD_DIR="${1:-build}"
+SECONDS_PER_RUN="${2:-3}"
+BENCH="${BUILD_DIR}/apps/packet_bench"
+
+[ -x "${BENCH}" ] || { echo "${BENCH} not found (build the packet_bench target first)"; exit 1; }
+[ "$(id -u)" = "0" ] || { echo "please run this script as root (e.g. with sudo)"; exit 1; }
+
+stop_veth () {
+    ip netns del "${NETNS}" 2>/dev/null
+}
+
+start_veth () {
+    ip netns add "${NETNS}"
+    ip -n "${NETNS}" link add "${VETH_TX}" type veth peer name "${VETH_RX}"
+    for DEV in "${VETH_TX}" "${VETH_RX}"; do
+        # keep the kernel from sending frames of its own (e.g. IPv6 router solicitations) during the run
+        ip netns exec "${NETNS}" sysctl -q -w "net.ipv6.conf.${DEV}.disable_ipv6=1"
+        ip -n "${NETNS}" link set dev "${DEV}" up
+    done
+}
+
+stop_veth
+trap stop_veth EXIT
+start_veth || exit 1
+
+ip netns exec "${NETNS}" "${BENCH}" "${VETH_TX}" "${VETH_RX}" "${SECONDS_PER_RUN}"
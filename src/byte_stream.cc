@@ -24,7 +24,9 @@ bool Writer::is_closed() const
 
 uint64_t Writer::available_capacity() const
 {
-  return capacity_ - ( buffer_.size() - read_index_ );
+  // The capacity may have been shrunk below what is currently buffered.
+  const uint64_t buffered = buffer_.size() - read_index_;
+  return capacity_ > buffered ? capacity_ - buffered : 0;
 }
 
 uint64_t Writer::bytes_pushed() const
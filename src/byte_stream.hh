@@ -21,6 +21,11 @@ public:
   void set_error() { error_ = true; };       // Signal that the stream suffered an error.
   bool has_error() const { return error_; }; // Has the stream had an error?
 
+  // Change the capacity at runtime. Shrinking below the bytes already buffered keeps those bytes
+  // (nothing is discarded) but leaves no available capacity until enough of them are popped.
+  void set_capacity( uint64_t capacity ) { capacity_ = capacity; }
+  uint64_t capacity() const { return capacity_; } // Current capacity of the stream
+
 protected:
   // Please add any additional state to the ByteStream here, and not to the Writer and Reader interfaces.
   uint64_t capacity_;
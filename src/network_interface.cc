@@ -136,3 +136,22 @@ void NetworkInterface::tick( const size_t ms_since_last_tick )
   // Drop any expired datagrams
   drop_expired_datagrams();
 }
+
+optional<uint64_t> NetworkInterface::next_deadline() const
+{
+  // Both containers are ordered by the time each entry was added, so the oldest expires first
+  // (a mapping once it is more than MAPPING_TIMEOUT old, a queued datagram once it is ARP_REQUEST_TIMEOUT old)
+  optional<uint64_t> expiry;
+  if ( !mappings.empty() ) {
+    expiry = mappings.begin()->first + MAPPING_TIMEOUT + 1;
+  }
+  if ( !datagrams_queued_.empty() ) {
+    const uint64_t drop = datagrams_queued_.begin()->first + ARP_REQUEST_TIMEOUT;
+    expiry = expiry.has_value() ? min( expiry.value(), drop ) : drop;
+  }
+
+  if ( !expiry.has_value() ) {
+    return {};
+  }
+  return expiry.value() > time_elapsed_ ? expiry.value() - time_elapsed_ : 0;
+}
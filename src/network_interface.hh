@@ -7,6 +7,7 @@
 
 #include <map>
 #include <memory>
+#include <optional>
 #include <queue>
 #include <unordered_map>
 
@@ -63,6 +64,9 @@ public:
   // Called periodically when time elapses
   void tick( size_t ms_since_last_tick );
 
+  // Milliseconds until tick() next has something to expire (a mapping or a queued datagram), if anything
+  std::optional<uint64_t> next_deadline() const;
+
   // Accessors
   const std::string& name() const { return name_; }
   const OutputPort& output() const { return *port_; }
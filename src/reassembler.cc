@@ -44,6 +44,23 @@ void Reassembler::insert( uint64_t first_index, string data, bool is_last_substr
   }
 }
 
+void Reassembler::set_capacity( uint64_t capacity )
+{
+  capacity_ = capacity;
+  output_.set_capacity( capacity );
+
+  // Discard stored bytes that now lie beyond the available capacity
+  const uint64_t limit = next_byte_index() + available_capacity();
+  auto it = unassembled_substrings_.lower_bound( limit );
+  unassembled_substrings_.erase( it, unassembled_substrings_.end() );
+  if ( !unassembled_substrings_.empty() ) {
+    auto& last = *unassembled_substrings_.rbegin();
+    if ( last.first + last.second.length() > limit ) {
+      last.second.resize( limit - last.first );
+    }
+  }
+}
+
 // How many bytes are stored in the Reassembler itself?
 // This function is for testing only; don't add extra state to support it.
 uint64_t Reassembler::count_bytes_pending() const
@@ -33,6 +33,13 @@ public:
    */
   void insert( uint64_t first_index, std::string data, bool is_last_substring );
 
+  /*
+   * Change the capacity of the output ByteStream (and therefore of the Reassembler) at runtime.
+   * When the capacity shrinks, any stored bytes that no longer fit within the new available
+   * capacity are discarded, exactly as if they had arrived beyond the capacity in the first place.
+   */
+  void set_capacity( uint64_t capacity );
+
   // How many bytes are stored in the Reassembler itself?
   // This function is for testing only; don't add extra state to support it.
   uint64_t count_bytes_pending() const;
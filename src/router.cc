@@ -51,8 +51,7 @@ void Router::route()
              << ", dst = " << Address::from_ipv4_numeric( dgram.header.dst ).ip() << "\n";
         continue;
       }
-      dgram.header.ttl--;
-      dgram.header.compute_checksum();
+      dgram.header.set_ttl( dgram.header.ttl - 1 ); // (adjusts the checksum, rather than recomputing it)
 
       uint32_t next_hop_ip;
       size_t interface_num;
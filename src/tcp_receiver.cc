@@ -35,6 +35,17 @@ void TCPReceiver::receive( TCPSenderMessage message )
   }
 }
 
+bool TCPReceiver::predicts( const TCPSenderMessage& message ) const
+{
+  if ( message.SYN || message.FIN || message.RST || !reassembler_.SYN || FIN ) {
+    return false;
+  }
+
+  return reassembler_.unassembled_substrings_.empty() && !reassembler_.output_.has_error()
+         && message.seqno == Wrap32::wrap( reassembler_.next_byte_index(), zero_point_ )
+         && message.payload.size() <= reassembler_.available_capacity();
+}
+
 TCPReceiverMessage TCPReceiver::send() const
 {
   // Your code here.
@@ -19,6 +19,18 @@ public:
   // The TCPReceiver sends TCPReceiverMessages to the peer's TCPSender.
   TCPReceiverMessage send() const;
 
+  /*
+   * Header prediction: is this the next in-order segment, without flags, that fits in the stream
+   * whole while nothing waits in the Reassembler? If so, its payload can go to receive_predicted().
+   */
+  bool predicts( const TCPSenderMessage& message ) const;
+
+  // Append the payload of a segment that predicts() accepted straight to the stream.
+  void receive_predicted( std::string payload ) { reassembler_.get_writer().push( std::move( payload ) ); }
+
+  // Resize the receive buffer (and with it the advertised window) at runtime.
+  void set_capacity( uint64_t capacity ) { reassembler_.set_capacity( capacity ); }
+
   // Access the output
   const Reassembler& reassembler() const { return reassembler_; }
   Reader& reader() { return reassembler_.reader(); }
@@ -12,7 +12,7 @@ uint64_t TCPSender::sequence_numbers_in_flight() const
   uint64_t count = 0;
   auto it = outstanding_segments_.begin();
   while ( it != outstanding_segments_.end() ) {
-    count += it->second.sequence_length();
+    count += it->second.message.sequence_length();
     ++it;
   }
   return count;
@@ -30,7 +30,17 @@ void TCPSender::push( const TransmitFunction& transmit )
 {
   // debug( "unimplemented push() called" );
 
-  while ( ( !FIN && sender_window_size_ > 0 ) || zero_windowsize_received_ ) {
+  // The receiver had no room for the zero-window probe, so it has been dropped: send it again now that the window
+  // is open, rather than leaving the byte missing from the data that follows until the retransmission timeout.
+  if ( resend_probe_ ) {
+    resend_probe_ = false;
+    if ( const auto probe = outstanding_segments_.find( last_ackno_ ); probe != outstanding_segments_.end() ) {
+      transmit( probe->second.message );
+    }
+  }
+
+  // A zero window is probed with one byte, but only once everything before the probe has been acknowledged
+  while ( ( !FIN && sender_window_size_ > 0 ) || ( zero_windowsize_received_ && next_seqno_ == last_ackno_ ) ) {
     if ( FIN )
       return;
 
@@ -49,8 +59,7 @@ void TCPSender::push( const TransmitFunction& transmit )
       sender_window_size_ = 1;
       payload_size = min( sender_window_size_ - msg.SYN, reader().bytes_buffered() );
     } else {
-      payload_size
-        = min( min( (uint64_t)TCPConfig::MAX_PAYLOAD_SIZE, reader().bytes_buffered() ), sender_window_size_ - msg.SYN );
+      payload_size = min( min( max_payload_size_, reader().bytes_buffered() ), sender_window_size_ - msg.SYN );
     }
 
     msg.payload = reader().peek().substr( 0, payload_size );
@@ -82,14 +91,17 @@ void TCPSender::push( const TransmitFunction& transmit )
     //        msg.RST,
     //        msg.sequence_length() );
 
-    // Add the segment to the outstanding segments map and update the next sequence number.
-    outstanding_segments_[next_seqno_] = msg;
+    // Add the segment to the outstanding segments map and update the next sequence number. The segment is sent
+    // from the map, with its payload's sum, which is kept for any retransmission.
+    const uint16_t payload_sum = msg.payload_sum();
+    const TCPSenderMessage& outstanding
+      = ( outstanding_segments_[next_seqno_] = { .message = move( msg ), .payload_sum = payload_sum } ).message;
     reader().pop( payload_size );
     next_seqno_ = reader().bytes_popped() + SYN + FIN;
-    sender_window_size_ = rwindow_ - next_seqno_ + 1;
+    sender_window_size_ = window_remaining();
 
-    transmit( msg );
-    if ( msg.sequence_length() > 0 && !timer_.is_running() ) {
+    transmit( outstanding );
+    if ( !timer_.is_running() ) {
       timer_.start();
     }
 
@@ -137,33 +149,53 @@ void TCPSender::receive( const TCPReceiverMessage& msg )
 
   // Update the sender's and receiver's window even if we have received a duplicate ACK or a null ACK.
   if ( msg.ackno->unwrap( isn_, last_ackno_ ) == last_ackno_ || !msg.ackno ) {
+    resend_probe_
+      |= receiver_window_size_ == 0 && msg.window_size > 0 && outstanding_segments_.contains( last_ackno_ );
     receiver_window_size_ = msg.window_size;
-    if ( receiver_window_size_ == 0 ) {
-      zero_windowsize_received_ = true;
-    }
+    zero_windowsize_received_ = ( receiver_window_size_ == 0 );
     rwindow_ = last_ackno_ + msg.window_size - 1;
-    sender_window_size_ = rwindow_ - next_seqno_ + 1;
+    sender_window_size_ = window_remaining();
     return;
   }
 
   // If we get to this point, it means we have received a new ACK message.
-  last_ackno_ = msg.ackno->unwrap( isn_, last_ackno_ );
-  receiver_window_size_ = msg.window_size;
-  if ( receiver_window_size_ == 0 ) {
-    zero_windowsize_received_ = true;
+  acknowledge( msg.ackno->unwrap( isn_, last_ackno_ ), msg.window_size );
+}
+
+bool TCPSender::receive_predicted( const TCPReceiverMessage& msg )
+{
+  // A zero window, a window that changed, and an ACK that goes with a probe all take the full path.
+  if ( !msg.ackno || msg.RST || msg.window_size == 0 || msg.window_size != receiver_window_size_
+       || resend_probe_ ) {
+    return false;
   }
-  rwindow_ = last_ackno_ + msg.window_size - 1;
-  sender_window_size_ = rwindow_ - next_seqno_ + 1;
 
-  // Remove any segments that have been acknowledged from the outstanding segments map.
-  auto it = outstanding_segments_.begin();
-  while ( it != outstanding_segments_.end() ) {
-    if ( it->first + it->second.sequence_length() <= last_ackno_ ) {
-      // This segment has been acknowledged.
-      it = outstanding_segments_.erase( it );
-    } else {
-      ++it;
+  const uint64_t ackno = msg.ackno->unwrap( isn_, last_ackno_ );
+  if ( ackno < last_ackno_ || ackno > next_seqno_ ) {
+    return false;
+  }
+
+  if ( ackno > last_ackno_ ) {
+    acknowledge( ackno, msg.window_size );
+  }
+  return true;
+}
+
+void TCPSender::acknowledge( uint64_t ackno, uint16_t window_size )
+{
+  last_ackno_ = ackno;
+  receiver_window_size_ = window_size;
+  zero_windowsize_received_ = ( receiver_window_size_ == 0 );
+  rwindow_ = last_ackno_ + window_size - 1;
+  sender_window_size_ = window_remaining();
+
+  // Remove the segments that have been acknowledged (the outstanding segments are in order, without overlap).
+  while ( !outstanding_segments_.empty() ) {
+    const auto& [seqno, segment] = *outstanding_segments_.begin();
+    if ( seqno + segment.message.sequence_length() > last_ackno_ ) {
+      break;
     }
+    outstanding_segments_.erase( outstanding_segments_.begin() );
   }
 
   /*
@@ -181,6 +213,24 @@ void TCPSender::receive( const TCPReceiverMessage& msg )
   consecutive_retransmissions_ = 0;
 }
 
+optional<uint64_t> TCPSender::next_deadline() const
+{
+  // Only the retransmission timer makes the sender act on its own
+  if ( !timer_.is_running() )
+    return {};
+
+  return timer_.time_remaining();
+}
+
+optional<uint16_t> TCPSender::kept_payload_sum( const TCPSenderMessage& msg ) const
+{
+  const auto it = outstanding_segments_.find( msg.seqno.unwrap( isn_, last_ackno_ ) );
+  if ( it == outstanding_segments_.end() || &it->second.message != &msg ) {
+    return {};
+  }
+  return it->second.payload_sum;
+}
+
 void TCPSender::tick( uint64_t ms_since_last_tick, const TransmitFunction& transmit )
 {
   // debug( "unimplemented tick({}, ...) called", ms_since_last_tick );
@@ -192,7 +242,7 @@ void TCPSender::tick( uint64_t ms_since_last_tick, const TransmitFunction& trans
 
   if ( timer_.expired() ) {
     // Retransmit the earliest outstanding segment.
-    transmit( outstanding_segments_.begin()->second );
+    transmit( outstanding_segments_.begin()->second.message );
 
     // If the receiver's window size is nonzero, increment the number of consecutive retransmissions and double RTO.
     if ( receiver_window_size_ != 0 ) {
@@ -1,11 +1,13 @@
 #pragma once
 
 #include "byte_stream.hh"
+#include "tcp_config.hh"
 #include "tcp_receiver_message.hh"
 #include "tcp_sender_message.hh"
 
 #include <functional>
 #include <map>
+#include <optional>
 
 class RetransmissionTimer {
 private:
@@ -50,6 +52,11 @@ public:
       return running_;
     }
 
+    // Time left until the timer expires (0 if it already has)
+    uint64_t time_remaining() const {
+      return current_RTO_ms_ > time_elapsed_ ? current_RTO_ms_ - time_elapsed_ : 0;
+    }
+
     void time_elapsed(uint64_t time_ms) {
       time_elapsed_ += time_ms;
     }
@@ -58,9 +65,17 @@ public:
 class TCPSender
 {
 public:
-  /* Construct TCP sender with given default Retransmission Timeout and possible ISN */
-  TCPSender( ByteStream&& input, Wrap32 isn, uint64_t initial_RTO_ms )
-    : input_( std::move( input ) ), isn_( isn ), initial_RTO_ms_( initial_RTO_ms ), timer_(initial_RTO_ms)
+  /* Construct TCP sender with given default Retransmission Timeout and possible ISN (and, for segmentation
+     offload, segments of up to `max_payload_size` bytes: see TCPConfig::max_segment_payload) */
+  TCPSender( ByteStream&& input,
+             Wrap32 isn,
+             uint64_t initial_RTO_ms,
+             uint64_t max_payload_size = TCPConfig::MAX_PAYLOAD_SIZE )
+    : input_( std::move( input ) )
+    , isn_( isn )
+    , initial_RTO_ms_( initial_RTO_ms )
+    , max_payload_size_( max_payload_size )
+    , timer_( initial_RTO_ms )
   {}
 
   /* Generate an empty TCPSenderMessage */
@@ -69,6 +84,10 @@ public:
   /* Receive and process a TCPReceiverMessage from the peer's receiver */
   void receive( const TCPReceiverMessage& msg );
 
+  /* Header prediction: receive an ACK that acknowledges new data (or nothing new) without changing the
+     window, and return true; return false, having done nothing, if the ACK needs the full receive() */
+  bool receive_predicted( const TCPReceiverMessage& msg );
+
   /* Type of the `transmit` function that the push and tick methods can use to send messages */
   using TransmitFunction = std::function<void( const TCPSenderMessage& )>;
 
@@ -81,6 +100,11 @@ public:
   // Accessors
   uint64_t sequence_numbers_in_flight() const;  // For testing: how many sequence numbers are outstanding?
   uint64_t consecutive_retransmissions() const; // For testing: how many consecutive retransmissions have happened?
+  std::optional<uint64_t> next_deadline() const; // Milliseconds until tick() has work to do (none if idle)
+
+  /* The payload_sum() kept with `msg`, if it is an outstanding segment as given to transmit (so that sending
+     it again doesn't sum its payload again) */
+  std::optional<uint16_t> kept_payload_sum( const TCPSenderMessage& msg ) const;
   const Writer& writer() const { return input_.writer(); }
   const Reader& reader() const { return input_.reader(); }
   Writer& writer() { return input_.writer(); }
@@ -88,9 +112,16 @@ public:
 private:
   Reader& reader() { return input_.reader(); }
 
+  // Room left in the receiver's window (none if the window shrank below what is already in flight)
+  uint64_t window_remaining() const { return rwindow_ + 1 > next_seqno_ ? rwindow_ + 1 - next_seqno_ : 0; }
+
+  // Take a new ackno (beyond last_ackno_): slide the window, drop acknowledged segments and restart the timer
+  void acknowledge( uint64_t ackno, uint16_t window_size );
+
   ByteStream input_;
   Wrap32 isn_;
   uint64_t initial_RTO_ms_;
+  uint64_t max_payload_size_;    // The largest payload of a segment (a super-segment, above the MSS)
   RetransmissionTimer timer_;
   uint64_t next_seqno_ {};    // The next sequence number to be sent
   uint64_t last_sent_seqno_ {};    // The last sequence number sent
@@ -102,6 +133,14 @@ private:
   bool SYN {};    // Whether the TCPSender has sent SYN flag
   bool FIN {};    // Whether the TCPSender has sent FIN flag
   bool zero_windowsize_received_ {};    // Whether the TCPSender has received a zero window size from the receiver
+  bool resend_probe_ {};    // Whether the window reopened before the zero-window probe was acknowledged
+
+  // A segment that may be retransmitted, with its payload's sum (computed once, when it is first sent)
+  struct OutstandingSegment
+  {
+    TCPSenderMessage message {};
+    uint16_t payload_sum {};
+  };
 
-  std::map<uint64_t, TCPSenderMessage> outstanding_segments_ {};
+  std::map<uint64_t, OutstandingSegment> outstanding_segments_ {};
 };
\ No newline at end of file
@@ -0,0 +1,215 @@
+#include "async.hh"
+#include "exception.hh"
+
+#include <algorithm>
+#include <array>
+#include <csignal>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t NUM_CLIENTS = 1000;
+
+void expect( bool condition, const string& what )
+{
+  if ( not condition ) {
+    throw runtime_error( "expectation failed: " + what );
+  }
+}
+
+void raise_fd_limit( const size_t needed )
+{
+  rlimit limit {};
+  CheckSystemCall( "getrlimit", getrlimit( RLIMIT_NOFILE, &limit ) );
+  if ( limit.rlim_cur < needed ) {
+    limit.rlim_cur = min<rlim_t>( needed, limit.rlim_max );
+    CheckSystemCall( "setrlimit", setrlimit( RLIMIT_NOFILE, &limit ) );
+  }
+}
+
+void sleepers_wake_in_order()
+{
+  AsyncRuntime runtime;
+  vector<uint64_t> woken;
+  const auto sleeper = [&]( uint64_t delay_ms ) -> Task<> {
+    co_await runtime.sleep( delay_ms );
+    woken.push_back( delay_ms );
+  };
+  for ( const uint64_t delay_ms : { 30, 10, 20 } ) {
+    runtime.spawn( sleeper( delay_ms ) );
+  }
+  expect( runtime.running() == 3, "spawned tasks run until they first suspend" );
+  runtime.run();
+  expect( woken == vector<uint64_t> { 10, 20, 30 }, "sleepers wake in order of their delays" );
+}
+
+void results_and_exceptions_propagate()
+{
+  AsyncRuntime runtime;
+  const auto square = [&]( int x ) -> Task<int> {
+    co_await runtime.sleep( 1 );
+    co_return x * x;
+  };
+  const auto fail = [&]() -> Task<int> {
+    co_await runtime.sleep( 1 );
+    throw runtime_error( "failed on purpose" );
+  };
+
+  int total = 0;
+  string caught;
+  const auto combine = [&]() -> Task<> { // (a coroutine lambda must outlive its coroutine)
+    total = co_await square( 3 ) + co_await square( 4 );
+    try {
+      co_await fail();
+    } catch ( const runtime_error& e ) {
+      caught = e.what();
+    }
+  };
+  runtime.spawn( combine() );
+  runtime.run();
+  expect( total == 25, "a Task's co_return value reaches its awaiter" );
+  expect( caught == "failed on purpose", "an exception reaches the awaiter" );
+
+  const auto fail_uncaught = [&]() -> Task<> { co_await fail(); };
+  runtime.spawn( fail_uncaught() );
+  bool rethrown = false;
+  try {
+    runtime.run();
+  } catch ( const runtime_error& ) {
+    rethrown = true;
+  }
+  expect( rethrown, "run() rethrows an exception that escaped a spawned Task" );
+}
+
+// Read until EOF
+Task<string> read_all( AsyncStream& stream )
+{
+  string contents;
+  string buffer;
+  while ( not stream.eof() ) {
+    buffer.clear();
+    co_await stream.read( buffer );
+    contents += buffer;
+  }
+  co_return contents;
+}
+
+// A server answering each of NUM_CLIENTS connections, all made at once by clients in the same thread
+void many_concurrent_exchanges()
+{
+  raise_fd_limit( NUM_CLIENTS * 2 + 64 );
+
+  AsyncRuntime runtime;
+  TCPSocket listening;
+  listening.bind( Address { "127.0.0.1", 0 } );
+  listening.listen( NUM_CLIENTS );
+  AsyncListener listener { runtime, move( listening ) };
+
+  const auto serve = [&]( AsyncStream connection ) -> Task<> {
+    const string request = co_await read_all( connection );
+    co_await runtime.sleep( 1 ); // (so every exchange is in flight at once)
+    const string reply = "reply to " + request;
+    co_await connection.write( reply );
+  };
+
+  const auto accept_all = [&]() -> Task<> {
+    for ( size_t i = 0; i < NUM_CLIENTS; ++i ) {
+      runtime.spawn( serve( co_await listener.accept() ) );
+    }
+  };
+  runtime.spawn( accept_all() );
+
+  size_t correct = 0;
+  const auto client = [&]( size_t id ) -> Task<> {
+    AsyncStream stream = co_await AsyncStream::connect( runtime, listener.local_address() );
+    const string request = "request " + to_string( id ) + string( id, 'x' );
+    co_await stream.write( request );
+    stream.shutdown_write();
+    if ( co_await read_all( stream ) == "reply to " + request ) {
+      ++correct;
+    }
+  };
+  for ( size_t i = 0; i < NUM_CLIENTS; ++i ) {
+    runtime.spawn( client( i ) );
+  }
+
+  runtime.run();
+  expect( correct == NUM_CLIENTS, to_string( correct ) + " of " + to_string( NUM_CLIENTS ) + " replies correct" );
+}
+
+// When another acceptor takes the connection that made the listener ready, accept() keeps waiting
+void accept_after_another_acceptor()
+{
+  AsyncRuntime runtime;
+  array<int, 2> fds {};
+  CheckSystemCall( "pipe", ::pipe( fds.data() ) );
+  AsyncStream signal { runtime, FileDescriptor { fds[0] } };
+  FileDescriptor signal_writer { fds[1] };
+
+  TCPSocket listening;
+  listening.bind( Address { "127.0.0.1", 0 } );
+  listening.listen( 4 );
+  AsyncListener listener { runtime, move( listening ) };
+
+  // woken in the same round as the listener, but served first (its rules are older), it takes the connection
+  bool taken = false;
+  TCPSocket second_client;
+  const auto other_acceptor = [&]() -> Task<> {
+    string buffer( 1, 0 );
+    co_await signal.read( buffer );
+    const int fd = ::accept( listener.fd().fd_num(), nullptr, nullptr );
+    taken = fd >= 0;
+    if ( taken ) {
+      FileDescriptor { fd }.close();
+    }
+    co_await runtime.sleep( 1 ); // (after the listener's rule has found nothing to accept)
+    second_client.connect( listener.local_address() );
+  };
+
+  bool accepted = false;
+  const auto acceptor = [&]() -> Task<> {
+    co_await listener.accept();
+    accepted = true;
+  };
+
+  runtime.spawn( other_acceptor() );
+  runtime.spawn( acceptor() );
+  signal_writer.write( "x" );
+  TCPSocket first_client;
+  first_client.connect( listener.local_address() );
+  pollfd ready { .fd = listener.fd().fd_num(), .events = POLLIN, .revents = 0 };
+  CheckSystemCall( "poll", ::poll( &ready, 1, 1000 ) ); // (so the first wait finds both ready)
+  runtime.run();
+
+  expect( taken, "the other acceptor took the first connection" );
+  expect( accepted, "accept() returned the second connection" );
+  expect( ::fcntl( STDIN_FILENO, F_GETFD ) >= 0, "and stdin is still open" ); // NOLINT(*-vararg)
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    signal( SIGPIPE, SIG_IGN ); // NOLINT(*-err33-c)
+    sleepers_wake_in_order();
+    results_and_exceptions_propagate();
+    many_concurrent_exchanges();
+    accept_after_another_acceptor();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
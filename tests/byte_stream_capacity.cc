@@ -96,6 +96,39 @@ int main()
       test.execute( BytesBuffered { 1 } );
     }
 
+    {
+      ByteStreamTestHarness test { "grow capacity", 2 };
+
+      test.execute( Push { "cat" } );
+      test.execute( BytesPushed { 2 } );
+      test.execute( AvailableCapacity { 0 } );
+      test.execute( SetCapacity { 5 } );
+      test.execute( AvailableCapacity { 3 } );
+      test.execute( Push { "tac" } );
+      test.execute( BytesPushed { 5 } );
+      test.execute( AvailableCapacity { 0 } );
+      test.execute( Peek { "catac" } );
+    }
+
+    {
+      ByteStreamTestHarness test { "shrink capacity below bytes buffered", 4 };
+
+      test.execute( Push { "cat" } );
+      test.execute( AvailableCapacity { 1 } );
+      test.execute( SetCapacity { 2 } );
+      test.execute( AvailableCapacity { 0 } );
+      test.execute( BytesBuffered { 3 } );
+      test.execute( Push { "s" } );
+      test.execute( BytesPushed { 3 } );
+      test.execute( Pop { 1 } );
+      test.execute( AvailableCapacity { 0 } );
+      test.execute( Pop { 1 } );
+      test.execute( AvailableCapacity { 1 } );
+      test.execute( Push { "ss" } );
+      test.execute( BytesPushed { 4 } );
+      test.execute( Peek { "ts" } );
+    }
+
   } catch ( const exception& e ) {
     cerr << "Exception: " << e.what() << "\n";
     return EXIT_FAILURE;
@@ -0,0 +1,178 @@
+#include "checksum.hh"
+#include "ipv4_header.hh"
+#include "random.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t NUM_TRIALS = 20'000;
+
+void expect( bool condition, const string& what )
+{
+  if ( not condition ) {
+    throw runtime_error( "expectation failed: " + what );
+  }
+}
+
+// The checksum as computed a byte at a time
+class BytewiseChecksum
+{
+  uint32_t sum_;
+  bool parity_ {};
+
+public:
+  explicit BytewiseChecksum( uint32_t sum ) : sum_( sum ) {}
+
+  void add( string_view data )
+  {
+    for ( const uint8_t byte : data ) {
+      sum_ += parity_ ? byte : byte << 8;
+      parity_ = not parity_;
+    }
+  }
+
+  uint16_t value() const
+  {
+    uint32_t ret = sum_;
+    while ( ret > 0xffff ) {
+      ret = ( ret >> 16 ) + static_cast<uint16_t>( ret );
+    }
+    return ~ret;
+  }
+};
+
+// Checksum the same buffers, split at random and starting at random alignments, with every kernel
+void kernels_match_bytewise( const InternetChecksum::Kernel kernel )
+{
+  InternetChecksum::use_kernel( kernel );
+  auto rd = get_random_engine();
+
+  string storage;
+  for ( size_t trial = 0; trial < NUM_TRIALS; ++trial ) {
+    const size_t size = trial % 100 == 0 ? rd() % 70'000 : rd() % 300;
+    const size_t alignment = rd() % 64;
+    storage.resize( alignment + size );
+    const uint8_t pattern = rd() % 4; // (all zeros, all ones, or random: the sum's extremes)
+    ranges::generate( storage, [&] { return static_cast<char>( pattern == 0 ? 0 : pattern == 1 ? 0xff : rd() ); } );
+    const string_view data = string_view { storage }.substr( alignment );
+
+    vector<string_view> buffers;
+    for ( size_t offset = 0; offset < size; ) {
+      const size_t length = min<size_t>( size - offset, rd() % 4 == 0 ? rd() % 5 : rd() % ( size + 1 ) );
+      buffers.push_back( data.substr( offset, length ) );
+      offset += length;
+    }
+
+    const uint32_t initial = rd() % 3 == 0 ? 0 : rd() % 0x10'0000;
+    BytewiseChecksum expected { initial };
+    InternetChecksum actual { initial };
+    for ( const auto buffer : buffers ) {
+      expected.add( buffer );
+    }
+    actual.add( buffers );
+    expect( actual.value() == expected.value(),
+            "kernel " + to_string( static_cast<int>( kernel ) ) + " matches the bytewise checksum of "
+              + to_string( size ) + " bytes in " + to_string( buffers.size() ) + " buffers" );
+  }
+}
+
+// Changing a word of a buffer and adjusting its checksum gives the checksum of the changed buffer
+void adjust_matches_recomputed()
+{
+  auto rd = get_random_engine();
+  for ( size_t trial = 0; trial < NUM_TRIALS; ++trial ) {
+    string data( 2 * ( 1 + rd() % 32 ), 0 );
+    const uint8_t pattern = rd() % 4;
+    ranges::generate( data, [&] { return static_cast<char>( pattern == 0 ? 0 : pattern == 1 ? 0xff : rd() ); } );
+    const uint32_t initial = rd() % 2 ? 0 : 1 + rd() % 0xffff; // (0 for a buffer of zeros alone)
+
+    InternetChecksum before { initial };
+    before.add( string_view { data } );
+
+    const size_t word = 2 * ( rd() % ( data.size() / 2 ) );
+    const auto old_word
+      = static_cast<uint16_t>( static_cast<uint8_t>( data[word] ) << 8 | static_cast<uint8_t>( data[word + 1] ) );
+    const auto new_word = static_cast<uint16_t>( rd() % 3 == 0 ? ( rd() % 2 ? 0 : 0xffff ) : rd() );
+    data[word] = static_cast<char>( new_word >> 8 );
+    data[word + 1] = static_cast<char>( new_word );
+
+    InternetChecksum after { initial };
+    after.add( string_view { data } );
+    if ( initial == 0 and after.value() == 0xffff ) {
+      continue; // (a buffer now all zeros: the one sum that one's complement arithmetic can't reach by adding)
+    }
+    expect( InternetChecksum::adjust( before.value(), old_word, new_word ) == after.value(),
+            "adjusting the checksum for a changed word matches recomputing it" );
+  }
+}
+
+// An IPv4 header's TTL and addresses, changed with its checksum adjusted, give the header that recomputing the
+// checksum would
+void header_updates_match_recomputed()
+{
+  auto rd = get_random_engine();
+  for ( size_t trial = 0; trial < NUM_TRIALS; ++trial ) {
+    IPv4Header header;
+    header.tos = rd();
+    header.len = rd();
+    header.id = rd();
+    header.ttl = rd();
+    header.proto = rd();
+    header.src = rd() % 4 == 0 ? 0 : rd() * 2 + rd() % 2;
+    header.dst = rd() % 4 == 0 ? 0xffff'ffff : rd() * 2 + rd() % 2;
+    header.compute_checksum();
+
+    for ( size_t change = 0; change < 8; ++change ) {
+      switch ( rd() % 3 ) {
+        case 0:
+          header.set_ttl( rd() % 4 == 0 ? header.ttl - 1 : rd() );
+          break;
+        case 1:
+          header.set_src( rd() % 4 == 0 ? 0 : rd() * 2 + rd() % 2 );
+          break;
+        default:
+          header.set_dst( rd() % 4 == 0 ? 0xffff'ffff : rd() * 2 + rd() % 2 );
+          break;
+      }
+
+      IPv4Header recomputed = header;
+      recomputed.compute_checksum();
+      expect( header.cksum == recomputed.cksum, "the adjusted IPv4 header checksum matches recomputing it" );
+    }
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    const auto fastest = InternetChecksum::kernel();
+    for ( const auto kernel :
+          { InternetChecksum::Kernel::Portable, InternetChecksum::Kernel::SSE2, InternetChecksum::Kernel::AVX2 } ) {
+      if ( InternetChecksum::supported( kernel ) ) {
+        kernels_match_bytewise( kernel );
+      }
+    }
+    expect( InternetChecksum::supported( fastest ), "the default kernel is supported" );
+    InternetChecksum::use_kernel( fastest );
+
+    adjust_matches_recomputed();
+    header_updates_match_recomputed();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,137 @@
+#include "checksum.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr size_t BYTES_PER_RUN = 512 * 1024 * 1024;
+constexpr double MIN_GB_PER_SECOND = 1; // of the default kernel, for a full-sized datagram
+
+// Where each run's checksums end up, so the compiler must compute them
+volatile uint32_t checksum_sink = 0; // NOLINT(*-avoid-non-const-global-variables)
+
+// The checksum as computed a byte at a time (as InternetChecksum once did)
+uint16_t bytewise_checksum( string_view data )
+{
+  uint32_t sum = 0;
+  bool parity = false;
+  for ( const uint8_t byte : data ) {
+    sum += parity ? byte : byte << 8;
+    parity = not parity;
+  }
+  while ( sum > 0xffff ) {
+    sum = ( sum >> 16 ) + static_cast<uint16_t>( sum );
+  }
+  return ~sum;
+}
+
+// GB/s checksumming buffers of `size` bytes (one byte into the allocation, so misaligned), with `checksum`
+template<class Checksum>
+double gigabytes_per_second( const size_t size, const Checksum& checksum )
+{
+  string storage( size + 1, 0 );
+  for ( size_t i = 0; i < storage.size(); ++i ) {
+    storage[i] = static_cast<char>( i * 131 );
+  }
+  const string_view data = string_view { storage }.substr( 1 );
+
+  const size_t repetitions = BYTES_PER_RUN / size;
+  uint32_t total = 0;
+  const auto start = steady_clock::now();
+  for ( size_t i = 0; i < repetitions; ++i ) {
+    total += checksum( data );
+    storage[1 + i % size]++; // (so the sum can't be hoisted out of the loop)
+  }
+  const auto elapsed = duration_cast<duration<double>>( steady_clock::now() - start );
+
+  checksum_sink = total;
+  return static_cast<double>( repetitions * size ) / elapsed.count() / 1e9;
+}
+
+string kernel_name( const InternetChecksum::Kernel kernel )
+{
+  switch ( kernel ) {
+    case InternetChecksum::Kernel::Portable:
+      return "64-bit words";
+    case InternetChecksum::Kernel::SSE2:
+      return "SSE2";
+    case InternetChecksum::Kernel::AVX2:
+      return "AVX2";
+  }
+  return "unknown";
+}
+
+void program_body()
+{
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  const auto fastest = InternetChecksum::kernel();
+  vector<pair<string, double>> datagram_rates;
+  for ( const size_t size : { 64, 256, 1500, 16384, 65536 } ) {
+    vector<pair<string, double>> rates;
+    rates.emplace_back( "a byte at a time", gigabytes_per_second( size, bytewise_checksum ) );
+    for ( const auto kernel :
+          { InternetChecksum::Kernel::Portable, InternetChecksum::Kernel::SSE2, InternetChecksum::Kernel::AVX2 } ) {
+      if ( InternetChecksum::supported( kernel ) ) {
+        InternetChecksum::use_kernel( kernel );
+        rates.emplace_back( kernel_name( kernel ), gigabytes_per_second( size, []( string_view data ) {
+                              InternetChecksum check;
+                              check.add( data );
+                              return check.value();
+                            } ) );
+      }
+    }
+    InternetChecksum::use_kernel( fastest );
+
+    for ( const auto& [name, rate] : rates ) {
+      cout << "Checksum " << size << "-byte buffers (" << name << "): " << fixed << setprecision( 2 ) << rate
+           << " GB/s.\n";
+      debug_output << "    Checksum " << setw( 5 ) << size << "-byte buffers " << setw( 16 ) << name << ": "
+                   << fixed << setprecision( 2 ) << setw( 6 ) << rate << " GB/s\n";
+    }
+    if ( size == 1500 ) {
+      datagram_rates = rates;
+    }
+  }
+
+  const double bytewise = datagram_rates.front().second;
+  for ( const auto& [name, rate] : datagram_rates ) {
+    if ( name == kernel_name( fastest ) ) {
+      cout << "Checksum speedup (" << name << " over a byte at a time, 1500-byte buffers): " << fixed
+           << setprecision( 2 ) << rate / bytewise << "x.\n";
+      if ( rate < MIN_GB_PER_SECOND ) {
+        throw runtime_error( "the " + name + " checksum did not meet minimum speed of "
+                             + to_string( static_cast<int>( MIN_GB_PER_SECOND ) ) + " GB/s" );
+      }
+    }
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
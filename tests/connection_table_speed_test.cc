@@ -0,0 +1,153 @@
+#include "connection_table.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr size_t NUM_CONNECTIONS = 100'000;
+constexpr size_t NUM_LOOKUPS = 10'000'000;
+
+// Connections as a busy server sees them: a few local addresses and ports, many remote hosts
+vector<FourTuple> make_tuples( const size_t count, default_random_engine& rd )
+{
+  uniform_int_distribution<uint32_t> remote_address { 0x0a000000, 0x0affffff };
+  uniform_int_distribution<uint16_t> remote_port { 1024, 65535 };
+  uniform_int_distribution<uint16_t> server { 0, 3 };
+
+  vector<FourTuple> ret;
+  ret.reserve( count );
+  for ( size_t i = 0; i < count; ++i ) {
+    const uint16_t which_server = server( rd );
+    ret.push_back( { .local_address = 0xc0a80001 + which_server,
+                     .remote_address = remote_address( rd ),
+                     .local_port = static_cast<uint16_t>( 80 + which_server ),
+                     .remote_port = remote_port( rd ) } );
+  }
+  return ret;
+}
+
+struct FourTupleHash
+{
+  size_t operator()( const FourTuple& t ) const { return t.hash( 0 ); }
+};
+
+// Look up `queries` in `table`, cycling through them until NUM_LOOKUPS lookups have been done
+template<class Lookup>
+double ns_per_lookup( const vector<FourTuple>& queries, uint64_t& checksum, Lookup&& lookup )
+{
+  const auto start_time = steady_clock::now();
+  for ( size_t i = 0, j = 0; i < NUM_LOOKUPS; ++i, j = ( j + 1 == queries.size() ) ? 0 : j + 1 ) {
+    checksum += lookup( queries[j] );
+  }
+  const auto stop_time = steady_clock::now();
+  return static_cast<double>( duration_cast<nanoseconds>( stop_time - start_time ).count() ) / NUM_LOOKUPS;
+}
+
+void report( fstream& debug_output, string_view what, double ns )
+{
+  cout << "Connection table: " << what << fixed << setprecision( 1 ) << ns << " ns/lookup.\n";
+  debug_output << "        Connection table " << what << fixed << setprecision( 1 ) << setw( 5 ) << ns
+               << " ns/lookup\n";
+}
+
+void program_body()
+{
+  default_random_engine rd { 20240927 };
+  const vector<FourTuple> tuples = make_tuples( NUM_CONNECTIONS, rd );
+
+  ConnectionTable<uint64_t> table;
+  unordered_map<FourTuple, uint64_t, FourTupleHash> reference;
+  for ( size_t i = 0; i < tuples.size(); ++i ) {
+    table.emplace( tuples[i], i );
+    reference.emplace( tuples[i], i );
+  }
+  if ( table.size() != reference.size() ) {
+    throw runtime_error( "ConnectionTable disagrees with std::unordered_map about the number of connections" );
+  }
+
+  // Queries arrive in random order; misses are segments for connections that do not exist
+  vector<FourTuple> hits = tuples;
+  shuffle( hits.begin(), hits.end(), rd );
+  vector<FourTuple> misses;
+  for ( const auto& t : make_tuples( NUM_CONNECTIONS, rd ) ) {
+    if ( not reference.contains( t ) ) {
+      misses.push_back( t );
+    }
+  }
+
+  for ( const auto& t : hits ) {
+    const uint64_t* value = table.find( t );
+    if ( value == nullptr or *value != reference.at( t ) ) {
+      throw runtime_error( "ConnectionTable lost a connection" );
+    }
+  }
+
+  uint64_t checksum = 0;
+  const double hit_ns = ns_per_lookup( hits, checksum, [&]( const FourTuple& t ) { return *table.find( t ); } );
+  const double miss_ns
+    = ns_per_lookup( misses, checksum, [&]( const FourTuple& t ) { return table.find( t ) != nullptr; } );
+  const double reference_ns
+    = ns_per_lookup( hits, checksum, [&]( const FourTuple& t ) { return reference.find( t )->second; } );
+
+  // Churn: close half of the connections and open as many new ones; lookups must stay correct
+  for ( size_t i = 0; i < tuples.size(); i += 2 ) {
+    if ( not table.erase( tuples[i] ) ) {
+      throw runtime_error( "ConnectionTable could not erase a connection" );
+    }
+  }
+  for ( size_t i = 0; i < misses.size() and table.size() < NUM_CONNECTIONS; ++i ) {
+    table.emplace( misses[i], i );
+  }
+  for ( size_t i = 0; i < tuples.size(); ++i ) {
+    const uint64_t* value = table.find( tuples[i] );
+    if ( ( i % 2 == 0 ) != ( value == nullptr ) or ( value != nullptr and *value != i ) ) {
+      throw runtime_error( "ConnectionTable returned the wrong connection after churn" );
+    }
+  }
+  const double churned_ns = ns_per_lookup( misses, checksum, [&]( const FourTuple& t ) {
+    const uint64_t* value = table.find( t );
+    return value == nullptr ? 0 : *value;
+  } );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "Connection table with " << NUM_CONNECTIONS << " entries (" << table.capacity()
+       << " slots), checksum " << checksum << ".\n";
+  report( debug_output, "hit:                ", hit_ns );
+  report( debug_output, "miss:               ", miss_ns );
+  report( debug_output, "after churn:        ", churned_ns );
+  report( debug_output, "std::unordered_map: ", reference_ns );
+
+  if ( hit_ns > 500 or miss_ns > 500 or churned_ns > 500 ) {
+    throw runtime_error( "ConnectionTable did not meet maximum lookup cost of 500 ns." );
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
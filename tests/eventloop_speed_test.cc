@@ -0,0 +1,161 @@
+#include "eventloop.hh"
+#include "exception.hh"
+#include "file_descriptor.hh"
+#include "io_uring.hh"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr array<size_t, 3> NUM_FDS { 10, 1'000, 10'000 };
+constexpr size_t BATCH_SIZE = 16;   // fds made ready at once, for the batched measurement
+constexpr size_t WORK = 10'000'000; // rules examined per measurement (fewer wakeups with more fds)
+constexpr size_t MIN_WAKEUPS = 1'000;
+
+struct Measurement
+{
+  double ns_per_wakeup;   //!< One fd ready: cost of one wait_next_event() that serves it
+  double ns_per_event;    //!< BATCH_SIZE fds ready: cost per served event, over as many calls as it takes
+  double calls_per_batch; //!< wait_next_event() calls needed to serve BATCH_SIZE ready fds
+};
+
+// Make sure there are file descriptors to spare for the largest test
+void raise_fd_limit( const size_t needed )
+{
+  rlimit limit {};
+  CheckSystemCall( "getrlimit", getrlimit( RLIMIT_NOFILE, &limit ) );
+  if ( limit.rlim_cur < needed ) {
+    limit.rlim_cur = min<rlim_t>( needed, limit.rlim_max );
+    CheckSystemCall( "setrlimit", setrlimit( RLIMIT_NOFILE, &limit ) );
+  }
+}
+
+Measurement measure( const EventLoop::Backend backend, const size_t num_fds )
+{
+  // one eventfd per rule; only the fds written by the test ever become readable
+  vector<FileDescriptor> fds;
+  fds.reserve( num_fds );
+  for ( size_t i = 0; i < num_fds; ++i ) {
+    fds.emplace_back( CheckSystemCall( "eventfd", ::eventfd( 0, EFD_CLOEXEC ) ) );
+  }
+
+  EventLoop loop { backend };
+  size_t served = 0;
+  string buffer;
+  const size_t category = loop.add_category( "read eventfd" );
+  for ( auto& fd : fds ) {
+    loop.add_rule( category, fd, Direction::In, [&] {
+      fd.read( buffer );
+      ++served;
+    } );
+  }
+
+  const uint64_t one = 1;
+  // NOLINTNEXTLINE(*-reinterpret-cast)
+  const string_view increment { reinterpret_cast<const char*>( &one ), sizeof( one ) };
+  default_random_engine rng { 20241018 };
+  uniform_int_distribution<size_t> which { 0, num_fds - 1 };
+
+  // wakeups with one ready fd
+  const size_t wakeups = max( MIN_WAKEUPS, WORK / num_fds );
+  auto start_time = steady_clock::now();
+  for ( size_t i = 0; i < wakeups; ++i ) {
+    fds[which( rng )].write( increment );
+    if ( loop.wait_next_event( -1 ) != EventLoop::Result::Success ) {
+      throw runtime_error( "EventLoop did not serve a ready fd" );
+    }
+  }
+  const double ns_per_wakeup
+    = static_cast<double>( duration_cast<nanoseconds>( steady_clock::now() - start_time ).count() ) / wakeups;
+  if ( served != wakeups ) {
+    throw runtime_error( "EventLoop served " + to_string( served ) + " of " + to_string( wakeups ) + " events" );
+  }
+
+  // batches of BATCH_SIZE distinct ready fds
+  const size_t batches = max<size_t>( 1, wakeups / BATCH_SIZE );
+  size_t calls = 0;
+  served = 0;
+  start_time = steady_clock::now();
+  for ( size_t i = 0; i < batches; ++i ) {
+    const size_t first = which( rng );
+    for ( size_t j = 0; j < BATCH_SIZE; ++j ) {
+      fds[( first + j * ( num_fds / BATCH_SIZE + 1 ) ) % num_fds].write( increment );
+    }
+    for ( const size_t target = ( i + 1 ) * min( BATCH_SIZE, num_fds ); served < target; ++calls ) {
+      loop.wait_next_event( -1 );
+    }
+  }
+  const double ns_per_event
+    = static_cast<double>( duration_cast<nanoseconds>( steady_clock::now() - start_time ).count() ) / served;
+
+  return { ns_per_wakeup, ns_per_event, static_cast<double>( calls ) / static_cast<double>( batches ) };
+}
+
+void program_body()
+{
+  raise_fd_limit( NUM_FDS.back() + 256 );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  for ( const size_t num_fds : NUM_FDS ) {
+    const Measurement poll = measure( EventLoop::Backend::Poll, num_fds );
+    const Measurement epoll = measure( EventLoop::Backend::Epoll, num_fds );
+    vector<pair<const char*, Measurement>> results { { "poll", poll }, { "epoll", epoll } };
+    if ( IoUring::available() ) {
+      results.emplace_back( "io_uring", measure( EventLoop::Backend::IoUring, num_fds ) );
+    }
+
+    for ( const auto& [name, result] : results ) {
+      cout << "EventLoop (" << name << ") with " << num_fds << " fds: " << fixed << setprecision( 0 )
+           << result.ns_per_wakeup << " ns/wakeup; with " << BATCH_SIZE << " ready, " << result.ns_per_event
+           << " ns/event over " << setprecision( 1 ) << result.calls_per_batch << " calls.\n";
+      debug_output << "    EventLoop " << setw( 8 ) << name << " (" << setw( 5 ) << num_fds << " fds): " << fixed
+                   << setprecision( 0 ) << setw( 8 ) << result.ns_per_wakeup << " ns/wakeup\n";
+    }
+
+    // epoll (and the io_uring of poll requests) serve every ready rule from one wait, and no longer
+    // hand the kernel every fd
+    for ( const auto& [name, result] : results | views::drop( 1 ) ) {
+      if ( result.calls_per_batch > 1.5 ) {
+        throw runtime_error( "EventLoop (" + string( name ) + ") needed " + to_string( result.calls_per_batch )
+                             + " calls to serve " + to_string( BATCH_SIZE ) + " ready fds." );
+      }
+    }
+    if ( num_fds >= 1'000 and epoll.ns_per_wakeup > poll.ns_per_wakeup ) {
+      throw runtime_error( "EventLoop (epoll) was slower than poll with " + to_string( num_fds ) + " fds." );
+    }
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
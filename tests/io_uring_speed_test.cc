@@ -0,0 +1,232 @@
+#include "exception.hh"
+#include "io_uring.hh"
+#include "random.hh"
+#include "socket.hh"
+#include "speed_test_helpers.hh"
+#include "tcp_minnow_socket_impl.hh"
+#include "tun.hh"
+#include "tuntap_adapter.hh"
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <linux/if.h>
+#include <netinet/in.h>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr const char* TUN_NAME = "minnow-uring";
+constexpr const char* KERNEL_IP = "169.254.145.1"; // the kernel's end of the TUN device
+constexpr const char* MINNOW_IP = "169.254.145.9";
+constexpr uint16_t PORT = 14500; // the kernel's port (minnow's is random, so no earlier run's TIME-WAIT matches)
+constexpr size_t TRANSFER_BYTES = 4 * 1024 * 1024; // sent by the kernel to a TCPMinnowSocket
+
+// How the TCPMinnowSocket reads and writes the TUN device
+enum class Mode : uint8_t
+{
+  Poll,    // directly, on readiness
+  IoUring, // through io_uring
+  Offload  // directly, with a virtio-net header (and so 64 KiB super-packets)
+};
+
+// (per MiB transferred: with offload, one packet can carry 64 KiB)
+struct Result
+{
+  double syscalls_per_mib; // polls or io_uring_enter calls, plus every read and write (by the application too)
+  double packets_per_mib;  // through the TUN device, both ways
+  double mib_per_second;
+};
+
+// Datagrams that have crossed the TUN device, both ways
+uint64_t tun_packets()
+{
+  uint64_t total = 0;
+  for ( const string counter : { "rx_packets", "tx_packets" } ) {
+    ifstream stats { "/sys/class/net/" + string( TUN_NAME ) + "/statistics/" + counter };
+    uint64_t value = 0;
+    stats >> value;
+    total += value;
+  }
+  return total;
+}
+
+// Create the TUN device (it lasts as long as the TunFD), give the kernel its address, and bring it up
+// (returns nothing without the privileges to do so)
+optional<TunFD> open_tun( const bool offload )
+{
+  try {
+    TunFD tun { TUN_NAME, false, offload };
+
+    UDPSocket control;
+    ifreq request {};
+    strncpy( static_cast<char*>( request.ifr_name ), TUN_NAME, IFNAMSIZ - 1 );
+    sockaddr_in address {};
+    address.sin_family = AF_INET;
+    inet_pton( AF_INET, KERNEL_IP, &address.sin_addr );
+    memcpy( &request.ifr_addr, &address, sizeof( address ) );
+    CheckSystemCall( "SIOCSIFADDR", ioctl( control.fd_num(), SIOCSIFADDR, &request ) );
+    inet_pton( AF_INET, "255.255.255.0", &address.sin_addr );
+    memcpy( &request.ifr_netmask, &address, sizeof( address ) );
+    CheckSystemCall( "SIOCSIFNETMASK", ioctl( control.fd_num(), SIOCSIFNETMASK, &request ) );
+    CheckSystemCall( "SIOCGIFFLAGS", ioctl( control.fd_num(), SIOCGIFFLAGS, &request ) );
+    request.ifr_flags = static_cast<int16_t>( request.ifr_flags | IFF_UP | IFF_RUNNING );
+    CheckSystemCall( "SIOCSIFFLAGS", ioctl( control.fd_num(), SIOCSIFFLAGS, &request ) );
+    return tun;
+  } catch ( const unix_error& e ) {
+    cout << "Could not set up TUN device " << TUN_NAME << " (" << e.what() << ").\n";
+    return {};
+  }
+}
+
+// Receive TRANSFER_BYTES from a kernel TCP socket in another process, through the TUN device
+Result run( TunFD&& tun, const Mode mode )
+{
+  TCPSocket listener;
+  listener.set_reuseaddr();
+  listener.bind( Address { KERNEL_IP, PORT } );
+  listener.listen();
+
+  const pid_t sender = CheckSystemCall( "fork", fork() );
+  if ( sender == 0 ) {
+    try {
+      tun.close();
+      TCPSocket connection = listener.accept();
+      const string chunk( 64 * 1024, 'x' );
+      for ( size_t sent = 0; sent < TRANSFER_BYTES; ) {
+        sent += connection.write( string_view { chunk }.substr( 0, TRANSFER_BYTES - sent ) );
+      }
+      connection.shutdown( SHUT_WR );
+      string rest;
+      while ( not connection.eof() ) {
+        connection.read( rest );
+      }
+    } catch ( const exception& e ) {
+      cerr << "Exception in sender: " << e.what() << "\n";
+      _exit( EXIT_FAILURE );
+    }
+    _exit( EXIT_SUCCESS );
+  }
+  listener.close();
+
+  TCPOverIPv4OverTunFdAdapter adapter { move( tun ) };
+  if ( mode == Mode::IoUring ) {
+    adapter.use_io_uring();
+  }
+  if ( mode == Mode::Offload ) {
+    adapter.use_virtio_net_header();
+  }
+  TCPOverIPv4MinnowSocket socket { move( adapter ) };
+  if ( mode == Mode::IoUring ) {
+    socket.set_event_backend( EventLoop::Backend::IoUring );
+  }
+
+  auto rng = get_random_engine();
+  TCPConfig tcp_config;
+  tcp_config.rt_timeout = 100;
+  FdAdapterConfig config;
+  config.source = Address { MINNOW_IP, uniform_int_distribution<uint16_t> { 20000, 59999 }( rng ) };
+  config.destination = Address { KERNEL_IP, PORT };
+
+  const uint64_t syscalls_before = io_syscalls() + IoUring::total_enter_count();
+  const uint64_t packets_before = tun_packets();
+  const auto start_time = steady_clock::now();
+
+  socket.connect( tcp_config, config );
+  socket.set_blocking( true );
+  size_t received = 0;
+  string buffer;
+  while ( not socket.eof() ) {
+    buffer.clear(); // read() fills a non-empty buffer only up to its current size
+    socket.read( buffer );
+    received += buffer.size();
+  }
+  socket.wait_until_closed();
+
+  const auto test_duration = duration_cast<duration<double>>( steady_clock::now() - start_time );
+  const auto packets = static_cast<double>( tun_packets() - packets_before );
+  const uint64_t waits = mode == Mode::IoUring ? 0 : socket.poll_count(); // (an io_uring wait is an io_uring_enter)
+  const uint64_t syscalls_after = io_syscalls() + IoUring::total_enter_count();
+  const auto syscalls = static_cast<double>( syscalls_after - syscalls_before + waits );
+
+  int status = 0;
+  CheckSystemCall( "waitpid", waitpid( sender, &status, 0 ) );
+  if ( not WIFEXITED( status ) or WEXITSTATUS( status ) != EXIT_SUCCESS ) {
+    throw runtime_error( "kernel-side sender failed" );
+  }
+  if ( received != TRANSFER_BYTES ) {
+    throw runtime_error( "received " + to_string( received ) + " of " + to_string( TRANSFER_BYTES ) + " bytes" );
+  }
+
+  const double mib = static_cast<double>( TRANSFER_BYTES ) / ( 1024 * 1024 );
+  return { .syscalls_per_mib = syscalls / mib,
+           .packets_per_mib = packets / mib,
+           .mib_per_second = mib / test_duration.count() };
+}
+
+void program_body()
+{
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  if ( not IoUring::available() ) {
+    cout << "io_uring is not available; nothing to compare.\n";
+    return;
+  }
+
+  vector<pair<const char*, Result>> results;
+  for ( const auto& [mode, name] : { pair { Mode::Poll, "poll" },
+                                     pair { Mode::IoUring, "io_uring" },
+                                     pair { Mode::Offload, "offload" } } ) {
+    optional<TunFD> tun = open_tun( mode == Mode::Offload );
+    if ( not tun.has_value() ) {
+      return;
+    }
+    results.emplace_back( name, run( move( tun.value() ), mode ) );
+  }
+
+  for ( const auto& [name, result] : results ) {
+    cout << "TCPOverIPv4OverTunFdAdapter (" << name << "): " << fixed << setprecision( 1 )
+         << result.syscalls_per_mib << " syscalls/MiB, " << result.packets_per_mib << " packets/MiB, "
+         << result.mib_per_second << " MiB/s.\n";
+    debug_output << "    TUN adapter " << setw( 8 ) << name << ": " << fixed << setprecision( 1 ) << setw( 7 )
+                 << result.syscalls_per_mib << " syscalls/MiB\n";
+  }
+
+  const double poll_syscalls = results.at( 0 ).second.syscalls_per_mib;
+  if ( results.at( 1 ).second.syscalls_per_mib >= poll_syscalls ) {
+    throw runtime_error( "io_uring did not save system calls." );
+  }
+  if ( results.at( 2 ).second.syscalls_per_mib >= poll_syscalls ) {
+    throw runtime_error( "offload did not save system calls." );
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
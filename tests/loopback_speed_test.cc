@@ -0,0 +1,119 @@
+#include "exception.hh"
+#include "loopback_adapter.hh"
+#include "tcp_minnow_socket_impl.hh"
+#include "tuntap_adapter.hh"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <thread>
+#include <utility>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr size_t TRANSFER_BYTES = 32 * 1024 * 1024;
+constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+const Address server_address { "10.0.0.1", 80 };
+const Address client_address { "10.0.0.2", 40000 };
+
+pair<TCPOverIPv4OverTunFdAdapter, TCPOverIPv4OverTunFdAdapter> socket_pair_adapters()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+  return { TCPOverIPv4OverTunFdAdapter { FileDescriptor { fds[0] } },
+           TCPOverIPv4OverTunFdAdapter { FileDescriptor { fds[1] } } };
+}
+
+// Send TRANSFER_BYTES from one TCPMinnowSocket to another in this process, over the pair of adapters
+template<class AdapterT>
+double megabits_per_second( pair<AdapterT, AdapterT>&& adapters )
+{
+  TCPMinnowSocket<AdapterT> client { move( adapters.first ) };
+  TCPMinnowSocket<AdapterT> server { move( adapters.second ) };
+
+  TCPConfig tcp_config;
+  tcp_config.rt_timeout = 100;
+  const auto start_time = steady_clock::now();
+
+  size_t received = 0;
+  duration<double> transfer_duration {};
+  thread server_thread( [&] {
+    FdAdapterConfig config;
+    config.source = server_address;
+    server.listen_and_accept( tcp_config, config );
+    server.set_blocking( true );
+
+    string buffer;
+    while ( not server.eof() ) {
+      buffer.clear(); // read() fills a non-empty buffer only up to its current size
+      server.read( buffer );
+      if ( buffer.find_first_not_of( 'x' ) != string::npos ) {
+        throw runtime_error( "server received corrupted bytes" );
+      }
+      received += buffer.size();
+    }
+    transfer_duration = steady_clock::now() - start_time; // (not counting the linger before the connection closes)
+    server.wait_until_closed();
+  } );
+
+  FdAdapterConfig config;
+  config.source = client_address;
+  config.destination = server_address;
+  client.connect( tcp_config, config );
+  client.set_blocking( true );
+
+  const string chunk( CHUNK_SIZE, 'x' );
+  for ( size_t sent = 0; sent < TRANSFER_BYTES; ) {
+    sent += client.write( string_view { chunk }.substr( 0, TRANSFER_BYTES - sent ) );
+  }
+  client.wait_until_closed();
+  server_thread.join();
+
+  if ( received != TRANSFER_BYTES ) {
+    throw runtime_error( "server received " + to_string( received ) + " of " + to_string( TRANSFER_BYTES )
+                         + " bytes" );
+  }
+  return static_cast<double>( TRANSFER_BYTES * 8 ) / transfer_duration.count() / 1e6;
+}
+
+void program_body()
+{
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  const double serialized = megabits_per_second( socket_pair_adapters() );
+  const double loopback = megabits_per_second( LoopbackAdapter::make_pair() );
+
+  for ( const auto& [name, rate] :
+        { pair { "IPv4 over socketpair", serialized }, pair { "loopback", loopback } } ) {
+    cout << "TCPMinnowSocket (" << name << "): " << fixed << setprecision( 1 ) << rate << " Mbit/s.\n";
+    debug_output << "    TCPMinnowSocket " << setw( 20 ) << name << ": " << fixed << setprecision( 1 ) << setw( 8 )
+                 << rate << " Mbit/s\n";
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
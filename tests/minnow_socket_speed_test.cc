@@ -0,0 +1,184 @@
+#include "exception.hh"
+#include "helpers.hh"
+#include "speed_test_helpers.hh"
+#include "tcp_minnow_socket_impl.hh"
+#include "tcp_over_ip.hh"
+
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr size_t TRANSFER_BYTES = 8 * 1024 * 1024;
+constexpr size_t CHUNK_SIZE = 64 * 1024;
+constexpr size_t RUNS = 2;              // of each kind of dispatch
+constexpr double MAX_POLL_RATIO = 1.25; // batched polls / one-rule polls (allowing for scheduling noise)
+
+const Address server_address { "10.0.0.1", 80 };
+const Address client_address { "10.0.0.2", 40000 };
+
+//! Carries each IPv4 datagram over one end of an AF_UNIX datagram socketpair, one datagram per read (unlike
+//! TCPOverIPv4OverTunFdAdapter, whose read_batch() would take every waiting datagram in either kind of dispatch)
+class SocketPairAdapter : public TCPOverIPv4Adapter
+{
+  FileDescriptor fd_;
+
+public:
+  explicit SocketPairAdapter( FileDescriptor&& fd ) : fd_( move( fd ) ) {}
+
+  optional<TCPMessage> read()
+  {
+    vector<string> strs( 3 );
+    strs[0].resize( IPv4Header::LENGTH );
+    strs[1].resize( TCPSegment::HEADER_LENGTH );
+    fd_.read( strs );
+
+    InternetDatagram ip_dgram;
+    if ( parse( ip_dgram, move( strs ) ) ) {
+      return unwrap_tcp_in_ip( move( ip_dgram ) );
+    }
+    return {};
+  }
+
+  void write( const TCPMessage& seg )
+  {
+    const InternetDatagram ip_dgram = wrap_tcp_in_ip( seg );
+    fd_.write( serialize( ip_dgram ) );
+  }
+
+  FileDescriptor& fd() { return fd_; }
+};
+
+struct Result
+{
+  double polls_per_megabyte;
+  double syscalls_per_megabyte; // polls, plus every read and write (by the application too)
+  double megabits_per_second;
+};
+
+// Send TRANSFER_BYTES from one TCPMinnowSocket to another, with either kind of EventLoop dispatch
+Result run( const bool batched )
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+
+  TCPMinnowSocket<SocketPairAdapter> client { SocketPairAdapter { FileDescriptor { fds[0] } } };
+  TCPMinnowSocket<SocketPairAdapter> server { SocketPairAdapter { FileDescriptor { fds[1] } } };
+  client.set_batched_dispatch( batched );
+  server.set_batched_dispatch( batched );
+
+  TCPConfig tcp_config;
+  tcp_config.rt_timeout = 100;
+
+  const uint64_t syscalls_before = io_syscalls();
+  const auto start_time = steady_clock::now();
+
+  size_t received = 0;
+  thread server_thread( [&] {
+    FdAdapterConfig config;
+    config.source = server_address;
+    server.listen_and_accept( tcp_config, config );
+    server.set_blocking( true );
+
+    string buffer;
+    while ( not server.eof() ) {
+      buffer.clear(); // read() fills a non-empty buffer only up to its current size
+      server.read( buffer );
+      if ( buffer.find_first_not_of( 'x' ) != string::npos ) {
+        throw runtime_error( "server received corrupted bytes" );
+      }
+      received += buffer.size();
+    }
+    server.wait_until_closed();
+  } );
+
+  FdAdapterConfig config;
+  config.source = client_address;
+  config.destination = server_address;
+  client.connect( tcp_config, config );
+  client.set_blocking( true );
+
+  const string chunk( CHUNK_SIZE, 'x' );
+  for ( size_t sent = 0; sent < TRANSFER_BYTES; ) {
+    sent += client.write( string_view { chunk }.substr( 0, TRANSFER_BYTES - sent ) );
+  }
+  client.wait_until_closed();
+  server_thread.join();
+
+  const auto stop_time = steady_clock::now();
+  const uint64_t syscalls = io_syscalls() - syscalls_before;
+
+  if ( received != TRANSFER_BYTES ) {
+    throw runtime_error( "server received " + to_string( received ) + " of " + to_string( TRANSFER_BYTES )
+                         + " bytes" );
+  }
+
+  const double megabytes = static_cast<double>( TRANSFER_BYTES ) / ( 1024 * 1024 );
+  const auto polls = static_cast<double>( client.poll_count() + server.poll_count() );
+  const auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
+  return { .polls_per_megabyte = polls / megabytes,
+           .syscalls_per_megabyte = ( polls + static_cast<double>( syscalls ) ) / megabytes,
+           .megabits_per_second = static_cast<double>( TRANSFER_BYTES * 8 ) / test_duration.count() / 1e6 };
+}
+
+void program_body()
+{
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  // alternate the two kinds of dispatch, and keep each one's best run (the threads share the CPUs with
+  // everything else, so the polls each run needs vary with scheduling)
+  Result one_rule { HUGE_VAL, 0, 0 };
+  Result batched { HUGE_VAL, 0, 0 };
+  for ( size_t i = 0; i < RUNS; ++i ) {
+    for ( auto [best, is_batched] : { pair { &one_rule, false }, pair { &batched, true } } ) {
+      const Result result = run( is_batched );
+      if ( result.polls_per_megabyte < best->polls_per_megabyte ) {
+        *best = result;
+      }
+    }
+  }
+
+  for ( const auto& [name, result] : { pair { "one rule per poll", one_rule }, pair { "batched", batched } } ) {
+    cout << "TCPMinnowSocket (" << name << "): " << fixed << setprecision( 0 ) << result.polls_per_megabyte
+         << " polls/MB, " << result.syscalls_per_megabyte << " syscalls/MB, " << setprecision( 1 )
+         << result.megabits_per_second << " Mbit/s.\n";
+    debug_output << "    TCPMinnowSocket " << setw( 17 ) << name << ": " << fixed << setprecision( 0 ) << setw( 6 )
+                 << result.syscalls_per_megabyte << " syscalls/MB\n";
+  }
+
+  if ( batched.polls_per_megabyte > one_rule.polls_per_megabyte * MAX_POLL_RATIO ) {
+    throw runtime_error( "Batched dispatch needed more polls than serving one rule per poll." );
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
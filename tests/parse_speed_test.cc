@@ -0,0 +1,138 @@
+#include "ethernet_header.hh"
+#include "helpers.hh"
+#include "ipv4_header.hh"
+#include "parser.hh"
+#include "tcp_segment.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr size_t HEADERS_PER_ROUND = 100'000; // inputs prepared (untimed) before each round of parsing
+constexpr size_t ROUNDS = 10;
+constexpr size_t PIECE_SIZE = 3;          // of the split inputs, so that most integers straddle two buffers
+constexpr double MAX_NS_PER_HEADER = 10000; // parsing a header from one buffer
+
+// ns per header to construct a Parser over a serialized header and parse it with `parse_one`, with each
+// header in one buffer or split into PIECE_SIZE-byte pieces
+double ns_per_header( const string& serialized, const bool split, const function<void( Parser& )>& parse_one )
+{
+  vector<vector<string>> inputs( HEADERS_PER_ROUND );
+  nanoseconds elapsed {};
+  for ( size_t round = 0; round < ROUNDS; ++round ) {
+    for ( auto& input : inputs ) {
+      input.clear();
+      for ( size_t offset = 0; offset < serialized.size(); offset += split ? PIECE_SIZE : serialized.size() ) {
+        input.push_back( serialized.substr( offset, split ? PIECE_SIZE : serialized.size() ) );
+      }
+    }
+
+    const auto start = steady_clock::now();
+    for ( auto& input : inputs ) {
+      Parser parser { move( input ) };
+      parse_one( parser );
+      if ( parser.has_error() ) {
+        throw runtime_error( "header failed to parse" );
+      }
+    }
+    elapsed += steady_clock::now() - start;
+  }
+  return static_cast<double>( elapsed.count() ) / static_cast<double>( HEADERS_PER_ROUND * ROUNDS );
+}
+
+void program_body()
+{
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  const EthernetHeader ethernet {
+    .dst = { 2, 0, 0, 0, 0, 1 }, .src = { 2, 0, 0, 0, 0, 2 }, .type = EthernetHeader::TYPE_IPv4 };
+
+  IPv4Header ip;
+  ip.len = IPv4Header::LENGTH + TCPSegment::HEADER_LENGTH;
+  ip.src = 0x0a00'0002;
+  ip.dst = 0x0a00'0001;
+  ip.compute_checksum();
+
+  TCPSegment tcp;
+  tcp.message.sender->seqno = Wrap32 { 0x1234'5678 };
+  tcp.message.receiver->ackno = Wrap32 { 0x9abc'def0 };
+  tcp.message.receiver->window_size = 64000;
+  tcp.udinfo = { .src_port = 40000, .dst_port = 80, .cksum = 0 };
+
+  const vector<pair<string, pair<string, function<void( Parser& )>>>> headers {
+    { "Ethernet",
+      { concat( serialize( ethernet ) ),
+        [&]( Parser& parser ) {
+          EthernetHeader header;
+          header.parse( parser );
+          if ( header.type != ethernet.type or header.src != ethernet.src ) {
+            throw runtime_error( "wrong Ethernet header" );
+          }
+        } } },
+    { "IPv4",
+      { concat( serialize( ip ) ),
+        [&]( Parser& parser ) {
+          IPv4Header header;
+          header.parse( parser );
+          if ( header.dst != ip.dst or header.cksum != ip.cksum ) {
+            throw runtime_error( "wrong IPv4 header" );
+          }
+        } } },
+    { "TCP",
+      { concat( serialize( tcp ) ),
+        [&]( Parser& parser ) {
+          TCPSegment segment;
+          segment.parse( parser, 0, false );
+          if ( segment.message.sender->seqno != tcp.message.sender->seqno
+               or segment.udinfo.dst_port != tcp.udinfo.dst_port ) {
+            throw runtime_error( "wrong TCP header" );
+          }
+        } } } };
+
+  for ( const auto& [name, header] : headers ) {
+    const auto& [serialized, parse_one] = header;
+    const double contiguous = ns_per_header( serialized, false, parse_one );
+    const double pieces = ns_per_header( serialized, true, parse_one );
+
+    cout << "Parse " << name << " header: " << fixed << setprecision( 1 ) << contiguous << " ns (one buffer), "
+         << pieces << " ns (" << PIECE_SIZE << "-byte pieces), speedup " << setprecision( 2 ) << pieces / contiguous
+         << "x.\n";
+    debug_output << "    Parse " << setw( 8 ) << name << " header: " << fixed << setprecision( 1 ) << setw( 6 )
+                 << contiguous << " ns (one buffer), " << setw( 6 ) << pieces << " ns (" << PIECE_SIZE
+                 << "-byte pieces)\n";
+
+    if ( contiguous > MAX_NS_PER_HEADER ) {
+      throw runtime_error( "parsing a " + name + " header from one buffer did not meet maximum time of "
+                           + to_string( static_cast<int>( MAX_NS_PER_HEADER ) ) + " ns" );
+    }
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
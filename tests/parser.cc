@@ -0,0 +1,172 @@
+#include "parser.hh"
+#include "random.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t NUM_TRIALS = 20'000;
+
+void expect( bool condition, const string& what )
+{
+  if ( not condition ) {
+    throw runtime_error( "expectation failed: " + what );
+  }
+}
+
+string joined( const vector<string_view>& buffers )
+{
+  string ret;
+  for ( const auto buffer : buffers ) {
+    ret.append( buffer );
+  }
+  return ret;
+}
+
+// The bytes still to be parsed, kept in one string, and what the Parser should make of them
+class Model
+{
+  string rest_;
+  bool error_ {};
+
+public:
+  explicit Model( string data ) : rest_( move( data ) ) {}
+
+  const string& rest() const { return rest_; }
+  bool error() const { return error_; }
+
+  template<std::unsigned_integral T>
+  T integer()
+  {
+    if ( rest_.size() < sizeof( T ) ) {
+      error_ = true;
+    }
+    if ( error_ ) {
+      return 0;
+    }
+    T ret = 0;
+    for ( size_t i = 0; i < sizeof( T ); ++i ) {
+      ret = static_cast<T>( ret << 8 ) | static_cast<uint8_t>( rest_[i] );
+    }
+    rest_.erase( 0, sizeof( T ) );
+    return ret;
+  }
+
+  string take( const size_t size )
+  {
+    if ( rest_.size() < size ) {
+      error_ = true;
+    }
+    if ( error_ ) {
+      return {};
+    }
+    string ret = rest_.substr( 0, size );
+    rest_.erase( 0, size );
+    return ret;
+  }
+
+  void remove_prefix( const size_t size ) { rest_.erase( 0, min( size, rest_.size() ) ); }
+  void truncate( const size_t size ) { rest_.resize( min( size, rest_.size() ) ); }
+};
+
+template<std::unsigned_integral T>
+void read_integer( Parser& parser, Model& model )
+{
+  T actual = 0;
+  parser.integer( actual );
+  const T expected = model.integer<T>();
+  if ( not model.error() ) {
+    expect( actual == expected, "a " + to_string( sizeof( T ) ) + "-byte integer is read big-endian" );
+  }
+}
+
+// Parse the same bytes, split at random into buffers (some empty, some a byte long, sometimes more than are
+// kept inline), with a random series of reads
+void parses_like_one_string()
+{
+  auto rd = get_random_engine();
+  for ( size_t trial = 0; trial < NUM_TRIALS; ++trial ) {
+    string data( rd() % 200, 0 );
+    ranges::generate( data, [&] { return static_cast<char>( rd() ); } );
+
+    vector<string> buffers;
+    for ( size_t offset = 0; offset < data.size() or rd() % 8 == 0; ) {
+      const size_t length = min<size_t>( data.size() - offset, rd() % 2 ? rd() % 4 : rd() % ( data.size() + 1 ) );
+      buffers.push_back( data.substr( offset, length ) );
+      offset += length;
+    }
+
+    Parser parser { move( buffers ) };
+    Model model { data };
+    for ( size_t op = 0; op < 40 and not model.error(); ++op ) {
+      switch ( rd() % 8 ) {
+        case 0:
+          read_integer<uint8_t>( parser, model );
+          break;
+        case 1:
+          read_integer<uint16_t>( parser, model );
+          break;
+        case 2:
+          read_integer<uint32_t>( parser, model );
+          break;
+        case 3:
+          read_integer<uint64_t>( parser, model );
+          break;
+        case 4: {
+          string actual( rd() % 24, 0 );
+          parser.string( actual );
+          const string expected = model.take( actual.size() );
+          expect( model.error() or actual == expected, "a string is read" );
+          break;
+        }
+        case 5: {
+          const size_t size = rd() % 16;
+          parser.remove_prefix( size );
+          model.remove_prefix( size );
+          break;
+        }
+        case 6: {
+          const size_t size = rd() % ( model.rest().size() + 4 );
+          parser.truncate( size );
+          model.truncate( size );
+          break;
+        }
+        default:
+          break;
+      }
+      expect( parser.has_error() == model.error(), "the parser runs out of input when the model does" );
+      if ( not model.error() ) {
+        expect( joined( parser.buffer() ) == model.rest(), "the parser's remaining buffers hold the rest" );
+      }
+    }
+
+    if ( not model.error() ) {
+      string rest;
+      parser.concatenate_all_remaining( rest );
+      expect( rest == model.rest(), "all that remains is concatenated" );
+    }
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    parses_like_one_string();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -248,6 +248,25 @@ int main()
 
       test.execute( IsFinished( true ) );
     }
+
+    {
+      ReassemblerTestHarness test { "shrink capacity discards stored bytes beyond it", 10 };
+
+      test.execute( Insert { "bcdefgh", 1 } );
+      test.execute( BytesPending( 7 ) );
+      test.execute( Resize { 4 } );
+      test.execute( BytesPending( 3 ) );
+
+      test.execute( Insert { "a", 0 } );
+      test.execute( BytesPushed( 4 ) );
+      test.execute( BytesPending( 0 ) );
+
+      test.execute( Resize { 8 } );
+      test.execute( Insert { "efghijkl", 4 } );
+      test.execute( BytesPushed( 8 ) );
+      test.execute( BytesPending( 0 ) );
+      test.execute( ReadAll( "abcdefgh" ) );
+    }
   } catch ( const exception& e ) {
     cerr << "Exception: " << e.what() << "\n";
     return EXIT_FAILURE;
@@ -73,3 +73,12 @@ struct Insert : public Action<Reassembler>
 
   void execute( Reassembler& r ) const override { r.insert( first_index_, data_, is_last_substring_ ); }
 };
+
+struct Resize : public Action<Reassembler>
+{
+  uint64_t capacity_;
+
+  explicit Resize( uint64_t capacity ) : capacity_( capacity ) {}
+  std::string description() const override { return "set_capacity( " + std::to_string( capacity_ ) + " )"; }
+  void execute( Reassembler& r ) const override { r.set_capacity( capacity_ ); }
+};
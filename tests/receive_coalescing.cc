@@ -0,0 +1,178 @@
+#include "random.hh"
+#include "tcp_config.hh"
+#include "tcp_peer.hh"
+#include "tcp_segment.hh"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+constexpr uint16_t WINDOW = 5000;
+
+void expect( bool condition, const string& what )
+{
+  if ( not condition ) {
+    throw runtime_error( "expectation failed: " + what );
+  }
+}
+
+TCPMessage data_segment( uint32_t seqno, const string& payload, uint32_t ackno = 1, uint16_t window = WINDOW )
+{
+  return { TCPSenderMessage { .seqno = Wrap32 { seqno }, .payload = payload },
+           TCPReceiverMessage { .ackno = Wrap32 { ackno }, .window_size = window } };
+}
+
+// Merge each run in `msgs`, returning the resulting messages
+vector<TCPMessage> coalesced( vector<TCPMessage> msgs, size_t max_payload = UINT16_MAX )
+{
+  vector<TCPMessage> merged;
+  for ( span<TCPMessage> rest { msgs }; not rest.empty(); ) {
+    const size_t run_length = coalescible_run( rest, max_payload );
+    merged.push_back( run_length == 1 ? move( rest.front() ) : coalesce( rest.first( run_length ) ) );
+    rest = rest.subspan( run_length );
+  }
+  return merged;
+}
+
+void runs_merge()
+{
+  vector<TCPMessage> msgs;
+  for ( uint32_t i = 0; i < 5; ++i ) {
+    msgs.push_back( data_segment( 100 + i * 3, string( 3, static_cast<char>( 'a' + i ) ), 1, WINDOW + i ) );
+  }
+  msgs.back().sender.get_mut().FIN = true;
+
+  const auto merged = coalesced( move( msgs ) );
+  expect( merged.size() == 1, "five back-to-back segments merge into one" );
+  expect( merged[0].sender->seqno == Wrap32 { 100 }, "the merged segment starts at the first seqno" );
+  expect( merged[0].sender->payload == "aaabbbcccdddeee", "payloads are concatenated in order" );
+  expect( merged[0].sender->FIN, "a FIN on the last segment of a run is kept" );
+  expect( merged[0].receiver->window_size == WINDOW + 4, "the merged segment takes the last window" );
+}
+
+void runs_break()
+{
+  vector<TCPMessage> msgs;
+  msgs.push_back( data_segment( 0, "abc" ) );
+  msgs.push_back( data_segment( 3, "def" ) );
+  msgs.push_back( data_segment( 7, "hij" ) );      // (gap)
+  msgs.push_back( data_segment( 10, "klm", 2 ) ); // (new ackno)
+  msgs.push_back( data_segment( 13, "nop", 2 ) );
+  msgs.push_back( data_segment( 16, "", 2 ) ); // (pure ACK)
+  msgs.push_back( data_segment( 16, "qrs", 2 ) );
+  msgs.back().sender.get_mut().FIN = true;
+  msgs.push_back( data_segment( 20, "tuv", 2 ) ); // (after a FIN)
+  msgs.push_back( data_segment( 23, "wxy", 2 ) );
+  msgs.back().receiver.get_mut().RST = true;
+
+  const auto merged = coalesced( move( msgs ) );
+  vector<string> payloads;
+  for ( const auto& msg : merged ) {
+    payloads.push_back( msg.sender->payload );
+  }
+  expect( payloads == vector<string> { "abcdef", "hij", "klmnop", "", "qrs", "tuv", "wxy" },
+          "gaps, new acknos, pure ACKs, FINs and RSTs end runs" );
+
+  msgs.clear();
+  msgs.push_back( data_segment( 0, "" ) );
+  msgs.back().sender.get_mut().SYN = true;
+  msgs.push_back( data_segment( 1, "abc" ) );
+  msgs.push_back( data_segment( 4, "def" ) );
+  msgs.push_back( data_segment( 7, "ghi" ) );
+  const auto limited = coalesced( move( msgs ), 6 );
+  expect( limited.size() == 3 and limited[0].sender->SYN and limited[1].sender->payload == "abcdef"
+            and limited[2].sender->payload == "ghi",
+          "a SYN is never merged, and runs stop at the payload limit" );
+}
+
+// One TCPPeer sends to another, which receives in batches that are sometimes reordered or missing a segment
+string transfer( const bool receive_coalescing, const bool header_prediction, const string& data )
+{
+  TCPConfig config;
+  config.receive_coalescing = receive_coalescing;
+  config.header_prediction = header_prediction;
+  config.isn = Wrap32 { 0xfffffff0 };
+  TCPPeer sender { config };
+  TCPPeer receiver { config };
+
+  auto rd = get_random_engine();
+  vector<TCPMessage> to_receiver;
+  vector<TCPMessage> to_sender;
+  const auto send = [&]( const TCPMessage& x ) { to_receiver.push_back( x ); }; // (copied: it may borrow)
+  const auto reply = [&]( const TCPMessage& x ) { to_sender.push_back( x ); };
+
+  size_t written = 0;
+  string received;
+  sender.push( send );
+  for ( size_t round = 0; not receiver.inbound_reader().is_finished() and round < 100'000; ++round ) {
+    Writer& writer = sender.outbound_writer();
+    const size_t room = min<size_t>( writer.available_capacity(), data.size() - written );
+    writer.push( data.substr( written, room ) );
+    written += room;
+    if ( written == data.size() and not writer.is_closed() ) {
+      writer.close();
+    }
+    sender.push( send );
+
+    if ( to_receiver.size() > 2 and rd() % 4 == 0 ) {
+      swap( to_receiver[rd() % to_receiver.size()], to_receiver[rd() % to_receiver.size()] );
+    }
+    if ( to_receiver.size() > 2 and rd() % 4 == 0 ) {
+      to_receiver.erase( to_receiver.begin() + static_cast<ptrdiff_t>( rd() % to_receiver.size() ) );
+    }
+    receiver.receive_batch( to_receiver, reply );
+    to_receiver.clear();
+
+    received += receiver.inbound_reader().peek();
+    receiver.inbound_reader().pop( receiver.inbound_reader().bytes_buffered() );
+    receiver.send_window_update( reply );
+
+    for ( auto& msg : to_sender ) {
+      sender.receive( move( msg ), send );
+    }
+    to_sender.clear();
+    sender.tick( config.rt_timeout, send );
+  }
+
+  expect( receiver.inbound_reader().is_finished(), "the inbound stream finishes" );
+  return received;
+}
+
+void peers_agree()
+{
+  string data( 300'000, 0 );
+  auto rd = get_random_engine();
+  ranges::generate( data, [&] { return static_cast<char>( 'a' + rd() % 26 ); } );
+  for ( const bool header_prediction : { true, false } ) {
+    expect( transfer( true, header_prediction, data ) == data,
+            "a peer coalescing its received batches receives the data intact" );
+    expect( transfer( false, header_prediction, data ) == data, "so does a peer that does not" );
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    runs_merge();
+    runs_break();
+    peers_agree();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+#include "debug.hh"
+#include "receive_buffer_tuner.hh"
+#include "tcp_receiver.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+constexpr uint64_t TICK_MS = 10;
+constexpr uint64_t RTT_MS = 40;
+constexpr uint64_t BASE_CAPACITY = 8000;
+constexpr uint64_t MAX_CAPACITY = 64000;
+constexpr uint64_t BUDGET = 96000;
+
+// One receiving connection: a TCPReceiver driven by an auto-tuner, fed by a window-limited sender
+// that sends one full window of data per round trip.
+class Connection
+{
+  string name_;
+  Wrap32 isn_;
+  TCPReceiver receiver_ { Reassembler { ByteStream { BASE_CAPACITY } } };
+  ReceiveBufferTuner tuner_;
+  uint64_t next_to_send_ {};
+  uint64_t advertised_edge_ {};
+
+  // Contents of the stream at a given index
+  static char byte_at( uint64_t index ) { return static_cast<char>( ( index * 2654435761U ) >> 11 ); }
+
+public:
+  Connection( string name, const shared_ptr<ReceiveBufferBudget>& budget, uint32_t isn )
+    : name_( move( name ) ), isn_( isn ), tuner_( BASE_CAPACITY, MAX_CAPACITY, 100, budget )
+  {
+    TCPSenderMessage syn;
+    syn.seqno = isn_;
+    syn.SYN = true;
+    receiver_.receive( syn );
+  }
+
+  // The sender transmits everything the current window allows (once per RTT)
+  void send_window()
+  {
+    // The window is advertised (in an ACK) once per round trip, and the sender fills it
+    const uint64_t right_edge = receiver_.writer().bytes_pushed() + receiver_.send().window_size;
+    advertised_edge_ = max( advertised_edge_, right_edge );
+    while ( next_to_send_ < right_edge ) {
+      TCPSenderMessage msg;
+      msg.seqno = Wrap32::wrap( next_to_send_ + 1, isn_ );
+      msg.payload.resize( min<uint64_t>( 1000, right_edge - next_to_send_ ) );
+      for ( auto& ch : msg.payload ) {
+        ch = byte_at( next_to_send_++ );
+      }
+      receiver_.receive( move( msg ) );
+    }
+  }
+
+  // The application reads up to `max_len` bytes, then time passes and the tuner runs
+  void tick( uint64_t max_len )
+  {
+    Reader& reader = receiver_.reader();
+    while ( reader.bytes_buffered() and max_len ) {
+      const auto view = reader.peek().substr( 0, max_len );
+      for ( size_t i = 0; i < view.size(); ++i ) {
+        if ( view[i] != byte_at( reader.bytes_popped() + i ) ) {
+          throw runtime_error( name_ + ": mismatch between data sent and data read" );
+        }
+      }
+      max_len -= view.size();
+      reader.pop( view.size() );
+    }
+
+    receiver_.set_capacity( tuner_.tick( TICK_MS,
+                                         receiver_.writer().bytes_pushed(),
+                                         as_const( receiver_ ).reader().bytes_popped(),
+                                         advertised_edge_ ) );
+
+    const uint64_t right_edge = receiver_.writer().bytes_pushed() + receiver_.send().window_size;
+    if ( right_edge < advertised_edge_ ) {
+      throw runtime_error( name_ + ": right edge of window moved backwards from " + to_string( advertised_edge_ )
+                           + " to " + to_string( right_edge ) );
+    }
+  }
+
+  uint64_t capacity() const { return tuner_.capacity(); }
+  uint64_t bytes_read() const { return receiver_.reader().bytes_popped(); }
+};
+
+void expect( bool condition, const string& what )
+{
+  if ( not condition ) {
+    throw runtime_error( "expectation failed: " + what );
+  }
+}
+
+void run_test()
+{
+  auto budget = make_shared<ReceiveBufferBudget>( BUDGET );
+
+  Connection fast { "fast consumer", budget, 0xfffff000 };
+  Connection slow { "slow consumer", budget, 12345 };
+  expect( budget->reserved() == 2 * BASE_CAPACITY, "both base capacities are reserved" );
+
+  uint64_t now = 0;
+  auto run_for = [&]( uint64_t duration_ms, uint64_t slow_read_per_tick ) {
+    for ( const uint64_t end = now + duration_ms; now < end; now += TICK_MS ) {
+      if ( now % RTT_MS == 0 ) {
+        fast.send_window();
+        slow.send_window();
+      }
+      fast.tick( UINT64_MAX );
+      slow.tick( slow_read_per_tick );
+      expect( budget->reserved() <= BUDGET, "reservations stay within the budget" );
+      expect( fast.capacity() <= MAX_CAPACITY and slow.capacity() <= MAX_CAPACITY, "capacity stays under ceiling" );
+    }
+  };
+
+  // Phase 1: both applications drain as fast as data arrives, so both windows grow
+  run_for( 2000, UINT64_MAX );
+  const uint64_t fast_capacity_when_shared = fast.capacity();
+  const uint64_t fast_read_when_shared = fast.bytes_read();
+  const uint64_t slow_read_when_shared = slow.bytes_read();
+  expect( fast.capacity() > BASE_CAPACITY, "fast consumer's buffer grew" );
+  expect( slow.capacity() > BASE_CAPACITY, "second consumer's buffer grew while it was fast" );
+  expect( fast.capacity() + slow.capacity() > BUDGET - BASE_CAPACITY, "together they use most of the budget" );
+
+  // Phase 2: the second application slows to a trickle; its buffer shrinks back and the memory
+  // moves to the connection that can use it
+  run_for( 8000, 200 );
+  expect( slow.capacity() == BASE_CAPACITY, "slow consumer's buffer shrank back to its base capacity" );
+  expect( fast.capacity() > fast_capacity_when_shared, "fast consumer's buffer grew into the released memory" );
+  expect( fast.capacity() == MAX_CAPACITY, "fast consumer's buffer reached the ceiling" );
+  expect( fast.bytes_read() - fast_read_when_shared > 10 * ( slow.bytes_read() - slow_read_when_shared ),
+          "fast consumer read much more than slow consumer" );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    set_debug_handler( []( void* /*unused*/, std::string_view /*unused*/ ) {}, nullptr );
+    run_test();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,164 @@
+#include "arp_message.hh"
+#include "helpers.hh"
+#include "ipv4_header.hh"
+#include "router.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr size_t DATAGRAMS = 1'000'000;   // forwarded through the router
+constexpr size_t BATCH_SIZE = 64;         // datagrams queued on the interface per call to route()
+constexpr size_t TTL_UPDATES = 5'000'000; // per way of updating the checksum
+constexpr double MAX_ADJUST_NS = 100;     // per TTL decrement, adjusting the checksum
+
+constexpr EthernetAddress ROUTER_ETHERNET { 0x02, 0, 0, 0, 0, 0x01 };
+constexpr EthernetAddress NEXT_HOP_ETHERNET { 0x02, 0, 0, 0, 0, 0x05 };
+const Address ROUTER_IP { "10.0.0.1" };
+const Address NEXT_HOP_IP { "10.0.0.5" };
+const Address SOURCE_IP { "192.168.0.50" };
+const Address DESTINATION_IP { "172.16.0.9" };
+
+// Counts the frames sent, without keeping them
+class CountingPort : public NetworkInterface::OutputPort
+{
+public:
+  size_t frames {};
+  void transmit( const NetworkInterface& n [[maybe_unused]], const EthernetFrame& x [[maybe_unused]] ) override
+  {
+    ++frames;
+  }
+};
+
+// ns per datagram for Router::route() to forward datagrams queued on one interface out of another, via a
+// next hop whose Ethernet address it knows
+double forward()
+{
+  auto port = make_shared<CountingPort>();
+  Router router;
+  const size_t inside = router.add_interface(
+    make_shared<NetworkInterface>( "inside", port, ROUTER_ETHERNET, Address { "192.168.0.1" } ) );
+  const size_t outside
+    = router.add_interface( make_shared<NetworkInterface>( "outside", port, ROUTER_ETHERNET, ROUTER_IP ) );
+  router.add_route( 0, 0, NEXT_HOP_IP, outside );
+
+  ARPMessage arp;
+  arp.opcode = ARPMessage::OPCODE_REQUEST;
+  arp.sender_ethernet_address = NEXT_HOP_ETHERNET;
+  arp.sender_ip_address = NEXT_HOP_IP.ipv4_numeric();
+  arp.target_ip_address = ROUTER_IP.ipv4_numeric();
+  router.interface( outside )->recv_frame(
+    clone( { .header = { .dst = ETHERNET_BROADCAST, .src = NEXT_HOP_ETHERNET, .type = EthernetHeader::TYPE_ARP },
+             .payload = serialize( arp ) } ) );
+  const size_t arp_replies = port->frames;
+
+  InternetDatagram dgram;
+  dgram.header.src = SOURCE_IP.ipv4_numeric();
+  dgram.header.dst = DESTINATION_IP.ipv4_numeric();
+  dgram.header.len = IPv4Header::LENGTH + 1000;
+  dgram.header.compute_checksum();
+  dgram.payload.emplace_back( string( 1000, 'x' ) );
+
+  auto& received = router.interface( inside )->datagrams_received();
+  const auto start = steady_clock::now();
+  for ( size_t sent = 0; sent < DATAGRAMS; sent += BATCH_SIZE ) {
+    for ( size_t i = 0; i < BATCH_SIZE; ++i ) {
+      received.push( dgram );
+    }
+    router.route();
+  }
+  const auto elapsed = duration_cast<nanoseconds>( steady_clock::now() - start );
+
+  const size_t forwarded = port->frames - arp_replies;
+  if ( forwarded != ( DATAGRAMS + BATCH_SIZE - 1 ) / BATCH_SIZE * BATCH_SIZE ) {
+    throw runtime_error( "the router did not forward every datagram" );
+  }
+  return static_cast<double>( elapsed.count() ) / static_cast<double>( forwarded );
+}
+
+// ns per TTL decrement (restarting from the default TTL before it expires), with the checksum recomputed
+// over the whole header or adjusted for the changed field
+double decrement_ttl( const bool recompute )
+{
+  IPv4Header header;
+  header.src = SOURCE_IP.ipv4_numeric();
+  header.dst = DESTINATION_IP.ipv4_numeric();
+  header.len = IPv4Header::LENGTH + 1000;
+  header.compute_checksum();
+
+  const auto start = steady_clock::now();
+  for ( size_t i = 0; i < TTL_UPDATES; ++i ) {
+    const uint8_t ttl = header.ttl > 1 ? header.ttl - 1 : IPv4Header::DEFAULT_TTL;
+    if ( recompute ) {
+      header.ttl = ttl;
+      header.compute_checksum();
+    } else {
+      header.set_ttl( ttl );
+    }
+  }
+  const auto elapsed = duration_cast<nanoseconds>( steady_clock::now() - start );
+
+  IPv4Header recomputed = header;
+  recomputed.compute_checksum();
+  if ( header.cksum != recomputed.cksum ) {
+    throw runtime_error( "the adjusted checksum is wrong" );
+  }
+  return static_cast<double>( elapsed.count() ) / static_cast<double>( TTL_UPDATES );
+}
+
+void program_body()
+{
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  // (the router reports each datagram it routes)
+  cerr.setstate( ios::badbit );
+  const double forwarding = forward();
+  cerr.clear();
+
+  const double recomputed = decrement_ttl( true );
+  const double adjusted = decrement_ttl( false );
+
+  cout << "Router forwarding: " << fixed << setprecision( 1 ) << forwarding << " ns/datagram.\n";
+  debug_output << "    Router forwarding: " << fixed << setprecision( 1 ) << setw( 6 ) << forwarding
+               << " ns/datagram\n";
+  for ( const auto& [name, ns] : { pair { "recomputed", recomputed }, pair { "adjusted (RFC 1624)", adjusted } } ) {
+    cout << "TTL decrement, checksum " << name << ": " << fixed << setprecision( 2 ) << ns << " ns.\n";
+    debug_output << "    TTL decrement, checksum " << setw( 19 ) << name << ": " << fixed << setprecision( 2 )
+                 << setw( 6 ) << ns << " ns\n";
+  }
+
+  cout << "Checksum adjustment speedup: " << fixed << setprecision( 1 ) << recomputed / adjusted << "x.\n";
+
+  if ( adjusted > MAX_ADJUST_NS ) {
+    throw runtime_error( "adjusting the checksum did not meet maximum time of "
+                         + to_string( static_cast<int>( MAX_ADJUST_NS ) ) + " ns per TTL decrement" );
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -708,6 +708,29 @@ int main()
       test.execute( ExpectSeqno { isn + bigstring.size() + 2 } );
       test.execute( ExpectSeqnosInFlight { 0 } );
     }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+
+      TCPSenderTestHarness test { "Dropped zero-window probe is resent when the window opens", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_no_flags().with_syn( true ).with_payload_size( 0 ).with_seqno( isn ) );
+      test.execute( AckReceived { isn + 1 }.with_win( 0 ) );
+      test.execute( Push { "abcdefg" } );
+      test.execute( ExpectMessage {}.with_no_flags().with_data( "a" ).with_seqno( isn + 1 ) );
+      test.execute( AckReceived { isn + 1 }.with_win( 0 ) ); // receiver was full: the probe was dropped
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { isn + 1 }.with_win( 4 ) ); // same ackno, window opens
+      test.execute( ExpectMessage {}.with_no_flags().with_data( "a" ).with_seqno( isn + 1 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_data( "bcd" ).with_seqno( isn + 2 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectConsecutiveRetransmissions { 0 } );
+      test.execute( AckReceived { isn + 5 }.with_win( 4 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_data( "efg" ).with_seqno( isn + 5 ) );
+      test.execute( ExpectSeqnosInFlight { 3 } );
+    }
   } catch ( const exception& e ) {
     cerr << e.what() << "\n";
     return 1;
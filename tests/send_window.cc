@@ -137,6 +137,74 @@ int main()
       test.execute( ExpectMessage {}.with_fin( true ).with_data( "4567" ) );
       test.execute( ExpectNoSegment {} );
     }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+
+      TCPSenderTestHarness test { "Zero window is probed only once nothing is outstanding", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_no_flags().with_syn( true ).with_payload_size( 0 ).with_seqno( isn ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 4 ) );
+      test.execute( Push { "abcdefgh" } );
+      test.execute( ExpectMessage {}.with_no_flags().with_data( "abcd" ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 0 ) );
+      test.execute( ExpectNoSegment {} ); // "abcd" is still in flight, so no probe yet
+      test.execute( ExpectSeqnosInFlight { 4 } );
+      test.execute( AckReceived { Wrap32 { isn + 5 } }.with_win( 0 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_data( "e" ).with_seqno( isn + 5 ) );
+      test.execute( ExpectNoSegment {} ); // only one probe at a time
+      test.execute( Push {} );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectSeqnosInFlight { 1 } );
+      test.execute( AckReceived { Wrap32 { isn + 6 } }.with_win( 3 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_data( "fgh" ).with_seqno( isn + 6 ) );
+      test.execute( ExpectNoSegment {} );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+
+      TCPSenderTestHarness test { "Window reopens after a probe is acknowledged", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_no_flags().with_syn( true ).with_payload_size( 0 ).with_seqno( isn ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 0 ) );
+      test.execute( Push { "abcdefg" } );
+      test.execute( ExpectMessage {}.with_no_flags().with_data( "a" ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { Wrap32 { isn + 2 } }.with_win( 0 ) ); // probe accepted, window still closed
+      test.execute( ExpectMessage {}.with_no_flags().with_data( "b" ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { Wrap32 { isn + 3 } }.with_win( 10 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_data( "cdefg" ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( ExpectSeqnosInFlight { 5 } );
+    }
+
+    {
+      TCPConfig cfg;
+      const Wrap32 isn( rd() );
+      cfg.isn = isn;
+
+      TCPSenderTestHarness test { "Window shrinks below the bytes in flight", cfg };
+      test.execute( Push {} );
+      test.execute( ExpectMessage {}.with_no_flags().with_syn( true ).with_payload_size( 0 ).with_seqno( isn ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 6 ) );
+      test.execute( Push { "abcdef" } );
+      test.execute( ExpectMessage {}.with_no_flags().with_data( "abcdef" ) );
+      test.execute( AckReceived { Wrap32 { isn + 1 } }.with_win( 2 ) );
+      test.execute( Push { "ghij" } );
+      test.execute( ExpectNoSegment {} ); // nothing fits until the window passes "f"
+      test.execute( AckReceived { Wrap32 { isn + 5 } }.with_win( 2 ) );
+      test.execute( ExpectNoSegment {} );
+      test.execute( AckReceived { Wrap32 { isn + 7 } }.with_win( 2 ) );
+      test.execute( ExpectMessage {}.with_no_flags().with_data( "gh" ).with_seqno( isn + 7 ) );
+      test.execute( ExpectNoSegment {} );
+    }
   } catch ( const exception& e ) {
     cerr << e.what() << "\n";
     return 1;
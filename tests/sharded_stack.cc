@@ -0,0 +1,204 @@
+#include "debug.hh"
+#include "exception.hh"
+#include "helpers.hh"
+#include "sharded_tcp_stack.hh"
+#include "tcp_over_ip.hh"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <future>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+const Address server_address { "10.0.0.1", 80 };
+constexpr size_t FLOOD_DATAGRAMS = 10000; // more than a shard's inbound socket and the dispatcher's backlog hold
+
+void expect( bool condition, const string& what )
+{
+  if ( not condition ) {
+    throw runtime_error( "expectation failed: " + what );
+  }
+}
+
+// An "interface" that is always readable, but fails every read (a directory)
+FileDescriptor broken_interface()
+{
+  return FileDescriptor { CheckSystemCall( "open", ::open( "/", O_RDONLY | O_DIRECTORY ) ) }; // NOLINT(*-vararg)
+}
+
+// Does `action` throw the unix_error that stopped the stack (and not some other exception)?
+template<class F>
+bool throws_unix_error( F&& action )
+{
+  try {
+    action();
+  } catch ( const unix_error& ) {
+    return true;
+  } catch ( const exception& ) {
+    return false;
+  }
+  return false;
+}
+
+// Once a thread has failed, listen() or accept() (whichever the failure reaches first) rethrows its exception
+void expect_listen_reports_error( ShardedTCPStack& stack )
+{
+  bool reported = false;
+  try {
+    ShardedListener& listener = stack.listen( {}, server_address );
+    reported = throws_unix_error( [&] { listener.accept( seconds( 5 ) ); } );
+  } catch ( const unix_error& ) {
+    reported = true;
+  }
+  expect( reported, "accept() (or listen()) rethrows the thread's exception" );
+}
+
+// A shard whose interface fails stops the stack, and the error reaches the application's thread
+void shard_error_reaches_application()
+{
+  vector<FileDescriptor> queues;
+  queues.push_back( broken_interface() );
+  ShardedTCPStack stack { move( queues ) };
+  expect_listen_reports_error( stack );
+
+  FdAdapterConfig config;
+  config.source = Address { "10.0.0.2", 5000 };
+  config.destination = server_address;
+  expect( throws_unix_error( [&] { stack.connect( {}, config ); } ), "connect() rethrows it too" );
+  expect( throws_unix_error( [&] { stack.join(); } ), "join() rethrows it once every thread has exited" );
+}
+
+// The same for the dispatcher's thread
+void dispatcher_error_reaches_application()
+{
+  ShardedTCPStack stack { broken_interface(), 2 };
+  expect_listen_reports_error( stack );
+  expect( throws_unix_error( [&] { stack.join(); } ), "join() rethrows the dispatcher's exception" );
+}
+
+FdAdapterConfig client_config( const uint16_t port )
+{
+  FdAdapterConfig config;
+  config.source = Address { "10.0.0.2", port };
+  config.destination = server_address;
+  return config;
+}
+
+// The shard of `server` that receives a client's datagrams from `port`
+size_t server_shard( const ShardedTCPStack& server, const uint16_t port )
+{
+  return server.shard_of( { .local_address = server_address.ipv4_numeric(),
+                            .remote_address = Address { "10.0.0.2" }.ipv4_numeric(),
+                            .local_port = server_address.port(),
+                            .remote_port = port } );
+}
+
+// A shard that stops reading loses its own datagrams, but the dispatcher keeps serving the other shards
+void stalled_shard_does_not_block_others()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+  FileDescriptor flood { CheckSystemCall( "dup", ::dup( fds[0] ) ) };
+  ShardedTCPStack client { FileDescriptor { fds[0] }, 1 };
+  ShardedTCPStack server { FileDescriptor { fds[1] }, 2 };
+  ShardedListener& listener = server.listen( {}, server_address, 16 );
+
+  constexpr size_t stalled = 0;
+  promise<void> stalling;
+  promise<void> release;
+  thread stall( [&, resume = release.get_future()] {
+    server.run_on_shard( stalled, [&]( TCPStack& /*unused*/ ) {
+      stalling.set_value();
+      resume.wait();
+    } );
+  } );
+  stalling.get_future().wait(); // (so that none of the flood reaches the shard)
+
+  bool dropped = false;
+  bool accepted = false;
+  bool received = false;
+  try {
+    // flood the stalled shard with resets (which it ignores, once released)
+    uint16_t port = 10000;
+    while ( server_shard( server, port ) != stalled ) {
+      ++port;
+    }
+    const FourTuple tuple { .local_address = Address { "10.0.0.2" }.ipv4_numeric(),
+                            .remote_address = server_address.ipv4_numeric(),
+                            .local_port = port,
+                            .remote_port = server_address.port() };
+    const string reset = concat( serialize( TCPOverIPv4Adapter::wrap_tcp_in_ip(
+      tuple, { TCPSenderMessage { .RST = true }, TCPReceiverMessage { .RST = true } } ) ) );
+    flood.set_blocking( false ); // (it shares the client stack's non-blocking file description anyway)
+    for ( size_t i = 0; i < FLOOD_DATAGRAMS; ++i ) {
+      while ( flood.write( reset ) == 0 ) {
+        this_thread::yield();
+      }
+    }
+    const auto deadline = chrono::steady_clock::now() + seconds( 5 );
+    while ( server.dispatch_drops() == 0 and chrono::steady_clock::now() < deadline ) {
+      this_thread::sleep_for( milliseconds( 1 ) );
+    }
+    dropped = server.dispatch_drops() > 0;
+
+    // a connection on another shard is still established, and carries data
+    ++port;
+    while ( server_shard( server, port ) == stalled ) {
+      ++port;
+    }
+    LocalStreamSocket sender = client.connect( {}, client_config( port ) );
+    auto connection = listener.accept( seconds( 5 ) );
+    accepted = connection.has_value();
+    if ( accepted ) {
+      sender.write( "hello" );
+      string received_bytes;
+      string buffer;
+      while ( received_bytes.size() < 5 and not connection->socket.eof() ) {
+        buffer.clear();
+        connection->socket.read( buffer );
+        received_bytes += buffer;
+      }
+      received = received_bytes == "hello";
+    }
+  } catch ( ... ) {
+    release.set_value();
+    stall.join();
+    throw;
+  }
+  release.set_value();
+  stall.join();
+
+  expect( dropped, "datagrams for the stalled shard are dropped once its backlog is full" );
+  expect( accepted, "a connection to another shard is accepted while one shard is stalled" );
+  expect( received, "and carries data" );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    set_debug_handler( []( void* /*unused*/, std::string_view /*unused*/ ) {}, nullptr );
+    shard_error_reaches_application();
+    dispatcher_error_reaches_application();
+    stalled_shard_does_not_block_others();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
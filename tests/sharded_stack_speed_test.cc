@@ -0,0 +1,206 @@
+#include "debug.hh"
+#include "exception.hh"
+#include "sharded_tcp_stack.hh"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr size_t NUM_CONNECTIONS = 1000; // connections opened (and closed at once) to measure connections/s
+constexpr size_t MAX_CONNECTING = 64;    // the load generator keeps at most this many handshakes in progress
+constexpr size_t NUM_STREAMS = 8;        // connections that each carry STREAM_BYTES to measure throughput
+constexpr size_t STREAM_BYTES = 1024 * 1024;
+constexpr size_t MAX_CORES = 8;
+constexpr uint64_t IDLE_MS = 1000;    // how long an idle connection is watched
+constexpr uint64_t MAX_IDLE_POLLS = 5; // waits allowed (every shard of both sides together) while it is idle
+
+const Address server_address { "10.0.0.1", 80 };
+
+struct Result
+{
+  double connections_per_second;
+  double gigabits_per_second;
+};
+
+FdAdapterConfig client_config( uint16_t port )
+{
+  FdAdapterConfig config;
+  config.source = Address { "10.0.0.2", port };
+  config.destination = server_address;
+  return config;
+}
+
+// Connections per second: open connections from successive ports and close each one immediately
+double connection_rate( ShardedTCPStack& client, ShardedListener& listener )
+{
+  size_t opened = 0;
+  size_t accepted = 0;
+  const auto start_time = steady_clock::now();
+  const auto deadline = start_time + seconds( 20 );
+  while ( accepted < NUM_CONNECTIONS and steady_clock::now() < deadline ) {
+    while ( opened < NUM_CONNECTIONS and opened < accepted + MAX_CONNECTING ) {
+      client.connect( {}, client_config( static_cast<uint16_t>( 10000 + opened++ ) ) ).close();
+    }
+    while ( listener.accept( milliseconds( 1 ) ) ) {
+      ++accepted;
+    }
+  }
+  const auto stop_time = steady_clock::now();
+
+  if ( accepted < NUM_CONNECTIONS ) {
+    throw runtime_error( "only " + to_string( accepted ) + " of " + to_string( NUM_CONNECTIONS )
+                         + " connections were accepted" );
+  }
+  return static_cast<double>( NUM_CONNECTIONS ) / duration_cast<duration<double>>( stop_time - start_time ).count();
+}
+
+// Aggregate throughput: send STREAM_BYTES over each of NUM_STREAMS connections at once
+double throughput( ShardedTCPStack& client, ShardedListener& listener )
+{
+  vector<LocalStreamSocket> senders;
+  vector<LocalStreamSocket> receivers;
+  for ( size_t i = 0; i < NUM_STREAMS; ++i ) {
+    senders.push_back( client.connect( {}, client_config( static_cast<uint16_t>( 20000 + i ) ) ) );
+  }
+  while ( receivers.size() < NUM_STREAMS ) {
+    auto connection = listener.accept( seconds( 5 ) );
+    if ( not connection.has_value() ) {
+      throw runtime_error( "stream connection was not accepted" );
+    }
+    receivers.push_back( move( connection->socket ) );
+  }
+
+  const string chunk( 65536, 'x' );
+  atomic<size_t> bytes_received {};
+  vector<thread> threads;
+  const auto start_time = steady_clock::now();
+  for ( auto& sender : senders ) {
+    threads.emplace_back( [&] {
+      for ( size_t sent = 0; sent < STREAM_BYTES; ) {
+        sent += sender.write( string_view { chunk }.substr( 0, STREAM_BYTES - sent ) );
+      }
+      sender.shutdown( SHUT_WR );
+    } );
+  }
+  for ( auto& receiver : receivers ) {
+    threads.emplace_back( [&] {
+      string buffer;
+      while ( not receiver.eof() ) {
+        buffer.clear();
+        receiver.read( buffer );
+        bytes_received += buffer.size();
+      }
+    } );
+  }
+  for ( auto& thread : threads ) {
+    thread.join();
+  }
+  const auto stop_time = steady_clock::now();
+
+  if ( bytes_received != NUM_STREAMS * STREAM_BYTES ) {
+    throw runtime_error( "received " + to_string( bytes_received ) + " of "
+                         + to_string( NUM_STREAMS * STREAM_BYTES ) + " bytes" );
+  }
+  const auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
+  return static_cast<double>( NUM_STREAMS * STREAM_BYTES * 8 ) / test_duration.count() / 1e9;
+}
+
+Result run( size_t cores )
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+
+  ShardedTCPStack client { FileDescriptor { fds[0] }, cores };
+  ShardedTCPStack server { FileDescriptor { fds[1] }, cores };
+  ShardedListener& listener = server.listen( {}, server_address, 256 );
+
+  const double connections_per_second = connection_rate( client, listener );
+  return { connections_per_second, throughput( client, listener ) };
+}
+
+// Waits made by every shard of both sides while one established connection does nothing for IDLE_MS
+uint64_t idle_polls()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+
+  ShardedTCPStack client { FileDescriptor { fds[0] }, 2 };
+  ShardedTCPStack server { FileDescriptor { fds[1] }, 2 };
+  ShardedListener& listener = server.listen( {}, server_address );
+  LocalStreamSocket sender = client.connect( {}, client_config( 30000 ) );
+  if ( not listener.accept( seconds( 5 ) ).has_value() ) {
+    throw runtime_error( "idle connection was not accepted" );
+  }
+
+  // let the handshake's last segment land, then watch the connection do nothing
+  this_thread::sleep_for( milliseconds( 50 ) );
+  const uint64_t polls_before = client.poll_count() + server.poll_count();
+  this_thread::sleep_for( milliseconds( IDLE_MS ) );
+  return client.poll_count() + server.poll_count() - polls_before;
+}
+
+void program_body()
+{
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  // scaling stops at the number of cores (but always try two shards, to exercise the dispatcher)
+  const size_t max_cores = max<size_t>( 2, min<size_t>( MAX_CORES, thread::hardware_concurrency() ) );
+  for ( size_t cores = 1; cores <= max_cores; cores *= 2 ) {
+    const Result result = run( cores );
+
+    cout << "ShardedTCPStack with " << cores << " shard" << ( cores == 1 ? "" : "s" ) << " per side: " << fixed
+         << setprecision( 0 ) << result.connections_per_second << " connections/s, " << setprecision( 2 )
+         << result.gigabits_per_second << " Gbit/s over " << NUM_STREAMS << " streams.\n";
+
+    debug_output << "    ShardedTCPStack (" << setw( 1 ) << cores << " core" << ( cores == 1 ? ") " : "s)" )
+                 << ": " << fixed << setprecision( 0 ) << setw( 6 ) << result.connections_per_second
+                 << " connections/s, " << setprecision( 2 ) << setw( 5 ) << result.gigabits_per_second
+                 << " Gbit/s\n";
+
+    if ( result.connections_per_second < 200 ) {
+      throw runtime_error( "ShardedTCPStack did not meet minimum acceptance rate of 200 connections/s." );
+    }
+    if ( result.gigabits_per_second < 0.01 ) {
+      throw runtime_error( "ShardedTCPStack did not meet minimum throughput of 0.01 Gbit/s." );
+    }
+  }
+
+  const uint64_t polls = idle_polls();
+  cout << "Idle ShardedTCPStack connection (2 shards per side): " << polls << " polls in " << IDLE_MS << " ms.\n";
+  debug_output << "    Idle ShardedTCPStack connection: " << setw( 3 ) << polls << " polls/s\n";
+  if ( polls > MAX_IDLE_POLLS ) {
+    throw runtime_error( "Idle ShardedTCPStack shards kept waking up." );
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    set_debug_handler( []( void* /*unused*/, std::string_view /*unused*/ ) {}, nullptr );
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+// read(2)-like and write(2)-like syscalls made by this process so far
+inline uint64_t io_syscalls()
+{
+  std::ifstream io { "/proc/self/io" };
+  uint64_t total = 0;
+  std::string key;
+  uint64_t value = 0;
+  while ( io >> key >> value ) {
+    if ( key == "syscr:" or key == "syscw:" ) {
+      total += value;
+    }
+  }
+  return total;
+}
+
+// CPU time used by this thread, in nanoseconds
+inline uint64_t cpu_ns()
+{
+  timespec now {};
+  if ( clock_gettime( CLOCK_THREAD_CPUTIME_ID, &now ) != 0 ) {
+    throw std::runtime_error( "clock_gettime failed" );
+  }
+  return static_cast<uint64_t>( now.tv_sec ) * 1'000'000'000 + static_cast<uint64_t>( now.tv_nsec );
+}
@@ -0,0 +1,177 @@
+#include "debug.hh"
+#include "exception.hh"
+#include "random.hh"
+#include "tcp_over_ip.hh"
+#include "tcp_stack.hh"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr size_t NUM_SPOOFED = 100'000; // SYNs from forged addresses, which never complete the handshake
+constexpr size_t NUM_LEGITIMATE = 200;  // connections opened by a real client during the flood
+constexpr size_t MAX_CONNECTING = 32;   // the real client keeps at most this many handshakes in progress
+constexpr size_t BATCH_SIZE = 256;      // spoofed SYNs injected per iteration of the server's event loop
+constexpr size_t SYN_BACKLOG = 128;
+
+const Address server_address { "10.0.0.1", 80 };
+
+size_t resident_bytes()
+{
+  ifstream statm { "/proc/self/statm" };
+  size_t total_pages {};
+  size_t resident_pages {};
+  statm >> total_pages >> resident_pages;
+  return resident_pages * static_cast<size_t>( sysconf( _SC_PAGESIZE ) );
+}
+
+struct ServerStats
+{
+  atomic<size_t> accepted {};
+  atomic<bool> failed {};
+  size_t max_connections {};
+  size_t rss_growth {};
+  uint64_t cookies_sent {};
+  uint64_t cookies_accepted {};
+  duration<double> flood_duration {};
+};
+
+// Server: inject a flood of spoofed SYNs while accepting (and immediately closing) real connections
+void serve( FileDescriptor&& wire, ServerStats& stats )
+{
+  try {
+    TCPStack server { move( wire ) };
+    TCPListener& listener = server.listen( {}, server_address, 256, SYN_BACKLOG );
+
+    auto rng = get_random_engine();
+    uniform_int_distribution<uint32_t> spoofed_address { Address { "11.0.0.0" }.ipv4_numeric(),
+                                                         Address { "11.255.255.255" }.ipv4_numeric() };
+    uniform_int_distribution<uint16_t> spoofed_port { 1024 };
+
+    size_t spoofed = 0;
+    size_t rss_before {};
+    const auto start_time = steady_clock::now();
+    const auto deadline = start_time + seconds( 20 );
+    while ( ( spoofed < NUM_SPOOFED or stats.accepted.load() < NUM_LEGITIMATE ) and not stats.failed.load()
+            and steady_clock::now() < deadline ) {
+      for ( size_t i = 0; i < BATCH_SIZE and spoofed < NUM_SPOOFED; ++i, ++spoofed ) {
+        const FourTuple from { .local_address = spoofed_address( rng ),
+                               .remote_address = server_address.ipv4_numeric(),
+                               .local_port = spoofed_port( rng ),
+                               .remote_port = server_address.port() };
+        const TCPSenderMessage syn { .seqno = Wrap32 { static_cast<uint32_t>( rng() ) }, .SYN = true };
+        const TCPReceiverMessage window { .window_size = 1000 };
+        server.receive_datagram( TCPOverIPv4Adapter::wrap_tcp_in_ip( from, { borrow( syn ), borrow( window ) } ) );
+        if ( spoofed == NUM_SPOOFED / 10 ) {
+          rss_before = resident_bytes(); // the SYN queue is full and the cookie path is warm
+        }
+      }
+      if ( spoofed == NUM_SPOOFED and stats.flood_duration == duration<double> {} ) {
+        stats.flood_duration = steady_clock::now() - start_time;
+        const size_t rss_after = resident_bytes();
+        stats.rss_growth = rss_after > rss_before ? rss_after - rss_before : 0;
+      }
+
+      server.wait_next_event( spoofed < NUM_SPOOFED ? 0 : 1 );
+      while ( listener.accept() ) {
+        ++stats.accepted;
+      }
+      stats.max_connections = max( stats.max_connections, server.connection_count() );
+    }
+
+    stats.cookies_sent = listener.cookies_sent();
+    stats.cookies_accepted = listener.cookies_accepted();
+  } catch ( const exception& e ) {
+    cerr << "Server exception: " << e.what() << "\n";
+    stats.failed = true;
+  }
+}
+
+void program_body()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+  ServerStats stats;
+
+  // Client: opens connections from successive ports (and drops the SYN/ACKs meant for spoofed hosts)
+  TCPStack client { FileDescriptor { fds[0] } };
+  FileDescriptor server_wire { fds[1] };
+
+  thread server_thread( [&] { serve( move( server_wire ), stats ); } );
+
+  size_t opened = 0;
+  const auto deadline = steady_clock::now() + seconds( 20 );
+  while ( stats.accepted.load() < NUM_LEGITIMATE and not stats.failed.load() and steady_clock::now() < deadline ) {
+    while ( opened < NUM_LEGITIMATE and opened < stats.accepted.load() + MAX_CONNECTING ) {
+      FdAdapterConfig config;
+      config.source = Address { "10.0.0.2", static_cast<uint16_t>( 10000 + opened++ ) };
+      config.destination = server_address;
+      client.connect( {}, config ).close();
+    }
+    client.wait_next_event( 1 );
+  }
+
+  stats.failed = stats.failed.load() or stats.accepted.load() < NUM_LEGITIMATE;
+  server_thread.join();
+  if ( stats.failed.load() ) {
+    throw runtime_error( "only " + to_string( stats.accepted.load() ) + " of " + to_string( NUM_LEGITIMATE )
+                         + " legitimate connections were accepted during the SYN flood" );
+  }
+
+  const double syns_per_second = static_cast<double>( NUM_SPOOFED ) / stats.flood_duration.count();
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "TCPListener answered " << NUM_SPOOFED << " spoofed SYNs at " << fixed << setprecision( 0 )
+       << syns_per_second << " SYNs/s (" << stats.cookies_sent << " SYN cookies sent, "
+       << stats.cookies_accepted << " accepted) and accepted all " << NUM_LEGITIMATE
+       << " legitimate connections.\n";
+  cout << "At most " << stats.max_connections << " connections were open; resident memory grew by "
+       << stats.rss_growth / 1024 << " KiB during the flood.\n";
+
+  debug_output << "          SYN flood (SYN cookies): " << fixed << setprecision( 0 ) << setw( 8 )
+               << syns_per_second << " SYNs/s\n";
+
+  if ( stats.max_connections > SYN_BACKLOG + NUM_LEGITIMATE ) {
+    throw runtime_error( "SYN flood created " + to_string( stats.max_connections ) + " connections." );
+  }
+  if ( stats.rss_growth > 8 * 1024 * 1024 ) {
+    throw runtime_error( "SYN flood grew resident memory by " + to_string( stats.rss_growth / 1024 ) + " KiB." );
+  }
+  if ( syns_per_second < 10'000 ) {
+    throw runtime_error( "TCPListener did not meet minimum SYN cookie rate of 10,000 SYNs/s." );
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    set_debug_handler( []( void* /*unused*/, std::string_view /*unused*/ ) {}, nullptr );
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
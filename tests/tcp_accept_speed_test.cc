@@ -0,0 +1,111 @@
+#include "debug.hh"
+#include "exception.hh"
+#include "tcp_stack.hh"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr size_t NUM_CONNECTIONS = 2000;
+constexpr size_t MAX_CONNECTING = 64; // the load generator keeps at most this many handshakes in progress
+
+const Address server_address { "10.0.0.1", 80 };
+
+// Server: accept connections until NUM_CONNECTIONS have arrived, closing each one immediately
+void serve( FileDescriptor&& wire, atomic<size_t>& accepted, atomic<bool>& failed )
+{
+  try {
+    TCPStack server { move( wire ) };
+    TCPListener& listener = server.listen( {}, server_address, 128, 128 );
+    while ( accepted.load() < NUM_CONNECTIONS and not failed.load() ) {
+      server.wait_next_event( 1 );
+      while ( listener.accept() ) {
+        ++accepted;
+      }
+    }
+  } catch ( const exception& e ) {
+    cerr << "Server exception: " << e.what() << "\n";
+    failed = true;
+  }
+}
+
+void program_body()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+  atomic<size_t> accepted {};
+  atomic<bool> failed {};
+
+  // Client: a load generator that opens connections from successive ports and closes each one
+  TCPStack client { FileDescriptor { fds[0] } };
+  FileDescriptor server_wire { fds[1] };
+
+  const auto start_time = steady_clock::now();
+  thread server_thread( [&] { serve( move( server_wire ), accepted, failed ); } );
+
+  size_t opened = 0;
+  const auto deadline = start_time + seconds( 10 );
+  while ( accepted.load() < NUM_CONNECTIONS and not failed.load() and steady_clock::now() < deadline ) {
+    while ( opened < NUM_CONNECTIONS and opened < accepted.load() + MAX_CONNECTING ) {
+      FdAdapterConfig config;
+      config.source = Address { "10.0.0.2", static_cast<uint16_t>( 10000 + opened++ ) };
+      config.destination = server_address;
+      client.connect( {}, config ).close();
+    }
+    client.wait_next_event( 1 );
+  }
+  const auto stop_time = steady_clock::now();
+
+  failed = failed.load() or accepted.load() < NUM_CONNECTIONS;
+  server_thread.join();
+  if ( failed.load() ) {
+    throw runtime_error( "only " + to_string( accepted.load() ) + " of " + to_string( NUM_CONNECTIONS )
+                         + " connections were accepted" );
+  }
+
+  const auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
+  const double connections_per_second = static_cast<double>( NUM_CONNECTIONS ) / test_duration.count();
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "TCPListener accepted " << NUM_CONNECTIONS << " connections (" << MAX_CONNECTING
+       << " handshakes in progress) at " << fixed << setprecision( 0 ) << connections_per_second
+       << " connections/s.\n";
+
+  debug_output << "        TCPListener acceptance rate: " << fixed << setprecision( 0 ) << setw( 6 )
+               << connections_per_second << " connections/s\n";
+
+  if ( connections_per_second < 200 ) {
+    throw runtime_error( "TCPListener did not meet minimum acceptance rate of 200 connections/s." );
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    set_debug_handler( []( void* /*unused*/, std::string_view /*unused*/ ) {}, nullptr );
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,188 @@
+#include "checksum.hh"
+#include "ipv4_header.hh"
+#include "parser.hh"
+#include "random.hh"
+#include "tcp_config.hh"
+#include "tcp_peer.hh"
+#include "tcp_segment.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr uint64_t TRANSFER_BYTES = 256 * 1024 * 1024;
+constexpr double MAX_US_PER_MB = 10000; // computing the checksum from header fields and a kept payload sum
+
+// How the sender's segments are checksummed
+enum class Method : uint8_t
+{
+  Reserialized, // serialize the segment (copying its payload) and sum the result, as TCPSegment once did
+  FromFields    // TCPSegment::compute_checksum: the header's fields plus the payload's (kept) sum
+};
+
+void reserialized_checksum( TCPSegment& seg, const uint32_t pseudo_checksum )
+{
+  seg.udinfo.cksum = 0;
+  Serializer serializer;
+  seg.serialize( serializer );
+
+  InternetChecksum check { pseudo_checksum };
+  check.add( serializer.finish() );
+  seg.udinfo.cksum = check.value();
+}
+
+struct Result
+{
+  double us_per_mb;         // spent checksumming, per MB transmitted (retransmissions included)
+  double retransmitted_pct; // of the segments transmitted
+};
+
+// A TCPPeer sends TRANSFER_BYTES, checksumming each segment it transmits. Each new segment is lost with
+// probability `loss`: the peer acknowledges up to it, and the sender retransmits it once its timer expires.
+// Once any losses are recovered, the window is acknowledged whole.
+Result bulk_send( const Method method, const double loss )
+{
+  TCPConfig config;
+  TCPPeer sender { config };
+  auto rd = get_random_engine();
+  bernoulli_distribution lose { loss };
+
+  IPv4Header ip_header;
+  ip_header.src = 0x0a00'0002;
+  ip_header.dst = 0x0a00'0001;
+
+  uint64_t bytes = 0;
+  uint64_t segments = 0;
+  uint64_t retransmissions = 0;
+  nanoseconds checksum_time {};
+  optional<Wrap32> isn;
+  uint64_t sent_end = 0;  // (absolute sequence numbers)
+  vector<Wrap32> lost {}; // in order
+
+  const auto transmit = [&]( const TCPMessage& msg ) {
+    const TCPSenderMessage& segment = msg.sender.get();
+    if ( segment.sequence_length() == 0 ) {
+      return;
+    }
+    if ( segment.SYN ) {
+      isn = segment.seqno;
+    }
+
+    // a new segment's payload is summed once (TCPSender keeps the sum with the segment); a retransmission
+    // comes with that sum
+    const uint64_t seqno = segment.seqno.unwrap( isn.value(), sent_end );
+    const bool retransmission = seqno < sent_end;
+    TCPSegment seg { .message = { msg.sender.borrow(),
+                                  msg.receiver.borrow(),
+                                  retransmission ? msg.payload_sum : optional<uint16_t> {} } };
+    seg.udinfo.src_port = 40000;
+    seg.udinfo.dst_port = 80;
+    ip_header.len = IPv4Header::LENGTH + TCPSegment::HEADER_LENGTH + segment.payload.size();
+    const uint32_t pseudo_checksum = ip_header.pseudo_checksum();
+
+    const auto start = steady_clock::now();
+    if ( method == Method::Reserialized ) {
+      reserialized_checksum( seg, pseudo_checksum );
+    } else {
+      seg.compute_checksum( pseudo_checksum );
+    }
+    checksum_time += steady_clock::now() - start;
+
+    bytes += segment.payload.size();
+    ++segments;
+    if ( retransmission ) {
+      ++retransmissions;
+    } else {
+      sent_end = seqno + segment.sequence_length();
+      if ( lose( rd ) ) {
+        lost.push_back( segment.seqno );
+      }
+    }
+  };
+  const auto acknowledge = [&]( const Wrap32 ackno ) {
+    TCPReceiverMessage ack { .ackno = ackno, .window_size = TCPConfig::DEFAULT_CAPACITY };
+    sender.receive( { TCPSenderMessage {}, move( ack ) }, transmit );
+  };
+
+  const string chunk( TCPConfig::DEFAULT_CAPACITY, 'x' );
+  uint64_t written = 0;
+
+  sender.push( transmit ); // SYN
+  while ( sent_end < TRANSFER_BYTES ) {
+    // (acknowledging up to a lost segment can send more, which may be lost in turn)
+    for ( size_t i = 0; i < lost.size(); ++i ) {
+      acknowledge( lost[i] );
+      sender.tick( config.rt_timeout, transmit );
+    }
+    lost.clear();
+    if ( isn.has_value() ) {
+      acknowledge( Wrap32::wrap( sent_end, isn.value() ) );
+    }
+
+    Writer& writer = sender.outbound_writer();
+    const uint64_t room = min( writer.available_capacity(), TRANSFER_BYTES - written );
+    writer.push( chunk.substr( 0, room ) );
+    written += room;
+    sender.push( transmit );
+  }
+
+  return { .us_per_mb = static_cast<double>( checksum_time.count() ) / 1e3 / ( static_cast<double>( bytes ) / 1e6 ),
+           .retransmitted_pct = 100.0 * static_cast<double>( retransmissions ) / static_cast<double>( segments ) };
+}
+
+void program_body()
+{
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  for ( const double loss : { 0.0, 0.05 } ) {
+    const Result reserialized = bulk_send( Method::Reserialized, loss );
+    const Result from_fields = bulk_send( Method::FromFields, loss );
+
+    for ( const auto& [name, result] :
+          { pair { "re-serialized", reserialized }, pair { "from header fields", from_fields } } ) {
+      cout << "Checksum time (" << name << ", " << fixed << setprecision( 1 ) << result.retransmitted_pct
+           << "% retransmitted): " << setprecision( 1 ) << result.us_per_mb << " us/MB.\n";
+      debug_output << "    Checksum time " << setw( 18 ) << name << ", " << fixed << setprecision( 1 ) << setw( 4 )
+                   << result.retransmitted_pct << "% retransmitted: " << setw( 6 ) << result.us_per_mb
+                   << " us/MB\n";
+    }
+
+    cout << "Checksum speedup (from header fields over re-serialized): " << fixed << setprecision( 2 )
+         << reserialized.us_per_mb / from_fields.us_per_mb << "x.\n";
+
+    if ( from_fields.us_per_mb > MAX_US_PER_MB ) {
+      throw runtime_error( "checksumming from header fields did not meet maximum time of "
+                           + to_string( static_cast<int>( MAX_US_PER_MB ) ) + " us/MB" );
+    }
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,103 @@
+#include "speed_test_helpers.hh"
+#include "tcp_config.hh"
+#include "tcp_peer.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+constexpr uint64_t TRANSFER_BYTES = 1024 * 1024 * 1024;
+constexpr double MAX_CPU_MS_PER_GB = 10000; // receiving with generic receive offload
+
+// One TCPPeer sends TRANSFER_BYTES to another, which receives each window's worth of segments as one batch
+// (as from one read of an adapter); returns the receiver's CPU milliseconds per GB received
+double receive_cpu_ms_per_gb( const bool receive_coalescing, const bool header_prediction )
+{
+  TCPConfig config;
+  config.receive_coalescing = receive_coalescing;
+  config.header_prediction = header_prediction;
+  TCPPeer sender { config };
+  TCPPeer receiver { config };
+
+  vector<TCPMessage> to_receiver;
+  vector<TCPMessage> to_sender;
+  const auto send = [&]( const TCPMessage& x ) { to_receiver.push_back( x ); }; // (copied: it may borrow)
+  const auto reply = [&]( const TCPMessage& x ) { to_sender.push_back( x ); };
+
+  const string chunk( TCPConfig::DEFAULT_CAPACITY, 'x' );
+  uint64_t written = 0;
+  uint64_t receiver_ns = 0;
+
+  sender.push( send ); // SYN
+  while ( receiver.inbound_reader().bytes_popped() < TRANSFER_BYTES ) {
+    Writer& writer = sender.outbound_writer();
+    const uint64_t room = min( writer.available_capacity(), TRANSFER_BYTES - written );
+    writer.push( chunk.substr( 0, room ) );
+    written += room;
+    sender.push( send );
+
+    const uint64_t start = cpu_ns();
+    receiver.receive_batch( to_receiver, reply );
+    receiver.inbound_reader().pop( receiver.inbound_reader().bytes_buffered() );
+    receiver.send_window_update( reply );
+    receiver_ns += cpu_ns() - start;
+    to_receiver.clear();
+
+    for ( auto& msg : to_sender ) {
+      sender.receive( move( msg ), send );
+    }
+    to_sender.clear();
+  }
+
+  if ( receiver.inbound_reader().bytes_popped() != TRANSFER_BYTES ) {
+    throw runtime_error( "transfer did not complete" );
+  }
+  return static_cast<double>( receiver_ns ) / 1e6 / ( static_cast<double>( TRANSFER_BYTES ) / 1e9 );
+}
+
+void program_body()
+{
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  for ( const bool header_prediction : { false, true } ) {
+    const double without = receive_cpu_ms_per_gb( false, header_prediction );
+    const double with = receive_cpu_ms_per_gb( true, header_prediction );
+    const string path = header_prediction ? "header prediction" : "general path";
+    for ( const auto& [name, ms] : { pair { "without GRO", without }, pair { "with GRO", with } } ) {
+      cout << "Receive CPU (" << path << ", " << name << "): " << fixed << setprecision( 1 ) << ms << " ms/GB.\n";
+      debug_output << "    Receive CPU " << setw( 18 ) << path << ", " << setw( 11 ) << name << ": " << fixed
+                   << setprecision( 1 ) << setw( 6 ) << ms << " ms/GB\n";
+    }
+    cout << "GRO speedup (" << path << "): " << fixed << setprecision( 2 ) << without / with << "x.\n";
+    if ( with > MAX_CPU_MS_PER_GB ) {
+      throw runtime_error( "receiving with GRO (" + path + ") did not meet maximum CPU time of "
+                           + to_string( static_cast<int>( MAX_CPU_MS_PER_GB ) ) + " ms/GB" );
+    }
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
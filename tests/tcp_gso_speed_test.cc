@@ -0,0 +1,133 @@
+#include "speed_test_helpers.hh"
+#include "tcp_config.hh"
+#include "tcp_over_ip.hh"
+#include "tcp_peer.hh"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+constexpr uint64_t TRANSFER_BYTES = 1024 * 1024 * 1024;
+constexpr double MAX_CPU_MS_PER_GB = 10000; // sending super-segments
+
+struct Result
+{
+  double cpu_ms_per_gb; // spent by the sending TCPPeer and the adapter, per GB sent
+  uint64_t segments;    // built by the TCPSender
+  uint64_t datagrams;   // written by the adapter
+};
+
+// A TCPPeer sends TRANSFER_BYTES through an adapter that splits its segments into MSS-sized datagrams (each
+// copied out, as into a device's buffer). Each window's worth is acknowledged with one ACK.
+Result bulk_send( const size_t max_segment_payload, const TCPChecksum checksum )
+{
+  TCPConfig config;
+  config.max_segment_payload = max_segment_payload;
+  TCPPeer sender { config };
+
+  TCPOverIPv4Adapter adapter;
+  adapter.config_mut().source = Address { "10.0.0.2", 40000 };
+  adapter.config_mut().destination = Address { "10.0.0.1", 80 };
+
+  array<char, 2048> frame {};
+  uint64_t bytes = 0;
+  Result result {};
+  optional<Wrap32> next_seqno;
+  const auto write_datagram = [&]( string_view headers, string_view payload ) {
+    memcpy( frame.data(), headers.data(), headers.size() );
+    memcpy( &frame.at( headers.size() ), payload.data(), payload.size() );
+    bytes += payload.size();
+    ++result.datagrams;
+  };
+  const auto transmit = [&]( const TCPMessage& msg ) {
+    adapter.split_segment( msg, TCPConfig::MAX_PAYLOAD_SIZE, checksum, write_datagram );
+    next_seqno = msg.sender->seqno + static_cast<uint32_t>( msg.sender->sequence_length() );
+    result.segments += msg.sender->sequence_length() > 0;
+  };
+
+  const string chunk( TCPConfig::DEFAULT_CAPACITY, 'x' );
+  uint64_t written = 0;
+
+  const uint64_t start = cpu_ns();
+  sender.push( transmit ); // SYN
+  while ( bytes < TRANSFER_BYTES ) {
+    TCPReceiverMessage ack { .ackno = next_seqno, .window_size = TCPConfig::DEFAULT_CAPACITY };
+    sender.receive( { TCPSenderMessage {}, move( ack ) }, transmit );
+
+    Writer& writer = sender.outbound_writer();
+    const uint64_t room = min( writer.available_capacity(), TRANSFER_BYTES - written );
+    writer.push( chunk.substr( 0, room ) );
+    written += room;
+    sender.push( transmit );
+  }
+  const uint64_t elapsed = cpu_ns() - start;
+
+  if ( bytes != TRANSFER_BYTES ) {
+    throw runtime_error( "wrong number of bytes sent" );
+  }
+  result.cpu_ms_per_gb = static_cast<double>( elapsed ) / 1e6 / ( static_cast<double>( TRANSFER_BYTES ) / 1e9 );
+  return result;
+}
+
+void program_body()
+{
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  for ( const auto checksum : { TCPChecksum::Full, TCPChecksum::Offloaded } ) {
+    const string mode = checksum == TCPChecksum::Full ? "full checksum" : "checksum offloaded";
+    const Result mss_sized = bulk_send( TCPConfig::MAX_PAYLOAD_SIZE, checksum );
+    const Result super = bulk_send( TCPConfig::SUPER_SEGMENT_PAYLOAD, checksum );
+    if ( super.datagrams != mss_sized.datagrams ) {
+      throw runtime_error( "super-segments did not go out as the same datagrams" );
+    }
+
+    for ( const auto& [name, result] :
+          { pair { "MSS-sized segments", mss_sized }, pair { "super-segments", super } } ) {
+      cout << "Send CPU (" << mode << ", " << name << "): " << fixed << setprecision( 1 ) << result.cpu_ms_per_gb
+           << " ms/GB, " << result.segments << " segments, " << result.datagrams << " datagrams.\n";
+      debug_output << "    Send CPU " << setw( 18 ) << mode << ", " << setw( 18 ) << name << ": " << fixed
+                   << setprecision( 1 ) << setw( 6 ) << result.cpu_ms_per_gb << " ms/GB, " << setw( 8 )
+                   << result.segments << " segments\n";
+    }
+
+    cout << "Super-segment speedup (" << mode << "): " << fixed << setprecision( 2 )
+         << mss_sized.cpu_ms_per_gb / super.cpu_ms_per_gb << "x.\n";
+
+    if ( super.segments >= mss_sized.segments ) {
+      throw runtime_error( "the sender built no fewer super-segments than MSS-sized segments" );
+    }
+    if ( super.cpu_ms_per_gb > MAX_CPU_MS_PER_GB ) {
+      throw runtime_error( "sending super-segments (" + mode + ") did not meet maximum CPU time of "
+                           + to_string( static_cast<int>( MAX_CPU_MS_PER_GB ) ) + " ms/GB" );
+    }
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
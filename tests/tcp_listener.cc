@@ -0,0 +1,375 @@
+#include "debug.hh"
+#include "exception.hh"
+#include "helpers.hh"
+#include "syn_cookies.hh"
+#include "tcp_over_ip.hh"
+#include "tcp_stack.hh"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const Address server_address { "10.0.0.1", 80 };
+const uint32_t client_ip = Address { "10.0.0.2" }.ipv4_numeric();
+
+void expect( bool condition, const string& what )
+{
+  if ( not condition ) {
+    throw runtime_error( "expectation failed: " + what );
+  }
+}
+
+// The far end of the server's datagram interface: a client that writes segments by hand
+class Client
+{
+  TCPStack& server_;
+  FileDescriptor wire_;
+
+public:
+  Client( TCPStack& server, FileDescriptor&& wire ) : server_( server ), wire_( move( wire ) )
+  {
+    wire_.set_blocking( false );
+  }
+
+  static FourTuple tuple( uint16_t port )
+  {
+    return { .local_address = client_ip,
+             .remote_address = server_address.ipv4_numeric(),
+             .local_port = port,
+             .remote_port = server_address.port() };
+  }
+
+  static Wrap32 isn( uint16_t port ) { return Wrap32 { port * 1000U }; }
+
+  void send( const FourTuple& from, const TCPSenderMessage& sender, const TCPReceiverMessage& receiver )
+  {
+    server_.receive_datagram(
+      TCPOverIPv4Adapter::wrap_tcp_in_ip( from, { borrow( sender ), borrow( receiver ) } ) );
+  }
+
+  void syn( uint16_t port )
+  {
+    send( tuple( port ), { .seqno = isn( port ), .SYN = true }, { .window_size = 1000 } );
+  }
+
+  void ack( uint16_t port, Wrap32 server_isn, const string& payload = {} )
+  {
+    send( tuple( port ),
+          { .seqno = isn( port ) + 1, .payload = payload },
+          { .ackno = server_isn + 1, .window_size = 1000 } );
+  }
+
+  // The next segment the server transmitted (to any client port), and its 4-tuple from the client's side
+  optional<pair<FourTuple, TCPMessage>> receive()
+  {
+    vector<string> strs( 3 );
+    strs[0].resize( IPv4Header::LENGTH );
+    strs[1].resize( TCPSegment::HEADER_LENGTH );
+    wire_.read( strs );
+    if ( strs.empty() ) {
+      return {};
+    }
+
+    InternetDatagram ip_dgram;
+    expect( parse( ip_dgram, move( strs ) ), "server sent a valid IPv4 datagram" );
+    FourTuple to_client;
+    auto msg = TCPOverIPv4Adapter::unwrap_tcp_in_ip( move( ip_dgram ), to_client );
+    expect( msg.has_value(), "server sent a valid TCP segment" );
+    return make_pair( to_client, move( msg.value() ) );
+  }
+
+  // The server's ISN, taken from its SYN/ACK to `port`
+  Wrap32 syn_ack( uint16_t port )
+  {
+    auto segment = receive();
+    expect( segment.has_value(), "server replied to SYN" );
+    const auto& [to_client, msg] = segment.value();
+    expect( to_client.local_port == port, "SYN/ACK went to port " + to_string( port ) );
+    expect( msg.sender->SYN, "server's reply has SYN" );
+    expect( msg.receiver->ackno == isn( port ) + 1, "server's reply acknowledges the SYN" );
+    return msg.sender->seqno;
+  }
+};
+
+void run_for( TCPStack& stack, int iterations )
+{
+  for ( int i = 0; i < iterations; ++i ) {
+    stack.wait_next_event( 0 );
+  }
+}
+
+void queues_and_accept()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+  TCPStack server { FileDescriptor { fds[0] } };
+  Client client { server, FileDescriptor { fds[1] } };
+
+  TCPListener& listener = server.listen( {}, Address { "0", 80 }, 2, 3 );
+  listener.set_syn_cookies( false );
+
+  // The SYN queue holds three half-open connections; later SYNs are dropped
+  for ( uint16_t port = 5000; port < 5005; ++port ) {
+    client.syn( port );
+  }
+  expect( listener.syn_queue_size() == 3, "SYN queue is full" );
+  expect( listener.syns_dropped() == 2, "two SYNs were dropped" );
+  expect( server.connection_count() == 3, "three connections exist" );
+  array<Wrap32, 3> server_isn { client.syn_ack( 5000 ), client.syn_ack( 5001 ), client.syn_ack( 5002 ) };
+  expect( not client.receive().has_value(), "dropped SYNs got no reply" );
+
+  // Segments that are not for a listener are dropped
+  FourTuple wrong_port = Client::tuple( 6000 );
+  wrong_port.remote_port = 81;
+  client.send( wrong_port, { .seqno = Wrap32 { 0 }, .SYN = true }, {} );
+  client.ack( 5003, Wrap32 { 0 } );
+  expect( server.segments_dropped() == 2, "segments for no connection were dropped" );
+  expect( server.connection_count() == 3, "no new connections" );
+
+  // Completing the handshake moves connections to the accept queue; the first carries data
+  client.ack( 5000, server_isn[0], "hello" );
+  client.ack( 5001, server_isn[1] );
+  expect( listener.syn_queue_size() == 1, "one connection is still half-open" );
+  expect( listener.accept_queue_size() == 2, "two connections await accept()" );
+
+  // While the accept queue is full, SYNs are dropped, but a handshake in progress still completes
+  client.syn( 5010 );
+  expect( listener.syns_dropped() == 3, "SYN dropped while accept queue is full" );
+  client.ack( 5002, server_isn[2] );
+  expect( listener.accept_queue_size() == 3, "handshake completed despite full accept queue" );
+  expect( listener.syn_queue_size() == 0, "SYN queue is empty" );
+
+  // accept() returns the oldest connection, with data received before it was accepted
+  auto first = listener.accept();
+  expect( first.has_value(), "accept() returned a connection" );
+  expect( first->peer == Address { "10.0.0.2", 5000 }, "first connection is from port 5000" );
+  run_for( server, 4 );
+  string buffer;
+  first->socket.read( buffer );
+  expect( buffer == "hello", "data sent before accept() is readable" );
+
+  // The application can write to the accepted connection
+  first->socket.write( "world" );
+  run_for( server, 4 );
+  bool delivered = false;
+  while ( auto segment = client.receive() ) {
+    delivered |= ( segment->first.local_port == 5000 and segment->second.sender->payload == "world" );
+  }
+  expect( delivered, "data written to an accepted socket is sent to the peer" );
+
+  expect( listener.accept()->peer.port() == 5001, "second connection is from port 5001" );
+  expect( listener.accept()->peer.port() == 5002, "third connection is from port 5002" );
+  expect( not listener.accept().has_value(), "accept queue is empty" );
+
+  // Listening twice on one port is an error
+  bool threw = false;
+  try {
+    server.listen( {}, server_address );
+  } catch ( const runtime_error& ) {
+    threw = true;
+  }
+  expect( threw, "second listen() on the same port throws" );
+}
+
+void half_open_timeout()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+  TCPStack server { FileDescriptor { fds[0] } };
+  Client client { server, FileDescriptor { fds[1] } };
+
+  TCPConfig config;
+  config.rt_timeout = 5;
+  TCPListener& listener = server.listen( config, server_address );
+
+  client.syn( 7000 );
+  expect( listener.syn_queue_size() == 1, "SYN queue holds the connection" );
+
+  // The client never completes the handshake; the server gives up after retransmitting its SYN/ACK
+  unsigned syn_acks = 0;
+  const auto deadline = chrono::steady_clock::now() + chrono::seconds( 5 );
+  while ( listener.syn_queue_size() > 0 and chrono::steady_clock::now() < deadline ) {
+    server.wait_next_event( 1 );
+    while ( client.receive() ) {
+      ++syn_acks;
+    }
+  }
+  expect( listener.syn_queue_size() == 0, "half-open connection was abandoned" );
+  expect( server.connection_count() == 0, "half-open connection was forgotten" );
+  expect( syn_acks == 1 + TCPListener::MAX_SYN_ACK_RETRIES, "SYN/ACK was retransmitted" );
+}
+
+void syn_cookie_codec()
+{
+  const SYNCookies cookies;
+  const FourTuple tuple = Client::tuple( 5000 );
+  const Wrap32 peer_isn { 123456789 };
+  const uint64_t now = 1'000'000; // 15 periods and 40 seconds
+
+  const Wrap32 cookie = cookies.make( tuple, peer_isn, 1000, now );
+  expect( cookies.check( tuple, peer_isn, cookie, now ) == 1000, "cookie is valid" );
+
+  // valid until the end of the next period
+  expect( cookies.check( tuple, peer_isn, cookie, 17 * SYNCookies::COUNTER_PERIOD_MS - 1 ).has_value(),
+          "cookie is valid in the next period" );
+  expect( not cookies.check( tuple, peer_isn, cookie, 17 * SYNCookies::COUNTER_PERIOD_MS ).has_value(),
+          "cookie expires after the next period" );
+  expect( not cookies.check( tuple, peer_isn, cookie, 15 * SYNCookies::COUNTER_PERIOD_MS - 1 ).has_value(),
+          "cookie is not valid before it was made" );
+  expect( not cookies.check( tuple, peer_isn, cookie, now + 32 * SYNCookies::COUNTER_PERIOD_MS ).has_value(),
+          "cookie is not valid when the counter wraps around" );
+
+  // bound to the connection, the peer's ISN and the secret key
+  expect( not cookies.check( Client::tuple( 5001 ), peer_isn, cookie, now ).has_value(), "other port" );
+  expect( not cookies.check( tuple, peer_isn + 1, cookie, now ).has_value(), "other peer ISN" );
+  expect( not cookies.check( tuple, peer_isn, cookie + 1, now ).has_value(), "altered cookie" );
+  expect( not SYNCookies {}.check( tuple, peer_isn, cookie, now ).has_value(), "other key" );
+
+  // MSS is rounded down to an entry of the table
+  expect( cookies.check( tuple, peer_isn, cookies.make( tuple, peer_isn, 1460, now ), now ) == 1460, "MSS 1460" );
+  expect( cookies.check( tuple, peer_isn, cookies.make( tuple, peer_isn, 1300, now ), now ) == 1220, "MSS 1300" );
+  expect( cookies.check( tuple, peer_isn, cookies.make( tuple, peer_isn, 100, now ), now ) == 216, "MSS 100" );
+}
+
+void syn_cookie_handshake()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+  TCPStack server { FileDescriptor { fds[0] } };
+  Client client { server, FileDescriptor { fds[1] } };
+
+  TCPListener& listener = server.listen( {}, server_address, 16, 1 );
+
+  // Once the SYN queue is full, SYNs are answered statelessly
+  client.syn( 5000 );
+  client.syn_ack( 5000 );
+  client.syn( 5001 );
+  const Wrap32 cookie = client.syn_ack( 5001 );
+  expect( listener.cookies_sent() == 1, "a SYN cookie was sent" );
+  expect( listener.syns_dropped() == 0, "no SYNs were dropped" );
+  expect( server.connection_count() == 1, "no state was kept for the second SYN" );
+
+  // An ACK that does not acknowledge the cookie creates nothing
+  client.ack( 5001, cookie + 1 );
+  client.ack( 5002, cookie );
+  expect( server.connection_count() == 1 and listener.cookies_accepted() == 0, "bad ACKs are ignored" );
+  expect( server.segments_dropped() == 2, "bad ACKs were dropped" );
+
+  // The right ACK rebuilds the connection, which goes straight to the accept queue
+  client.ack( 5001, cookie, "cookie" );
+  expect( listener.cookies_accepted() == 1, "cookie was accepted" );
+  expect( listener.accept_queue_size() == 1 and listener.syn_queue_size() == 1, "connection is established" );
+
+  auto accepted = listener.accept();
+  expect( accepted.has_value() and accepted->peer.port() == 5001, "accept() returns the rebuilt connection" );
+  run_for( server, 4 );
+  string buffer;
+  accepted->socket.read( buffer );
+  expect( buffer == "cookie", "data on the final ACK is delivered" );
+  accepted->socket.write( "reply" );
+  run_for( server, 4 );
+  bool delivered = false;
+  while ( auto segment = client.receive() ) {
+    delivered |= ( segment->first.local_port == 5001 and segment->second.sender->payload == "reply"
+                   and segment->second.sender->seqno == cookie + 1 );
+  }
+  expect( delivered, "the rebuilt connection continues from the cookie's sequence number" );
+}
+
+// The stack keeps running while the interface is full: replies wait in a bounded queue, and beyond it are dropped
+void full_interface()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+  TCPStack server { FileDescriptor { fds[0] } };
+  Client client { server, FileDescriptor { fds[1] } };
+
+  const size_t syns = TCPStack::MAX_OUTBOUND_QUEUE * 2;
+  TCPListener& listener = server.listen( {}, server_address, 16, syns );
+  for ( size_t i = 0; i < syns; ++i ) {
+    client.syn( static_cast<uint16_t>( 10000 + i ) );
+  }
+  expect( listener.syn_queue_size() == syns, "every SYN was received while the client was not reading" );
+  expect( server.datagrams_dropped() > 0, "SYN/ACKs beyond the outbound queue were dropped" );
+
+  // Once the client reads, the queued SYN/ACKs follow
+  const size_t expected = syns - server.datagrams_dropped();
+  size_t received = 0;
+  for ( int i = 0; i < 10000 and received < expected; ++i ) {
+    while ( client.receive() ) {
+      ++received;
+    }
+    server.wait_next_event( 0 );
+  }
+  expect( received == expected, "every SYN/ACK that was not dropped was sent" );
+}
+
+// A round ticks only the connections that something happened to, however many others are open
+void idle_connections()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+  TCPStack server { FileDescriptor { fds[0] } };
+  Client client { server, FileDescriptor { fds[1] } };
+
+  constexpr uint16_t connections = 1000;
+  TCPListener& listener = server.listen( {}, server_address, connections, connections );
+  vector<TCPListener::AcceptedConnection> accepted;
+  Wrap32 first_isn { 0 };
+  for ( uint16_t port = 20000; port < 20000 + connections; ++port ) {
+    client.syn( port );
+    const Wrap32 server_isn = client.syn_ack( port );
+    client.ack( port, server_isn );
+    if ( port == 20000 ) {
+      first_isn = server_isn;
+    }
+  }
+  while ( auto connection = listener.accept() ) {
+    accepted.push_back( move( connection.value() ) );
+  }
+  expect( accepted.size() == connections, "every connection was established" );
+
+  run_for( server, 4 );
+  const uint64_t before = server.connections_ticked();
+  client.send( Client::tuple( 20000 ),
+               { .seqno = Client::isn( 20000 ) + 1, .payload = "busy" },
+               { .ackno = first_isn + 1, .window_size = 1000 } );
+  run_for( server, 4 );
+  string buffer;
+  accepted.front().socket.read( buffer );
+  expect( buffer == "busy", "the busy connection received its data" );
+  expect( server.connections_ticked() - before < 10, "the idle connections were not ticked" );
+  expect( server.connection_count() == connections, "and are still open" );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    set_debug_handler( []( void* /*unused*/, std::string_view /*unused*/ ) {}, nullptr );
+    queues_and_accept();
+    half_open_timeout();
+    syn_cookie_codec();
+    syn_cookie_handshake();
+    full_interface();
+    idle_connections();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,142 @@
+#include "exception.hh"
+#include "socket.hh"
+#include "tcp_minnow_socket_impl.hh"
+#include "tcp_over_udp.hh"
+
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t TRANSFER_BYTES = 1024 * 1024;
+constexpr size_t OVERSIZED_BYTES = 20000; // more than a receive buffer holds
+
+void expect( bool condition, const string& what )
+{
+  if ( not condition ) {
+    throw runtime_error( "expectation failed: " + what );
+  }
+}
+
+UDPSocket bound_socket()
+{
+  UDPSocket socket;
+  socket.bind( Address { "127.0.0.1", 0 } );
+  return socket;
+}
+
+void batches_skip_oversized_datagrams()
+{
+  UDPSocket sender = bound_socket();
+  UDPSocket receiver = bound_socket();
+  receiver.set_blocking( false );
+
+  const string oversized( OVERSIZED_BYTES, 'z' );
+  sender.sendto( receiver.local_address(), "before" );
+  sender.sendto( receiver.local_address(), oversized );
+  sender.sendto( receiver.local_address(), "after" );
+
+  array<string, 4> payloads;
+  vector<Address> sources;
+  expect( receiver.recv_batch( payloads, sources ) == 2, "the oversized datagram is not returned" );
+  expect( payloads[0] == "before" and payloads[1] == "after", "the datagrams around it are" );
+  expect( sources.size() == 2 and sources[1] == sender.local_address(), "with their senders" );
+  expect( receiver.truncated_datagrams() == 1, "the oversized datagram is counted" );
+  expect( receiver.recv_batch( payloads ) == 0, "nothing else is waiting" );
+}
+
+// Anyone may send to the adapter's port; a datagram too big for its buffer must not end the connection
+void oversized_datagram_mid_transfer()
+{
+  TCPConfig tcp_config;
+  tcp_config.rt_timeout = 100;
+
+  UDPSocket receiver_socket = bound_socket();
+  UDPSocket sender_socket = bound_socket();
+  const Address receiver_address = receiver_socket.local_address();
+
+  FdAdapterConfig sender_config;
+  sender_config.source = sender_socket.local_address();
+  sender_config.destination = receiver_address;
+
+  exception_ptr sender_error;
+  thread sender_thread( [&] {
+    try {
+      TCPOverUDPMinnowSocket socket { TCPOverUDPAdapter { move( sender_socket ) } };
+      socket.connect( tcp_config, sender_config );
+      socket.set_blocking( true );
+      const string chunk( 65536, 'x' );
+      for ( size_t sent = 0; sent < TRANSFER_BYTES; ) {
+        sent += socket.write( string_view { chunk }.substr( 0, TRANSFER_BYTES - sent ) );
+      }
+      socket.shutdown( SHUT_WR );
+      string rest;
+      while ( not socket.eof() ) {
+        socket.read( rest );
+      }
+      socket.wait_until_closed();
+    } catch ( ... ) {
+      sender_error = current_exception();
+    }
+  } );
+
+  FdAdapterConfig receiver_config;
+  receiver_config.source = receiver_address;
+  TCPOverUDPMinnowSocket socket { TCPOverUDPAdapter { move( receiver_socket ) } };
+  socket.listen_and_accept( tcp_config, receiver_config );
+  socket.set_blocking( true );
+
+  UDPSocket stranger = bound_socket();
+  const string oversized( OVERSIZED_BYTES, 'z' );
+  size_t received = 0;
+  bool interrupted = false;
+  string buffer;
+  while ( not socket.eof() ) {
+    buffer.clear();
+    socket.read( buffer );
+    expect( buffer.find_first_not_of( 'x' ) == string::npos, "received the sender's bytes" );
+    received += buffer.size();
+
+    if ( not interrupted and received >= TRANSFER_BYTES / 4 ) {
+      for ( int i = 0; i < 3; ++i ) {
+        stranger.sendto( receiver_address, oversized );
+      }
+      interrupted = true;
+    }
+  }
+  socket.wait_until_closed();
+  sender_thread.join();
+
+  if ( sender_error ) {
+    rethrow_exception( sender_error );
+  }
+  expect( interrupted, "the oversized datagrams were sent mid-transfer" );
+  expect( received == TRANSFER_BYTES, "the whole transfer arrived (" + to_string( received ) + " bytes)" );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    batches_skip_oversized_datagrams();
+    oversized_datagram_mid_transfer();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
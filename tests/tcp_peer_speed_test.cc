@@ -0,0 +1,129 @@
+#include "tcp_config.hh"
+#include "tcp_peer.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr size_t TRANSFER_BYTES = 256 * 1024 * 1024;
+constexpr double MAX_NS_PER_MESSAGE = 10000; // on the receive path with header prediction
+
+struct Result
+{
+  double data_ns; // per data segment received (including the ACK sent in reply)
+  double ack_ns;  // per pure ACK received (including any data the opened window let the sender push)
+};
+
+// Have `peer` receive each message in `queue`, adding its replies to `replies`; returns the nanoseconds spent
+uint64_t deliver( TCPPeer& peer, vector<TCPMessage>& queue, vector<TCPMessage>& replies )
+{
+  const auto transmit = [&]( const TCPMessage& x ) { replies.push_back( x ); }; // (copied: a reply may borrow)
+  const auto start = steady_clock::now();
+  for ( auto& msg : queue ) {
+    peer.receive( move( msg ), transmit );
+  }
+  const auto elapsed = duration_cast<nanoseconds>( steady_clock::now() - start ).count();
+  queue.clear();
+  return elapsed;
+}
+
+// One TCPPeer sends TRANSFER_BYTES to another, with the segments handed over in memory
+Result bulk_transfer( const bool header_prediction )
+{
+  TCPConfig sender_config;
+  sender_config.header_prediction = header_prediction;
+  sender_config.isn = Wrap32 { 0xfffff000 }; // (wraps during the transfer)
+  TCPConfig receiver_config = sender_config;
+  receiver_config.isn = Wrap32 { 12345 };
+
+  TCPPeer sender { sender_config };
+  TCPPeer receiver { receiver_config };
+  vector<TCPMessage> to_receiver;
+  vector<TCPMessage> to_sender;
+  const auto send = [&]( const TCPMessage& x ) { to_receiver.push_back( x ); };
+
+  const string chunk( TCPConfig::DEFAULT_CAPACITY, 'x' );
+  uint64_t written = 0;
+  uint64_t data_segments = 0;
+  uint64_t acks = 0;
+  uint64_t data_ns = 0;
+  uint64_t ack_ns = 0;
+
+  sender.push( send ); // SYN
+  while ( receiver.inbound_reader().bytes_popped() < TRANSFER_BYTES ) {
+    Writer& writer = sender.outbound_writer();
+    const uint64_t room = min( writer.available_capacity(), TRANSFER_BYTES - written );
+    writer.push( chunk.substr( 0, room ) );
+    written += room;
+    sender.push( send );
+
+    for ( const auto& msg : to_receiver ) {
+      data_segments += not msg.sender->payload.empty();
+    }
+    data_ns += deliver( receiver, to_receiver, to_sender );
+    receiver.inbound_reader().pop( receiver.inbound_reader().bytes_buffered() );
+    receiver.send_window_update( [&]( const TCPMessage& x ) { to_sender.push_back( x ); } );
+
+    acks += to_sender.size();
+    ack_ns += deliver( sender, to_sender, to_receiver );
+  }
+
+  if ( receiver.inbound_reader().bytes_popped() != TRANSFER_BYTES
+       or sender.sender().sequence_numbers_in_flight() > 0 ) {
+    throw runtime_error( "transfer did not complete" );
+  }
+  return { .data_ns = static_cast<double>( data_ns ) / static_cast<double>( data_segments ),
+           .ack_ns = static_cast<double>( ack_ns ) / static_cast<double>( acks ) };
+}
+
+void program_body()
+{
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  const Result general = bulk_transfer( false );
+  const Result predicted = bulk_transfer( true );
+
+  for ( const auto& [name, result] :
+        { pair { "general path", general }, pair { "header prediction", predicted } } ) {
+    cout << "TCPPeer::receive (" << name << "): " << fixed << setprecision( 1 ) << result.data_ns
+         << " ns/data segment, " << result.ack_ns << " ns/ACK.\n";
+    debug_output << "    TCPPeer::receive " << setw( 18 ) << name << ": " << fixed << setprecision( 1 ) << setw( 7 )
+                 << result.data_ns << " ns/data segment, " << setw( 6 ) << result.ack_ns << " ns/ACK\n";
+  }
+
+  const double speedup = ( general.data_ns + general.ack_ns ) / ( predicted.data_ns + predicted.ack_ns );
+  cout << "Header prediction speedup: " << fixed << setprecision( 2 ) << speedup << "x.\n";
+
+  if ( predicted.data_ns > MAX_NS_PER_MESSAGE or predicted.ack_ns > MAX_NS_PER_MESSAGE ) {
+    throw runtime_error( "TCPPeer::receive (header prediction) did not meet maximum time of "
+                         + to_string( static_cast<int>( MAX_NS_PER_MESSAGE ) ) + " ns per message" );
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
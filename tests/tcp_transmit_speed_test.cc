@@ -0,0 +1,105 @@
+#include "helpers.hh"
+#include "tcp_over_ip.hh"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr size_t NUM_SEGMENTS = 1'000'000;
+constexpr double MIN_MPPS = 0.1; // with the header template
+
+// Copy a datagram's buffers into a frame, as a write into a registered io_uring buffer would
+template<class Buffers>
+size_t copy_out( const Buffers& buffers, array<char, 2048>& frame )
+{
+  size_t size = 0;
+  for ( const auto& x : buffers ) {
+    const string_view view { x };
+    memcpy( &frame.at( size ), view.data(), view.size() );
+    size += view.size();
+  }
+  return size;
+}
+
+// Millions of segments per second turned into datagrams (and copied out) by `transmit`
+double mpps( const size_t payload_size, const bool use_template )
+{
+  TCPOverIPv4Adapter adapter;
+  adapter.config_mut().source = Address { "10.0.0.2", 40000 };
+  adapter.config_mut().destination = Address { "10.0.0.1", 80 };
+
+  TCPSenderMessage sender { .payload = string( payload_size, 'x' ) };
+  TCPReceiverMessage receiver { .ackno = Wrap32 { 1 }, .window_size = 1000 };
+  array<char, 2048> frame {};
+  size_t bytes = 0;
+
+  const auto start = steady_clock::now();
+  for ( size_t i = 0; i < NUM_SEGMENTS; ++i ) {
+    sender.seqno = sender.seqno + static_cast<uint32_t>( payload_size );
+    receiver.window_size = static_cast<uint16_t>( i );
+    const TCPMessage msg { borrow( sender ), borrow( receiver ) };
+    if ( use_template ) {
+      bytes += copy_out( array { adapter.tcp_ip_headers( msg ), string_view { sender.payload } }, frame );
+    } else {
+      bytes += copy_out( serialize( adapter.wrap_tcp_in_ip( msg ) ), frame );
+    }
+  }
+  const auto elapsed = duration_cast<duration<double>>( steady_clock::now() - start );
+
+  if ( bytes != NUM_SEGMENTS * ( TCPHeaderTemplate::LENGTH + payload_size ) ) {
+    throw runtime_error( "wrong number of bytes transmitted" );
+  }
+  return static_cast<double>( NUM_SEGMENTS ) / elapsed.count() / 1e6;
+}
+
+void program_body()
+{
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  for ( const size_t payload_size : { 0, 1000 } ) {
+    const double wrapped = mpps( payload_size, false );
+    const double templated = mpps( payload_size, true );
+    for ( const auto& [name, rate] :
+          { pair { "wrap and serialize", wrapped }, pair { "header template", templated } } ) {
+      cout << "Transmit " << payload_size << "-byte payloads (" << name << "): " << fixed << setprecision( 2 )
+           << rate << " Mpps.\n";
+      debug_output << "    Transmit " << setw( 4 ) << payload_size << "-byte payloads " << setw( 18 ) << name
+                   << ": " << fixed << setprecision( 2 ) << setw( 6 ) << rate << " Mpps\n";
+    }
+    cout << "Header template speedup (" << payload_size << "-byte payloads): " << fixed << setprecision( 2 )
+         << templated / wrapped << "x.\n";
+    if ( templated < MIN_MPPS ) {
+      throw runtime_error( "the header template did not meet minimum speed of 0.1 Mpps" );
+    }
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
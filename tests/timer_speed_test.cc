@@ -0,0 +1,231 @@
+#include "eventloop.hh"
+#include "exception.hh"
+#include "tcp_minnow_socket_impl.hh"
+#include "timer_wheel.hh"
+#include "tuntap_adapter.hh"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr size_t NUM_TIMERS = 1'000'000;
+constexpr uint64_t IDLE_MS = 1000;         // how long the idle connection is watched
+constexpr uint64_t MAX_IDLE_POLLS = 5;     // polls allowed (both sides together) while it is idle
+constexpr size_t NUM_SLEEPS = 200;         // EventLoop timers used to measure lateness
+constexpr double MAX_MEAN_LATENESS_MS = 2; // how late, on average, a timer may fire
+
+// Check the wheel against a sorted list of deadlines, and time its operations
+void wheel_test( fstream& debug_output )
+{
+  default_random_engine rng { 1634 };
+  // mostly short timeouts (retransmissions), some long ones (ARP, keep-alive), a few beyond the top level
+  uniform_int_distribution<uint64_t> short_delay { 0, 5'000 };
+  uniform_int_distribution<uint64_t> long_delay { 0, 30ULL * 24 * 3600 * 1000 };
+  uniform_int_distribution<uint64_t> huge_delay { 0, 1ULL << 40 };
+  uniform_int_distribution<unsigned> kind { 0, 99 };
+
+  const uint64_t start = 1ULL << 33; // not a round number at any level
+  TimerWheel wheel { start };
+  vector<uint64_t> deadline( NUM_TIMERS );
+  vector<TimerWheel::TimerId> ids( NUM_TIMERS );
+  vector<uint64_t> fired_at( NUM_TIMERS, UINT64_MAX );
+  vector<uint64_t> fired_order( NUM_TIMERS );
+  uint64_t now = start;
+  uint64_t fired_so_far = 0;
+
+  const auto add_start = steady_clock::now();
+  for ( size_t i = 0; i < NUM_TIMERS; ++i ) {
+    const unsigned k = kind( rng );
+    deadline[i] = start + ( k < 90 ? short_delay( rng ) : k < 99 ? long_delay( rng ) : huge_delay( rng ) );
+    ids[i] = wheel.add( deadline[i], [&, i] {
+      fired_at[i] = now;
+      fired_order[i] = fired_so_far++;
+    } );
+  }
+  const auto add_ns = duration_cast<nanoseconds>( steady_clock::now() - add_start ).count();
+
+  // cancel every third timer
+  const auto cancel_start = steady_clock::now();
+  for ( size_t i = 0; i < NUM_TIMERS; i += 3 ) {
+    if ( not wheel.cancel( ids[i] ) ) {
+      throw runtime_error( "could not cancel a pending timer" );
+    }
+  }
+  const auto cancel_ns = duration_cast<nanoseconds>( steady_clock::now() - cancel_start ).count();
+
+  // advance in uneven steps (short ones first, then long jumps), checking next_deadline() on the way
+  vector<uint64_t> pending;
+  for ( size_t i = 0; i < NUM_TIMERS; ++i ) {
+    if ( i % 3 != 0 ) {
+      pending.push_back( deadline[i] );
+    }
+  }
+  ranges::sort( pending );
+  auto next_pending = pending.begin();
+
+  uniform_int_distribution<uint64_t> short_step { 1, 50 };
+  uniform_int_distribution<uint64_t> long_step { 1, 1ULL << 37 };
+  size_t fired = 0;
+  vector<uint64_t> advances;
+  const auto advance_start = steady_clock::now();
+  while ( not wheel.empty() ) {
+    const optional<uint64_t> next = wheel.next_deadline();
+    if ( next != *next_pending ) {
+      throw runtime_error( "next_deadline() was " + to_string( next.value_or( 0 ) ) + ", not "
+                           + to_string( *next_pending ) );
+    }
+    now += now - start < 10'000 ? short_step( rng ) : long_step( rng );
+    advances.push_back( now );
+    fired += wheel.advance( now );
+    next_pending = ranges::upper_bound( pending, now );
+    if ( next_pending == pending.end() ) {
+      break;
+    }
+  }
+  const auto advance_ns = duration_cast<nanoseconds>( steady_clock::now() - advance_start ).count();
+
+  if ( fired != pending.size() or not wheel.empty() ) {
+    throw runtime_error( "fired " + to_string( fired ) + " of " + to_string( pending.size() ) + " timers" );
+  }
+
+  // each timer fired at the first advance() to reach its deadline, in deadline order, and cancelled
+  // ones never did
+  vector<pair<uint64_t, uint64_t>> by_firing; // (firing order, deadline)
+  for ( size_t i = 0; i < NUM_TIMERS; ++i ) {
+    if ( i % 3 == 0 ) {
+      if ( fired_at[i] != UINT64_MAX ) {
+        throw runtime_error( "a cancelled timer fired" );
+      }
+      continue;
+    }
+    if ( fired_at[i] != *ranges::lower_bound( advances, deadline[i] ) ) {
+      throw runtime_error( "a timer fired at " + to_string( fired_at[i] ) + ", not the first advance() after "
+                           + to_string( deadline[i] ) );
+    }
+    by_firing.emplace_back( fired_order[i], deadline[i] );
+  }
+  ranges::sort( by_firing );
+  if ( not ranges::is_sorted( by_firing, {}, &pair<uint64_t, uint64_t>::second ) ) {
+    throw runtime_error( "timers fired out of deadline order" );
+  }
+
+  const auto per_timer = [&]( auto ns ) { return static_cast<double>( ns ) / static_cast<double>( NUM_TIMERS ); };
+  cout << "TimerWheel: " << fixed << setprecision( 0 ) << per_timer( add_ns ) << " ns/add, "
+       << per_timer( cancel_ns * 3 ) << " ns/cancel, " << per_timer( advance_ns * 3 / 2 ) << " ns/expiry.\n";
+  debug_output << "    TimerWheel: " << fixed << setprecision( 0 ) << setw( 4 ) << per_timer( add_ns )
+               << " ns/add\n";
+}
+
+// How late EventLoop timers fire, with and without a timerfd
+double mean_lateness_ms( const bool use_timerfd )
+{
+  EventLoop loop;
+  loop.set_timerfd( use_timerfd );
+
+  double total_lateness = 0;
+  uniform_int_distribution<uint64_t> delay { 1, 5 };
+  default_random_engine rng { 1624 };
+  for ( size_t i = 0; i < NUM_SLEEPS; ++i ) {
+    const uint64_t delay_ms = delay( rng );
+    const auto start = steady_clock::now();
+    bool fired = false;
+    loop.add_timer( delay_ms, [&] {
+      fired = true;
+      total_lateness += duration<double, milli>( steady_clock::now() - start ).count() - delay_ms;
+    } );
+    while ( not fired ) {
+      if ( loop.wait_next_event( -1 ) == EventLoop::Result::Exit ) {
+        throw runtime_error( "EventLoop exited with a timer pending" );
+      }
+    }
+  }
+  return total_lateness / NUM_SLEEPS;
+}
+
+// Polls made by both ends of an established, idle TCPMinnowSocket connection over IDLE_MS
+uint64_t idle_polls()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+  TCPMinnowSocket<TCPOverIPv4OverTunFdAdapter> client { TCPOverIPv4OverTunFdAdapter { FileDescriptor { fds[0] } } };
+  TCPMinnowSocket<TCPOverIPv4OverTunFdAdapter> server { TCPOverIPv4OverTunFdAdapter { FileDescriptor { fds[1] } } };
+
+  TCPConfig tcp_config;
+  tcp_config.rt_timeout = 100;
+  FdAdapterConfig server_config;
+  server_config.source = Address { "10.0.0.1", 80 };
+  FdAdapterConfig client_config;
+  client_config.source = Address { "10.0.0.2", 40000 };
+  client_config.destination = server_config.source;
+
+  thread server_thread( [&] { server.listen_and_accept( tcp_config, server_config ); } );
+  client.connect( tcp_config, client_config );
+  server_thread.join();
+
+  // let the handshake's last segment land, then watch the connection do nothing
+  this_thread::sleep_for( milliseconds( 50 ) );
+  const uint64_t polls_before = client.poll_count() + server.poll_count();
+  this_thread::sleep_for( milliseconds( IDLE_MS ) );
+  const uint64_t polls = client.poll_count() + server.poll_count() - polls_before;
+
+  client.shutdown( SHUT_WR );
+  server.shutdown( SHUT_WR );
+  client.wait_until_closed();
+  server.wait_until_closed();
+  return polls;
+}
+
+void program_body()
+{
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  wheel_test( debug_output );
+
+  for ( const bool use_timerfd : { false, true } ) {
+    const double lateness = mean_lateness_ms( use_timerfd );
+    cout << "EventLoop timers (" << ( use_timerfd ? "timerfd" : "poll timeout" ) << "): " << fixed
+         << setprecision( 2 ) << lateness << " ms late on average.\n";
+    if ( lateness > MAX_MEAN_LATENESS_MS ) {
+      throw runtime_error( "EventLoop timers fired too late." );
+    }
+  }
+
+  const uint64_t polls = idle_polls();
+  cout << "Idle TCPMinnowSocket connection: " << polls << " polls in " << IDLE_MS << " ms.\n";
+  debug_output << "    Idle TCPMinnowSocket connection: " << setw( 3 ) << polls << " polls/s\n";
+  if ( polls > MAX_IDLE_POLLS ) {
+    throw runtime_error( "An idle TCPMinnowSocket connection kept waking up." );
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
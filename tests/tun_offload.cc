@@ -0,0 +1,331 @@
+#include "checksum.hh"
+#include "exception.hh"
+#include "helpers.hh"
+#include "random.hh"
+#include "tcp_over_ip.hh"
+#include "tcp_sender.hh"
+#include "tuntap_adapter.hh"
+#include "virtio_net_header.hh"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const Address minnow_address { "10.0.0.2", 5000 };
+const Address peer_address { "10.0.0.1", 80 };
+constexpr uint16_t MSS = 1000;
+
+void expect( bool condition, const string& what )
+{
+  if ( not condition ) {
+    throw runtime_error( "expectation failed: " + what );
+  }
+}
+
+FourTuple from_peer()
+{
+  return { .local_address = peer_address.ipv4_numeric(),
+           .remote_address = minnow_address.ipv4_numeric(),
+           .local_port = peer_address.port(),
+           .remote_port = minnow_address.port() };
+}
+
+// The other end of the datagram fd: the kernel's side of a TUN device opened with offload
+class Wire
+{
+  FileDescriptor fd_;
+
+public:
+  explicit Wire( FileDescriptor&& fd ) : fd_( move( fd ) ) { fd_.set_blocking( false ); }
+
+  void send( const VirtioNetHeader& header, const InternetDatagram& ip_dgram )
+  {
+    auto buffers = serialize( ip_dgram );
+    buffers.insert( buffers.begin(), header.serialize() );
+    fd_.write( buffers );
+  }
+
+  // The next datagram written by the adapter, split into its virtio-net header and the IPv4 datagram
+  pair<VirtioNetHeader, string> receive()
+  {
+    string datagram( VirtioNetHeader::LENGTH + UINT16_MAX, 0 );
+    fd_.read( datagram );
+    VirtioNetHeader header;
+    expect( header.parse( datagram ), "a datagram with a virtio-net header was written" );
+    return { header, datagram.substr( VirtioNetHeader::LENGTH ) };
+  }
+};
+
+pair<TCPOverIPv4OverTunFdAdapter, Wire> make_link()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+  TCPOverIPv4OverTunFdAdapter adapter { FileDescriptor { fds[0] } };
+  adapter.config_mut().source = minnow_address;
+  adapter.config_mut().destination = peer_address;
+  adapter.use_virtio_net_header( MSS );
+  return { move( adapter ), Wire { FileDescriptor { fds[1] } } };
+}
+
+// Complete a partial TCP checksum as the kernel would, then parse the datagram (verifying the checksum)
+optional<TCPMessage> complete_and_parse( string datagram, const VirtioNetHeader& header )
+{
+  const size_t checksum_at = header.csum_start + header.csum_offset;
+  InternetChecksum check;
+  check.add( string_view { datagram }.substr( header.csum_start ) );
+  const uint16_t checksum = check.value();
+  datagram[checksum_at] = static_cast<char>( checksum >> 8 );
+  datagram[checksum_at + 1] = static_cast<char>( checksum & 0xff );
+
+  InternetDatagram ip_dgram;
+  vector<string> buffers { move( datagram ) };
+  expect( parse( ip_dgram, move( buffers ) ), "the adapter wrote a valid IPv4 datagram" );
+  FourTuple tuple;
+  return TCPOverIPv4Adapter::unwrap_tcp_in_ip( move( ip_dgram ), tuple );
+}
+
+void writes_super_segments_for_the_kernel_to_split()
+{
+  auto [adapter, wire] = make_link();
+  const TCPSenderMessage data { .seqno = Wrap32 { 1 }, .payload = string( 3 * MSS, 'x' ) };
+  const TCPReceiverMessage ack { .ackno = Wrap32 { 7 }, .window_size = 1000 };
+
+  adapter.write( { borrow( data ), borrow( ack ) } );
+  const auto [header, datagram] = wire.receive();
+  expect( header.gso_type == VirtioNetHeader::GSO_TCPV4, "a long segment is a TCP/IPv4 super-segment" );
+  expect( header.gso_size == MSS, "the kernel splits it into MSS-sized segments" );
+  expect( header.hdr_len == IPv4Header::LENGTH + TCPSegment::HEADER_LENGTH, "headers to copy are given" );
+  expect( header.flags == VirtioNetHeader::F_NEEDS_CSUM, "the kernel completes the checksum" );
+  expect( header.csum_start == IPv4Header::LENGTH and header.csum_offset == 16, "checksum is in the TCP header" );
+  expect( datagram.size() == IPv4Header::LENGTH + TCPSegment::HEADER_LENGTH + 3 * MSS, "written whole" );
+  const auto msg = complete_and_parse( datagram, header );
+  expect( msg.has_value(), "the completed checksum is valid" );
+  expect( msg->sender->payload == data.payload, "payload is intact" );
+
+  const TCPSenderMessage empty { .seqno = Wrap32 { 1 } };
+  adapter.write( { borrow( empty ), borrow( ack ) } );
+  const auto [ack_header, ack_datagram] = wire.receive();
+  expect( ack_header.gso_type == VirtioNetHeader::GSO_NONE, "a short segment is not a super-segment" );
+  expect( ack_header.flags == VirtioNetHeader::F_NEEDS_CSUM, "a short segment's checksum is still offloaded" );
+  expect( complete_and_parse( ack_datagram, ack_header ).has_value(), "short segment's checksum is valid" );
+}
+
+// Without a virtio-net header, the adapter splits a super-segment into MSS-sized segments itself
+void splits_super_segments_in_software()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+  TCPOverIPv4OverTunFdAdapter adapter { FileDescriptor { fds[0] } };
+  adapter.config_mut().source = minnow_address;
+  adapter.config_mut().destination = peer_address;
+  FileDescriptor wire { fds[1] };
+
+  string payload( 3 * MSS + MSS / 2, 0 );
+  for ( size_t i = 0; i < payload.size(); ++i ) {
+    payload[i] = static_cast<char>( i * 7 );
+  }
+  const TCPSenderMessage super { .seqno = Wrap32 { 0xffff'fc00 }, .SYN = true, .payload = payload, .FIN = true };
+  const TCPReceiverMessage ack { .ackno = Wrap32 { 7 }, .window_size = 1000 };
+  adapter.write( { borrow( super ), borrow( ack ) } );
+
+  string received;
+  for ( size_t i = 0; i < 4; ++i ) {
+    string datagram( UINT16_MAX, 0 );
+    wire.read( datagram );
+    InternetDatagram ip_dgram;
+    vector<string> buffers { move( datagram ) };
+    expect( parse( ip_dgram, move( buffers ) ), "each piece is a valid IPv4 datagram" );
+    FourTuple tuple;
+    const auto msg = TCPOverIPv4Adapter::unwrap_tcp_in_ip( move( ip_dgram ), tuple );
+    expect( msg.has_value(), "each piece's checksum is valid" );
+
+    const TCPSenderMessage& piece = msg->sender.get();
+    expect( piece.payload.size() == ( i < 3 ? MSS : MSS / 2 ), "pieces are MSS-sized, but for the last" );
+    expect( piece.seqno == super.seqno + static_cast<uint32_t>( i == 0 ? 0 : 1 + received.size() ),
+            "each piece's seqno follows on from the one before" );
+    expect( piece.SYN == ( i == 0 ) and piece.FIN == ( i == 3 ), "SYN goes with the first piece, FIN the last" );
+    expect( msg->receiver->ackno == ack.ackno and msg->receiver->window_size == ack.window_size,
+            "every piece carries the ACK" );
+    received += piece.payload;
+  }
+  expect( received == payload, "the pieces make up the payload" );
+
+  const TCPSenderMessage small { .seqno = Wrap32 { 5 }, .payload = string( MSS, 's' ) };
+  adapter.write( { borrow( small ), borrow( ack ) } );
+  string datagram( UINT16_MAX, 0 );
+  wire.read( datagram );
+  expect( datagram.size() == IPv4Header::LENGTH + TCPSegment::HEADER_LENGTH + MSS, "an MSS is written whole" );
+}
+
+void reads_super_packets_from_the_kernel()
+{
+  auto [adapter, wire] = make_link();
+  const TCPSenderMessage data { .seqno = Wrap32 { 1 }, .payload = string( 20000, 'y' ) };
+  const TCPMessage msg { borrow( data ), TCPReceiverMessage { .ackno = Wrap32 { 7 }, .window_size = 1000 } };
+  const auto partial = TCPOverIPv4Adapter::wrap_tcp_in_ip( from_peer(), msg, TCPChecksum::Offloaded );
+  const auto full = TCPOverIPv4Adapter::wrap_tcp_in_ip( from_peer(), msg );
+
+  // A super-packet from a sender on this host, its checksum partial
+  wire.send( { .flags = VirtioNetHeader::F_NEEDS_CSUM,
+               .gso_type = VirtioNetHeader::GSO_TCPV4,
+               .hdr_len = IPv4Header::LENGTH + TCPSegment::HEADER_LENGTH,
+               .gso_size = 536,
+               .csum_start = IPv4Header::LENGTH,
+               .csum_offset = 16 },
+             partial );
+  const auto received = adapter.read();
+  expect( received.has_value(), "a super-packet with a partial checksum is read" );
+  expect( received->sender->payload == data.payload, "the whole super-packet's payload is read" );
+
+  // Checksums are verified unless the kernel vouches for them
+  wire.send( {}, partial );
+  expect( not adapter.read().has_value(), "a partial checksum the kernel did not flag is rejected" );
+  wire.send( {}, full );
+  expect( adapter.read().has_value(), "a full checksum is verified" );
+  wire.send( { .flags = VirtioNetHeader::F_DATA_VALID }, partial );
+  expect( adapter.read().has_value(), "a checksum the kernel verified is not checked again" );
+}
+
+void limits_segments_to_one_datagram()
+{
+  const TCPSenderMessage largest { .payload = string( TCPOverIPv4Adapter::MAX_SEGMENT_PAYLOAD, 'z' ) };
+  const auto ip_dgram = TCPOverIPv4Adapter::wrap_tcp_in_ip( from_peer(), { borrow( largest ), {} } );
+  expect( ip_dgram.header.len == UINT16_MAX, "the largest segment fills a datagram" );
+
+  const TCPSenderMessage too_large { .payload = string( TCPOverIPv4Adapter::MAX_SEGMENT_PAYLOAD + 1, 'z' ) };
+  try {
+    (void)TCPOverIPv4Adapter::wrap_tcp_in_ip( from_peer(), { borrow( too_large ), {} } );
+  } catch ( const runtime_error& ) {
+    return;
+  }
+  throw runtime_error( "a segment too large for a datagram was wrapped" );
+}
+
+// The headers filled in from a template match the serialized datagram, whatever the segment
+void header_template_matches_wrap()
+{
+  const TCPSenderMessage syn { .seqno = Wrap32 { 0xffff'fff0 }, .SYN = true };
+  const TCPSenderMessage data { .seqno = Wrap32 { 0x1234'5678 }, .payload = "odd-length payload" };
+  const TCPSenderMessage large { .seqno = Wrap32 { 1 }, .payload = string( 30001, 'q' ), .FIN = true };
+  const TCPSenderMessage reset { .seqno = Wrap32 { 2 }, .RST = true };
+  const TCPReceiverMessage no_ack { .window_size = 512 };
+  const TCPReceiverMessage ack { .ackno = Wrap32 { 0xabcd'ef01 }, .window_size = UINT16_MAX };
+
+  TCPOverIPv4Adapter adapter;
+  adapter.config_mut().source = peer_address;
+  adapter.config_mut().destination = minnow_address;
+  for ( const auto* sender : { &syn, &data, &large, &reset } ) {
+    for ( const auto* receiver : { &no_ack, &ack } ) {
+      for ( const auto checksum : { TCPChecksum::Full, TCPChecksum::Offloaded } ) {
+        const TCPMessage msg { borrow( *sender ), borrow( *receiver ) };
+        const auto ip_dgram = TCPOverIPv4Adapter::wrap_tcp_in_ip( from_peer(), msg, checksum );
+        const string expected = concat( serialize( ip_dgram ) );
+        expect( string { adapter.tcp_ip_headers( msg, checksum ) } + sender->payload == expected,
+                "template-filled headers match the serialized datagram" );
+      }
+    }
+  }
+
+  adapter.config_mut().destination = Address { "10.0.0.3", 443 };
+  const TCPMessage msg { borrow( data ), borrow( ack ) };
+  FourTuple tuple = from_peer();
+  tuple.remote_address = adapter.config().destination.ipv4_numeric();
+  tuple.remote_port = 443;
+  expect( string { adapter.tcp_ip_headers( msg ) } + data.payload
+            == concat( serialize( TCPOverIPv4Adapter::wrap_tcp_in_ip( tuple, msg ) ) ),
+          "the template follows a change of destination" );
+}
+
+// The checksum computed from the header's fields and the payload's sum verifies over the serialized segment
+void checksum_verifies_over_serialized_segment()
+{
+  auto rd = get_random_engine();
+  for ( size_t trial = 0; trial < 1000; ++trial ) {
+    string payload( rd() % 3000, 0 );
+    ranges::generate( payload, [&] { return static_cast<char>( rd() ); } );
+    const TCPSenderMessage sender {
+      .seqno = Wrap32 { static_cast<uint32_t>( rd() ) }, .SYN = rd() % 2 == 0, .payload = payload };
+    TCPReceiverMessage receiver { .window_size = static_cast<uint16_t>( rd() ) };
+    if ( rd() % 2 ) {
+      receiver.ackno = Wrap32 { static_cast<uint32_t>( rd() ) };
+    }
+
+    const TCPMessage msg { borrow( sender ), borrow( receiver ) };
+    const auto ip_dgram = TCPOverIPv4Adapter::wrap_tcp_in_ip( from_peer(), msg );
+    InternetChecksum check { ip_dgram.header.pseudo_checksum() };
+    check.add( ip_dgram.payload );
+    expect( check.value() == 0, "the segment's checksum verifies" );
+    const TCPMessage with_sum { borrow( sender ), borrow( receiver ), sender.payload_sum() };
+    expect( concat( serialize( TCPOverIPv4Adapter::wrap_tcp_in_ip( from_peer(), with_sum ) ) )
+              == concat( serialize( ip_dgram ) ),
+            "a retransmission (with the payload's kept sum) is the same datagram" );
+  }
+
+  // nothing stale travels with a copy of a message whose payload then changes
+  const TCPSenderMessage original { .payload = "before" };
+  (void)TCPOverIPv4Adapter::wrap_tcp_in_ip( from_peer(), { borrow( original ), {} } );
+  TCPSenderMessage changed = original;
+  changed.payload = "after!";
+  const auto ip_dgram = TCPOverIPv4Adapter::wrap_tcp_in_ip( from_peer(), { borrow( changed ), {} } );
+  InternetChecksum check { ip_dgram.header.pseudo_checksum() };
+  check.add( ip_dgram.payload );
+  expect( check.value() == 0, "a changed copy's payload is summed again" );
+}
+
+// The TCPSender keeps each segment's payload sum, for the segment and its retransmissions (and only for them)
+void sender_keeps_payload_sums()
+{
+  const Wrap32 isn { 1000 };
+  TCPSender sender { ByteStream { 1000 }, isn, 100 };
+  vector<pair<string, optional<uint16_t>>> sent;
+  optional<TCPSenderMessage> copy;
+  const auto transmit = [&]( const TCPSenderMessage& msg ) {
+    sent.emplace_back( msg.payload, sender.kept_payload_sum( msg ) );
+    copy = msg;
+  };
+
+  sender.push( transmit ); // SYN
+  sender.receive( { .ackno = isn + 1, .window_size = 1000 } );
+  sender.writer().push( "hello, checksum" );
+  sender.push( transmit );
+  sender.tick( 100, transmit ); // (retransmits the data)
+
+  expect( sent.size() == 3, "SYN, data, and the retransmission were sent" );
+  const uint16_t sum = TCPSenderMessage { .payload = "hello, checksum" }.payload_sum();
+  expect( sent[1] == pair { string { "hello, checksum" }, optional { sum } }, "the data came with its sum" );
+  expect( sent[2] == sent[1], "and so did its retransmission" );
+  expect( not sender.kept_payload_sum( copy.value() ).has_value(), "a copy of the segment has no kept sum" );
+  expect( not sender.kept_payload_sum( sender.make_empty_message() ).has_value(), "nor an empty message" );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    writes_super_segments_for_the_kernel_to_split();
+    splits_super_segments_in_software();
+    reads_super_packets_from_the_kernel();
+    limits_segments_to_one_datagram();
+    header_template_matches_wrap();
+    checksum_verifies_over_serialized_segment();
+    sender_keeps_payload_sums();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,153 @@
+#include "exception.hh"
+#include "helpers.hh"
+#include "tcp_over_ip.hh"
+#include "tcp_peer.hh"
+#include "tuntap_adapter.hh"
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const Address minnow_address { "10.0.0.2", 5000 };
+const Address peer_address { "10.0.0.1", 80 };
+const Wrap32 peer_isn { 1000 };
+
+void expect( bool condition, const string& what )
+{
+  if ( not condition ) {
+    throw runtime_error( "expectation failed: " + what );
+  }
+}
+
+// The other end of the datagram fd: the network, writing whole IPv4 datagrams as a TUN device would
+class Wire
+{
+  FileDescriptor fd_;
+
+public:
+  explicit Wire( FileDescriptor&& fd ) : fd_( move( fd ) ) {}
+
+  static FourTuple from_peer( uint16_t to_port = minnow_address.port() )
+  {
+    return { .local_address = peer_address.ipv4_numeric(),
+             .remote_address = minnow_address.ipv4_numeric(),
+             .local_port = peer_address.port(),
+             .remote_port = to_port };
+  }
+
+  void send( const FourTuple& from, const TCPSenderMessage& sender, const TCPReceiverMessage& receiver = {} )
+  {
+    const InternetDatagram ip_dgram
+      = TCPOverIPv4Adapter::wrap_tcp_in_ip( from, { borrow( sender ), borrow( receiver ) } );
+    fd_.write( serialize( ip_dgram ) );
+  }
+
+  void send_raw( const string& datagram ) { fd_.write( datagram ); }
+};
+
+// An adapter on one end of a SOCK_DGRAM socketpair (standing in for the TUN device), and the wire on the other
+pair<TCPOverIPv4OverTunFdAdapter, Wire> make_link()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+  TCPOverIPv4OverTunFdAdapter adapter { FileDescriptor { fds[0] } };
+  adapter.config_mut().source = minnow_address;
+  adapter.config_mut().destination = peer_address;
+  return { move( adapter ), Wire { FileDescriptor { fds[1] } } };
+}
+
+// The peer's `index`th segment of data (all the same length)
+TCPSenderMessage data_segment( size_t index )
+{
+  string payload = "segment " + to_string( index % 10 );
+  return { .seqno = peer_isn + 1 + static_cast<uint32_t>( index * payload.size() ), .payload = move( payload ) };
+}
+
+void batches_stop_when_nothing_is_waiting()
+{
+  auto [adapter, wire] = make_link();
+
+  // Ten segments for the connection, with a segment for another port and a datagram that is not IPv4 among them
+  for ( size_t i = 0; i < 5; ++i ) {
+    wire.send( Wire::from_peer(), data_segment( i ) );
+  }
+  wire.send( Wire::from_peer( 5001 ), data_segment( 99 ) );
+  wire.send_raw( "not an IPv4 datagram" );
+  for ( size_t i = 5; i < 10; ++i ) {
+    wire.send( Wire::from_peer(), data_segment( i ) );
+  }
+
+  vector<TCPMessage> segments;
+  expect( adapter.read_batch( segments, 4 ) == 4, "a batch reads no more than asked for" );
+  expect( segments.size() == 4, "four segments from the first batch" );
+
+  expect( adapter.read_batch( segments ) == 8, "the next batch reads the rest, then stops" );
+  expect( segments.size() == 10, "datagrams not for the connection are dropped from the batch" );
+  for ( size_t i = 0; i < segments.size(); ++i ) {
+    expect( segments[i].sender->payload == data_segment( i ).payload, "segment " + to_string( i ) + " in order" );
+    expect( segments[i].sender->payload.capacity() < 1024, "payload " + to_string( i ) + " is copied at its size" );
+  }
+
+  expect( adapter.read_batch( segments ) == 0, "an empty batch once nothing is waiting" );
+  expect( segments.size() == 10, "an empty batch appends nothing" );
+  expect( not adapter.read().has_value(), "read() does not block once nothing is waiting" );
+}
+
+void one_reply_per_batch()
+{
+  // A SYN and three segments of data that arrive together
+  const auto arrivals = [] {
+    vector<TCPMessage> messages;
+    messages.push_back( { .sender = TCPSenderMessage { .seqno = peer_isn, .SYN = true },
+                          .receiver = TCPReceiverMessage { .window_size = 1000 } } );
+    for ( size_t i = 0; i < 3; ++i ) {
+      messages.push_back( { .sender = data_segment( i ), .receiver = TCPReceiverMessage { .window_size = 1000 } } );
+    }
+    return messages;
+  };
+  const uint64_t bytes = data_segment( 0 ).payload.size() * 3;
+
+  vector<TCPMessage> replies;
+  const auto transmit = [&]( const TCPMessage& x ) { replies.push_back( x ); }; // (copied: a reply may borrow)
+
+  TCPPeer individually { TCPConfig {} };
+  for ( auto& msg : arrivals() ) {
+    individually.receive( move( msg ), transmit );
+  }
+  expect( replies.size() == 4, "each segment received alone gets a reply" );
+
+  replies.clear();
+  TCPPeer batched { TCPConfig {} };
+  auto batch = arrivals();
+  batched.receive_batch( batch, transmit );
+  expect( replies.size() == 1, "a batch gets one reply" );
+  expect( replies.front().sender->SYN, "the reply carries the peer's SYN" );
+  expect( replies.front().receiver->ackno == peer_isn + 1 + static_cast<uint32_t>( bytes ),
+          "the reply acknowledges the whole batch" );
+  expect( batched.inbound_reader().bytes_buffered() == bytes, "every segment's payload was received" );
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    batches_stop_when_nothing_is_waiting();
+    one_reply_per_batch();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+#include "exception.hh"
+#include "socket.hh"
+#include "speed_test_helpers.hh"
+#include "tcp_minnow_socket_impl.hh"
+#include "tcp_over_udp.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr size_t TRANSFER_BYTES = 8 * 1024 * 1024; // from one minnow process to another, over UDP on localhost
+constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+struct Result
+{
+  double syscalls_per_megabyte; // by the receiving process: polls, plus every read and write
+  double megabits_per_second;
+};
+
+// Send TRANSFER_BYTES from a TCPOverUDPMinnowSocket in another process to one in this process
+Result run()
+{
+  TCPConfig tcp_config;
+  tcp_config.rt_timeout = 100;
+
+  UDPSocket receiver_socket;
+  receiver_socket.bind( Address { "127.0.0.1", 0 } );
+  const Address receiver_address = receiver_socket.local_address();
+
+  const pid_t sender = CheckSystemCall( "fork", fork() );
+  if ( sender == 0 ) {
+    try {
+      receiver_socket.close();
+      UDPSocket sender_socket;
+      sender_socket.bind( Address { "127.0.0.1", 0 } );
+      FdAdapterConfig config;
+      config.source = sender_socket.local_address();
+      config.destination = receiver_address;
+
+      TCPOverUDPMinnowSocket socket { TCPOverUDPAdapter { move( sender_socket ) } };
+      socket.connect( tcp_config, config );
+      socket.set_blocking( true );
+      const string chunk( CHUNK_SIZE, 'x' );
+      for ( size_t sent = 0; sent < TRANSFER_BYTES; ) {
+        sent += socket.write( string_view { chunk }.substr( 0, TRANSFER_BYTES - sent ) );
+      }
+      socket.shutdown( SHUT_WR );
+      string rest;
+      while ( not socket.eof() ) {
+        socket.read( rest );
+      }
+      socket.wait_until_closed();
+    } catch ( const exception& e ) {
+      cerr << "Exception in sender: " << e.what() << "\n";
+      _exit( EXIT_FAILURE );
+    }
+    _exit( EXIT_SUCCESS );
+  }
+
+  FdAdapterConfig config;
+  config.source = receiver_address;
+  TCPOverUDPMinnowSocket socket { TCPOverUDPAdapter { move( receiver_socket ) } };
+
+  const uint64_t syscalls_before = io_syscalls();
+  const auto start_time = steady_clock::now();
+
+  socket.listen_and_accept( tcp_config, config );
+  socket.set_blocking( true );
+  size_t received = 0;
+  string buffer;
+  while ( not socket.eof() ) {
+    buffer.clear(); // read() fills a non-empty buffer only up to its current size
+    socket.read( buffer );
+    if ( buffer.find_first_not_of( 'x' ) != string::npos ) {
+      throw runtime_error( "received corrupted bytes" );
+    }
+    received += buffer.size();
+  }
+  socket.wait_until_closed();
+
+  const auto test_duration = duration_cast<duration<double>>( steady_clock::now() - start_time );
+  const auto syscalls = static_cast<double>( io_syscalls() - syscalls_before + socket.poll_count() );
+
+  int status = 0;
+  CheckSystemCall( "waitpid", waitpid( sender, &status, 0 ) );
+  if ( not WIFEXITED( status ) or WEXITSTATUS( status ) != EXIT_SUCCESS ) {
+    throw runtime_error( "sending process failed" );
+  }
+  if ( received != TRANSFER_BYTES ) {
+    throw runtime_error( "received " + to_string( received ) + " of " + to_string( TRANSFER_BYTES ) + " bytes" );
+  }
+
+  const double megabytes = static_cast<double>( TRANSFER_BYTES ) / ( 1024 * 1024 );
+  return { .syscalls_per_megabyte = syscalls / megabytes,
+           .megabits_per_second = static_cast<double>( TRANSFER_BYTES * 8 ) / test_duration.count() / 1e6 };
+}
+
+void program_body()
+{
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  const Result result = run();
+  cout << "TCPOverUDPMinnowSocket: " << fixed << setprecision( 0 ) << result.syscalls_per_megabyte
+       << " syscalls/MB, " << setprecision( 1 ) << result.megabits_per_second << " Mbit/s.\n";
+  debug_output << "    TCPOverUDPMinnowSocket: " << fixed << setprecision( 1 ) << setw( 7 )
+               << result.megabits_per_second << " Mbit/s\n";
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
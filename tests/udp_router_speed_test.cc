@@ -0,0 +1,263 @@
+#include "arp_message.hh"
+#include "eventloop.hh"
+#include "exception.hh"
+#include "helpers.hh"
+#include "router.hh"
+#include "socket.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr size_t FRAMES = 100'000;    // routed out to the echo server and back in, per measurement
+constexpr size_t IN_FLIGHT = 64;      // frames between the host and the echo server at any time
+constexpr size_t BATCH_SIZE = 64;     // datagrams per recv_batch
+constexpr size_t PAYLOAD_SIZE = 1000; // bytes of each datagram's payload
+
+constexpr EthernetAddress HOST_ETHERNET { 0x02, 0, 0, 0, 0, 0x50 };
+constexpr EthernetAddress ROUTER_HOST_SIDE_ETHERNET { 0x02, 0, 0, 0, 0, 0x01 };
+constexpr EthernetAddress ROUTER_INTERNET_SIDE_ETHERNET { 0x02, 0, 0, 0, 0, 0xc0 };
+constexpr EthernetAddress ECHO_ETHERNET { 0x02, 0, 0, 0, 0, 0x05 };
+const Address HOST_IP { "192.168.0.50" };
+const Address ROUTER_HOST_SIDE_IP { "192.168.0.1" };
+const Address ROUTER_INTERNET_SIDE_IP { "10.0.0.192" };
+const Address ECHO_IP { "10.0.0.5" };
+
+struct Result
+{
+  double frames_per_second;  // out through the router to the echo server, and back in
+  double syscalls_per_frame; // reads and writes of the router's UDP socket
+};
+
+class FramesOut : public NetworkInterface::OutputPort
+{
+public:
+  deque<EthernetFrame> frames {};
+  void transmit( const NetworkInterface& n [[maybe_unused]], const EthernetFrame& x ) override
+  {
+    frames.push_back( clone( x ) );
+  }
+};
+
+// Parse a frame received whole (splitting it as a readv into header-sized buffers would)
+optional<EthernetFrame> parse_frame( string_view datagram )
+{
+  vector<string> strs;
+  strs.reserve( 3 );
+  for ( const size_t length : { EthernetHeader::LENGTH, IPv4Header::LENGTH } ) {
+    const size_t taken = min( length, datagram.size() );
+    strs.emplace_back( datagram.substr( 0, taken ) );
+    datagram.remove_prefix( taken );
+  }
+  strs.emplace_back( datagram );
+
+  EthernetFrame frame;
+  if ( not parse( frame, move( strs ) ) ) {
+    return {};
+  }
+  return frame;
+}
+
+// An ARP request from `sender`, so that the interface receiving it learns the sender's Ethernet address
+EthernetFrame arp_from( const EthernetAddress& sender_ethernet, const Address& sender_ip, const Address& target )
+{
+  ARPMessage arp;
+  arp.opcode = ARPMessage::OPCODE_REQUEST;
+  arp.sender_ethernet_address = sender_ethernet;
+  arp.sender_ip_address = sender_ip.ipv4_numeric();
+  arp.target_ip_address = target.ipv4_numeric();
+  return clone( { .header = { .dst = ETHERNET_BROADCAST, .src = sender_ethernet, .type = EthernetHeader::TYPE_ARP },
+                   .payload = serialize( arp ) } ); // (the serialized buffers may refer to `arp`)
+}
+
+// A frame from the host to the echo server
+EthernetFrame host_frame()
+{
+  InternetDatagram dgram;
+  dgram.header.src = HOST_IP.ipv4_numeric();
+  dgram.header.dst = ECHO_IP.ipv4_numeric();
+  dgram.header.len = IPv4Header::LENGTH + PAYLOAD_SIZE;
+  dgram.header.compute_checksum();
+  dgram.payload.emplace_back( string( PAYLOAD_SIZE, 'x' ) );
+  return clone(
+    { .header = { .dst = ROUTER_HOST_SIDE_ETHERNET, .src = HOST_ETHERNET, .type = EthernetHeader::TYPE_IPv4 },
+      .payload = serialize( dgram ) } );
+}
+
+// The bouncer's stand-in: send each frame back, addressed from the echo server to the host (swapping the
+// Ethernet and IPv4 addresses leaves the IPv4 checksum correct). An empty datagram stops it.
+void echo_frames( UDPSocket& socket )
+{
+  vector<string> datagrams( BATCH_SIZE );
+  vector<string_view> replies;
+  while ( true ) {
+    replies.clear();
+    const size_t received = socket.recv_batch( datagrams );
+    for ( size_t i = 0; i < received; ++i ) {
+      string& frame = datagrams[i];
+      if ( frame.empty() ) {
+        return;
+      }
+      if ( frame.size() < EthernetHeader::LENGTH + IPv4Header::LENGTH ) {
+        continue;
+      }
+      swap_ranges( frame.begin(), frame.begin() + 6, frame.begin() + 6 );
+      const auto ip_addresses = frame.begin() + EthernetHeader::LENGTH + 12;
+      swap_ranges( ip_addresses, ip_addresses + 4, ip_addresses + 4 );
+      replies.emplace_back( frame );
+    }
+    socket.send_batch( replies );
+  }
+}
+
+// Keep IN_FLIGHT frames going from the host, through the router, to the echo server over UDP and back,
+// moving the router's frames over UDP one at a time or in batches
+Result run( const bool batched )
+{
+  UDPSocket router_socket;
+  UDPSocket echo_socket;
+  router_socket.bind( Address { "127.0.0.1", 0 } );
+  echo_socket.bind( Address { "127.0.0.1", 0 } );
+  router_socket.connect( echo_socket.local_address() );
+  echo_socket.connect( router_socket.local_address() );
+  thread echo_thread { [&] { echo_frames( echo_socket ); } };
+
+  auto to_host = make_shared<FramesOut>();
+  auto to_internet = make_shared<FramesOut>();
+  Router router;
+  const size_t host_side = router.add_interface(
+    make_shared<NetworkInterface>( "host side", to_host, ROUTER_HOST_SIDE_ETHERNET, ROUTER_HOST_SIDE_IP ) );
+  const size_t internet_side = router.add_interface( make_shared<NetworkInterface>(
+    "internet side", to_internet, ROUTER_INTERNET_SIDE_ETHERNET, ROUTER_INTERNET_SIDE_IP ) );
+  router.add_route( Address { "192.168.0.0" }.ipv4_numeric(), 16, {}, host_side );
+  router.add_route( Address { "10.0.0.0" }.ipv4_numeric(), 8, {}, internet_side );
+  router.interface( host_side )->recv_frame( arp_from( HOST_ETHERNET, HOST_IP, ROUTER_HOST_SIDE_IP ) );
+  router.interface( internet_side )->recv_frame( arp_from( ECHO_ETHERNET, ECHO_IP, ROUTER_INTERNET_SIDE_IP ) );
+  to_host->frames.clear(); // (the ARP replies)
+  to_internet->frames.clear();
+
+  vector<string> inbound( BATCH_SIZE );
+  vector<vector<Ref<string>>> outbound;
+  EventLoop loop;
+  loop.add_rule(
+    "frames from router to echo server",
+    router_socket,
+    Direction::Out,
+    [&] {
+      auto& frames = to_internet->frames;
+      if ( not batched ) {
+        router_socket.write( serialize( frames.front() ) );
+        frames.pop_front();
+        return;
+      }
+      outbound.clear();
+      for ( const auto& frame : frames ) {
+        outbound.push_back( serialize( frame ) );
+      }
+      const size_t sent = router_socket.send_batch( outbound );
+      frames.erase( frames.begin(), frames.begin() + static_cast<ptrdiff_t>( sent ) );
+    },
+    [&] { return not to_internet->frames.empty(); } );
+  loop.add_rule( "frames from echo server to router", router_socket, Direction::In, [&] {
+    if ( not batched ) {
+      router_socket.read( inbound.front() );
+      if ( auto frame = parse_frame( inbound.front() ) ) {
+        router.interface( internet_side )->recv_frame( move( frame.value() ) );
+      }
+      router.route();
+      return;
+    }
+    const size_t received = router_socket.recv_batch( inbound );
+    for ( size_t i = 0; i < received; ++i ) {
+      if ( auto frame = parse_frame( inbound[i] ) ) {
+        router.interface( internet_side )->recv_frame( move( frame.value() ) );
+      }
+    }
+    router.route();
+  } );
+
+  const EthernetFrame frame = host_frame();
+  size_t sent = 0;
+  size_t delivered = 0;
+  const auto start_time = steady_clock::now();
+  for ( ; sent < IN_FLIGHT; ++sent ) {
+    router.interface( host_side )->recv_frame( clone( frame ) );
+  }
+  router.route();
+  while ( delivered < FRAMES ) {
+    loop.wait_next_event( -1 );
+
+    // each frame back at the host makes room for another
+    delivered += to_host->frames.size();
+    for ( ; sent < FRAMES and sent < delivered + IN_FLIGHT; ++sent ) {
+      router.interface( host_side )->recv_frame( clone( frame ) );
+    }
+    to_host->frames.clear();
+    router.route();
+  }
+  const duration<double> test_duration = steady_clock::now() - start_time;
+
+  const double syscalls = router_socket.read_count() + router_socket.write_count();
+  router_socket.send( "" );
+  echo_thread.join();
+
+  return { .frames_per_second = static_cast<double>( delivered ) / test_duration.count(),
+           .syscalls_per_frame = syscalls / static_cast<double>( delivered ) };
+}
+
+void program_body()
+{
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  // (the router reports each datagram it routes)
+  cerr.setstate( ios::badbit );
+  vector<pair<const char*, Result>> results;
+  for ( const bool batched : { false, true } ) {
+    results.emplace_back( batched ? "recvmmsg/sendmmsg" : "read/write", run( batched ) );
+  }
+  cerr.clear();
+
+  for ( const auto& [name, result] : results ) {
+    cout << "Router over UDP (" << name << "): " << fixed << setprecision( 0 ) << result.frames_per_second
+         << " frames/s, " << setprecision( 2 ) << result.syscalls_per_frame << " syscalls/frame.\n";
+    debug_output << "    Router over UDP " << setw( 17 ) << name << ": " << fixed << setprecision( 0 ) << setw( 8 )
+                 << result.frames_per_second << " frames/s\n";
+  }
+
+  if ( results.at( 1 ).second.syscalls_per_frame >= results.at( 0 ).second.syscalls_per_frame ) {
+    throw runtime_error( "recvmmsg/sendmmsg did not save system calls." );
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,231 @@
+#include "debug.hh"
+#include "eventloop.hh"
+#include "exception.hh"
+#include "tcp_stack.hh"
+#include "work_stealing_executor.hh"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+
+constexpr size_t NUM_CONNECTIONS = 32;
+constexpr size_t TOTAL_BYTES = 8 * 1024 * 1024; // shared among the connections by a Zipf distribution
+constexpr double ZIPF_EXPONENT = 1.0;           // connection k (from 1) carries a share proportional to 1/k^s
+constexpr size_t MAX_WORKERS = 8;
+constexpr uint16_t FIRST_PORT = 20000;
+
+const Address server_address { "10.0.0.1", 80 };
+
+// Bytes carried by each connection: a few heavy connections and a long tail of light ones
+vector<size_t> zipf_loads()
+{
+  vector<double> weights;
+  for ( size_t k = 1; k <= NUM_CONNECTIONS; ++k ) {
+    weights.push_back( 1.0 / pow( static_cast<double>( k ), ZIPF_EXPONENT ) );
+  }
+  double total_weight = 0;
+  for ( const double weight : weights ) {
+    total_weight += weight;
+  }
+
+  vector<size_t> loads;
+  for ( const double weight : weights ) {
+    loads.push_back( max<size_t>( 1, static_cast<size_t>( TOTAL_BYTES * weight / total_weight ) ) );
+  }
+  return loads;
+}
+
+struct Result
+{
+  double gigabits_per_second;
+  uint64_t tasks_run;
+  uint64_t tasks_stolen;
+};
+
+// Move the Zipf loads from a client stack to a server stack, each driven by its own thread and (if
+// `workers` > 0) given its own WorkStealingExecutor; the application runs one EventLoop over every socket
+Result run( const size_t workers )
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+
+  optional<WorkStealingExecutor> client_executor;
+  optional<WorkStealingExecutor> server_executor;
+  TCPStack client { FileDescriptor { fds[0] } };
+  TCPStack server { FileDescriptor { fds[1] } };
+  if ( workers > 0 ) {
+    client.set_executor( client_executor.emplace( workers ) );
+    server.set_executor( server_executor.emplace( workers ) );
+  }
+  TCPListener& listener = server.listen( {}, server_address, NUM_CONNECTIONS );
+
+  // open every connection with both stacks on this thread
+  vector<LocalStreamSocket> senders;
+  vector<optional<LocalStreamSocket>> receivers( NUM_CONNECTIONS );
+  for ( size_t i = 0; i < NUM_CONNECTIONS; ++i ) {
+    FdAdapterConfig config;
+    config.source = Address { "10.0.0.2", static_cast<uint16_t>( FIRST_PORT + i ) };
+    config.destination = server_address;
+    senders.push_back( client.connect( {}, config ) );
+  }
+  size_t accepted = 0;
+  const auto handshake_deadline = steady_clock::now() + seconds( 5 );
+  while ( accepted < NUM_CONNECTIONS ) {
+    if ( steady_clock::now() > handshake_deadline ) {
+      throw runtime_error( "only " + to_string( accepted ) + " connections were accepted" );
+    }
+    server.wait_next_event( 0 );
+    client.wait_next_event( 0 );
+    while ( auto connection = listener.accept() ) {
+      receivers.at( connection->peer.port() - FIRST_PORT ).emplace( move( connection->socket ) );
+      ++accepted;
+    }
+  }
+
+  atomic<bool> done {};
+  thread client_thread( [&] {
+    while ( not done ) {
+      client.wait_next_event( 1 );
+    }
+  } );
+  thread server_thread( [&] {
+    while ( not done ) {
+      server.wait_next_event( 1 );
+    }
+  } );
+
+  // the application: connection i sends loads[i] copies of one letter, and checks what it receives
+  const vector<size_t> loads = zipf_loads();
+  vector<size_t> sent( NUM_CONNECTIONS );
+  vector<size_t> received( NUM_CONNECTIONS );
+  size_t finished = 0;
+  EventLoop application;
+  vector<string> chunks;
+  for ( size_t i = 0; i < NUM_CONNECTIONS; ++i ) {
+    chunks.emplace_back( 65536, static_cast<char>( 'a' + i % 26 ) );
+  }
+  for ( size_t i = 0; i < NUM_CONNECTIONS; ++i ) {
+    senders[i].set_blocking( false );
+    receivers[i]->set_blocking( false );
+
+    application.add_rule(
+      "write", senders[i], Direction::Out,
+      [&, i] {
+        sent[i] += senders[i].write( string_view { chunks[i] }.substr( 0, loads[i] - sent[i] ) );
+        if ( sent[i] == loads[i] ) {
+          senders[i].shutdown( SHUT_WR );
+        }
+      },
+      [&, i] { return sent[i] < loads[i]; } );
+
+    application.add_rule(
+      "read", *receivers[i], Direction::In,
+      [&, i] {
+        string buffer;
+        receivers[i]->read( buffer );
+        if ( buffer.find_first_not_of( static_cast<char>( 'a' + i % 26 ) ) != string::npos ) {
+          throw runtime_error( "connection " + to_string( i ) + " received another connection's bytes" );
+        }
+        received[i] += buffer.size();
+        finished += receivers[i]->eof();
+      },
+      [&, i] { return not receivers[i]->eof(); } );
+  }
+
+  const auto start_time = steady_clock::now();
+  const auto deadline = start_time + seconds( 60 );
+  while ( finished < NUM_CONNECTIONS and steady_clock::now() < deadline ) {
+    application.wait_next_event( 10 );
+  }
+  const auto stop_time = steady_clock::now();
+
+  done = true;
+  client_thread.join();
+  server_thread.join();
+
+  for ( size_t i = 0; i < NUM_CONNECTIONS; ++i ) {
+    if ( received[i] != loads[i] ) {
+      throw runtime_error( "connection " + to_string( i ) + " received " + to_string( received[i] ) + " of "
+                           + to_string( loads[i] ) + " bytes" );
+    }
+  }
+
+  size_t total = 0;
+  for ( const size_t load : loads ) {
+    total += load;
+  }
+  const auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
+  return { .gigabits_per_second = static_cast<double>( total * 8 ) / test_duration.count() / 1e9,
+           .tasks_run = server_executor.has_value() ? server_executor->tasks_run() : 0,
+           .tasks_stolen = server_executor.has_value() ? server_executor->tasks_stolen() : 0 };
+}
+
+void program_body()
+{
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  const vector<size_t> loads = zipf_loads();
+  cout << "Zipf load (s = " << ZIPF_EXPONENT << ") over " << NUM_CONNECTIONS
+       << " connections: the heaviest carries " << loads.front() / 1024 << " KiB, the lightest "
+       << loads.back() / 1024 << " KiB.\n";
+
+  // 0 workers: every callback inline on the stack's own thread (the baseline)
+  const size_t max_workers = max<size_t>( 2, min<size_t>( MAX_WORKERS, thread::hardware_concurrency() ) );
+  for ( size_t workers = 0; workers <= max_workers; workers = max<size_t>( 1, workers * 2 ) ) {
+    const Result result = run( workers );
+
+    if ( workers == 0 ) {
+      cout << "TCPStack without an executor: ";
+    } else {
+      cout << "TCPStack with " << workers << " work-stealing worker" << ( workers == 1 ? "" : "s" ) << ": ";
+    }
+    cout << fixed << setprecision( 2 ) << result.gigabits_per_second << " Gbit/s";
+    if ( workers > 0 ) {
+      cout << " (server ran " << result.tasks_run << " tasks, " << result.tasks_stolen << " stolen)";
+    }
+    cout << ".\n";
+
+    debug_output << "    TCPStack, Zipf load (" << setw( 1 ) << workers << " worker"
+                 << ( workers == 1 ? ") " : "s)" ) << ": " << fixed << setprecision( 2 ) << setw( 5 ) << result.gigabits_per_second << " Gbit/s\n";
+
+    // without an executor, the EventLoop serves one rule per poll, so the baseline is held to a lower bar
+    const double minimum = workers == 0 ? 0.002 : 0.05;
+    if ( result.gigabits_per_second < minimum ) {
+      throw runtime_error( "TCPStack did not meet minimum throughput of " + to_string( minimum ) + " Gbit/s." );
+    }
+  }
+}
+
+} // namespace
+
+int main()
+{
+  try {
+    set_debug_handler( []( void* /*unused*/, std::string_view /*unused*/ ) {}, nullptr );
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -51,8 +51,8 @@ public:
   std::pair<std::string, uint16_t> ip_port() const;
   //! Dotted-quad IP address string ("18.243.0.1").
   std::string ip() const { return ip_port().first; }
-  //! Numeric port (host byte order).
-  uint16_t port() const { return ip_port().second; }
+  //! Numeric port (host byte order), read straight from the socket address.
+  uint16_t port() const;
   //! Numeric IP address as an integer (i.e., in [host byte order](\ref man3::byteorder)).
   uint32_t ipv4_numeric() const;
   //! Create an Address from a 32-bit raw numeric IP address
@@ -0,0 +1,214 @@
+#include "async.hh"
+#include "exception.hh"
+
+#include <stdexcept>
+#include <sys/socket.h>
+
+using namespace std;
+
+AsyncRuntime::AsyncRuntime()
+  : _categories { _loop.add_category( "async read" ), _loop.add_category( "async write" ) }
+{
+  _loop.set_batched( true );
+}
+
+void AsyncRuntime::spawn( Task<> task )
+{
+  ++_running;
+  supervise( move( task ) );
+}
+
+AsyncRuntime::Detached AsyncRuntime::supervise( Task<> task )
+{
+  try {
+    co_await task;
+  } catch ( ... ) {
+    if ( not _error ) {
+      _error = current_exception();
+    }
+  }
+  --_running;
+}
+
+void AsyncRuntime::run()
+{
+  while ( _running > 0 ) {
+    if ( _loop.wait_next_event( -1 ) == EventLoop::Result::Exit ) {
+      if ( _error ) {
+        break; // (the remaining Tasks were presumably waiting on the one that failed)
+      }
+      throw runtime_error( "AsyncRuntime: " + to_string( _running )
+                           + " Tasks are waiting for events that will never come" );
+    }
+  }
+
+  if ( _error ) {
+    rethrow_exception( exchange( _error, {} ) );
+  }
+}
+
+AsyncFD::AsyncFD( AsyncRuntime& runtime, FileDescriptor&& fd )
+  : _runtime( &runtime ), _state( make_shared<State>( State { .fd = move( fd ) } ) )
+{
+  _state->fd.set_blocking( false );
+
+  for ( const Direction direction : { Direction::In, Direction::Out } ) {
+    const auto index = static_cast<size_t>( direction );
+    _rules.push_back( runtime.loop().add_rule(
+      runtime.rule_category( direction ),
+      _state->fd,
+      direction,
+      [state = _state, index] { progress( state->operations.at( index ), false ); },
+      [state = _state, index] { return static_cast<bool>( state->operations.at( index ).waiter ); },
+      [state = _state, index] {
+        state->retired.at( index ) = true;
+        if ( state->operations.at( index ).waiter ) {
+          progress( state->operations.at( index ), true );
+        }
+      } ) );
+  }
+}
+
+AsyncFD::~AsyncFD()
+{
+  for ( auto& rule : _rules ) {
+    rule.cancel();
+  }
+}
+
+AsyncFD& AsyncFD::operator=( AsyncFD&& other ) noexcept
+{
+  for ( auto& rule : _rules ) {
+    rule.cancel();
+  }
+  _runtime = other._runtime;
+  _state = move( other._state );
+  _rules = move( other._rules );
+  other._rules.clear();
+  return *this;
+}
+
+void AsyncFD::progress( Operation& operation, const bool last_try )
+{
+  try {
+    if ( not operation.attempt() ) {
+      if ( not last_try ) {
+        return;
+      }
+      throw runtime_error( "AsyncFD: file descriptor closed before the operation completed" );
+    }
+  } catch ( ... ) {
+    operation.error = current_exception();
+  }
+
+  operation.attempt = nullptr;
+  exchange( operation.waiter, {} ).resume(); // (may destroy the AsyncFD, but not the State)
+}
+
+AsyncFD::Wait::Wait( State& state, const Direction direction, AttemptT attempt, const bool try_first )
+  : _state( state )
+  , _index( static_cast<size_t>( direction ) )
+  , _attempt( move( attempt ) )
+  , _try_first( try_first )
+{}
+
+bool AsyncFD::Wait::await_ready()
+{
+  if ( _state.operations.at( _index ).waiter ) {
+    throw runtime_error( "AsyncFD: another Task is already waiting in the same direction" );
+  }
+
+  if ( _state.retired.at( _index ) ) {
+    if ( _attempt() ) {
+      return true;
+    }
+    throw runtime_error( "AsyncFD: file descriptor closed before the operation completed" );
+  }
+
+  return _try_first and _attempt();
+}
+
+void AsyncFD::Wait::await_suspend( const coroutine_handle<> waiter )
+{
+  auto& operation = _state.operations.at( _index );
+  operation.attempt = move( _attempt );
+  operation.waiter = waiter;
+}
+
+void AsyncFD::Wait::await_resume()
+{
+  auto& operation = _state.operations.at( _index );
+  if ( operation.error ) {
+    rethrow_exception( exchange( operation.error, {} ) );
+  }
+}
+
+AsyncStream::AsyncStream( AsyncRuntime& runtime, FileDescriptor&& fd ) : AsyncFD( runtime, move( fd ) ) {}
+
+Task<AsyncStream> AsyncStream::connect( AsyncRuntime& runtime, const Address& address )
+{
+  TCPSocket socket;
+  socket.set_blocking( false );
+  socket.connect( address ); // (returns right away, with the handshake in progress)
+
+  AsyncStream stream { runtime, socket.duplicate() };
+  co_await stream.wait(
+    Direction::Out,
+    [&socket] {
+      socket.throw_if_error();
+      return true;
+    },
+    false );
+  co_return stream;
+}
+
+AsyncFD::Wait AsyncStream::read( string& buffer )
+{
+  return wait(
+    Direction::In,
+    [&fd = fd(), &buffer, size = buffer.size()] {
+      buffer.resize( size ); // (an attempt that found nothing to read emptied the buffer)
+      fd.read( buffer );
+      return not buffer.empty() or fd.eof();
+    },
+    true );
+}
+
+AsyncFD::Wait AsyncStream::write( string_view data )
+{
+  return wait(
+    Direction::Out,
+    [&fd = fd(), data]() mutable {
+      while ( not data.empty() ) {
+        const size_t written = fd.write( data );
+        if ( written == 0 ) {
+          return false;
+        }
+        data.remove_prefix( written );
+      }
+      return true;
+    },
+    true );
+}
+
+void AsyncStream::shutdown_write()
+{
+  CheckSystemCall( "shutdown", ::shutdown( fd().fd_num(), SHUT_WR ) );
+}
+
+AsyncListener::AsyncListener( AsyncRuntime& runtime, TCPSocket&& socket )
+  : AsyncFD( runtime, socket.duplicate() ), _socket( move( socket ) )
+{}
+
+Task<AsyncStream> AsyncListener::accept()
+{
+  optional<TCPSocket> connection;
+  co_await wait(
+    Direction::In,
+    [&] {
+      connection = _socket.try_accept(); // (nothing if another acceptor took the connection first)
+      return connection.has_value();
+    },
+    false );
+  co_return AsyncStream { runtime(), move( connection.value() ) };
+}
@@ -0,0 +1,330 @@
+#pragma once
+
+#include "address.hh"
+#include "eventloop.hh"
+#include "file_descriptor.hh"
+#include "socket.hh"
+
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+template<class T>
+class Task;
+
+//! The parts of a Task's promise that do not depend on its result type
+class TaskPromiseBase
+{
+public:
+  //! A Task does not start until it is awaited (or spawned)
+  std::suspend_always initial_suspend() noexcept { return {}; }
+
+  //! On finishing, resume whatever awaited the Task
+  auto final_suspend() noexcept
+  {
+    struct ResumeContinuation
+    {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend( std::coroutine_handle<> /* finished */ ) noexcept
+      {
+        return continuation ? continuation : std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+
+      std::coroutine_handle<> continuation;
+    };
+    return ResumeContinuation { _continuation };
+  }
+
+  void unhandled_exception() noexcept { _exception = std::current_exception(); }
+
+  void set_continuation( std::coroutine_handle<> continuation ) { _continuation = continuation; }
+
+protected:
+  void rethrow_if_failed() const
+  {
+    if ( _exception ) {
+      std::rethrow_exception( _exception );
+    }
+  }
+
+private:
+  std::coroutine_handle<> _continuation {};
+  std::exception_ptr _exception {};
+};
+
+template<class T>
+class TaskPromise : public TaskPromiseBase
+{
+public:
+  Task<T> get_return_object();
+
+  void return_value( T value ) { _value.emplace( std::move( value ) ); }
+
+  T result()
+  {
+    rethrow_if_failed();
+    return std::move( _value.value() );
+  }
+
+private:
+  std::optional<T> _value {};
+};
+
+template<>
+class TaskPromise<void> : public TaskPromiseBase
+{
+public:
+  Task<void> get_return_object();
+
+  void return_void() {}
+
+  void result() { rethrow_if_failed(); }
+};
+
+//! \brief A coroutine that runs when it is awaited, and resumes its awaiter when it finishes
+//! \details `co_await task` runs the task until it finishes, and evaluates to its `co_return` value
+//! (or rethrows what it threw). Tasks run on one thread: each suspends only by awaiting something
+//! that an AsyncRuntime resumes (a file descriptor, a timer, or another Task).
+template<class T = void>
+class Task
+{
+public:
+  using promise_type = TaskPromise<T>;
+
+  explicit Task( std::coroutine_handle<promise_type> handle ) : _handle( handle ) {}
+
+  ~Task()
+  {
+    if ( _handle ) {
+      _handle.destroy();
+    }
+  }
+
+  Task( const Task& other ) = delete;
+  Task& operator=( const Task& other ) = delete;
+  Task( Task&& other ) noexcept : _handle( std::exchange( other._handle, {} ) ) {}
+  Task& operator=( Task&& other ) noexcept
+  {
+    std::swap( _handle, other._handle );
+    return *this;
+  }
+
+  auto operator co_await() const noexcept
+  {
+    struct Awaiter
+    {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend( std::coroutine_handle<> awaiter ) noexcept
+      {
+        handle.promise().set_continuation( awaiter );
+        return handle;
+      }
+      T await_resume() { return handle.promise().result(); }
+
+      std::coroutine_handle<promise_type> handle;
+    };
+    return Awaiter { _handle };
+  }
+
+private:
+  std::coroutine_handle<promise_type> _handle;
+};
+
+template<class T>
+Task<T> TaskPromise<T>::get_return_object()
+{
+  return Task<T> { std::coroutine_handle<TaskPromise<T>>::from_promise( *this ) };
+}
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+  return Task<void> { std::coroutine_handle<TaskPromise<void>>::from_promise( *this ) };
+}
+
+//! \brief Runs Tasks on one thread, resuming each when the file descriptor or timer it awaits is ready
+//! \details The runtime owns an EventLoop (with Backend::Epoll, serving every ready fd per wait), so
+//! a suspended Task costs its coroutine frame and, while it awaits an fd, one interested rule.
+class AsyncRuntime
+{
+public:
+  AsyncRuntime();
+
+  //! Start `task` (it runs until it first suspends before spawn() returns)
+  void spawn( Task<> task );
+
+  //! \brief Wait for events and resume Tasks until every spawned Task has finished
+  //! \details Rethrows the first exception to escape a spawned Task, once the others have finished
+  //! (or can no longer make progress).
+  void run();
+
+  //! Spawned Tasks that have not yet finished
+  size_t running() const { return _running; }
+
+  //! An awaitable that resumes its awaiter after `delay_ms` milliseconds
+  auto sleep( uint64_t delay_ms )
+  {
+    struct Sleep
+    {
+      bool await_ready() noexcept { return false; }
+      void await_suspend( std::coroutine_handle<> awaiter )
+      {
+        loop.add_timer( delay_ms, [awaiter] { awaiter.resume(); } );
+      }
+      void await_resume() noexcept {}
+
+      EventLoop& loop;
+      uint64_t delay_ms;
+    };
+    return Sleep { _loop, delay_ms };
+  }
+
+  EventLoop& loop() { return _loop; }
+
+  //! The EventLoop category for AsyncFD rules in `direction`
+  size_t rule_category( Direction direction ) const { return _categories.at( static_cast<size_t>( direction ) ); }
+
+private:
+  //! A coroutine that starts right away and frees itself when it finishes
+  struct Detached
+  {
+    struct promise_type
+    {
+      Detached get_return_object() noexcept { return {}; }
+      std::suspend_never initial_suspend() noexcept { return {}; }
+      std::suspend_never final_suspend() noexcept { return {}; }
+      void return_void() noexcept {}
+      void unhandled_exception() noexcept { std::terminate(); }
+    };
+  };
+
+  //! Await `task`, keeping the first exception to escape any Task for run() to rethrow
+  Detached supervise( Task<> task );
+
+  EventLoop _loop { EventLoop::Backend::Epoll };
+  std::array<size_t, 2> _categories;
+  size_t _running {};
+  std::exception_ptr _error {};
+};
+
+//! \brief A file descriptor on which a Task can await readiness (at most one Task per direction at a time)
+//! \details Each direction has an EventLoop rule that is interested only while a Task awaits it. When
+//! its fd is ready, the rule retries the awaited operation, and resumes the Task once it completes or
+//! throws. If the rule is cancelled (the fd reached EOF, hung up or had an error), the Task is resumed
+//! after one last try, with an exception unless that try completed the operation.
+class AsyncFD
+{
+public:
+  AsyncFD( AsyncRuntime& runtime, FileDescriptor&& fd );
+  ~AsyncFD();
+
+  AsyncFD( const AsyncFD& other ) = delete;
+  AsyncFD& operator=( const AsyncFD& other ) = delete;
+  AsyncFD( AsyncFD&& other ) noexcept = default;
+  AsyncFD& operator=( AsyncFD&& other ) noexcept;
+
+  FileDescriptor& fd() { return _state->fd; }
+  const FileDescriptor& fd() const { return _state->fd; }
+
+protected:
+  //! Makes what progress it can without blocking; returns true once the operation is complete
+  using AttemptT = std::function<bool()>;
+
+  //! An operation awaited in one direction
+  struct Operation
+  {
+    AttemptT attempt {};
+    std::coroutine_handle<> waiter {};
+    std::exception_ptr error {};
+  };
+
+  //! What the rules share with the awaiters (kept alive by the rules until the EventLoop drops them)
+  struct State
+  {
+    FileDescriptor fd;
+    std::array<Operation, 2> operations {};
+    std::array<bool, 2> retired {}; //!< Has the direction's rule been cancelled?
+  };
+
+  //! The awaitable returned by wait()
+  class Wait
+  {
+  public:
+    Wait( State& state, Direction direction, AttemptT attempt, bool try_first );
+
+    bool await_ready();
+    void await_suspend( std::coroutine_handle<> waiter );
+    void await_resume();
+
+  private:
+    State& _state;
+    size_t _index;
+    AttemptT _attempt;
+    bool _try_first;
+  };
+
+  //! \brief An awaitable that completes when `attempt` does (tried first without waiting if `try_first`)
+  //! \details `attempt` runs from the EventLoop each time the fd is ready in `direction`, and must
+  //! read or write it at least once per call (or complete).
+  Wait wait( Direction direction, AttemptT attempt, bool try_first )
+  {
+    return { *_state, direction, std::move( attempt ), try_first };
+  }
+
+  AsyncRuntime& runtime() { return *_runtime; }
+
+private:
+  //! Try the waiting operation again, and resume its waiter if it is complete (or this was its last try)
+  static void progress( Operation& operation, bool last_try );
+
+  AsyncRuntime* _runtime;
+  std::shared_ptr<State> _state;
+  std::vector<EventLoop::RuleHandle> _rules {};
+};
+
+//! \brief A byte stream (e.g. a connected TCPSocket, a pipe, or a TCPMinnowSocket's fd) with awaitable I/O
+//! \details The fd is made non-blocking, and each read or write is tried right away before waiting.
+class AsyncStream : public AsyncFD
+{
+public:
+  AsyncStream( AsyncRuntime& runtime, FileDescriptor&& fd );
+
+  //! Connect a TCPSocket to `address`, waiting for the handshake without blocking
+  static Task<AsyncStream> connect( AsyncRuntime& runtime, const Address& address );
+
+  //! \brief An awaitable that reads into `buffer` once some bytes (or EOF) arrive
+  //! \details As with FileDescriptor::read(), a non-empty `buffer` is filled only up to its size.
+  Wait read( std::string& buffer );
+
+  //! An awaitable that writes all of `data`, waiting for room as needed (`data` must outlive it)
+  Wait write( std::string_view data );
+
+  //! Shut down the stream's writing direction (it must be a socket)
+  void shutdown_write();
+
+  bool eof() const { return fd().eof(); }
+};
+
+//! A listening TCPSocket whose accept() can be awaited
+class AsyncListener : public AsyncFD
+{
+public:
+  AsyncListener( AsyncRuntime& runtime, TCPSocket&& socket );
+
+  //! Accept the next connection, waiting until one arrives
+  Task<AsyncStream> accept();
+
+  Address local_address() const { return _socket.local_address(); }
+
+private:
+  TCPSocket _socket;
+};
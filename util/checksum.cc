@@ -0,0 +1,189 @@
+#include "checksum.hh"
+
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+#if defined( __x86_64__ )
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// One's complement addition (with end-around carry) of 64-bit words
+uint64_t add_with_carry( uint64_t sum, const uint64_t word )
+{
+  sum += word;
+  return sum + ( sum < word );
+}
+
+uint64_t load64( const char* data )
+{
+  uint64_t word {};
+  memcpy( &word, data, sizeof( word ) );
+  return word;
+}
+
+// Add `size` bytes to `sum`, a 64-bit word at a time
+uint64_t sum_portable( const char* data, size_t size, uint64_t sum )
+{
+  while ( size >= 32 ) {
+    sum = add_with_carry( sum, load64( data ) );
+    sum = add_with_carry( sum, load64( data + 8 ) );
+    sum = add_with_carry( sum, load64( data + 16 ) );
+    sum = add_with_carry( sum, load64( data + 24 ) );
+    data += 32;
+    size -= 32;
+  }
+  while ( size >= 8 ) {
+    sum = add_with_carry( sum, load64( data ) );
+    data += 8;
+    size -= 8;
+  }
+
+  // the last few bytes, padded with zeros
+  uint64_t tail = 0;
+  memcpy( &tail, data, size );
+  return add_with_carry( sum, tail );
+}
+
+uint64_t sum_portable( const char* data, const size_t size )
+{
+  return sum_portable( data, size, 0 );
+}
+
+#if defined( __x86_64__ )
+
+// Each 32-bit word of the vectors is added into a 64-bit lane, which can't overflow for any buffer that fits
+// in memory; the lanes are then added with end-around carry.
+
+[[gnu::target( "sse2" )]] uint64_t sum_sse2( const char* data, size_t size )
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i lanes_a = zero;
+  __m128i lanes_b = zero;
+  while ( size >= 32 ) {
+    const __m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data ) );
+    const __m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + 16 ) );
+    lanes_a = _mm_add_epi64( lanes_a, _mm_unpacklo_epi32( a, zero ) );
+    lanes_b = _mm_add_epi64( lanes_b, _mm_unpackhi_epi32( a, zero ) );
+    lanes_a = _mm_add_epi64( lanes_a, _mm_unpacklo_epi32( b, zero ) );
+    lanes_b = _mm_add_epi64( lanes_b, _mm_unpackhi_epi32( b, zero ) );
+    data += 32;
+    size -= 32;
+  }
+
+  const __m128i lanes = _mm_add_epi64( lanes_a, lanes_b );
+  uint64_t sum = add_with_carry( static_cast<uint64_t>( _mm_cvtsi128_si64( lanes ) ),
+                                 static_cast<uint64_t>( _mm_cvtsi128_si64( _mm_unpackhi_epi64( lanes, lanes ) ) ) );
+  return sum_portable( data, size, sum );
+}
+
+[[gnu::target( "avx2" )]] uint64_t sum_avx2( const char* data, size_t size )
+{
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i lanes_a = zero;
+  __m256i lanes_b = zero;
+  while ( size >= 64 ) {
+    const __m256i a = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( data ) );
+    const __m256i b = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( data + 32 ) );
+    lanes_a = _mm256_add_epi64( lanes_a, _mm256_unpacklo_epi32( a, zero ) );
+    lanes_b = _mm256_add_epi64( lanes_b, _mm256_unpackhi_epi32( a, zero ) );
+    lanes_a = _mm256_add_epi64( lanes_a, _mm256_unpacklo_epi32( b, zero ) );
+    lanes_b = _mm256_add_epi64( lanes_b, _mm256_unpackhi_epi32( b, zero ) );
+    data += 64;
+    size -= 64;
+  }
+
+  const __m256i lanes4 = _mm256_add_epi64( lanes_a, lanes_b );
+  const __m128i lanes
+    = _mm_add_epi64( _mm256_castsi256_si128( lanes4 ), _mm256_extracti128_si256( lanes4, 1 ) );
+  uint64_t sum = add_with_carry( static_cast<uint64_t>( _mm_cvtsi128_si64( lanes ) ),
+                                 static_cast<uint64_t>( _mm_cvtsi128_si64( _mm_unpackhi_epi64( lanes, lanes ) ) ) );
+  return sum_portable( data, size, sum );
+}
+
+#endif
+
+using SumFunction = uint64_t ( * )( const char*, size_t );
+
+SumFunction sum_function( const InternetChecksum::Kernel kernel )
+{
+  switch ( kernel ) {
+    case InternetChecksum::Kernel::Portable:
+      return sum_portable;
+#if defined( __x86_64__ )
+    case InternetChecksum::Kernel::SSE2:
+      return sum_sse2;
+    case InternetChecksum::Kernel::AVX2:
+      return __builtin_cpu_supports( "avx2" ) ? sum_avx2 : nullptr;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+InternetChecksum::Kernel fastest_kernel()
+{
+  for ( const auto kernel : { InternetChecksum::Kernel::AVX2, InternetChecksum::Kernel::SSE2 } ) {
+    if ( InternetChecksum::supported( kernel ) ) {
+      return kernel;
+    }
+  }
+  return InternetChecksum::Kernel::Portable;
+}
+
+struct ActiveKernel
+{
+  InternetChecksum::Kernel kernel;
+  SumFunction sum;
+};
+
+ActiveKernel& active_kernel()
+{
+  static ActiveKernel active { fastest_kernel(), sum_function( fastest_kernel() ) };
+  return active;
+}
+
+} // namespace
+
+bool InternetChecksum::supported( const Kernel kernel )
+{
+  return sum_function( kernel ) != nullptr;
+}
+
+InternetChecksum::Kernel InternetChecksum::kernel()
+{
+  return active_kernel().kernel;
+}
+
+void InternetChecksum::use_kernel( const Kernel kernel )
+{
+  const SumFunction sum = sum_function( kernel );
+  if ( sum == nullptr ) {
+    throw runtime_error( "InternetChecksum: this CPU does not support the requested kernel" );
+  }
+  active_kernel() = { kernel, sum };
+}
+
+uint16_t InternetChecksum::sum_words( const string_view data )
+{
+  uint64_t sum = active_kernel().sum( data.data(), data.size() );
+
+  // fold to 16 bits (each step keeps the sum congruent mod 0xffff, and nonzero if it was)
+  sum = ( sum & 0xffff'ffff ) + ( sum >> 32 );
+  sum = ( sum & 0xffff'ffff ) + ( sum >> 32 );
+  sum = ( sum & 0xffff ) + ( sum >> 16 );
+  sum = ( sum & 0xffff ) + ( sum >> 16 );
+
+  // the kernels add words in the machine's byte order; the checksum's are big-endian
+  const auto folded = static_cast<uint16_t>( sum );
+  if constexpr ( endian::native == endian::little ) {
+    return static_cast<uint16_t>( ( folded << 8 ) | ( folded >> 8 ) );
+  } else {
+    return folded;
+  }
+}
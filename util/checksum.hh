@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <ranges>
+#include <string_view>
 
 //! The internet checksum algorithm
 class InternetChecksum
@@ -11,17 +12,32 @@ private:
   bool parity_ {};
 
 public:
+  //! \brief The implementations of the loop that sums a buffer's words (all give the same results)
+  //! \details Each reads the buffer a machine word (or vector register) at a time, adding the words with
+  //! end-around carry, which gives a sum congruent (mod 0xffff) to that of the buffer's 16-bit words.
+  enum class Kernel : uint8_t
+  {
+    Portable, //!< 64-bit words
+    SSE2,     //!< 128-bit vectors (x86-64)
+    AVX2      //!< 256-bit vectors (x86-64, where the CPU supports AVX2)
+  };
+
   explicit InternetChecksum( const uint32_t sum = 0 ) : sum_( sum ) {}
+
+  //! \details Any length, from any starting address: a buffer that follows an odd number of bytes
+  //! has its sum's bytes swapped, as its words straddle those of the bytes before it.
   void add( std::string_view data )
   {
-    for ( const uint8_t i : data ) {
-      uint16_t val = i;
-      if ( not parity_ ) {
-        val <<= 8;
-      }
-      sum_ += val;
-      parity_ = !parity_;
+    if ( data.empty() ) {
+      return;
     }
+
+    uint32_t partial = sum_words( data );
+    if ( parity_ ) {
+      partial = ( ( partial & 0xff ) << 8 ) | ( partial >> 8 );
+    }
+    sum_ = ( sum_ & 0xffff ) + ( sum_ >> 16 ) + partial; // (folded, so that any number of adds fits)
+    parity_ ^= data.size() & 1;
   }
 
   uint16_t value() const
@@ -41,4 +57,29 @@ public:
       add( std::string_view { x } );
     }
   }
+
+  //! \brief A checksum (as stored in a header) updated, in constant time, for one of the 16-bit words it covers
+  //! changing from `old_word` to `new_word`
+  //! \details RFC 1624's HC' = ~(~HC + ~m + m'). For a checksum that was correct, this is the checksum that
+  //! summing all the words again would give; one that was wrong stays wrong.
+  static uint16_t adjust( const uint16_t checksum, const uint16_t old_word, const uint16_t new_word )
+  {
+    uint32_t sum = static_cast<uint16_t>( ~checksum ) + static_cast<uint16_t>( ~old_word ) + new_word;
+    sum = ( sum & 0xffff ) + ( sum >> 16 );
+    sum = ( sum & 0xffff ) + ( sum >> 16 );
+    return static_cast<uint16_t>( ~sum );
+  }
+
+  //! Can this CPU run `kernel`?
+  static bool supported( Kernel kernel );
+
+  //! The kernel in use (by default, the fastest one this CPU supports)
+  static Kernel kernel();
+
+  //! Switch to another (supported) kernel, e.g. to compare them; throws if this CPU can't run it
+  static void use_kernel( Kernel kernel );
+
+private:
+  //! The sum of `data`'s big-endian 16-bit words (the last byte, if odd, padded with zero), folded to 16 bits
+  static uint16_t sum_words( std::string_view data );
 };
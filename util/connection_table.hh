@@ -0,0 +1,164 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+//! \brief Identifies one TCP connection, from the point of view of this host
+struct FourTuple
+{
+  uint32_t local_address {};  //!< Our IPv4 address (host byte order)
+  uint32_t remote_address {}; //!< The peer's IPv4 address (host byte order)
+  uint16_t local_port {};     //!< Our TCP port
+  uint16_t remote_port {};    //!< The peer's TCP port
+
+  bool operator==( const FourTuple& other ) const = default;
+
+  //! \brief A well-mixed 64-bit hash of the four fields
+  //! \param[in] seed is a per-table secret, so that remote hosts cannot choose colliding tuples
+  uint64_t hash( uint64_t seed ) const
+  {
+    uint64_t h = seed ^ ( ( uint64_t { remote_address } << 32 ) | local_address );
+    h *= 0x9e3779b97f4a7c15;
+    h ^= ( uint64_t { remote_port } << 16 ) | local_port;
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9;
+    h ^= h >> 32;
+    return h;
+  }
+};
+
+//! \brief A hash table from FourTuple to connection state, for demultiplexing inbound segments
+//! \details Open addressing with linear probing over one flat array of slots. Each slot holds the
+//! full key, 32 bits of its hash, and a pointer to the value, so a lookup touches one or two cache
+//! lines and dereferences nothing until it has found the right connection. Deletion shifts later
+//! entries of the probe sequence backwards, so there are no tombstones and lookups stay short
+//! even after millions of connections have come and gone. Values live on the heap and never move:
+//! a pointer returned by find() or emplace() stays valid until that entry is erased.
+template<class T>
+class ConnectionTable
+{
+private:
+  struct Slot
+  {
+    FourTuple key {};
+    uint32_t tag {};             //!< Low 32 bits of the key's hash
+    std::unique_ptr<T> value {}; //!< Empty slots have no value
+  };
+
+  static constexpr size_t MIN_CAPACITY = 16;
+
+  std::vector<Slot> slots_ = std::vector<Slot>( MIN_CAPACITY );
+  size_t mask_ { MIN_CAPACITY - 1 };
+  int shift_ { 64 - std::countr_zero( MIN_CAPACITY ) }; //!< Home slot is the high bits of the hash
+  size_t size_ {};
+  uint64_t seed_;
+
+  size_t home( uint64_t hash ) const { return static_cast<size_t>( hash >> shift_ ); }
+
+  //! Index of the slot holding `key`, or of the empty slot that ends its probe sequence
+  size_t probe( const FourTuple& key, uint64_t hash ) const
+  {
+    const auto tag = static_cast<uint32_t>( hash );
+    size_t i = home( hash );
+    while ( slots_[i].value and ( slots_[i].tag != tag or slots_[i].key != key ) ) {
+      i = ( i + 1 ) & mask_;
+    }
+    return i;
+  }
+
+  //! Double the number of slots and reinsert every entry (keeps the load factor at or below 3/4)
+  void grow()
+  {
+    std::vector<Slot> old = std::exchange( slots_, std::vector<Slot>( slots_.size() * 2 ) );
+    mask_ = slots_.size() - 1;
+    --shift_;
+    for ( auto& slot : old ) {
+      if ( slot.value ) {
+        const uint64_t hash = slot.key.hash( seed_ );
+        slots_[probe( slot.key, hash )] = std::move( slot );
+      }
+    }
+  }
+
+public:
+  //! \param[in] seed keys the hash function (random by default)
+  explicit ConnectionTable( uint64_t seed = std::random_device {}() ) : seed_( seed ) {}
+
+  //! \returns the value stored for `key`, or nullptr if there is none
+  T* find( const FourTuple& key )
+  {
+    Slot& slot = slots_[probe( key, key.hash( seed_ ) )];
+    return slot.value.get();
+  }
+
+  const T* find( const FourTuple& key ) const
+  {
+    const Slot& slot = slots_[probe( key, key.hash( seed_ ) )];
+    return slot.value.get();
+  }
+
+  //! \brief Construct a value for `key` from `args`, unless `key` is already present
+  //! \returns the value stored for `key`, and whether it was inserted by this call
+  template<typename... Targs>
+  std::pair<T*, bool> emplace( const FourTuple& key, Targs&&... args )
+  {
+    if ( ( size_ + 1 ) * 4 > slots_.size() * 3 ) {
+      grow();
+    }
+
+    const uint64_t hash = key.hash( seed_ );
+    Slot& slot = slots_[probe( key, hash )];
+    if ( slot.value ) {
+      return { slot.value.get(), false };
+    }
+
+    slot.value = std::make_unique<T>( std::forward<Targs>( args )... );
+    slot.key = key;
+    slot.tag = static_cast<uint32_t>( hash );
+    ++size_;
+    return { slot.value.get(), true };
+  }
+
+  //! \brief Remove (and destroy) the value stored for `key`
+  //! \returns whether there was one
+  bool erase( const FourTuple& key )
+  {
+    size_t hole = probe( key, key.hash( seed_ ) );
+    if ( not slots_[hole].value ) {
+      return false;
+    }
+    slots_[hole].value.reset();
+    --size_;
+
+    // Backward-shift deletion: move later members of the probe run into the hole whenever
+    // that brings them no further from their home slot
+    for ( size_t i = ( hole + 1 ) & mask_; slots_[i].value; i = ( i + 1 ) & mask_ ) {
+      const size_t ideal = home( slots_[i].key.hash( seed_ ) );
+      if ( ( ( i - ideal ) & mask_ ) >= ( ( i - hole ) & mask_ ) ) {
+        slots_[hole] = std::move( slots_[i] );
+        hole = i;
+      }
+    }
+    return true;
+  }
+
+  //! Call `f( key, value )` for every entry (`f` must not insert or erase)
+  template<class F>
+  void for_each( F&& f )
+  {
+    for ( auto& slot : slots_ ) {
+      if ( slot.value ) {
+        f( std::as_const( slot.key ), *slot.value );
+      }
+    }
+  }
+
+  size_t size() const { return size_; }             //!< Number of entries
+  bool empty() const { return size_ == 0; }         //!< Is the table empty?
+  size_t capacity() const { return slots_.size(); } //!< Number of slots
+};
@@ -1,17 +1,53 @@
 #include "eventloop.hh"
 #include "exception.hh"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <climits>
 #include <cstring>
 #include <iostream>
+#include <span>
+#include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
 
 using namespace std;
 
+namespace {
+// The epoll event that a rule watching for `direction` waits for
+uint32_t epoll_event_for( const EventLoop::Direction direction )
+{
+  return direction == EventLoop::Direction::In ? EPOLLIN : EPOLLOUT;
+}
+} // namespace
+
 unsigned int EventLoop::FDRule::service_count() const
 {
   return direction == Direction::In ? fd.read_count() : fd.write_count();
 }
 
+EventLoop::EventLoop( const Backend backend )
+{
+  _rule_categories.reserve( 64 );
+  set_backend( backend );
+}
+
+void EventLoop::set_backend( const Backend backend )
+{
+  if ( not _fd_rules.empty() or not _non_fd_rules.empty() or _timerfd.has_value() ) {
+    throw runtime_error( "EventLoop: set_backend() called after rules were added" );
+  }
+
+  _epoll.reset();
+  _ring.reset();
+  if ( backend == Backend::Epoll ) {
+    _epoll.emplace( CheckSystemCall( "epoll_create1", ::epoll_create1( EPOLL_CLOEXEC ) ) );
+  } else if ( backend == Backend::IoUring and ::IoUring::available() ) {
+    _ring = make_unique<::IoUring>( RING_ENTRIES );
+  }
+}
+
 size_t EventLoop::add_category( const string& name )
 {
   if ( _rule_categories.size() >= _rule_categories.capacity() ) {
@@ -77,11 +113,150 @@ void EventLoop::RuleHandle::cancel()
   }
 }
 
+void EventLoop::RuleHandle::set_strand( shared_ptr<WorkStealingExecutor::Strand> strand )
+{
+  const shared_ptr<BasicRule> rule_shared_ptr = rule_weak_ptr_.lock();
+  if ( rule_shared_ptr ) {
+    rule_shared_ptr->strand = move( strand );
+  }
+}
+
+void EventLoop::post( shared_ptr<WorkStealingExecutor::Strand> strand, CallbackT task )
+{
+  if ( not _executor ) {
+    task();
+    return;
+  }
+
+  _posted.emplace_back( move( strand ), move( task ) );
+}
+
+void EventLoop::run_on_executor( const ReadyRules& ready )
+{
+  for ( const auto& [rule, count_before] : ready ) {
+    rule->strand->post( [r = rule.get()] { r->callback(); } );
+  }
+  for ( auto& [strand, task] : _posted ) {
+    strand->post( move( task ) );
+  }
+  _posted.clear();
+
+  _executor->wait_idle();
+
+  for ( const auto& [rule, count_before] : ready ) {
+    if ( count_before == rule->service_count() and ( not rule->fd.closed() ) and not rule->cancel_requested
+         and rule->interest() ) {
+      throw runtime_error( "EventLoop: busy wait detected: rule \""
+                           + _rule_categories.at( rule->category_id ).name
+                           + "\" did not read/write fd and is still interested" );
+    }
+  }
+}
+
+uint64_t EventLoop::now_ms()
+{
+  using namespace chrono;
+  return duration_cast<milliseconds>( steady_clock::now().time_since_epoch() ).count();
+}
+
+EventLoop::TimerId EventLoop::add_timer( const uint64_t delay_ms, const CallbackT& callback )
+{
+  return _timers.add( now_ms() + delay_ms, callback );
+}
+
+optional<uint64_t> EventLoop::ms_until_next_timer() const
+{
+  const optional<uint64_t> deadline = _timers.next_deadline();
+  if ( not deadline.has_value() ) {
+    return {};
+  }
+  const uint64_t now = now_ms();
+  return deadline.value() > now ? deadline.value() - now : 0;
+}
+
+void EventLoop::set_timerfd( const bool use_timerfd )
+{
+  if ( use_timerfd == _timerfd.has_value() ) {
+    return;
+  }
+
+  if ( not use_timerfd ) {
+    _timerfd->close(); // its rule is dropped on the next wait
+    _timerfd.reset();
+    _timerfd_deadline.reset();
+    return;
+  }
+
+  _timerfd.emplace( CheckSystemCall( "timerfd_create", ::timerfd_create( CLOCK_MONOTONIC, TFD_CLOEXEC ) ) );
+  _timerfd->set_blocking( false );
+  add_rule(
+    "timers",
+    *_timerfd,
+    Direction::In,
+    [this] {
+      string expirations;
+      _timerfd->read( expirations );
+      _timerfd_deadline.reset(); // expired, so arm it again for whatever is next
+      _timers.advance( now_ms() );
+    },
+    [this] { return not _timers.empty(); } );
+}
+
+int EventLoop::timeout_for_timers( const int timeout_ms )
+{
+  const optional<uint64_t> deadline = _timers.next_deadline();
+
+  if ( _timerfd.has_value() ) {
+    if ( deadline != _timerfd_deadline ) {
+      itimerspec expiry {}; // all zero disarms the timerfd
+      if ( deadline.has_value() ) {
+        expiry.it_value.tv_sec = static_cast<time_t>( deadline.value() / 1000 );
+        // (plus 1 ns, since an all-zero it_value would disarm it instead)
+        expiry.it_value.tv_nsec = static_cast<long>( deadline.value() % 1000 * 1'000'000 + 1 );
+      }
+      CheckSystemCall( "timerfd_settime",
+                       ::timerfd_settime( _timerfd->fd_num(), TFD_TIMER_ABSTIME, &expiry, nullptr ) );
+      _timerfd_deadline = deadline;
+    }
+    return timeout_ms;
+  }
+
+  if ( not deadline.has_value() ) {
+    return timeout_ms;
+  }
+  const uint64_t now = now_ms();
+  const int until_deadline
+    = static_cast<int>( min<uint64_t>( deadline.value() > now ? deadline.value() - now : 0, INT_MAX ) );
+  return timeout_ms < 0 ? until_deadline : min( timeout_ms, until_deadline );
+}
+
+void EventLoop::set_batched( const bool batched, const unsigned max_callbacks_per_rule )
+{
+  if ( max_callbacks_per_rule == 0 ) {
+    throw runtime_error( "EventLoop: max_callbacks_per_rule must be positive" );
+  }
+  _batched = batched;
+  _max_callbacks_per_rule = max_callbacks_per_rule;
+}
+
 // NOLINTBEGIN(*-cognitive-complexity)
 // NOLINTBEGIN(*-signed-bitwise)
 EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
 {
-  // first, handle the non-file-descriptor-related rules
+  // tasks posted since the last call (with an executor)
+  if ( not _posted.empty() ) {
+    run_on_executor( {} );
+  }
+
+  // timers that have come due
+  const bool timers_fired = _timers.advance( now_ms() ) > 0;
+  if ( timers_fired and not _batched ) {
+    return Result::Success;
+  }
+
+  // then the non-file-descriptor-related rules
+  bool any_fired = timers_fired;
+  bool any_unfinished = false; // a rule still interested when its turn (in batched mode) ran out
   {
     for ( auto it = _non_fd_rules.begin(); it != _non_fd_rules.end(); ) {
       auto& this_rule = **it;
@@ -92,27 +267,137 @@ EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
         continue;
       }
 
-      uint8_t iterations = 0;
+      unsigned callbacks = 0;
+      bool unfinished = false;
       while ( this_rule.interest() ) {
-        if ( iterations++ >= 128 ) {
+        if ( _batched and callbacks == _max_callbacks_per_rule ) {
+          unfinished = true; // give the other rules a turn; this one continues on the next call
+          break;
+        }
+
+        if ( this_rule.busy_callbacks++ >= 128 ) {
           throw runtime_error( "EventLoop: busy wait detected: rule \""
                                + _rule_categories.at( this_rule.category_id ).name + "\" is still interested after "
-                               + to_string( iterations ) + " iterations" );
+                               + to_string( this_rule.busy_callbacks ) + " iterations" );
         }
 
         rule_fired = true;
+        ++callbacks;
         this_rule.callback();
       }
 
-      if ( rule_fired ) {
+      if ( not unfinished ) {
+        this_rule.busy_callbacks = 0;
+      }
+
+      if ( rule_fired and not _batched ) {
         return Result::Success; /* only serve one rule on each iteration */
       }
 
+      any_fired |= rule_fired;
+      any_unfinished |= unfinished;
       ++it;
     }
   }
 
-  // now the file-descriptor-related rules. poll any "interested" file descriptors
+  // now the file-descriptor-related rules (without blocking, if there is already something to report),
+  // waking up in time for the next timer
+  const int timers_timeout_ms = timeout_for_timers( timeout_ms );
+  const int fd_timeout_ms = any_fired or any_unfinished ? 0 : timers_timeout_ms;
+  const Result result
+    = _epoll.has_value() or _ring ? wait_registered( fd_timeout_ms ) : wait_poll( fd_timeout_ms );
+  any_fired |= _timers.advance( now_ms() ) > 0;
+  return any_fired ? Result::Success : result;
+}
+
+bool EventLoop::retire( FDRule& rule )
+{
+  if ( rule.cancel_requested ) {
+    //      rule.cancel();
+    //      if rule is cancelled externally, no need to call the cancellation callback
+    //      this makes it easier to cancel rules and delete captured objects right away
+    return true;
+  }
+
+  if ( rule.direction == Direction::In && rule.fd.eof() ) {
+    // no more reading on this rule, it's reached eof
+    rule.cancel();
+    return true;
+  }
+
+  if ( rule.fd.closed() ) {
+    rule.cancel();
+    return true;
+  }
+
+  return false;
+}
+
+EventLoop::Outcome EventLoop::handle_events( const shared_ptr<FDRule>& rule,
+                                             const bool error,
+                                             const bool hangup,
+                                             const bool ready,
+                                             ReadyRules& ready_on_strands )
+{
+  auto& this_rule = *rule;
+
+  if ( error ) {
+    /* see if fd is a socket */
+    int socket_error = 0;
+    socklen_t optlen = sizeof( socket_error );
+    const int ret = getsockopt( this_rule.fd.fd_num(), SOL_SOCKET, SO_ERROR, &socket_error, &optlen );
+    if ( ret == -1 and errno == ENOTSOCK ) {
+      cerr << "error on polled file descriptor for rule \"" << _rule_categories.at( this_rule.category_id ).name
+           << "\"\n";
+    } else if ( ret == -1 ) {
+      throw unix_error( "getsockopt" );
+    } else if ( optlen != sizeof( socket_error ) ) {
+      throw runtime_error( "unexpected length from getsockopt: " + to_string( optlen ) );
+    } else if ( socket_error ) {
+      cerr << "error on polled socket for rule \"" << _rule_categories.at( this_rule.category_id ).name
+           << "\": " << strerror( socket_error ) << "\n";
+    }
+
+    this_rule.error();
+    this_rule.cancel();
+    return Outcome::Erase;
+  }
+
+  if ( hangup && ( ( this_rule.interested && !ready ) or ( this_rule.direction == Direction::Out ) ) ) {
+    // if we asked for the status, and the _only_ condition was a hangup, this FD is defunct:
+    //   - if it was POLLIN and nothing is readable, no more will ever be readable
+    //   - if it was POLLOUT, it will not be writable again
+    // additionally, consider FD defunct if rule will only query for Direction::Out
+    this_rule.cancel();
+    return Outcome::Erase;
+  }
+
+  if ( not ready ) {
+    return Outcome::Idle;
+  }
+
+  if ( _executor and this_rule.strand ) {
+    // runs later, alongside every other strand's callbacks
+    ready_on_strands.emplace_back( rule, this_rule.service_count() );
+    return Outcome::Served;
+  }
+
+  // we only want to call callback if revents includes the event we asked for
+  const auto count_before = this_rule.service_count();
+  this_rule.callback();
+
+  if ( count_before == this_rule.service_count() and ( not this_rule.fd.closed() ) and this_rule.interest() ) {
+    throw runtime_error( "EventLoop: busy wait detected: rule \""
+                         + _rule_categories.at( this_rule.category_id ).name
+                         + "\" did not read/write fd and is still interested" );
+  }
+
+  return Outcome::Served;
+}
+
+EventLoop::Result EventLoop::wait_poll( const int timeout_ms )
+{
+  // poll any "interested" file descriptors
   vector<pollfd> pollfds {};
   pollfds.reserve( _fd_rules.size() );
   bool something_to_poll = false;
@@ -121,28 +406,13 @@ EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
   for ( auto it = _fd_rules.begin(); it != _fd_rules.end(); ) { // NOTE: it gets erased or incremented in loop body
     auto& this_rule = **it;
 
-    if ( this_rule.cancel_requested ) {
-      //      this_rule.cancel();
-      //      if rule is cancelled externally, no need to call the cancellation callback
-      //      this makes it easier to cancel rules and delete captured objects right away
-      it = _fd_rules.erase( it );
-      continue;
-    }
-
-    if ( this_rule.direction == Direction::In && this_rule.fd.eof() ) {
-      // no more reading on this rule, it's reached eof
-      this_rule.cancel();
-      it = _fd_rules.erase( it );
-      continue;
-    }
-
-    if ( this_rule.fd.closed() ) {
-      this_rule.cancel();
+    if ( retire( this_rule ) ) {
       it = _fd_rules.erase( it );
       continue;
     }
 
-    if ( this_rule.interest() ) {
+    this_rule.interested = this_rule.interest();
+    if ( this_rule.interested ) {
       pollfds.push_back( { this_rule.fd.fd_num(),
                            static_cast<int16_t>( this_rule.direction == Direction::In ? POLLIN : POLLOUT ),
                            0 } );
@@ -153,75 +423,262 @@ EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
     ++it;
   }
 
-  // quit if there is nothing left to poll
-  if ( not something_to_poll ) {
+  // quit if there is nothing left to poll (or wait for)
+  if ( not something_to_poll and _timers.empty() ) {
     return Result::Exit;
   }
 
   // call poll -- wait until one of the fds satisfies one of the rules (writeable/readable)
+  ++_poll_count;
   if ( 0 == CheckSystemCall( "poll", ::poll( pollfds.data(), pollfds.size(), timeout_ms ) ) ) {
     return Result::Timeout;
   }
 
-  // go through the poll results
-  for ( auto [it, idx] = make_pair( _fd_rules.begin(), static_cast<size_t>( 0 ) ); it != _fd_rules.end(); ++idx ) {
+  // go through the poll results (rules added by a callback meanwhile were not polled)
+  ReadyRules ready_on_strands;
+  for ( auto [it, idx] = make_pair( _fd_rules.begin(), static_cast<size_t>( 0 ) );
+        it != _fd_rules.end() and idx < pollfds.size();
+        ++idx ) {
     const auto& this_pollfd = pollfds.at( idx );
-    auto& this_rule = **it;
 
-    const auto poll_error = static_cast<bool>( this_pollfd.revents & ( POLLERR | POLLNVAL ) );
-    if ( poll_error ) {
-      /* see if fd is a socket */
-      int socket_error = 0;
-      socklen_t optlen = sizeof( socket_error );
-      const int ret = getsockopt( this_rule.fd.fd_num(), SOL_SOCKET, SO_ERROR, &socket_error, &optlen );
-      if ( ret == -1 and errno == ENOTSOCK ) {
-        cerr << "error on polled file descriptor for rule \"" << _rule_categories.at( this_rule.category_id ).name
-             << "\"\n";
-      } else if ( ret == -1 ) {
-        throw unix_error( "getsockopt" );
-      } else if ( optlen != sizeof( socket_error ) ) {
-        throw runtime_error( "unexpected length from getsockopt: " + to_string( optlen ) );
-      } else if ( socket_error ) {
-        cerr << "error on polled socket for rule \"" << _rule_categories.at( this_rule.category_id ).name
-             << "\": " << strerror( socket_error ) << "\n";
-      }
+    if ( ( *it )->cancel_requested or ( *it )->fd.closed() ) { // by a callback earlier in this round
+      ++it;
+      continue;
+    }
 
-      this_rule.error();
-      this_rule.cancel();
+    const auto outcome = handle_events( *it,
+                                        this_pollfd.revents & ( POLLERR | POLLNVAL ),
+                                        this_pollfd.revents & POLLHUP,
+                                        this_pollfd.revents & this_pollfd.events,
+                                        ready_on_strands );
+    if ( outcome == Outcome::Erase ) {
       it = _fd_rules.erase( it );
       continue;
     }
 
-    const auto poll_ready = static_cast<bool>( this_pollfd.revents & this_pollfd.events );
-    const auto poll_hup = static_cast<bool>( this_pollfd.revents & POLLHUP );
-    if ( poll_hup && ( ( this_pollfd.events && !poll_ready ) or ( this_rule.direction == Direction::Out ) ) ) {
-      // if we asked for the status, and the _only_ condition was a hangup, this FD is defunct:
-      //   - if it was POLLIN and nothing is readable, no more will ever be readable
-      //   - if it was POLLOUT, it will not be writable again
-      // additionally, consider FD defunct if rule will only query for Direction::Out
-      this_rule.cancel();
+    if ( outcome == Outcome::Served and not _executor and not _batched ) {
+      return Result::Success; /* only serve one rule on each iteration */
+    }
+
+    ++it; // if we got here, it means we didn't call _fd_rules.erase()
+  }
+
+  if ( _executor ) {
+    run_on_executor( ready_on_strands );
+  }
+
+  return Result::Success;
+}
+
+EventLoop::Result EventLoop::wait_registered( const int timeout_ms )
+{
+  bool something_to_poll = false;
+
+  // register new rules, drop finished ones, and note whose interest has changed
+  for ( auto it = _fd_rules.begin(); it != _fd_rules.end(); ) { // NOTE: it gets erased or incremented in loop body
+    auto& this_rule = **it;
+
+    if ( retire( this_rule ) ) {
+      forget_registration( *it );
       it = _fd_rules.erase( it );
       continue;
     }
 
-    if ( poll_ready ) {
-      // we only want to call callback if revents includes the event we asked for
-      const auto count_before = this_rule.service_count();
-      this_rule.callback();
-
-      if ( count_before == this_rule.service_count() and ( not this_rule.fd.closed() ) and this_rule.interest() ) {
-        throw runtime_error( "EventLoop: busy wait detected: rule \""
-                             + _rule_categories.at( this_rule.category_id ).name
-                             + "\" did not read/write fd and is still interested" );
+    const bool interested = this_rule.interest();
+    if ( not this_rule.registered or interested != this_rule.interested ) {
+      Registration& registration = _registrations[this_rule.fd.fd_num()];
+      if ( not this_rule.registered ) {
+        registration.rules.push_back( *it );
+        this_rule.registered = true;
+      }
+      this_rule.interested = interested;
+      if ( not registration.dirty ) {
+        registration.dirty = true;
+        _dirty_fds.push_back( this_rule.fd.fd_num() );
       }
-
-      return Result::Success; /* only serve one rule on each iteration */
     }
+    something_to_poll |= interested;
+    ++it;
+  }
 
-    ++it; // if we got here, it means we didn't call _fd_rules.erase()
+  update_registrations();
+
+  // quit if there is nothing left to poll (or wait for)
+  if ( not something_to_poll and _timers.empty() ) {
+    return Result::Exit;
+  }
+
+  // wait until one of the fds satisfies one of the rules (writeable/readable), and serve every ready rule
+  // (rules that finish are erased on the next call)
+  ReadyRules ready_on_strands;
+  ++_poll_count;
+  const bool any_ready
+    = _ring ? wait_ring( timeout_ms, ready_on_strands ) : wait_epoll( timeout_ms, ready_on_strands );
+  if ( not any_ready ) {
+    return Result::Timeout;
+  }
+
+  if ( _executor ) {
+    run_on_executor( ready_on_strands );
   }
 
   return Result::Success;
 }
+
+bool EventLoop::wait_epoll( const int timeout_ms, ReadyRules& ready_on_strands )
+{
+  // (level-triggered, so fds beyond the first MAX_EPOLL_EVENTS are reported again by the next call)
+  array<epoll_event, MAX_EPOLL_EVENTS> events {};
+  const int count = CheckSystemCall(
+    "epoll_wait", ::epoll_wait( _epoll->fd_num(), events.data(), static_cast<int>( events.size() ), timeout_ms ) );
+
+  for ( const auto& event : span { events.data(), static_cast<size_t>( count ) } ) {
+    const auto registration = _registrations.find( event.data.fd );
+    if ( registration != _registrations.end() ) {
+      serve_registration( registration->second, event.events, ready_on_strands );
+    }
+  }
+
+  return count > 0;
+}
+
+// Each poll request's user_data holds its fd (low half) and the tag it was armed with (high half);
+// requests that were removed or belong to an fd's earlier registration complete with a stale tag.
+// (user_data 0 is the completion of a removal, which needs no action.)
+bool EventLoop::wait_ring( const int timeout_ms, ReadyRules& ready_on_strands )
+{
+  _ring->submit( timeout_ms == 0 ? 0 : 1, timeout_ms );
+
+  bool any_ready = false;
+  while ( const auto completion = _ring->pop() ) {
+    if ( completion->user_data == 0 ) {
+      continue;
+    }
+    const int fd_num = static_cast<int>( completion->user_data & UINT32_MAX );
+    const auto registration = _registrations.find( fd_num );
+    if ( registration == _registrations.end()
+         or registration->second.poll_tag != static_cast<uint32_t>( completion->user_data >> 32 ) ) {
+      continue;
+    }
+
+    // the one-shot request is spent, so arm another on the next call
+    Registration& this_registration = registration->second;
+    this_registration.added = false;
+    this_registration.poll_tag = 0;
+    if ( not this_registration.dirty ) {
+      this_registration.dirty = true;
+      _dirty_fds.push_back( fd_num );
+    }
+
+    const auto events = completion->result < 0 ? uint32_t { POLLERR } : static_cast<uint32_t>( completion->result );
+    serve_registration( this_registration, events, ready_on_strands );
+    any_ready = true;
+  }
+
+  return any_ready;
+}
+
+void EventLoop::serve_registration( const Registration& registration,
+                                    const uint32_t events,
+                                    ReadyRules& ready_on_strands )
+{
+  static_assert( EPOLLIN == POLLIN and EPOLLOUT == POLLOUT and EPOLLERR == POLLERR and EPOLLHUP == POLLHUP );
+
+  const vector<shared_ptr<FDRule>> rules = registration.rules; // a callback may add rules for this fd
+  for ( const auto& rule : rules ) {
+    if ( rule->cancel_requested ) {
+      continue;
+    }
+
+    const uint32_t wanted = rule->interested ? epoll_event_for( rule->direction ) : 0;
+    const auto outcome
+      = handle_events( rule, events & EPOLLERR, events & EPOLLHUP, events & wanted, ready_on_strands );
+    if ( outcome == Outcome::Erase ) {
+      rule->cancel_requested = true; // its cancel callback has already run
+    }
+  }
+}
+
+// Remove a rule from its fd's registration (and the fd from the epoll instance or the ring, if that
+// was its last rule)
+void EventLoop::forget_registration( const shared_ptr<FDRule>& rule )
+{
+  if ( not rule->registered ) {
+    return;
+  }
+  rule->registered = false;
+
+  const int fd_num = rule->fd.fd_num();
+  Registration& registration = _registrations.at( fd_num );
+  erase( registration.rules, rule );
+  if ( registration.rules.empty() ) {
+    if ( registration.added and _ring ) {
+      _ring->prepare_poll_remove( static_cast<uint64_t>( registration.poll_tag ) << 32 | fd_num, 0 );
+    } else if ( registration.added ) {
+      // fails harmlessly if the fd has already been closed (which removes it from the epoll instance)
+      ::epoll_ctl( _epoll->fd_num(), EPOLL_CTL_DEL, fd_num, nullptr );
+    }
+    _registrations.erase( fd_num );
+    return;
+  }
+
+  if ( not registration.dirty ) {
+    registration.dirty = true;
+    _dirty_fds.push_back( fd_num );
+  }
+}
+
+// Bring the registration of each dirty fd up to date with its rules' interests (with the ring,
+// the requests are only queued here, and go to the kernel with the next wait)
+void EventLoop::update_registrations()
+{
+  for ( const int fd_num : _dirty_fds ) {
+    const auto it = _registrations.find( fd_num );
+    if ( it == _registrations.end() ) {
+      continue;
+    }
+
+    Registration& registration = it->second;
+    registration.dirty = false;
+    uint32_t events = 0;
+    for ( const auto& rule : registration.rules ) {
+      if ( rule->interested ) {
+        events |= epoll_event_for( rule->direction );
+      }
+    }
+
+    if ( registration.added and events == registration.events ) {
+      continue;
+    }
+
+    if ( _ring ) {
+      if ( registration.added ) {
+        _ring->prepare_poll_remove( static_cast<uint64_t>( registration.poll_tag ) << 32 | fd_num, 0 );
+        registration.added = false;
+        registration.poll_tag = 0;
+      }
+      if ( events != 0 ) {
+        registration.poll_tag = _next_poll_tag++;
+        if ( _next_poll_tag == 0 ) {
+          _next_poll_tag = 1;
+        }
+        _ring->prepare_poll_add( fd_num, events, static_cast<uint64_t>( registration.poll_tag ) << 32 | fd_num );
+        registration.added = true;
+      }
+      registration.events = events;
+      continue;
+    }
+
+    epoll_event event {};
+    event.events = events;
+    event.data.fd = fd_num;
+    CheckSystemCall(
+      "epoll_ctl",
+      ::epoll_ctl( _epoll->fd_num(), registration.added ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd_num, &event ) );
+    registration.events = events;
+    registration.added = true;
+  }
+  _dirty_fds.clear();
+}
 // NOLINTEND(*-signed-bitwise)
 // NOLINTEND(*-cognitive-complexity)
@@ -1,11 +1,18 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
 #include <list>
 #include <memory>
+#include <optional>
 #include <poll.h>
+#include <unordered_map>
+#include <vector>
 
 #include "file_descriptor.hh"
+#include "io_uring.hh"
+#include "timer_wheel.hh"
+#include "work_stealing_executor.hh"
 
 //! Waits for events on file descriptors and executes corresponding callbacks.
 class EventLoop
@@ -18,6 +25,26 @@ public:
     Out // Callback will be triggered when Rule::fd is writable.
   };
 
+  //! Returned by each call to EventLoop::wait_next_event.
+  enum class Result : uint8_t
+  {
+    Success, //!< At least one Rule was triggered.
+    Timeout, //!< No rules were triggered before timeout.
+    Exit     //!< All rules have been canceled or were uninterested, and no timer is pending; make no
+             //!< further calls to EventLoop::wait_next_event.
+  };
+
+  //! How wait_next_event() waits for the rules' file descriptors
+  enum class Backend : uint8_t
+  {
+    Poll, //!< Build a pollfd for every rule, call poll(2), and serve the first ready rule (see set_batched)
+    Epoll,  //!< Register each fd with epoll(7) once (re-registering it only when a rule's interest
+            //!< changes), and serve every rule that one epoll_wait(2) reports ready
+    IoUring //!< Keep a one-shot poll request in an io_uring(7) for each fd, re-armed (along with any
+            //!< changes of interest) by the same io_uring_enter(2) that waits for the next completions,
+            //!< and serve every rule whose fd completed; falls back to Poll without io_uring support
+  };
+
 private:
   using CallbackT = std::function<void( void )>;
   using InterestT = std::function<bool( void )>;
@@ -33,6 +60,8 @@ private:
     InterestT interest;
     CallbackT callback;
     bool cancel_requested {};
+    unsigned busy_callbacks {}; //!< Callbacks in a row that left a non-fd rule still interested
+    std::shared_ptr<WorkStealingExecutor::Strand> strand {}; //!< Where the callback runs (see set_executor)
 
     BasicRule( size_t s_category_id, InterestT s_interest, CallbackT s_callback );
   };
@@ -43,6 +72,8 @@ private:
     Direction direction; //!< Direction::In for reading from fd, Direction::Out for writing to fd.
     CallbackT cancel;    //!< A callback that is called when the rule is cancelled (e.g. on EOF or hangup)
     CallbackT error;     //!< A callback that is called when the fd has an error before cancellation
+    bool interested {};  //!< Whether fd was polled for the rule's direction (as of the last wait)
+    bool registered {};  //!< With Backend::Epoll or IoUring: whether the rule is part of its fd's registration
 
     FDRule( BasicRule&& base, FileDescriptor&& s_fd, Direction s_direction, CallbackT s_cancel, CallbackT s_error );
 
@@ -55,18 +86,90 @@ private:
   std::list<std::shared_ptr<FDRule>> _fd_rules {};
   std::list<std::shared_ptr<BasicRule>> _non_fd_rules {};
 
-public:
-  EventLoop() { _rule_categories.reserve( 64 ); }
+  //! With Backend::Epoll or IoUring: the rules that watch one fd, and the events it is registered for
+  struct Registration
+  {
+    std::vector<std::shared_ptr<FDRule>> rules {};
+    uint32_t events {};
+    bool added {};        //!< Has the fd been added to the epoll instance (or has a poll request in the ring)?
+    bool dirty {};        //!< Has a rule been added or removed, or changed its interest, since the last update?
+    uint32_t poll_tag {}; //!< With Backend::IoUring: tells the poll request in flight from earlier ones
+  };
 
-  //! Returned by each call to EventLoop::wait_next_event.
-  enum class Result : uint8_t
+  std::optional<FileDescriptor> _epoll {}; //!< The epoll instance (with Backend::Epoll)
+  std::unique_ptr<::IoUring> _ring {};     //!< The ring of poll requests (with Backend::IoUring)
+  uint32_t _next_poll_tag { 1 };
+  std::unordered_map<int, Registration> _registrations {};
+  std::vector<int> _dirty_fds {}; //!< fds whose Registration is dirty
+  static constexpr size_t MAX_EPOLL_EVENTS = 256; //!< Ready fds collected by one epoll_wait
+  static constexpr unsigned RING_ENTRIES = 256;   //!< Poll requests queued in the ring before it is submitted
+
+  //! What became of a rule once the events reported for its fd were handled
+  enum class Outcome : uint8_t
   {
-    Success, //!< At least one Rule was triggered.
-    Timeout, //!< No rules were triggered before timeout.
-    Exit     //!< All rules have been canceled or were uninterested; make no further calls to
-             //!< EventLoop::wait_next_event.
+    Idle,   //!< Its fd was not ready
+    Served, //!< The callback ran (or, with an executor, was queued to run)
+    Erase   //!< The fd had an error or hung up, and the rule was cancelled
   };
 
+  using ReadyRules = std::vector<std::pair<std::shared_ptr<FDRule>, unsigned int>>;
+
+  //! Should `rule` be dropped before polling? (It was cancelled, or its fd reached EOF or was closed.)
+  static bool retire( FDRule& rule );
+
+  //! Act on the events reported for `rule`'s fd
+  Outcome handle_events( const std::shared_ptr<FDRule>& rule,
+                         bool error,
+                         bool hangup,
+                         bool ready,
+                         ReadyRules& ready_on_strands );
+
+  Result wait_poll( int timeout_ms );
+  Result wait_registered( int timeout_ms );
+  void forget_registration( const std::shared_ptr<FDRule>& rule );
+  void update_registrations();
+
+  //! Serve the rules of a registered fd, given the events reported for it
+  void serve_registration( const Registration& registration, uint32_t events, ReadyRules& ready_on_strands );
+
+  //! Wait on the epoll instance, serving every ready rule; returns whether any fd was ready
+  bool wait_epoll( int timeout_ms, ReadyRules& ready_on_strands );
+
+  //! Submit the ring's poll requests and wait for completions, serving every ready rule; returns
+  //! whether any fd was ready
+  bool wait_ring( int timeout_ms, ReadyRules& ready_on_strands );
+
+  bool _batched {};        //!< Serve every ready rule per wait_next_event() (see set_batched)
+  uint64_t _poll_count {}; //!< poll(2), epoll_wait(2) or io_uring_enter(2) waits so far
+  unsigned _max_callbacks_per_rule { DEFAULT_MAX_CALLBACKS_PER_RULE };
+
+  TimerWheel _timers { now_ms() };
+  std::optional<FileDescriptor> _timerfd {}; //!< Wakes the loop for timers, if set_timerfd() chose one
+  std::optional<uint64_t> _timerfd_deadline {}; //!< When _timerfd is armed to expire
+
+  //! The steady clock, in milliseconds
+  static uint64_t now_ms();
+
+  //! The poll timeout that also wakes the loop for the next timer (or arms the timerfd instead)
+  int timeout_for_timers( int timeout_ms );
+
+  WorkStealingExecutor* _executor {};
+  std::vector<std::pair<std::shared_ptr<WorkStealingExecutor::Strand>, CallbackT>> _posted {};
+
+  //! Hand `ready` rules' callbacks, and every posted task, to the executor, and wait for them to finish
+  void run_on_executor( const ReadyRules& ready );
+
+public:
+  explicit EventLoop( Backend backend = Backend::Poll );
+  ~EventLoop() = default;
+  EventLoop( const EventLoop& other ) = delete;
+  EventLoop& operator=( const EventLoop& other ) = delete;
+  EventLoop( EventLoop&& other ) = delete; // the timerfd's rule refers to this EventLoop
+  EventLoop& operator=( EventLoop&& other ) = delete;
+
+  //! Switch to waiting with `backend` (see Backend); call before adding any rule or choosing a timerfd
+  void set_backend( Backend backend );
+
   size_t add_category( const std::string& name );
 
   class RuleHandle
@@ -79,6 +182,9 @@ public:
     {}
 
     void cancel();
+
+    //! Run the rule's callback on `strand` when the EventLoop has an executor (see set_executor)
+    void set_strand( std::shared_ptr<WorkStealingExecutor::Strand> strand );
   };
 
   RuleHandle add_rule(
@@ -93,9 +199,52 @@ public:
   RuleHandle
   add_rule( size_t category_id, const CallbackT& callback, const InterestT& interest = [] { return true; } );
 
+  //! Default bound on a non-fd rule's callbacks per wait_next_event() in batched mode
+  static constexpr unsigned DEFAULT_MAX_CALLBACKS_PER_RULE = 16;
+
   //! Calls [poll(2)](\ref man2::poll) and then executes callback for each ready fd.
   Result wait_next_event( int timeout_ms );
 
+  //! \brief Serve every ready rule on each call to wait_next_event(), instead of only the first
+  //! \details In batched mode, each non-fd rule runs (while interested) at most `max_callbacks_per_rule`
+  //! times per call before the next rule gets its turn, and every fd rule that the same poll reports
+  //! ready is served once. A rule left interested at the end of its turn runs again on the next call,
+  //! which then polls without blocking. Busy waits are detected as before.
+  void set_batched( bool batched, unsigned max_callbacks_per_rule = DEFAULT_MAX_CALLBACKS_PER_RULE );
+
+  //! Number of [poll(2)](\ref man2::poll) (or epoll_wait, or io_uring_enter) waits made so far
+  uint64_t poll_count() const { return _poll_count; }
+
+  using TimerId = TimerWheel::TimerId;
+
+  //! \brief Call `callback` once, from wait_next_event(), when `delay_ms` milliseconds have passed
+  //! \details wait_next_event() shortens its timeout to wake up for the earliest timer, and keeps
+  //! waiting while a timer is pending even if no rule is interested.
+  TimerId add_timer( uint64_t delay_ms, const CallbackT& callback );
+
+  //! Forget a timer that has not fired yet (returns whether there was one; 0 is never a timer)
+  bool cancel_timer( TimerId id ) { return _timers.cancel( id ); }
+
+  //! Milliseconds until the earliest timer is due (0 if it is overdue), if any timer is pending
+  std::optional<uint64_t> ms_until_next_timer() const;
+
+  //! \brief Wake up for timers with a [timerfd](\ref man2::timerfd_create) polled alongside the rules,
+  //! instead of by shortening the poll timeout
+  void set_timerfd( bool use_timerfd );
+
+  //! \brief Run the callbacks of rules that have a strand on `executor`'s workers (or, given nullptr, inline)
+  //! \details With an executor, wait_next_event() serves every ready fd rule, not just the first.
+  //! Rules without a strand run inline, first; then the callbacks of ready rules with a strand, and
+  //! the tasks posted meanwhile, run in parallel (one at a time per strand), and wait_next_event()
+  //! returns when they have all finished. So interests, and rules without a strand, never run
+  //! concurrently with a callback on the executor.
+  void set_executor( WorkStealingExecutor* executor ) { _executor = executor; }
+
+  //! \brief Run `task` on `strand` (or right away, without an executor)
+  //! \details Tasks posted from a callback run with this round's callbacks; tasks posted from
+  //! outside wait_next_event() run at the start of the next call.
+  void post( std::shared_ptr<WorkStealingExecutor::Strand> strand, CallbackT task );
+
   // convenience function to add category and rule at the same time
   template<typename... Targs>
   auto add_rule( const std::string& name, Targs&&... Fargs )
@@ -2,6 +2,9 @@
 
 #include "tcp_config.hh"
 
+#include <cstdint>
+#include <optional>
+
 //! \brief Basic functionality for file descriptor adaptors
 //! \details See TCPOverIPv4OverTunFdAdapter for more information.
 class FdAdapterBase
@@ -32,4 +35,7 @@ public:
 
   //! Called periodically when time elapses
   void tick( const size_t unused [[maybe_unused]] ) {}
+
+  //! Milliseconds until tick() next has work to do, if ever (never, for a plain adapter)
+  std::optional<uint64_t> next_deadline() const { return {}; }
 };
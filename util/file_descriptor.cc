@@ -176,12 +176,16 @@ size_t FileDescriptor::write( const vector<string_view>& buffers )
 
   const ssize_t bytes_written
     = CheckSystemCall( "writev", ::writev( fd_num(), iovecs.data(), static_cast<int>( iovecs.size() ) ) );
-  register_write();
 
   if ( bytes_written == 0 and total_size != 0 ) {
+    if ( internal_fd_->non_blocking_ ) {
+      return 0; // (EAGAIN: no room to write anything yet)
+    }
     throw runtime_error( "write returned 0 given non-empty input buffer" );
   }
 
+  register_write();
+
   if ( bytes_written > static_cast<ssize_t>( total_size ) ) {
     throw runtime_error( "write wrote more than length of input buffer" );
   }
@@ -0,0 +1,255 @@
+#include "io_uring.hh"
+#include "exception.hh"
+
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+atomic<uint64_t> IoUring::_total_enters { 0 };
+
+namespace {
+constexpr uint32_t REQUIRED_FEATURES
+  = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG | IORING_FEAT_FAST_POLL;
+
+// io_uring_setup(2), which has no libc wrapper
+int io_uring_setup( const unsigned entries, io_uring_params& params )
+{
+  return static_cast<int>( ::syscall( SYS_io_uring_setup, entries, &params ) );
+}
+
+// A field of the rings, at `offset` bytes from the start of their mapping
+template<typename T>
+T* at_offset( void* base, const uint32_t offset )
+{
+  return reinterpret_cast<T*>( static_cast<char*>( base ) + offset ); // NOLINT(*-reinterpret-cast)
+}
+
+unsigned load_acquire( unsigned* x )
+{
+  return atomic_ref<unsigned> { *x }.load( memory_order_acquire );
+}
+
+void store_release( unsigned* x, const unsigned value )
+{
+  atomic_ref<unsigned> { *x }.store( value, memory_order_release );
+}
+} // namespace
+
+IoUring::IoUring( const unsigned entries ) : IoUring( entries, io_uring_params {} ) {}
+
+IoUring::IoUring( const unsigned entries, io_uring_params&& params )
+  : FileDescriptor( ::CheckSystemCall( "io_uring_setup", io_uring_setup( entries, params ) ) )
+{
+  if ( ( params.features & REQUIRED_FEATURES ) != REQUIRED_FEATURES ) {
+    throw runtime_error( "io_uring: kernel lacks required features" );
+  }
+
+  _rings.length = max( params.sq_off.array + params.sq_entries * sizeof( unsigned ),
+                       params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe ) );
+  _rings.address = ::mmap(
+    nullptr, _rings.length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_num(), IORING_OFF_SQ_RING );
+  if ( _rings.address == MAP_FAILED ) {
+    _rings = {};
+    throw unix_error( "mmap" );
+  }
+
+  _sqes.length = params.sq_entries * sizeof( io_uring_sqe );
+  _sqes.address
+    = ::mmap( nullptr, _sqes.length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_num(), IORING_OFF_SQES );
+  if ( _sqes.address == MAP_FAILED ) {
+    ::munmap( _rings.address, _rings.length );
+    _rings = _sqes = {};
+    throw unix_error( "mmap" );
+  }
+
+  _sq_head = at_offset<unsigned>( _rings.address, params.sq_off.head );
+  _sq_tail_shared = at_offset<unsigned>( _rings.address, params.sq_off.tail );
+  _sq_array = at_offset<unsigned>( _rings.address, params.sq_off.array );
+  _sq_mask = *at_offset<unsigned>( _rings.address, params.sq_off.ring_mask );
+  _sq_entries = params.sq_entries;
+  _sq_entries_array = static_cast<io_uring_sqe*>( _sqes.address );
+  _sq_tail = _sq_submitted = *_sq_tail_shared;
+
+  _cq_head = at_offset<unsigned>( _rings.address, params.cq_off.head );
+  _cq_tail = at_offset<unsigned>( _rings.address, params.cq_off.tail );
+  _cq_mask = *at_offset<unsigned>( _rings.address, params.cq_off.ring_mask );
+  _cqes = at_offset<io_uring_cqe>( _rings.address, params.cq_off.cqes );
+
+  // each slot of the queue always names the entry of the same index
+  for ( unsigned i = 0; i < _sq_entries; ++i ) {
+    _sq_array[i] = i; // NOLINT(*-pointer-arithmetic)
+  }
+}
+
+IoUring::~IoUring()
+{
+  for ( const Mapping& mapping : { _sqes, _rings } ) {
+    if ( mapping.address ) {
+      ::munmap( mapping.address, mapping.length );
+    }
+  }
+}
+
+bool IoUring::available()
+{
+  static const bool supported = [] {
+    try {
+      const IoUring probe { 2 };
+      return true;
+    } catch ( const exception& ) {
+      return false;
+    }
+  }();
+  return supported;
+}
+
+io_uring_sqe& IoUring::next_sqe()
+{
+  if ( _sq_tail - load_acquire( _sq_head ) == _sq_entries ) {
+    submit();
+    if ( _sq_tail - load_acquire( _sq_head ) == _sq_entries ) {
+      throw runtime_error( "io_uring: submission queue is full" );
+    }
+  }
+
+  io_uring_sqe& sqe = _sq_entries_array[_sq_tail & _sq_mask]; // NOLINT(*-pointer-arithmetic)
+  sqe = {};
+  ++_sq_tail;
+  return sqe;
+}
+
+void IoUring::prepare_poll_add( const int fd, const uint32_t poll_events, const uint64_t user_data )
+{
+  io_uring_sqe& sqe = next_sqe();
+  sqe.opcode = IORING_OP_POLL_ADD;
+  sqe.fd = fd;
+  sqe.poll32_events = poll_events;
+  sqe.user_data = user_data;
+}
+
+void IoUring::prepare_poll_remove( const uint64_t target_user_data, const uint64_t user_data )
+{
+  io_uring_sqe& sqe = next_sqe();
+  sqe.opcode = IORING_OP_POLL_REMOVE;
+  sqe.fd = -1;
+  sqe.addr = target_user_data;
+  sqe.user_data = user_data;
+}
+
+void IoUring::prepare_read_fixed( const int fd,
+                                  const span<char> buffer,
+                                  const uint16_t buffer_index,
+                                  const uint64_t user_data )
+{
+  io_uring_sqe& sqe = next_sqe();
+  sqe.opcode = IORING_OP_READ_FIXED;
+  sqe.fd = fd;
+  sqe.off = -1ULL; // the file's current position (which a TUN device or socket ignores)
+  sqe.addr = reinterpret_cast<uint64_t>( buffer.data() ); // NOLINT(*-reinterpret-cast)
+  sqe.len = static_cast<uint32_t>( buffer.size() );
+  sqe.buf_index = buffer_index;
+  sqe.user_data = user_data;
+}
+
+void IoUring::prepare_write_fixed( const int fd,
+                                   const span<const char> buffer,
+                                   const uint16_t buffer_index,
+                                   const uint64_t user_data )
+{
+  io_uring_sqe& sqe = next_sqe();
+  sqe.opcode = IORING_OP_WRITE_FIXED;
+  sqe.fd = fd;
+  sqe.off = -1ULL;
+  sqe.addr = reinterpret_cast<uint64_t>( buffer.data() ); // NOLINT(*-reinterpret-cast)
+  sqe.len = static_cast<uint32_t>( buffer.size() );
+  sqe.buf_index = buffer_index;
+  sqe.user_data = user_data;
+}
+
+int IoUring::enter( const unsigned to_submit,
+                    const unsigned min_complete,
+                    const unsigned flags,
+                    const void* arg,
+                    const size_t arg_size )
+{
+  _total_enters.fetch_add( 1, memory_order_relaxed );
+  return static_cast<int>(
+    ::syscall( SYS_io_uring_enter, fd_num(), to_submit, min_complete, flags, arg, arg_size ) );
+}
+
+bool IoUring::submit( const unsigned wait_for, const int timeout_ms )
+{
+  const unsigned to_submit = queued();
+  if ( to_submit == 0 and wait_for == 0 ) {
+    return true;
+  }
+  store_release( _sq_tail_shared, _sq_tail );
+
+  __kernel_timespec timeout {};
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_nsec = static_cast<long long>( timeout_ms % 1000 ) * 1'000'000;
+  io_uring_getevents_arg arg {};
+  arg.sigmask_sz = _NSIG / 8;
+  arg.ts = timeout_ms < 0 ? 0 : reinterpret_cast<uint64_t>( &timeout ); // NOLINT(*-reinterpret-cast)
+
+  const bool waiting = wait_for > 0;
+  const unsigned flags = waiting ? IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG : 0;
+  const int ret = enter( to_submit, wait_for, flags, waiting ? &arg : nullptr, waiting ? sizeof( arg ) : 0 );
+
+  // whatever the kernel took from the queue has been submitted, even if the wait then failed
+  _sq_submitted = load_acquire( _sq_head );
+
+  if ( ret < 0 ) {
+    if ( errno == ETIME or errno == EINTR ) {
+      return false;
+    }
+    throw unix_error( "io_uring_enter" );
+  }
+  return true;
+}
+
+optional<IoUring::Completion> IoUring::peek() const
+{
+  const unsigned head = *_cq_head;
+  if ( head == load_acquire( _cq_tail ) ) {
+    return {};
+  }
+  const io_uring_cqe& cqe = _cqes[head & _cq_mask]; // NOLINT(*-pointer-arithmetic)
+  return Completion { .user_data = cqe.user_data, .result = cqe.res, .flags = cqe.flags };
+}
+
+optional<IoUring::Completion> IoUring::pop()
+{
+  const optional<Completion> completion = peek();
+  if ( completion.has_value() ) {
+    store_release( _cq_head, *_cq_head + 1 );
+    register_read();
+  }
+  return completion;
+}
+
+void IoUring::collect()
+{
+  store_release( _sq_tail_shared, _sq_tail );
+  const int ret = enter( queued(), 0, IORING_ENTER_GETEVENTS, nullptr, 0 );
+  _sq_submitted = load_acquire( _sq_head );
+  if ( ret < 0 and errno != EINTR ) {
+    throw unix_error( "io_uring_enter" );
+  }
+}
+
+void IoUring::register_buffers( const span<const iovec> buffers )
+{
+  const auto count = static_cast<unsigned>( buffers.size() );
+  ::CheckSystemCall(
+    "io_uring_register",
+    static_cast<int>(
+      ::syscall( SYS_io_uring_register, fd_num(), IORING_REGISTER_BUFFERS, buffers.data(), count ) ) );
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "file_descriptor.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <optional>
+#include <span>
+#include <sys/uio.h>
+
+//! \brief An [io_uring](\ref man7::io_uring) instance, set up and driven with raw system calls
+//! \details The submission and completion queues are shared with the kernel, so queueing a request
+//! and collecting a completion cost no system call; submit() hands every queued request to the
+//! kernel (and can wait for completions) in one [io_uring_enter(2)](\ref man2::io_uring_enter).
+//! The ring's own file descriptor is readable while completions are waiting, so an EventLoop can
+//! poll it; each completion taken with pop() counts as one read of it.
+class IoUring : public FileDescriptor
+{
+public:
+  //! One completed request
+  struct Completion
+  {
+    uint64_t user_data {}; //!< As given to the request
+    int32_t result {};     //!< The operation's return value, or -errno
+    uint32_t flags {};
+  };
+
+  //! Set up a ring with room for `entries` queued requests (and twice as many completions)
+  explicit IoUring( unsigned entries );
+
+  //! \brief Whether this kernel supports the io_uring features used here
+  //! \details (Single-mmap rings, no dropped completions, waits with a timeout, and fast poll: Linux 5.11.)
+  static bool available();
+
+  //! \name Queue a request (submitted by the next submit(), or by this call if the queue is full)
+  //!@{
+  void prepare_poll_add( int fd, uint32_t poll_events, uint64_t user_data );
+  void prepare_poll_remove( uint64_t target_user_data, uint64_t user_data );
+  void prepare_read_fixed( int fd, std::span<char> buffer, uint16_t buffer_index, uint64_t user_data );
+  void prepare_write_fixed( int fd, std::span<const char> buffer, uint16_t buffer_index, uint64_t user_data );
+  //!@}
+
+  //! \brief Submit every queued request, and wait for at least `wait_for` completions (or for `timeout_ms`
+  //! milliseconds, if it is not negative)
+  //! \returns false if the wait timed out (or was interrupted by a signal)
+  bool submit( unsigned wait_for = 0, int timeout_ms = -1 );
+
+  //! Requests queued but not yet submitted
+  unsigned queued() const { return _sq_tail - _sq_submitted; }
+
+  //! Take the oldest completion, if there is one
+  std::optional<Completion> pop();
+
+  //! \brief Have the kernel post the completions it has finished but not yet queued
+  //! \details (It may hold them back until this thread next enters the kernel; the ring is readable meanwhile.)
+  void collect();
+
+  //! Look at the oldest completion without taking it
+  std::optional<Completion> peek() const;
+
+  //! Pin `buffers` in the kernel for prepare_read_fixed() and prepare_write_fixed() (indexed in order)
+  void register_buffers( std::span<const iovec> buffers );
+
+  //! io_uring_enter calls made by every IoUring in this process
+  static uint64_t total_enter_count() { return _total_enters.load( std::memory_order_relaxed ); }
+
+  ~IoUring();
+  IoUring( const IoUring& other ) = delete;
+  IoUring& operator=( const IoUring& other ) = delete;
+  IoUring( IoUring&& other ) = delete;
+  IoUring& operator=( IoUring&& other ) = delete;
+
+private:
+  //! A region of the ring mapped into this process
+  struct Mapping
+  {
+    void* address {};
+    size_t length {};
+  };
+
+  Mapping _rings {}; //!< The submission and completion queue rings (one mapping)
+  Mapping _sqes {};  //!< The submission queue entries
+
+  unsigned* _sq_head {};
+  unsigned* _sq_tail_shared {};
+  unsigned* _sq_array {};
+  unsigned _sq_mask {};
+  unsigned _sq_entries {};
+  io_uring_sqe* _sq_entries_array {};
+  unsigned _sq_tail {};      //!< Our tail (published to the kernel by submit())
+  unsigned _sq_submitted {}; //!< How much of the queue has been handed to the kernel
+
+  unsigned* _cq_head {};
+  unsigned* _cq_tail {};
+  unsigned _cq_mask {};
+  io_uring_cqe* _cqes {};
+
+  static std::atomic<uint64_t> _total_enters;
+
+  IoUring( unsigned entries, io_uring_params&& params );
+
+  //! A zeroed entry at the tail of the submission queue (submitting the queue first, if it is full)
+  io_uring_sqe& next_sqe();
+
+  //! io_uring_enter, counted
+  int enter( unsigned to_submit, unsigned min_complete, unsigned flags, const void* arg, size_t arg_size );
+};
@@ -114,6 +114,36 @@ void IPv4Header::compute_checksum()
   cksum = check.value();
 }
 
+void IPv4Header::set_ttl( const uint8_t new_ttl )
+{
+  // the TTL shares its 16-bit word with the protocol
+  cksum = InternetChecksum::adjust( cksum, ( ttl << 8 ) | proto, ( new_ttl << 8 ) | proto );
+  ttl = new_ttl;
+}
+
+namespace {
+
+// An address's two 16-bit words, adjusted one at a time
+uint16_t adjust_for_address( uint16_t cksum, const uint32_t old_address, const uint32_t new_address )
+{
+  cksum = InternetChecksum::adjust( cksum, old_address >> 16, new_address >> 16 );
+  return InternetChecksum::adjust( cksum, old_address & 0xffff, new_address & 0xffff );
+}
+
+} // namespace
+
+void IPv4Header::set_src( const uint32_t new_src )
+{
+  cksum = adjust_for_address( cksum, src, new_src );
+  src = new_src;
+}
+
+void IPv4Header::set_dst( const uint32_t new_dst )
+{
+  cksum = adjust_for_address( cksum, dst, new_dst );
+  dst = new_dst;
+}
+
 string IPv4Header::to_string() const
 {
   stringstream ss {};
@@ -57,6 +57,12 @@ struct IPv4Header
   // Set checksum to correct value
   void compute_checksum();
 
+  // Change one field, adjusting the checksum to match in constant time (RFC 1624) rather than summing the
+  // whole header again, as forwarding (the TTL) and address translation (the addresses) do
+  void set_ttl( uint8_t new_ttl );
+  void set_src( uint32_t new_src );
+  void set_dst( uint32_t new_dst );
+
   // Return a string containing a header in human-readable format
   std::string to_string() const;
 
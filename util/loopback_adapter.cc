@@ -0,0 +1,99 @@
+#include "loopback_adapter.hh"
+#include "exception.hh"
+
+#include <string>
+#include <string_view>
+#include <sys/eventfd.h>
+
+using namespace std;
+
+namespace {
+
+//! Make sure a Ref owns its object (so that it can outlive whatever it borrowed from)
+template<class T>
+void own( Ref<T>& ref )
+{
+  if ( ref.is_borrowed() ) {
+    ref = Ref<T> { T { ref.get() } };
+  }
+}
+
+} // namespace
+
+LoopbackAdapter::ReadyFD::ReadyFD() : FileDescriptor( ::CheckSystemCall( "eventfd", ::eventfd( 0, EFD_CLOEXEC ) ) )
+{
+  set_blocking( false );
+}
+
+LoopbackAdapter::Channel::Channel( const size_t capacity ) : ring( capacity ), ready() {}
+
+LoopbackAdapter::LoopbackAdapter( shared_ptr<Channel> inbound, shared_ptr<Channel> outbound )
+  : _inbound( move( inbound ) ), _outbound( move( outbound ) )
+{}
+
+pair<LoopbackAdapter, LoopbackAdapter> LoopbackAdapter::make_pair( const size_t capacity )
+{
+  auto a_to_b = make_shared<Channel>( capacity );
+  auto b_to_a = make_shared<Channel>( capacity );
+  return { LoopbackAdapter { b_to_a, a_to_b }, LoopbackAdapter { a_to_b, b_to_a } };
+}
+
+optional<TCPMessage> LoopbackAdapter::read()
+{
+  vector<TCPMessage> segments;
+  read_batch( segments, 1 );
+  if ( segments.empty() ) {
+    return {};
+  }
+  return move( segments.front() );
+}
+
+size_t LoopbackAdapter::read_batch( vector<TCPMessage>& segments, const size_t max_datagrams )
+{
+  size_t count = 0;
+  while ( count < max_datagrams ) {
+    auto msg = _inbound->ring.pop();
+    if ( not msg.has_value() ) {
+      break;
+    }
+    segments.push_back( move( msg.value() ) );
+    ++count;
+  }
+
+  // once the ring is empty, the eventfd should stop being readable -- unless a message arrived just
+  // before it was cleared (its writer, having found the ring empty, signalled the eventfd)
+  if ( _inbound->ring.empty() ) {
+    string counter;
+    _inbound->ready.read( counter );
+    if ( not _inbound->ring.empty() ) {
+      const uint64_t one = 1;
+      _inbound->ready.write( { reinterpret_cast<const char*>( &one ), sizeof( one ) } ); // NOLINT(*-cast)
+    }
+  } else if ( count > 0 ) {
+    _inbound->ready.count_read(); // the eventfd stays readable, but this call did take input
+  }
+
+  if ( listening() and count > 0 ) {
+    set_listening( false );
+  }
+  return count;
+}
+
+void LoopbackAdapter::write( const TCPMessage& seg )
+{
+  write( TCPMessage { seg } );
+}
+
+void LoopbackAdapter::write( TCPMessage&& seg )
+{
+  own( seg.sender );
+  own( seg.receiver );
+  if ( not _outbound->ring.push( move( seg ) ) ) {
+    ++_outbound->dropped;
+    return;
+  }
+  if ( _outbound->ring.was_empty() ) {
+    const uint64_t one = 1;
+    _outbound->ready.write( { reinterpret_cast<const char*>( &one ), sizeof( one ) } ); // NOLINT(*-cast)
+  }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "fd_adapter.hh"
+#include "file_descriptor.hh"
+#include "spsc_ring.hh"
+#include "tcp_segment.hh"
+#include "tuntap_adapter.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+//! \brief A FD adapter connected to another in the same process, passing TCPMessages without serializing
+//! \details Each direction is an SPSCRing of messages (moved in by the writer's TCPPeer thread, and out by
+//! the reader's), with an eventfd that is readable while that ring has messages waiting. The writer
+//! signals the eventfd only when its message lands on an empty ring. There are no headers, checksums, or
+//! addresses: whatever one end writes, the other reads. A message written to a full ring is dropped,
+//! as a full device queue would drop a datagram.
+class LoopbackAdapter : public FdAdapterBase
+{
+public:
+  //! Messages each direction holds unless asked otherwise
+  static constexpr size_t DEFAULT_CAPACITY = 1024;
+
+  //! Two adapters, each reading what the other writes (`capacity` a power of two)
+  static std::pair<LoopbackAdapter, LoopbackAdapter> make_pair( size_t capacity = DEFAULT_CAPACITY );
+
+  //! Datagrams taken by one read_batch() unless asked otherwise
+  static constexpr size_t DEFAULT_BATCH_SIZE = 64;
+
+  //! Take the next message the other end wrote, if there is one
+  std::optional<TCPMessage> read();
+
+  //! \brief Take up to `max_datagrams` of the messages the other end wrote, appending them to `segments`
+  //! \returns the number of messages taken
+  size_t read_batch( std::vector<TCPMessage>& segments, size_t max_datagrams = DEFAULT_BATCH_SIZE );
+
+  //! Pass a copy of a message to the other end
+  void write( const TCPMessage& seg );
+
+  //! Pass a message to the other end (copying only what it borrows)
+  void write( TCPMessage&& seg );
+
+  //! Readable while messages from the other end are waiting
+  FileDescriptor& fd() { return _inbound->ready; }
+
+  //! Messages this end has written that were dropped because the ring was full
+  uint64_t dropped() const { return _outbound->dropped; }
+
+private:
+  //! An eventfd that can count messages taken off the ring as reads, so the EventLoop sees the rule served
+  class ReadyFD : public FileDescriptor
+  {
+  public:
+    ReadyFD();
+    void count_read() { register_read(); }
+  };
+
+  //! One direction: the messages, and the eventfd that says some are waiting
+  struct Channel
+  {
+    explicit Channel( size_t capacity );
+
+    SPSCRing<TCPMessage> ring;
+    ReadyFD ready;
+    uint64_t dropped {}; //!< (written only by the writer)
+  };
+
+  LoopbackAdapter( std::shared_ptr<Channel> inbound, std::shared_ptr<Channel> outbound );
+
+  std::shared_ptr<Channel> _inbound;
+  std::shared_ptr<Channel> _outbound;
+};
+
+static_assert( TCPDatagramAdapter<LoopbackAdapter> );
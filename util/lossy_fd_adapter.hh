@@ -5,9 +5,12 @@
 #include "tcp_config.hh"
 #include "tcp_segment.hh"
 
+#include <algorithm>
+#include <cstddef>
 #include <optional>
 #include <random>
 #include <utility>
+#include <vector>
 
 //! An adapter class that adds random dropping behavior to an FD adapter
 template<typename AdapterT>
@@ -49,6 +52,22 @@ public:
     return ret;
   }
 
+  //! \brief Read a batch from the underlying AdapterT instance (for adapters that read in batches),
+  //! potentially dropping each of the segments read
+  //! \returns the number of datagrams the underlying AdapterT read
+  size_t read_batch( std::vector<TCPMessage>& segments, size_t max_datagrams = AdapterT::DEFAULT_BATCH_SIZE )
+    requires requires( AdapterT& a, std::vector<TCPMessage>& s ) { a.read_batch( s, 1 ); }
+  {
+    const size_t first = segments.size();
+    const size_t count = _adapter.read_batch( segments, max_datagrams );
+    const auto kept = std::remove_if(
+      segments.begin() + static_cast<std::ptrdiff_t>( first ), segments.end(), [&]( const TCPMessage& ) {
+        return _should_drop( false );
+      } );
+    segments.erase( kept, segments.end() );
+    return count;
+  }
+
   //! \brief Write to the underlying AdapterT instance, potentially dropping the datagram to be written
   //! \param[in] seg is the packet to either write or drop
   void write( const TCPMessage& seg )
@@ -66,4 +85,12 @@ public:
   const FdAdapterConfig& config() const { return _adapter.config(); } //!< FdAdapterBase::config passthrough
   FdAdapterConfig& config_mut() { return _adapter.config_mut(); }     //!< FdAdapterBase::config_mut passthrough
   void tick( const size_t ms_since_last_tick ) { _adapter.tick( ms_since_last_tick ); }
+  std::optional<uint64_t> next_deadline() const { return _adapter.next_deadline(); } //!< Passthrough
+
+  //! Passthrough, for adapters that queue their writes
+  void flush()
+    requires requires( AdapterT& a ) { a.flush(); }
+  {
+    _adapter.flush();
+  }
 };
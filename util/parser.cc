@@ -1,27 +1,38 @@
 #include "parser.hh"
 
 #include <cassert>
+#include <cstring>
 #include <string>
 
 using namespace std;
 
-string_view Parser::BufferList::peek() const
+void Parser::BufferList::push_back( Ref<std::string>&& buffer )
 {
-  if ( buffer_.empty() ) {
-    throw runtime_error( "peek on empty BufferList" );
+  if ( buffer.is_borrowed() ) {
+    throw runtime_error( "cannot parse borrowed string" );
   }
-  return string_view { buffer_.front().get() }.substr( skip_ );
+  if ( buffer->empty() ) {
+    return; // (so that the current buffer, if any, always has a byte to peek at)
+  }
+
+  size_ += buffer->size();
+  if ( count_ < INLINE_BUFFERS ) {
+    inline_.at( count_ ) = move( buffer );
+  } else {
+    overflow_.push_back( move( buffer ) );
+  }
+  ++count_;
 }
 
-void Parser::BufferList::remove_prefix( uint64_t len )
+void Parser::BufferList::remove_prefix_across_buffers( uint64_t len )
 {
-  while ( len and not buffer_.empty() ) {
+  while ( len and front_ < count_ ) {
     const uint64_t to_pop_now = min( len, peek().size() );
     skip_ += to_pop_now;
     len -= to_pop_now;
     size_ -= to_pop_now;
-    if ( skip_ == buffer_.front()->size() ) {
-      buffer_.pop_front();
+    if ( skip_ == at( front_ )->size() ) {
+      ++front_;
       skip_ = 0;
     }
   }
@@ -33,35 +44,32 @@ void Parser::BufferList::truncate( size_t len )
     return;
   }
 
-  if ( len == 0 ) {
-    buffer_.clear();
-    size_ = 0;
-    return;
-  }
-
   size_t size_so_far = 0;
-  auto it = buffer_.begin();
-  while ( it != buffer_.end() ) {
-    if ( size_so_far + it->get().size() < len ) {
-      size_so_far += it->get().size();
-      ++it;
+  size_t i = front_;
+  while ( i < count_ ) {
+    const size_t buffer_size = at( i )->size() - ( i == front_ ? skip_ : 0 );
+    if ( size_so_far + buffer_size <= len ) {
+      size_so_far += buffer_size;
+      ++i;
       continue;
     }
 
-    if ( size_so_far + it->get().size() == len ) {
-      ++it;
-      break;
+    if ( len > size_so_far ) {
+      assert( len - size_so_far < buffer_size );
+      at( i ).get_mut().resize( ( i == front_ ? skip_ : 0 ) + len - size_so_far );
+      ++i;
     }
-
-    assert( !it->get().empty() );
-    assert( len > size_so_far );
-    assert( len - size_so_far < it->get().size() );
-    it->get_mut().resize( len - size_so_far );
     break;
   }
 
-  while ( it != buffer_.end() ) {
-    it = buffer_.erase( it );
+  count_ = i;
+  if ( count_ == front_ ) {
+    skip_ = 0;
+  }
+  if ( count_ > INLINE_BUFFERS ) {
+    overflow_.erase( overflow_.begin() + static_cast<ptrdiff_t>( count_ - INLINE_BUFFERS ), overflow_.end() );
+  } else {
+    overflow_.clear();
   }
 
   size_ = len;
@@ -74,14 +82,16 @@ void Parser::BufferList::dump_all( vector<Ref<std::string>>& out )
     return;
   }
   if ( skip_ ) {
-    out.emplace_back( buffer_.front()->substr( skip_ ) );
+    out.emplace_back( at( front_ )->substr( skip_ ) );
   } else {
-    out.push_back( move( buffer_.front() ) );
+    out.push_back( move( at( front_ ) ) );
   }
-  buffer_.pop_front();
-  for ( auto&& x : buffer_ ) {
-    out.emplace_back( move( x ) );
+  for ( size_t i = front_ + 1; i < count_; ++i ) {
+    out.push_back( move( at( i ) ) );
   }
+  front_ = count_;
+  skip_ = 0;
+  size_ = 0;
 }
 
 vector<string_view> Parser::BufferList::buffer() const
@@ -92,8 +102,8 @@ vector<string_view> Parser::BufferList::buffer() const
   vector<string_view> ret;
   ret.reserve( buffer_segment_count() );
   auto tmp_skip = skip_;
-  for ( const auto& x : buffer_ ) {
-    ret.push_back( string_view { x.get() }.substr( tmp_skip ) );
+  for ( size_t i = front_; i < count_; ++i ) {
+    ret.push_back( string_view { at( i ).get() }.substr( tmp_skip ) );
     tmp_skip = 0;
   }
   return ret;
@@ -102,7 +112,14 @@ vector<string_view> Parser::BufferList::buffer() const
 void Parser::string( span<char> out )
 {
   check_size( out.size() );
-  if ( has_error() ) {
+  if ( has_error() or out.empty() ) {
+    return;
+  }
+
+  // the common case: all in the current buffer
+  if ( const auto current = input_.peek(); current.size() >= out.size() ) {
+    memcpy( out.data(), current.data(), out.size() );
+    input_.remove_prefix( out.size() );
     return;
   }
 
@@ -2,9 +2,11 @@
 
 #include "ref.hh"
 
+#include <array>
+#include <bit>
 #include <concepts>
 #include <cstdint>
-#include <deque>
+#include <cstring>
 #include <ranges>
 #include <span>
 #include <stdexcept>
@@ -16,30 +18,59 @@ class Parser
 {
   class BufferList
   {
+    // The buffers, in order: the first few kept in place (the common case of a frame in one to three pieces),
+    // any more in `overflow_`. Buffers before `front_` have been removed.
+    static constexpr size_t INLINE_BUFFERS = 3;
+    std::array<Ref<std::string>, INLINE_BUFFERS> inline_ {};
+    std::vector<Ref<std::string>> overflow_ {};
+    size_t count_ {};
+    size_t front_ {};
+
     uint64_t size_ {};
-    std::deque<Ref<std::string>> buffer_ {};
     uint64_t skip_ {};
 
+    Ref<std::string>& at( size_t i ) { return i < INLINE_BUFFERS ? inline_[i] : overflow_[i - INLINE_BUFFERS]; }
+    const Ref<std::string>& at( size_t i ) const
+    {
+      return i < INLINE_BUFFERS ? inline_[i] : overflow_[i - INLINE_BUFFERS];
+    }
+
+    void push_back( Ref<std::string>&& buffer );
+    void remove_prefix_across_buffers( uint64_t len );
+
   public:
     explicit BufferList( std::ranges::range auto&& buffers )
       requires std::is_convertible_v<decltype( std::move( *buffers.begin() ) ), Ref<std::string>>
     {
       for ( auto&& x : buffers ) {
-        buffer_.emplace_back( std::move( x ) );
-        if ( buffer_.back().is_borrowed() ) {
-          throw std::runtime_error( "cannot parse borrowed string" );
-        }
-        size_ += buffer_.back()->size();
+        push_back( std::move( x ) );
       }
     }
 
     uint64_t size() const { return size_; }
     uint64_t serialized_length() const { return size(); }
     bool empty() const { return size_ == 0; }
-    size_t buffer_segment_count() const { return buffer_.size(); }
+    size_t buffer_segment_count() const { return count_ - front_; }
+
+    std::string_view peek() const
+    {
+      if ( front_ == count_ ) {
+        throw std::runtime_error( "peek on empty BufferList" );
+      }
+      return std::string_view { at( front_ ).get() }.substr( skip_ );
+    }
+
+    void remove_prefix( uint64_t len )
+    {
+      // (the common case: the bytes removed leave some of the current buffer)
+      if ( front_ < count_ and skip_ + len < at( front_ )->size() ) {
+        skip_ += len;
+        size_ -= len;
+        return;
+      }
+      remove_prefix_across_buffers( len );
+    }
 
-    std::string_view peek() const;
-    void remove_prefix( uint64_t len );
     void truncate( size_t len );
     void dump_all( std::vector<Ref<std::string>>& out );
     std::vector<std::string_view> buffer() const;
@@ -77,17 +108,37 @@ public:
       return;
     }
 
-    if constexpr ( sizeof( T ) == 1 ) {
-      out = static_cast<uint8_t>( input_.peek().front() );
-      input_.remove_prefix( 1 );
+    // the common case: the whole integer in the current buffer, loaded at once and put in host byte order
+    const std::string_view current = input_.peek();
+    if ( current.size() >= sizeof( T ) ) {
+      std::memcpy( &out, current.data(), sizeof( T ) );
+      out = from_big_endian( out );
+      input_.remove_prefix( sizeof( T ) );
       return;
+    }
+
+    // otherwise, a byte at a time (across buffers)
+    out = static_cast<T>( 0 );
+    for ( size_t i = 0; i < sizeof( T ); i++ ) {
+      out <<= 8;
+      out |= static_cast<uint8_t>( input_.peek().front() );
+      input_.remove_prefix( 1 );
+    }
+  }
+
+private:
+  template<std::unsigned_integral T>
+  static T from_big_endian( const T value )
+  {
+    if constexpr ( sizeof( T ) == 1 or std::endian::native == std::endian::big ) {
+      return value;
+    } else if constexpr ( sizeof( T ) == 2 ) {
+      return __builtin_bswap16( value );
+    } else if constexpr ( sizeof( T ) == 4 ) {
+      return __builtin_bswap32( value );
     } else {
-      out = static_cast<T>( 0 );
-      for ( size_t i = 0; i < sizeof( T ); i++ ) {
-        out <<= 8;
-        out |= static_cast<uint8_t>( input_.peek().front() );
-        input_.remove_prefix( 1 );
-      }
+      static_assert( sizeof( T ) == 8 );
+      return __builtin_bswap64( value );
     }
   }
 };
@@ -0,0 +1,127 @@
+#include "receive_buffer_tuner.hh"
+
+#include <algorithm>
+
+using namespace std;
+
+uint64_t ReceiveBufferBudget::resize( const uint64_t current, const uint64_t desired )
+{
+  if ( desired <= current ) {
+    reserved_ -= min( reserved_, current - desired );
+    return desired;
+  }
+
+  const uint64_t room = total_ > reserved_ ? total_ - reserved_ : 0;
+  const uint64_t granted = min( desired - current, room );
+  reserved_ += granted;
+  return current + granted;
+}
+
+ReceiveBufferTuner::ReceiveBufferTuner( const uint64_t base_capacity,
+                                        const uint64_t max_capacity,
+                                        const uint64_t initial_rtt_ms,
+                                        shared_ptr<ReceiveBufferBudget> budget )
+  : min_capacity_( base_capacity )
+  , max_capacity_( max( base_capacity, max_capacity ) )
+  , capacity_( base_capacity )
+  , budget_( move( budget ) )
+  , rtt_ms_( max( initial_rtt_ms, uint64_t { 1 } ) )
+  , target_( base_capacity )
+{
+  if ( budget_ ) {
+    budget_->reserve( capacity_ );
+  }
+}
+
+ReceiveBufferTuner::ReceiveBufferTuner( ReceiveBufferTuner&& other ) noexcept
+  : min_capacity_( other.min_capacity_ )
+  , max_capacity_( other.max_capacity_ )
+  , capacity_( other.capacity_ )
+  , budget_( move( other.budget_ ) )
+  , now_( other.now_ )
+  , rtt_ms_( other.rtt_ms_ )
+  , rtt_sampled_( other.rtt_sampled_ )
+  , rtt_edge_( other.rtt_edge_ )
+  , rtt_start_( other.rtt_start_ )
+  , right_edge_( other.right_edge_ )
+  , popped_( other.popped_ )
+  , round_start_( other.round_start_ )
+  , round_popped_( other.round_popped_ )
+  , quiet_rounds_( other.quiet_rounds_ )
+  , target_( other.target_ )
+{
+  other.budget_.reset();
+}
+
+ReceiveBufferTuner::~ReceiveBufferTuner()
+{
+  if ( budget_ ) {
+    budget_->resize( capacity_, 0 );
+  }
+}
+
+// Receiver-side RTT estimate: the time the peer takes to send one full window's worth of data
+void ReceiveBufferTuner::sample_rtt( const uint64_t bytes_received )
+{
+  if ( rtt_edge_ > 0 and bytes_received >= rtt_edge_ ) {
+    const uint64_t sample = max( now_ - rtt_start_, uint64_t { 1 } );
+    rtt_ms_ = rtt_sampled_ ? ( 7 * rtt_ms_ + sample ) / 8 : sample;
+    rtt_sampled_ = true;
+    rtt_edge_ = 0;
+  }
+
+  // start a new sample if the window is open
+  if ( rtt_edge_ == 0 and popped_ + capacity_ > bytes_received ) {
+    rtt_edge_ = popped_ + capacity_;
+    rtt_start_ = now_;
+  }
+}
+
+// Move toward `desired`, without retracting the advertised right edge and within the shared budget
+void ReceiveBufferTuner::change_capacity( uint64_t desired )
+{
+  desired = max( desired, right_edge_ > popped_ ? right_edge_ - popped_ : 0 );
+  if ( desired == capacity_ ) {
+    return;
+  }
+
+  capacity_ = budget_ ? budget_->resize( capacity_, desired ) : desired;
+}
+
+uint64_t ReceiveBufferTuner::tick( const uint64_t ms_since_last_tick,
+                                   const uint64_t bytes_received,
+                                   const uint64_t bytes_popped,
+                                   const uint64_t advertised_edge )
+{
+  now_ += ms_since_last_tick;
+  popped_ = bytes_popped;
+  right_edge_ = advertised_edge;
+
+  sample_rtt( bytes_received );
+
+  // At the end of each round (one RTT), compare what the application drained to the capacity
+  const uint64_t elapsed = now_ - round_start_;
+  if ( elapsed >= rtt_ms_ ) {
+    const uint64_t drained_per_rtt = ( bytes_popped - round_popped_ ) * rtt_ms_ / elapsed;
+    const uint64_t wanted = clamp( 2 * drained_per_rtt, min_capacity_, max_capacity_ );
+
+    if ( wanted > capacity_ ) {
+      quiet_rounds_ = 0;
+      target_ = wanted;
+    } else if ( wanted < capacity_ and ++quiet_rounds_ >= SHRINK_AFTER_ROUNDS ) {
+      quiet_rounds_ = 0;
+      target_ = wanted;
+    } else {
+      // demand is met: stop chasing an earlier growth target (a pending shrink stays pending)
+      target_ = min( target_, capacity_ );
+      quiet_rounds_ = wanted < capacity_ ? quiet_rounds_ : 0;
+    }
+
+    round_start_ = now_;
+    round_popped_ = bytes_popped;
+  }
+
+  // Keep working toward the target: growth may be waiting for budget, shrinking for the application
+  change_capacity( target_ );
+  return capacity_;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+//! \brief Memory shared by the receive buffers of a group of connections
+//! \details Each ReceiveBufferTuner holds a reservation against the budget equal to its current
+//! receive capacity. Growth is granted only while the budget has room; shrinking always succeeds
+//! and returns the memory so that busier connections can use it.
+class ReceiveBufferBudget
+{
+private:
+  uint64_t total_;       //!< Total bytes that all receive buffers may occupy together
+  uint64_t reserved_ {}; //!< Bytes currently reserved by receive buffers
+
+public:
+  explicit ReceiveBufferBudget( uint64_t total ) : total_( total ) {}
+
+  //! \brief Change a reservation of `current` bytes into one of `desired` bytes
+  //! \returns the new size of the reservation, which is less than `desired` if the budget ran out
+  uint64_t resize( uint64_t current, uint64_t desired );
+
+  //! \brief Reserve `size` bytes unconditionally (a connection's base capacity is never refused)
+  void reserve( uint64_t size ) { reserved_ += size; }
+
+  uint64_t total() const { return total_; }       //!< Size of the whole budget
+  uint64_t reserved() const { return reserved_; } //!< Bytes currently reserved
+};
+
+//! \brief Receive-buffer auto-tuning ("dynamic right-sizing") for one connection
+//! \details Once per round-trip time, the tuner looks at how many bytes the application drained
+//! from the inbound stream and moves the receive capacity toward twice that amount (twice the
+//! bandwidth-delay product the application can actually sustain), between the connection's
+//! base capacity and a configured ceiling. The round-trip time is estimated on the receive side
+//! by timing how long the peer takes to fill one advertised window.
+//!
+//! The tuner never moves the right edge of the window backwards: a capacity decrease is limited
+//! so that every byte the peer has been told it may send still fits. A slow application with a
+//! full buffer therefore gives memory back only as fast as it reads.
+class ReceiveBufferTuner
+{
+private:
+  static constexpr uint64_t SHRINK_AFTER_ROUNDS = 4; //!< Rounds of low demand before the buffer shrinks
+
+  uint64_t min_capacity_;                       //!< Base capacity of the connection
+  uint64_t max_capacity_;                       //!< Ceiling for auto-tuning
+  uint64_t capacity_;                           //!< Current capacity
+  std::shared_ptr<ReceiveBufferBudget> budget_; //!< Optional shared budget (may be null)
+
+  uint64_t now_ {};          //!< Time since the tuner was created, in milliseconds
+  uint64_t rtt_ms_;          //!< Smoothed round-trip estimate (initially a configured guess)
+  bool rtt_sampled_ {};      //!< Has rtt_ms_ been measured at least once?
+  uint64_t rtt_edge_ {};     //!< Stream index that, once received, completes the current RTT sample
+  uint64_t rtt_start_ {};    //!< Time at which the current RTT sample started
+  uint64_t right_edge_ {};   //!< Largest right edge of the window advertised to the peer
+  uint64_t popped_ {};       //!< Bytes popped by the application as of the latest tick
+  uint64_t round_start_ {};  //!< Time at which the current measurement round started
+  uint64_t round_popped_ {}; //!< Bytes popped as of the start of the current round
+  uint64_t quiet_rounds_ {}; //!< Consecutive rounds in which demand was below capacity
+  uint64_t target_;          //!< Capacity the tuner is working toward
+
+  void sample_rtt( uint64_t bytes_received );
+  void change_capacity( uint64_t desired );
+
+public:
+  //! \param[in] base_capacity is the initial (and minimum) receive capacity
+  //! \param[in] max_capacity is the ceiling for auto-tuning
+  //! \param[in] initial_rtt_ms is the round-trip time to assume until one has been measured
+  //! \param[in] budget is an optional memory budget shared with other connections
+  ReceiveBufferTuner( uint64_t base_capacity,
+                      uint64_t max_capacity,
+                      uint64_t initial_rtt_ms,
+                      std::shared_ptr<ReceiveBufferBudget> budget = {} );
+
+  //! \brief Time has passed; observe the inbound stream and return the capacity it should have now
+  //! \param[in] ms_since_last_tick is the time since the previous call
+  //! \param[in] bytes_received is the number of in-order bytes assembled into the inbound stream
+  //! \param[in] bytes_popped is the number of bytes the application has read from the inbound stream
+  //! \param[in] advertised_edge is the largest stream index (exclusive) ever advertised to the peer
+  uint64_t tick( uint64_t ms_since_last_tick,
+                 uint64_t bytes_received,
+                 uint64_t bytes_popped,
+                 uint64_t advertised_edge );
+
+  //! Milliseconds until the current measurement round ends (when tick() next has to look)
+  uint64_t next_deadline() const { return round_start_ + rtt_ms_ > now_ ? round_start_ + rtt_ms_ - now_ : 0; }
+
+  uint64_t capacity() const { return capacity_; } //!< Current receive capacity
+  uint64_t rtt_ms() const { return rtt_ms_; }     //!< Current round-trip estimate
+
+  //! Release this connection's reservation from the shared budget
+  ~ReceiveBufferTuner();
+
+  ReceiveBufferTuner( const ReceiveBufferTuner& other ) = delete;
+  ReceiveBufferTuner& operator=( const ReceiveBufferTuner& other ) = delete;
+  ReceiveBufferTuner( ReceiveBufferTuner&& other ) noexcept;
+  ReceiveBufferTuner& operator=( ReceiveBufferTuner&& other ) = delete;
+};
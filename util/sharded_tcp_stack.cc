@@ -0,0 +1,409 @@
+#include "sharded_tcp_stack.hh"
+
+#include "exception.hh"
+#include "ipv4_header.hh"
+
+#include <array>
+#include <cstring>
+#include <endian.h>
+#include <future>
+#include <iostream>
+#include <pthread.h>
+#include <random>
+#include <sched.h>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+pair<FileDescriptor, FileDescriptor> datagram_socket_pair()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_DGRAM, 0, fds.data() ) );
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+// Pin `thread` to the index'th of the cores this process may run on (wrapping around)
+void pin( thread& thread, const size_t index )
+{
+  cpu_set_t allowed;
+  CPU_ZERO( &allowed );
+  CheckSystemCall( "sched_getaffinity", sched_getaffinity( 0, sizeof( allowed ), &allowed ) );
+
+  size_t remaining = index % static_cast<size_t>( CPU_COUNT( &allowed ) );
+  for ( int cpu = 0; cpu < CPU_SETSIZE; ++cpu ) {
+    if ( CPU_ISSET( cpu, &allowed ) and remaining-- == 0 ) {
+      cpu_set_t core;
+      CPU_ZERO( &core );
+      CPU_SET( cpu, &core );
+      const int error = pthread_setaffinity_np( thread.native_handle(), sizeof( core ), &core );
+      if ( error != 0 ) {
+        throw unix_error( "pthread_setaffinity_np", error );
+      }
+      return;
+    }
+  }
+}
+
+// The FourTuple of a raw IPv4 datagram carrying TCP, as the receiver sees it (the same tuple that
+// TCPOverIPv4Adapter::unwrap_tcp_in_ip would find), read without parsing the whole datagram
+optional<FourTuple> peek_four_tuple( const string_view dgram )
+{
+  if ( dgram.size() < IPv4Header::LENGTH or ( static_cast<uint8_t>( dgram[0] ) >> 4 ) != 4
+       or static_cast<uint8_t>( dgram[9] ) != IPv4Header::PROTO_TCP ) {
+    return {};
+  }
+
+  const size_t header_length = ( static_cast<uint8_t>( dgram[0] ) & 0xfU ) * 4;
+  if ( dgram.size() < header_length + 4 ) {
+    return {};
+  }
+
+  const auto be32 = [&]( size_t offset ) {
+    uint32_t x {};
+    memcpy( &x, dgram.data() + offset, sizeof( x ) );
+    return be32toh( x );
+  };
+  const auto be16 = [&]( size_t offset ) {
+    uint16_t x {};
+    memcpy( &x, dgram.data() + offset, sizeof( x ) );
+    return be16toh( x );
+  };
+
+  return FourTuple { .local_address = be32( 16 ),
+                     .remote_address = be32( 12 ),
+                     .local_port = be16( header_length + 2 ),
+                     .remote_port = be16( header_length ) };
+}
+
+} // namespace
+
+optional<TCPListener::AcceptedConnection> ShardedListener::accept( const chrono::milliseconds timeout )
+{
+  unique_lock lock { mutex_ };
+  const bool woken
+    = established_.wait_for( lock, timeout, [&] { return not accept_queue_.empty() or stack_.failed_; } );
+  stack_.rethrow_if_failed();
+  if ( not woken ) {
+    return {};
+  }
+
+  TCPListener::AcceptedConnection ret = move( accept_queue_.front() );
+  accept_queue_.pop_front();
+  return ret;
+}
+
+ShardedTCPStack::Shard::Shard( FileDescriptor&& inbound_fd,
+                               FileDescriptor&& outbound_fd,
+                               pair<FileDescriptor, FileDescriptor>&& wakeup_pair )
+  : stack( make_unique<TCPStack>( move( inbound_fd ), move( outbound_fd ) ) )
+  , wakeup_sender( move( wakeup_pair.first ) )
+  , wakeup_receiver( move( wakeup_pair.second ) )
+{
+  wakeup_sender.set_blocking( false ); // (if the socket is full, the shard has a wakeup pending already)
+  stack->add_wakeup( wakeup_receiver, [this] {
+    string byte;
+    wakeup_receiver.read( byte );
+
+    vector<function<void()>> ready;
+    {
+      const lock_guard lock { mutex };
+      swap( ready, commands );
+    }
+    for ( auto& command : ready ) {
+      command();
+    }
+  } );
+}
+
+ShardedTCPStack::ShardedTCPStack( FileDescriptor&& datagram_fd, const size_t num_shards )
+  : steering_seed_( random_device()() )
+{
+  if ( num_shards == 0 ) {
+    throw runtime_error( "ShardedTCPStack: needs at least one shard" );
+  }
+
+  datagram_fd_.emplace( move( datagram_fd ) );
+  auto [wakeup_sender, wakeup_receiver] = datagram_socket_pair();
+  dispatcher_wakeup_sender_.emplace( move( wakeup_sender ) );
+  dispatcher_wakeup_receiver_.emplace( move( wakeup_receiver ) );
+  for ( size_t i = 0; i < num_shards; ++i ) {
+    auto [dispatcher_end, shard_end] = datagram_socket_pair();
+    dispatcher_end.set_blocking( false ); // (a busy shard must not hold up the others' datagrams)
+    shard_inputs_.push_back( move( dispatcher_end ) );
+    shard_backlogs_.emplace_back();
+    shards_.push_back( make_unique<Shard>( move( shard_end ), datagram_fd_->duplicate(), datagram_socket_pair() ) );
+  }
+
+  start();
+  dispatcher_ = thread( &ShardedTCPStack::dispatch, this );
+}
+
+ShardedTCPStack::ShardedTCPStack( vector<FileDescriptor>&& queues ) : steering_seed_( random_device()() )
+{
+  if ( queues.empty() ) {
+    throw runtime_error( "ShardedTCPStack: needs at least one queue" );
+  }
+
+  for ( auto& queue : queues ) {
+    shards_.push_back( make_unique<Shard>( queue.duplicate(), move( queue ), datagram_socket_pair() ) );
+  }
+
+  start();
+}
+
+void ShardedTCPStack::start()
+{
+  for ( size_t i = 0; i < shards_.size(); ++i ) {
+    Shard& shard = *shards_[i];
+    shard.thread = thread( &ShardedTCPStack::run_shard, this, ref( shard ) );
+    pin( shard.thread, i );
+  }
+}
+
+ShardedTCPStack::~ShardedTCPStack()
+{
+  stop();
+  join_threads();
+}
+
+void ShardedTCPStack::join()
+{
+  stop();
+  join_threads();
+  rethrow_if_failed();
+}
+
+// Ask every thread to exit (each one checks stopping_ when it wakes up)
+void ShardedTCPStack::stop()
+{
+  stopping_ = true;
+  for ( auto& shard : shards_ ) {
+    shard->wakeup_sender.write( "!" );
+  }
+  if ( dispatcher_wakeup_sender_.has_value() ) {
+    dispatcher_wakeup_sender_->write( "!" );
+  }
+
+  // wake the application's threads waiting in accept() (to see the error, if there was one)
+  const lock_guard lock { listeners_mutex_ };
+  for ( auto& listener : listeners_ ) {
+    const lock_guard listener_lock { listener->mutex_ }; // (so that a waiting thread cannot miss the notification)
+    listener->established_.notify_all();
+  }
+}
+
+void ShardedTCPStack::join_threads()
+{
+  for ( auto& shard : shards_ ) {
+    if ( shard->thread.joinable() ) {
+      shard->thread.join();
+    }
+  }
+  if ( dispatcher_.joinable() ) {
+    dispatcher_.join();
+  }
+}
+
+void ShardedTCPStack::fail( exception_ptr error )
+{
+  {
+    const lock_guard lock { error_mutex_ };
+    if ( not error_ ) {
+      error_ = move( error );
+    }
+  }
+  failed_ = true;
+  stop();
+}
+
+void ShardedTCPStack::rethrow_if_failed() const
+{
+  if ( failed_ ) {
+    rethrow_exception( error_ ); // (set before failed_, and never again)
+  }
+}
+
+template<class F>
+invoke_result_t<F, TCPStack&> ShardedTCPStack::run_on( Shard& shard, F&& function )
+{
+  // (owned by the command, so that a command dropped by a shard that has stopped breaks its promise)
+  auto task = make_shared<packaged_task<invoke_result_t<F, TCPStack&>()>>( [&] { return function( *shard.stack ); } );
+  auto result = task->get_future();
+  {
+    const lock_guard lock { shard.mutex };
+    if ( shard.stopped ) {
+      rethrow_if_failed();
+      throw runtime_error( "ShardedTCPStack: stopped" );
+    }
+    shard.commands.emplace_back( [task = move( task )] { ( *task )(); } );
+    shard.wakeup_sender.write( "!" );
+  }
+
+  try {
+    return result.get();
+  } catch ( const future_error& ) {
+    rethrow_if_failed();
+    throw;
+  }
+}
+
+void ShardedTCPStack::run_on_shard( const size_t index, const function<void( TCPStack& )>& function )
+{
+  run_on( *shards_.at( index ), function );
+}
+
+// The main loop of a shard's thread
+void ShardedTCPStack::run_shard( Shard& shard )
+{
+  try {
+    while ( not stopping_ ) {
+      shard.stack->wait_next_event( -1 );
+
+      // hand newly established connections to the application (unless its accept queue is full)
+      for ( auto& [listener, sharded] : shard.listeners ) {
+        if ( listener->accept_queue_size() == 0 ) {
+          continue;
+        }
+        {
+          const lock_guard lock { sharded->mutex_ };
+          while ( sharded->accept_queue_.size() < sharded->backlog_ ) {
+            auto connection = listener->accept();
+            if ( not connection.has_value() ) {
+              break;
+            }
+            sharded->accept_queue_.push_back( move( connection.value() ) );
+          }
+        }
+        sharded->established_.notify_all();
+      }
+
+      shard.connection_count = shard.stack->connection_count();
+      shard.poll_count = shard.stack->poll_count();
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception in ShardedTCPStack shard thread: " << e.what() << "\n";
+    fail( current_exception() );
+  }
+
+  // commands that will never run break their promises, so their callers wake up
+  const lock_guard lock { shard.mutex };
+  shard.stopped = true;
+  shard.commands.clear();
+}
+
+// The main loop of the dispatcher's thread: steer each inbound datagram to the shard that owns its connection
+void ShardedTCPStack::dispatch()
+{
+  try {
+    EventLoop eventloop;
+    vector<string> buffer( 1 );
+    eventloop.add_rule( "steer datagram to shard", datagram_fd_.value(), Direction::In, [&] {
+      datagram_fd_->read( buffer );
+      if ( buffer.empty() ) {
+        buffer.resize( 1 ); // (EAGAIN: the shards share the non-blocking interface)
+        return;
+      }
+      const auto tuple = peek_four_tuple( buffer.front() );
+      const size_t shard = tuple.has_value() ? shard_of( tuple.value() ) : 0;
+      auto& backlog = shard_backlogs_[shard];
+      if ( backlog.empty() and shard_inputs_[shard].write( buffer.front() ) > 0 ) {
+        return;
+      }
+
+      // the shard's socket is full: hold the datagram until it has room, or drop it once the shard's
+      // backlog is full too (as a NIC would with a full receive queue)
+      if ( backlog.size() < MAX_DISPATCH_BACKLOG ) {
+        backlog.push_back( buffer.front() ); // (copied at its size, not the read buffer's)
+      } else {
+        ++dispatch_drops_;
+      }
+    } );
+
+    for ( size_t i = 0; i < shard_inputs_.size(); ++i ) {
+      eventloop.add_rule(
+        "write held datagrams to shard",
+        shard_inputs_[i],
+        Direction::Out,
+        [this, i] {
+          auto& backlog = shard_backlogs_[i];
+          while ( not backlog.empty() and shard_inputs_[i].write( backlog.front() ) > 0 ) {
+            backlog.pop_front();
+          }
+        },
+        [this, i] { return not shard_backlogs_[i].empty(); } );
+    }
+
+    eventloop.add_rule( "stop dispatcher", dispatcher_wakeup_receiver_.value(), Direction::In, [&] {
+      string byte;
+      dispatcher_wakeup_receiver_->read( byte );
+    } );
+
+    while ( not stopping_ ) {
+      if ( eventloop.wait_next_event( -1 ) == EventLoop::Result::Exit ) {
+        break;
+      }
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception in ShardedTCPStack dispatcher thread: " << e.what() << "\n";
+    fail( current_exception() );
+  }
+}
+
+size_t ShardedTCPStack::shard_of( const FourTuple& tuple ) const
+{
+  return tuple.hash( steering_seed_ ) % shards_.size();
+}
+
+size_t ShardedTCPStack::connection_count() const
+{
+  size_t count = 0;
+  for ( const auto& shard : shards_ ) {
+    count += shard->connection_count;
+  }
+  return count;
+}
+
+uint64_t ShardedTCPStack::poll_count() const
+{
+  uint64_t count = 0;
+  for ( const auto& shard : shards_ ) {
+    count += shard->poll_count;
+  }
+  return count;
+}
+
+LocalStreamSocket ShardedTCPStack::connect( const TCPConfig& tcp_config, const FdAdapterConfig& adapter_config )
+{
+  const FourTuple tuple { .local_address = adapter_config.source.ipv4_numeric(),
+                          .remote_address = adapter_config.destination.ipv4_numeric(),
+                          .local_port = adapter_config.source.port(),
+                          .remote_port = adapter_config.destination.port() };
+
+  return run_on( *shards_[shard_of( tuple )],
+                 [&]( TCPStack& stack ) { return stack.connect( tcp_config, adapter_config ); } );
+}
+
+ShardedListener& ShardedTCPStack::listen( const TCPConfig& tcp_config,
+                                          const Address& address,
+                                          const size_t backlog,
+                                          const size_t syn_backlog )
+{
+  ShardedListener* listener = nullptr;
+  {
+    const lock_guard lock { listeners_mutex_ };
+    listeners_.emplace_back( new ShardedListener( *this, backlog ) );
+    listener = listeners_.back().get();
+  }
+
+  for ( auto& shard : shards_ ) {
+    run_on( *shard, [&]( TCPStack& stack ) {
+      shard->listeners.emplace_back( &stack.listen( tcp_config, address, backlog, syn_backlog ), listener );
+    } );
+  }
+  return *listener;
+}
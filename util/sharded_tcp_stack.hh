@@ -0,0 +1,166 @@
+#pragma once
+
+#include "tcp_stack.hh"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class ShardedTCPStack;
+
+//! \brief A listening port of a ShardedTCPStack
+//! \details Every shard listens on the port, and hands the connections it establishes to this
+//! listener's accept queue (while that holds fewer than `backlog` connections).
+class ShardedListener
+{
+public:
+  //! \brief Take the oldest established connection, waiting up to `timeout` for one (safe to call from any thread)
+  //! \returns the connection, or nothing if none was established in time
+  //! \throws the exception that stopped the stack's threads, if one did
+  std::optional<TCPListener::AcceptedConnection> accept( std::chrono::milliseconds timeout = {} );
+
+private:
+  friend class ShardedTCPStack;
+
+  ShardedListener( const ShardedTCPStack& stack, size_t backlog ) : stack_( stack ), backlog_( backlog ) {}
+
+  const ShardedTCPStack& stack_;
+  size_t backlog_;
+  std::mutex mutex_ {};
+  std::condition_variable established_ {};
+  std::deque<TCPListener::AcceptedConnection> accept_queue_ {};
+};
+
+//! \brief A shared-nothing, multi-core TCP stack
+//! \details Each shard is a TCPStack (with its own EventLoop, connection table and timers) driven by
+//! its own thread, which is pinned to a core. A connection lives on one shard for its whole life,
+//! and inbound datagrams are steered to that shard by a hash of their FourTuple, either
+//!
+//! - by an in-process dispatcher thread, which reads every datagram from one interface, or
+//! - by the kernel, when each shard has its own queue of a multi-queue TUN device.
+//!
+//! Shards write their outbound datagrams directly to the interface. Each thread sleeps until it has
+//! a datagram, a command, or (for a shard) a connection deadline. The application may call
+//! connect(), listen() and accept() from any thread; connect() and listen() run on the shards' threads.
+//!
+//! If a thread fails (e.g. reading the interface throws), every thread stops, and connect(), listen(),
+//! accept() and join() rethrow its exception on the application's thread.
+class ShardedTCPStack
+{
+public:
+  //! \brief Run `num_shards` shards behind an in-process dispatcher
+  //! \param[in] datagram_fd reads and writes whole IPv4 datagrams (a TunFD, or one end of a SOCK_DGRAM socketpair)
+  ShardedTCPStack( FileDescriptor&& datagram_fd, size_t num_shards );
+
+  //! \brief Run one shard per queue of a multi-queue TUN device (see TunFD)
+  //! \details The kernel keeps each flow on the queue that last transmitted it, so connections
+  //! opened by connect() are steered back to their shard.
+  explicit ShardedTCPStack( std::vector<FileDescriptor>&& queues );
+
+  //! Stop and join every thread (closing every connection)
+  ~ShardedTCPStack();
+
+  //! \brief Stop and join every thread, as the destructor does
+  //! \throws the exception that stopped a thread before, if one did
+  void join();
+
+  //! \brief Open a connection from `adapter_config.source` to `adapter_config.destination` on its shard
+  //! \returns the application's end of the connection
+  LocalStreamSocket connect( const TCPConfig& tcp_config, const FdAdapterConfig& adapter_config );
+
+  //! \brief Accept connections to `address` on every shard (see TCPStack::listen)
+  //! \param[in] backlog is the capacity of the listener's accept queue (and of each shard's)
+  //! \param[in] syn_backlog is the capacity of each shard's SYN queue
+  //! \returns the listener, which remains valid for the lifetime of the ShardedTCPStack
+  ShardedListener& listen( const TCPConfig& tcp_config,
+                           const Address& address,
+                           size_t backlog = 16,
+                           size_t syn_backlog = 128 );
+
+  //! \brief Run `function` on the index'th shard's thread (between its events), and wait for it to return
+  //! \details While it runs, the shard serves nothing else. The dispatcher holds the shard's datagrams
+  //! (up to MAX_DISPATCH_BACKLOG) and then drops them, rather than waiting for it.
+  void run_on_shard( size_t index, const std::function<void( TCPStack& )>& function );
+
+  size_t num_shards() const { return shards_.size(); }
+  size_t shard_of( const FourTuple& tuple ) const; //!< The shard that owns a connection
+  size_t connection_count() const;                 //!< Connections open on all shards (approximately)
+  uint64_t poll_count() const;                     //!< Waits made by all shards so far (approximately)
+  uint64_t dispatch_drops() const { return dispatch_drops_; } //!< Datagrams whose shard had no room for them
+
+  ShardedTCPStack( const ShardedTCPStack& other ) = delete;
+  ShardedTCPStack& operator=( const ShardedTCPStack& other ) = delete;
+  ShardedTCPStack( ShardedTCPStack&& other ) = delete;
+  ShardedTCPStack& operator=( ShardedTCPStack&& other ) = delete;
+
+private:
+  //! One TCPStack and the thread that drives it
+  struct Shard
+  {
+    std::unique_ptr<TCPStack> stack;
+    FileDescriptor wakeup_sender;   //!< Written (one byte per command) by other threads
+    FileDescriptor wakeup_receiver; //!< Read by the shard's thread
+
+    std::mutex mutex {};
+    std::vector<std::function<void()>> commands {}; //!< Work for the shard's thread, guarded by `mutex`
+    bool stopped {};                                //!< The thread has exited (guarded by `mutex`)
+
+    std::vector<std::pair<TCPListener*, ShardedListener*>> listeners {}; //!< Used only by the shard's thread
+    std::atomic<size_t> connection_count {};
+    std::atomic<uint64_t> poll_count {};
+    std::thread thread {};
+
+    Shard( FileDescriptor&& inbound_fd,
+           FileDescriptor&& outbound_fd,
+           std::pair<FileDescriptor, FileDescriptor>&& wakeup_pair );
+  };
+
+  static constexpr size_t MAX_DISPATCH_BACKLOG = 4096; //!< Datagrams held for a busy shard before it drops more
+
+  std::vector<std::unique_ptr<Shard>> shards_ {};
+  std::atomic<bool> stopping_ {};
+  uint64_t steering_seed_; //!< Seed of the hash that maps a FourTuple to its shard
+
+  std::optional<FileDescriptor> datagram_fd_ {};          //!< The dispatcher's interface (if there is a dispatcher)
+  std::vector<FileDescriptor> shard_inputs_ {};           //!< The dispatcher's ends of each shard's inbound pair
+  std::vector<std::deque<std::string>> shard_backlogs_ {}; //!< Datagrams waiting for room in each shard's pair
+  std::atomic<uint64_t> dispatch_drops_ {};                //!< Datagrams whose shard's backlog was full
+  std::optional<FileDescriptor> dispatcher_wakeup_sender_ {};   //!< Written to stop the dispatcher
+  std::optional<FileDescriptor> dispatcher_wakeup_receiver_ {}; //!< Read by the dispatcher's thread
+  std::thread dispatcher_ {};
+
+  std::mutex listeners_mutex_ {};
+  std::vector<std::unique_ptr<ShardedListener>> listeners_ {};
+
+  std::atomic<bool> failed_ {};
+  std::mutex error_mutex_ {};
+  std::exception_ptr error_ {}; //!< The first exception that stopped a thread (written under `error_mutex_`)
+
+  friend class ShardedListener;
+
+  void start();
+  void stop();
+  void join_threads();
+  void run_shard( Shard& shard );
+  void dispatch();
+
+  //! Record `error`, from a thread that is about to exit, and stop every other thread
+  void fail( std::exception_ptr error );
+  void rethrow_if_failed() const;
+
+  //! Run `function( stack )` on `shard`'s thread, and wait for its result
+  template<class F>
+  std::invoke_result_t<F, TCPStack&> run_on( Shard& shard, F&& function );
+};
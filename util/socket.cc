@@ -2,8 +2,15 @@
 
 #include "exception.hh"
 
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <linux/if_ether.h>
 #include <linux/if_packet.h>
+#include <net/if.h>
 #include <stdexcept>
+#include <sys/mman.h>
+#include <utility>
 
 using namespace std;
 
@@ -147,6 +154,129 @@ void DatagramSocket::send( const string_view payload )
   register_write();
 }
 
+size_t DatagramSocket::recv_batch( const span<string> payloads )
+{
+  return receive_messages( payloads, nullptr );
+}
+
+size_t DatagramSocket::recv_batch( const span<string> payloads, vector<Address>& source_addresses )
+{
+  return receive_messages( payloads, &source_addresses );
+}
+
+size_t DatagramSocket::receive_messages( const span<string> payloads, vector<Address>* const source_addresses )
+{
+  _messages.assign( payloads.size(), {} );
+  _iovecs.resize( payloads.size() );
+  if ( source_addresses ) {
+    _source_addresses.resize( payloads.size() );
+  }
+  for ( size_t i = 0; i < payloads.size(); ++i ) {
+    payloads[i].resize( kReadBufferSize ); // (only fills what the last datagram in this buffer did not)
+    _iovecs[i] = { payloads[i].data(), payloads[i].size() };
+    _messages[i].msg_hdr.msg_iov = &_iovecs[i];
+    _messages[i].msg_hdr.msg_iovlen = 1;
+    if ( source_addresses ) {
+      _messages[i].msg_hdr.msg_name = static_cast<sockaddr*>( _source_addresses[i] );
+      _messages[i].msg_hdr.msg_namelen = sizeof( _source_addresses[i].storage );
+    }
+  }
+
+  const int received = ::recvmmsg(
+    fd_num(), _messages.data(), static_cast<unsigned>( _messages.size() ), MSG_WAITFORONE, nullptr );
+  if ( received < 0 ) {
+    if ( errno == EAGAIN or errno == EWOULDBLOCK ) {
+      return 0;
+    }
+    throw unix_error { "recvmmsg" };
+  }
+  register_read();
+
+  // skip datagrams too big for their buffers (anyone can send one), moving the rest up to fill the gaps
+  size_t kept = 0;
+  if ( source_addresses ) {
+    source_addresses->clear();
+  }
+  for ( size_t i = 0; i < static_cast<size_t>( received ); ++i ) {
+    if ( _messages[i].msg_hdr.msg_flags & MSG_TRUNC ) {
+      ++_truncated;
+      continue;
+    }
+    swap( payloads[kept], payloads[i] );
+    payloads[kept].resize( _messages[i].msg_len );
+    if ( source_addresses ) {
+      source_addresses->emplace_back( _source_addresses[i], _messages[i].msg_hdr.msg_namelen );
+    }
+    ++kept;
+  }
+  return kept;
+}
+
+size_t DatagramSocket::send_batch( const span<const vector<Ref<string>>> datagrams )
+{
+  // gather every datagram's buffers before pointing the headers at them (_iovecs may move as it grows)
+  _messages.assign( datagrams.size(), {} );
+  _iovecs.clear();
+  for ( size_t i = 0; i < datagrams.size(); ++i ) {
+    _messages[i].msg_hdr.msg_iovlen = datagrams[i].size();
+    for ( const auto& buffer : datagrams[i] ) {
+      _iovecs.push_back( { const_cast<char*>( buffer->data() ), buffer->size() } ); // NOLINT(*-const-cast)
+    }
+  }
+  return send_messages( datagrams.size() );
+}
+
+size_t DatagramSocket::send_batch( const span<const string_view> datagrams )
+{
+  gather( datagrams );
+  return send_messages( datagrams.size() );
+}
+
+size_t DatagramSocket::sendto_batch( const Address& destination, const span<const string_view> datagrams )
+{
+  gather( datagrams );
+  return send_messages( datagrams.size(), &destination );
+}
+
+void DatagramSocket::gather( const span<const string_view> datagrams )
+{
+  _messages.assign( datagrams.size(), {} );
+  _iovecs.clear();
+  for ( const auto datagram : datagrams ) {
+    _iovecs.push_back( { const_cast<char*>( datagram.data() ), datagram.size() } ); // NOLINT(*-const-cast)
+  }
+  for ( auto& message : _messages ) {
+    message.msg_hdr.msg_iovlen = 1;
+  }
+}
+
+size_t DatagramSocket::send_messages( const size_t count, const Address* const destination )
+{
+  iovec* next = _iovecs.data();
+  for ( auto& message : _messages ) {
+    message.msg_hdr.msg_iov = next;
+    next += message.msg_hdr.msg_iovlen;
+    if ( destination ) {
+      message.msg_hdr.msg_name = const_cast<sockaddr*>( destination->raw() ); // NOLINT(*-const-cast)
+      message.msg_hdr.msg_namelen = destination->size();
+    }
+  }
+
+  size_t sent = 0;
+  while ( sent < count ) {
+    const int result = ::sendmmsg( fd_num(), &_messages.at( sent ), static_cast<unsigned>( count - sent ), 0 );
+    if ( result < 0 ) {
+      if ( errno == EAGAIN or errno == EWOULDBLOCK ) {
+        break;
+      }
+      throw unix_error { "sendmmsg" };
+    }
+    register_write();
+    sent += result;
+  }
+  return sent;
+}
+
 // mark the socket as listening for incoming connections
 //! \param[in] backlog is the number of waiting connections to queue (see [listen(2)](\ref man2::listen))
 void TCPSocket::listen( const int backlog )
@@ -163,6 +293,16 @@ TCPSocket TCPSocket::accept()
   return TCPSocket( FileDescriptor( CheckSystemCall( "accept", ::accept( fd_num(), nullptr, nullptr ) ) ) );
 }
 
+optional<TCPSocket> TCPSocket::try_accept()
+{
+  register_read();
+  const int fd = ::accept( fd_num(), nullptr, nullptr );
+  if ( fd < 0 and ( errno == EAGAIN or errno == EWOULDBLOCK ) ) {
+    return {}; // (not through CheckSystemCall, which would return 0 for it: the fd of stdin)
+  }
+  return TCPSocket( FileDescriptor( CheckSystemCall( "accept", fd ) ) );
+}
+
 // get socket option
 template<typename option_type>
 socklen_t Socket::getsockopt( const int level, const int option, option_type& option_value ) const
@@ -215,3 +355,185 @@ void PacketSocket::set_promiscuous()
               PACKET_ADD_MEMBERSHIP,
               packet_mreq { local_address().as<sockaddr_ll>()->sll_ifindex, PACKET_MR_PROMISC, {}, {} } );
 }
+
+void PacketSocket::bind_interface( const string& name )
+{
+  sockaddr_ll address {};
+  address.sll_family = AF_PACKET;
+  address.sll_ifindex = static_cast<int>( ::if_nametoindex( name.c_str() ) );
+  if ( address.sll_ifindex == 0 ) {
+    throw unix_error( "if_nametoindex(" + name + ")" );
+  }
+  // (a zero sll_protocol keeps the protocol the socket was created with)
+  bind( { reinterpret_cast<const sockaddr*>( &address ), sizeof( address ) } ); // NOLINT(*-reinterpret-cast)
+}
+
+namespace {
+
+// The status words the kernel and this process hand each block and frame slot back and forth with
+uint32_t load_status( const uint32_t& status )
+{
+  return atomic_ref { const_cast<uint32_t&>( status ) }.load( memory_order_acquire ); // NOLINT(*-const-cast)
+}
+
+void store_status( uint32_t& status, const uint32_t value )
+{
+  atomic_ref { status }.store( value, memory_order_release );
+}
+
+tpacket_req3 ring_request( const PacketSocket::RingConfig& config, const bool tx )
+{
+  if ( config.block_size == 0 or config.block_size % ::getpagesize() != 0 or config.frame_size == 0
+       or config.block_size % config.frame_size != 0 ) {
+    throw runtime_error( "PacketSocket: ring blocks must be whole pages, and hold whole frames" );
+  }
+  tpacket_req3 request {};
+  request.tp_block_size = config.block_size;
+  request.tp_block_nr = config.block_count;
+  request.tp_frame_size = config.frame_size;
+  request.tp_frame_nr = config.block_size / config.frame_size * config.block_count;
+  if ( not tx ) {
+    // (the kernel wants the TX ring's to be zero)
+    request.tp_retire_blk_tov = config.retire_timeout_ms;
+  }
+  return request;
+}
+
+// Where a TX slot's frame goes (after its header, as the kernel reads it without PACKET_TX_HAS_OFF)
+constexpr size_t TX_DATA_OFFSET = TPACKET3_HDRLEN - sizeof( sockaddr_ll );
+
+} // namespace
+
+PacketSocket::Rings::~Rings()
+{
+  if ( not mapping.empty() ) {
+    ::munmap( mapping.data(), mapping.size() );
+  }
+}
+
+char* PacketSocket::Rings::tx_slot( const size_t index ) const
+{
+  const size_t frames_per_block = tx.tp_block_size / tx.tp_frame_size;
+  return mapping.data() + size_t { rx.tp_block_size } * rx.tp_block_nr
+         + index / frames_per_block * tx.tp_block_size + index % frames_per_block * tx.tp_frame_size;
+}
+
+void PacketSocket::map_rings( const optional<RingConfig> rx, const optional<RingConfig> tx )
+{
+  if ( _rings ) {
+    throw runtime_error( "PacketSocket: rings already mapped" );
+  }
+
+  auto rings = make_unique<Rings>();
+  setsockopt( SOL_PACKET, PACKET_VERSION, int { TPACKET_V3 } );
+  if ( rx.has_value() ) {
+    rings->rx = ring_request( rx.value(), false );
+    setsockopt( SOL_PACKET, PACKET_RX_RING, rings->rx );
+  }
+  if ( tx.has_value() ) {
+    rings->tx = ring_request( tx.value(), true );
+    setsockopt( SOL_PACKET, PACKET_TX_RING, rings->tx );
+  }
+
+  const size_t length = size_t { rings->rx.tp_block_size } * rings->rx.tp_block_nr
+                        + size_t { rings->tx.tp_block_size } * rings->tx.tp_block_nr;
+  void* const address = ::mmap( nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_num(), 0 );
+  if ( address == MAP_FAILED ) {
+    throw unix_error( "mmap" );
+  }
+  rings->mapping = { static_cast<char*>( address ), length };
+  _rings = move( rings );
+}
+
+size_t PacketSocket::recv_ring( const function<void( string_view )>& handler )
+{
+  if ( not _rings or _rings->rx.tp_block_nr == 0 ) {
+    throw runtime_error( "PacketSocket::recv_ring: no RX ring" );
+  }
+
+  size_t count = 0;
+  // each block is filled and handed over in turn, so stop at the first one the kernel still has
+  for ( size_t blocks = 0; blocks < _rings->rx.tp_block_nr; ++blocks ) {
+    auto* const block = reinterpret_cast<tpacket_block_desc*>( // NOLINT(*-reinterpret-cast)
+      _rings->rx_block( _rings->rx_next_block ) );
+    if ( not( load_status( block->hdr.bh1.block_status ) & TP_STATUS_USER ) ) {
+      break;
+    }
+
+    const char* frame_header = reinterpret_cast<const char*>( block ) // NOLINT(*-reinterpret-cast)
+                               + block->hdr.bh1.offset_to_first_pkt;
+    for ( uint32_t i = 0; i < block->hdr.bh1.num_pkts; ++i ) {
+      const auto* const frame = reinterpret_cast<const tpacket3_hdr*>( frame_header ); // NOLINT(*-cast)
+      handler( { frame_header + frame->tp_mac, frame->tp_snaplen } );
+      frame_header += frame->tp_next_offset;
+    }
+    count += block->hdr.bh1.num_pkts;
+
+    store_status( block->hdr.bh1.block_status, TP_STATUS_KERNEL );
+    _rings->rx_next_block = ( _rings->rx_next_block + 1 ) % _rings->rx.tp_block_nr;
+  }
+
+  if ( count > 0 ) {
+    register_read();
+  }
+  return count;
+}
+
+size_t PacketSocket::send_ring( const span<const vector<Ref<string>>> frames )
+{
+  if ( not _rings or _rings->tx.tp_block_nr == 0 ) {
+    throw runtime_error( "PacketSocket::send_ring: no TX ring" );
+  }
+
+  size_t queued = 0;
+  for ( const auto& frame : frames ) {
+    char* const slot = _rings->tx_slot( _rings->tx_next_frame );
+    auto* const header = reinterpret_cast<tpacket3_hdr*>( slot ); // NOLINT(*-reinterpret-cast)
+    const uint32_t status = load_status( header->tp_status );
+    if ( status == TP_STATUS_WRONG_FORMAT ) {
+      throw runtime_error( "PacketSocket::send_ring: kernel rejected a frame" );
+    }
+    if ( status != TP_STATUS_AVAILABLE ) {
+      break; // the kernel has not sent this slot's last frame yet
+    }
+
+    size_t length = 0;
+    for ( const auto& buffer : frame ) {
+      if ( TX_DATA_OFFSET + length + buffer->size() > _rings->tx.tp_frame_size ) {
+        throw runtime_error( "PacketSocket::send_ring: frame larger than a TX ring slot" );
+      }
+      memcpy( slot + TX_DATA_OFFSET + length, buffer->data(), buffer->size() );
+      length += buffer->size();
+    }
+    header->tp_len = length;
+    header->tp_snaplen = length;
+    store_status( header->tp_status, TP_STATUS_SEND_REQUEST );
+
+    _rings->tx_next_frame = ( _rings->tx_next_frame + 1 ) % _rings->tx.tp_frame_nr;
+    ++queued;
+  }
+
+  if ( queued > 0 ) {
+    // one call sends every queued frame (and does not wait for the slots to be free again); if the
+    // device queue is full, the frames stay queued for the next call
+    if ( ::send( fd_num(), nullptr, 0, MSG_DONTWAIT ) < 0 and errno != EAGAIN and errno != ENOBUFS ) {
+      throw unix_error( "send" );
+    }
+    register_write();
+  }
+  return queued;
+}
+
+size_t PacketSocket::tx_pending() const
+{
+  if ( not _rings ) {
+    return 0;
+  }
+  size_t pending = 0;
+  for ( size_t i = 0; i < _rings->tx.tp_frame_nr; ++i ) {
+    pending += load_status( reinterpret_cast<const tpacket3_hdr*>( _rings->tx_slot( i ) ) // NOLINT(*-cast)
+                              ->tp_status )
+               != TP_STATUS_AVAILABLE;
+  }
+  return pending;
+}
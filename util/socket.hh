@@ -3,8 +3,17 @@
 #include "address.hh"
 #include "file_descriptor.hh"
 
+#include <cstdint>
 #include <functional>
+#include <linux/if_packet.h>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
 
 //! \brief Base class for network sockets (TCP, UDP, etc.)
 //! \details Socket is generally used via a subclass. See TCPSocket and UDPSocket for usage examples.
@@ -69,6 +78,28 @@ public:
   //! Send datagram to the socket's connected address (must call connect() first)
   void send( std::string_view payload );
 
+  //! \brief Receive up to `payloads.size()` datagrams with one [recvmmsg(2)](\ref man2::recvmmsg)
+  //! \details Each datagram goes into the next payload's buffer, which is reused from call to call. Waits
+  //! only for the first datagram (not at all if the socket is non-blocking). A datagram too big for its
+  //! buffer is skipped, and counted by truncated_datagrams().
+  //! \returns the number of datagrams received (0 if the socket is non-blocking and none was waiting)
+  size_t recv_batch( std::span<std::string> payloads );
+
+  //! Receive a batch as above, and the Address of each datagram's sender (replacing `source_addresses`)
+  size_t recv_batch( std::span<std::string> payloads, std::vector<Address>& source_addresses );
+
+  //! Datagrams that recv_batch() skipped because they were too big
+  uint64_t truncated_datagrams() const { return _truncated; }
+
+  //! \brief Send datagrams to the connected address with one [sendmmsg(2)](\ref man2::sendmmsg)
+  //! \details Each datagram is gathered from its buffers (as serialize() gives them).
+  //! \returns the number of datagrams sent (fewer than given if a non-blocking socket's buffer filled)
+  size_t send_batch( std::span<const std::vector<Ref<std::string>>> datagrams );
+  size_t send_batch( std::span<const std::string_view> datagrams );
+
+  //! Send datagrams to the specified Address with one [sendmmsg(2)](\ref man2::sendmmsg), as send_batch() does
+  size_t sendto_batch( const Address& destination, std::span<const std::string_view> datagrams );
+
 protected:
   DatagramSocket( int domain, int type, int protocol = 0 ) : Socket( domain, type, protocol ) {}
 
@@ -76,6 +107,22 @@ protected:
   DatagramSocket( FileDescriptor&& fd, int domain, int type, int protocol = 0 )
     : Socket( std::move( fd ), domain, type, protocol )
   {}
+
+private:
+  //! Headers for recv_batch() and send_batch(), kept from call to call
+  std::vector<mmsghdr> _messages {};
+  std::vector<iovec> _iovecs {};
+  std::vector<Address::Raw> _source_addresses {};
+  uint64_t _truncated {};
+
+  //! Receive into `payloads`, and (if asked) the senders' addresses
+  size_t receive_messages( std::span<std::string> payloads, std::vector<Address>* source_addresses );
+
+  //! Point _messages at their buffers (one each)
+  void gather( std::span<const std::string_view> datagrams );
+
+  //! Send the first `count` of _messages, whose buffers are in _iovecs (to `destination`, if given)
+  size_t send_messages( size_t count, const Address* destination = nullptr );
 };
 
 //! A wrapper around [UDP sockets](\ref man7::udp)
@@ -106,15 +153,74 @@ public:
 
   //! Accept a new incoming connection
   TCPSocket accept();
+
+  //! \brief Accept a new incoming connection, if one is waiting
+  //! \details For a non-blocking socket: returns nothing (rather than throw) if there is no connection to accept.
+  std::optional<TCPSocket> try_accept();
 };
 
 //! A wrapper around [packet sockets](\ref man7:packet)
+//! \details Besides recv() and the batch calls, a packet socket can exchange frames with the kernel through
+//! [memory-mapped rings](https://docs.kernel.org/networking/packet_mmap.html) (TPACKET_V3). The kernel writes
+//! received frames into blocks of the RX ring and hands over a block at a time; frames queued in the TX ring
+//! are all sent by one system call.
 class PacketSocket : public DatagramSocket
 {
 public:
   PacketSocket( const int type, const int protocol ) : DatagramSocket( AF_PACKET, type, protocol ) {}
 
   void set_promiscuous();
+
+  //! Receive and send only the frames of the named network interface
+  void bind_interface( const std::string& name );
+
+  //! Geometry of a memory-mapped ring
+  struct RingConfig
+  {
+    uint32_t block_size = 1 << 20; //!< Bytes in each block (a multiple of the page size)
+    uint32_t block_count = 16;
+    uint32_t frame_size = 2048;     //!< (TX ring) Bytes in each frame slot, including the slot's header
+    uint32_t retire_timeout_ms = 1; //!< (RX ring) How long the kernel holds on to a partly filled block
+  };
+
+  //! \brief Set up an RX ring, a TX ring, or both (once, before the socket is bound)
+  //! \details Once there is an RX ring, received frames go only to it (not to recv()).
+  void map_rings( std::optional<RingConfig> rx, std::optional<RingConfig> tx = {} );
+
+  //! \brief (RX ring) Pass each frame in the blocks the kernel has finished to `handler`, then give the blocks back
+  //! \details Each frame is a view into the ring, valid only during the call. Never waits: the socket is
+  //! readable once a block is ready.
+  //! \returns the number of frames passed to `handler` (0 if no block was ready)
+  size_t recv_ring( const std::function<void( std::string_view )>& handler );
+
+  //! \brief (TX ring) Copy frames into free slots of the TX ring, and have the kernel send them all
+  //! \details Each frame is gathered from its buffers (as serialize() gives them).
+  //! \returns the number of frames queued (fewer than given if the ring filled)
+  size_t send_ring( std::span<const std::vector<Ref<std::string>>> frames );
+
+  //! (TX ring) Frames queued but not yet sent by the kernel
+  size_t tx_pending() const;
+
+private:
+  //! The rings, mapped into this process (the RX ring first)
+  struct Rings
+  {
+    std::span<char> mapping {};
+    tpacket_req3 rx {};
+    tpacket_req3 tx {};
+    size_t rx_next_block {}; //!< The block to look at next
+    size_t tx_next_frame {}; //!< The slot to fill next
+
+    Rings() = default;
+    ~Rings();
+    Rings( const Rings& other ) = delete;
+    Rings& operator=( const Rings& other ) = delete;
+
+    char* rx_block( size_t index ) const { return mapping.data() + index * rx.tp_block_size; }
+    char* tx_slot( size_t index ) const;
+  };
+
+  std::unique_ptr<Rings> _rings {};
 };
 
 //! A wrapper around [Unix-domain stream sockets](\ref man7::unix)
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+//! \brief A bounded, lock-free queue between one producer thread and one consumer thread
+//! \details Elements are moved in and out of a fixed array of slots (a power of two). The producer
+//! owns the tail index and the consumer the head; each only reads the other's. They live on separate
+//! cache lines, so the threads do not write to a line the other is reading except to hand elements
+//! over. push() and pop() are sequentially consistent on the indices, so that a producer that finds
+//! the ring empty after pushing cannot miss a consumer that has just found it empty (see was_empty()).
+template<class T>
+class SPSCRing
+{
+public:
+  //! Room for `capacity` elements (a power of two)
+  explicit SPSCRing( size_t capacity ) : slots_( capacity ), mask_( capacity - 1 )
+  {
+    if ( capacity == 0 or ( capacity & mask_ ) != 0 ) {
+      throw std::runtime_error( "SPSCRing capacity must be a power of two" );
+    }
+  }
+
+  //! \brief (Producer) Move `value` onto the ring
+  //! \returns false, leaving `value` alone, if the ring is full
+  bool push( T&& value )
+  {
+    const size_t tail = tail_.load( std::memory_order_relaxed );
+    if ( tail - head_.load( std::memory_order_acquire ) == slots_.size() ) {
+      return false;
+    }
+    slots_[tail & mask_] = std::move( value );
+    tail_.store( tail + 1, std::memory_order_seq_cst );
+    return true;
+  }
+
+  //! (Producer) After a push(), was the element pushed the only one on the ring?
+  bool was_empty() const
+  {
+    return tail_.load( std::memory_order_relaxed ) - head_.load( std::memory_order_seq_cst ) == 1;
+  }
+
+  //! (Consumer) Move the oldest element off the ring, if there is one
+  std::optional<T> pop()
+  {
+    const size_t head = head_.load( std::memory_order_relaxed );
+    if ( head == tail_.load( std::memory_order_seq_cst ) ) {
+      return {};
+    }
+    std::optional<T> value { std::move( slots_[head & mask_] ) };
+    head_.store( head + 1, std::memory_order_seq_cst );
+    return value;
+  }
+
+  //! (Consumer) Is the ring empty?
+  bool empty() const { return head_.load( std::memory_order_relaxed ) == tail_.load( std::memory_order_seq_cst ); }
+
+  size_t capacity() const { return slots_.size(); }
+
+private:
+  static constexpr size_t CACHE_LINE = 64;
+
+  std::vector<T> slots_;
+  size_t mask_;
+  alignas( CACHE_LINE ) std::atomic<size_t> head_ {}; //!< Next slot to pop (written by the consumer)
+  alignas( CACHE_LINE ) std::atomic<size_t> tail_ {}; //!< Next slot to push (written by the producer)
+};
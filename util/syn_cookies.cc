@@ -0,0 +1,132 @@
+#include "syn_cookies.hh"
+
+#include <algorithm>
+#include <bit>
+#include <random>
+
+using namespace std;
+
+namespace {
+
+class Wrap32Raw : public Wrap32
+{
+public:
+  uint32_t raw_value() const { return raw_value_; }
+};
+
+uint32_t raw( Wrap32 x )
+{
+  return Wrap32Raw { x }.raw_value();
+}
+
+// SipHash-2-4 of a message of whole 64-bit words
+template<size_t N>
+uint64_t siphash( const array<uint64_t, 2>& key, const array<uint64_t, N>& words )
+{
+  uint64_t v0 = key[0] ^ 0x736f6d6570736575;
+  uint64_t v1 = key[1] ^ 0x646f72616e646f6d;
+  uint64_t v2 = key[0] ^ 0x6c7967656e657261;
+  uint64_t v3 = key[1] ^ 0x7465646279746573;
+
+  auto round = [&] {
+    v0 += v1;
+    v1 = rotl( v1, 13 );
+    v1 ^= v0;
+    v0 = rotl( v0, 32 );
+    v2 += v3;
+    v3 = rotl( v3, 16 );
+    v3 ^= v2;
+    v0 += v3;
+    v3 = rotl( v3, 21 );
+    v3 ^= v0;
+    v2 += v1;
+    v1 = rotl( v1, 17 );
+    v1 ^= v2;
+    v2 = rotl( v2, 32 );
+  };
+
+  auto compress = [&]( uint64_t m ) {
+    v3 ^= m;
+    round();
+    round();
+    v0 ^= m;
+  };
+
+  for ( const uint64_t m : words ) {
+    compress( m );
+  }
+  compress( uint64_t { N * 8 } << 56 ); // final block: message length, no trailing bytes
+
+  v2 ^= 0xff;
+  for ( int i = 0; i < 4; ++i ) {
+    round();
+  }
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+constexpr unsigned HASH_BITS = 24;
+constexpr unsigned MSS_BITS = 3;
+constexpr unsigned COUNTER_BITS = 5;
+constexpr uint32_t HASH_MASK = ( 1U << HASH_BITS ) - 1;
+constexpr uint32_t MSS_MASK = ( 1U << MSS_BITS ) - 1;
+constexpr uint32_t COUNTER_MASK = ( 1U << COUNTER_BITS ) - 1;
+
+static_assert( SYNCookies::MSS_TABLE.size() == 1U << MSS_BITS );
+
+} // namespace
+
+SYNCookies::SYNCookies() : key_()
+{
+  random_device rd;
+  for ( auto& k : key_ ) {
+    k = ( uint64_t { rd() } << 32 ) | rd();
+  }
+}
+
+uint32_t SYNCookies::hash( const FourTuple& tuple,
+                           const Wrap32 peer_isn,
+                           const uint64_t counter,
+                           const uint32_t mss_index ) const
+{
+  const uint64_t addresses = ( uint64_t { tuple.local_address } << 32 ) | tuple.remote_address;
+  const uint64_t ports_and_isn
+    = ( uint64_t { tuple.local_port } << 48 ) | ( uint64_t { tuple.remote_port } << 32 ) | raw( peer_isn );
+  const array<uint64_t, 3> words { addresses, ports_and_isn, ( counter << MSS_BITS ) | mss_index };
+  return static_cast<uint32_t>( siphash( key_, words ) ) & HASH_MASK;
+}
+
+Wrap32 SYNCookies::make( const FourTuple& tuple,
+                         const Wrap32 peer_isn,
+                         const uint16_t mss,
+                         const uint64_t now_ms ) const
+{
+  // the largest entry in the table that does not exceed the peer's MSS (or the smallest entry)
+  const auto mss_index = static_cast<uint32_t>(
+    max<ptrdiff_t>( upper_bound( MSS_TABLE.begin(), MSS_TABLE.end(), mss ) - MSS_TABLE.begin() - 1, 0 ) );
+  const uint64_t counter = now_ms / COUNTER_PERIOD_MS;
+
+  return Wrap32 { ( static_cast<uint32_t>( counter & COUNTER_MASK ) << ( MSS_BITS + HASH_BITS ) )
+                  | ( mss_index << HASH_BITS ) | hash( tuple, peer_isn, counter, mss_index ) };
+}
+
+optional<uint16_t> SYNCookies::check( const FourTuple& tuple,
+                                      const Wrap32 peer_isn,
+                                      const Wrap32 cookie,
+                                      const uint64_t now_ms ) const
+{
+  const uint32_t bits = raw( cookie );
+  const uint64_t now_counter = now_ms / COUNTER_PERIOD_MS;
+
+  // how many periods ago was the cookie made? (only the current and previous period are valid)
+  const uint64_t age = ( now_counter - ( bits >> ( MSS_BITS + HASH_BITS ) ) ) & COUNTER_MASK;
+  if ( age > 1 or age > now_counter ) {
+    return {};
+  }
+
+  const uint32_t mss_index = ( bits >> HASH_BITS ) & MSS_MASK;
+  if ( ( bits & HASH_MASK ) != hash( tuple, peer_isn, now_counter - age, mss_index ) ) {
+    return {};
+  }
+
+  return MSS_TABLE.at( mss_index );
+}
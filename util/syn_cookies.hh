@@ -0,0 +1,46 @@
+#pragma once
+
+#include "connection_table.hh"
+#include "wrapping_integers.hh"
+
+#include <array>
+#include <cstdint>
+#include <optional>
+
+//! \brief Stateless SYN/ACK initial sequence numbers ("SYN cookies")
+//! \details A listener whose SYN queue is full answers a SYN with a SYN/ACK whose ISN is a cookie,
+//! and keeps no state. If the peer is genuine, its ACK acknowledges cookie + 1, and the listener
+//! can check the cookie and rebuild the connection from the ACK alone. The 32 bits of the cookie are
+//!
+//!     | 5 bits: time counter mod 32 | 3 bits: MSS index | 24 bits: keyed hash |
+//!
+//! where the counter advances every COUNTER_PERIOD_MS and the hash (SipHash-2-4 under a random key)
+//! covers the 4-tuple, the peer's ISN, the full counter value and the MSS index. A cookie is valid
+//! for between one and two counter periods.
+class SYNCookies
+{
+public:
+  static constexpr uint64_t COUNTER_PERIOD_MS = 64'000; //!< How often the time counter advances
+
+  //! The MSS values a cookie can encode
+  static constexpr std::array<uint16_t, 8> MSS_TABLE { 216, 536, 1000, 1200, 1220, 1380, 1440, 1460 };
+
+  //! Construct with a random secret key
+  SYNCookies();
+
+  //! \brief The ISN with which to answer a SYN
+  //! \param[in] tuple identifies the connection (with "local" being the listener)
+  //! \param[in] peer_isn is the sequence number of the peer's SYN
+  //! \param[in] mss is the largest segment the peer can receive (rounded down to an entry of MSS_TABLE)
+  //! \param[in] now_ms is the current time, in milliseconds
+  Wrap32 make( const FourTuple& tuple, Wrap32 peer_isn, uint16_t mss, uint64_t now_ms ) const;
+
+  //! \brief Check that `cookie` was made by make() for this connection, recently
+  //! \returns the MSS encoded in the cookie, or nothing if the cookie is invalid or expired
+  std::optional<uint16_t> check( const FourTuple& tuple, Wrap32 peer_isn, Wrap32 cookie, uint64_t now_ms ) const;
+
+private:
+  std::array<uint64_t, 2> key_; //!< SipHash key
+
+  uint32_t hash( const FourTuple& tuple, Wrap32 peer_isn, uint64_t counter, uint32_t mss_index ) const;
+};
@@ -1,10 +1,12 @@
 #pragma once
 
 #include "address.hh"
+#include "receive_buffer_tuner.hh"
 #include "wrapping_integers.hh"
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 
 //! Config for TCP sender and receiver
 class TCPConfig
@@ -14,11 +16,26 @@ public:
   static constexpr size_t MAX_PAYLOAD_SIZE = 1000;  //!< Conservative max payload size for real Internet
   static constexpr uint16_t TIMEOUT_DFLT = 1000;    //!< Default re-transmit timeout is 1 second
   static constexpr unsigned MAX_RETX_ATTEMPTS = 8;  //!< Maximum re-transmit attempts before giving up
+  //! Payload of a super-segment: as many MSS-sized segments as fit under 64 KiB (see max_segment_payload)
+  static constexpr size_t SUPER_SEGMENT_PAYLOAD = 64 * MAX_PAYLOAD_SIZE;
 
   uint16_t rt_timeout = TIMEOUT_DFLT;      //!< Initial value of the retransmission timeout, in milliseconds
   size_t recv_capacity = DEFAULT_CAPACITY; //!< Receive capacity, in bytes
   size_t send_capacity = DEFAULT_CAPACITY; //!< Sender capacity, in bytes
   Wrap32 isn { 137 };                      //!< Default initial sequence number
+
+  //! Ceiling for receive-buffer auto-tuning, in bytes (auto-tuning is off unless this exceeds recv_capacity)
+  size_t recv_capacity_max = 0;
+  //! Optional memory budget shared by the receive buffers of several connections
+  std::shared_ptr<ReceiveBufferBudget> recv_budget {};
+  //! Take the short path for in-order data and pure ACKs (header prediction; see TCPPeer)
+  bool header_prediction = true;
+  //! Merge back-to-back in-order segments within a received batch (generic receive offload; see TCPPeer)
+  bool receive_coalescing = true;
+  //! Largest payload the sender puts in one segment. Above MAX_PAYLOAD_SIZE (the MSS), segments are
+  //! super-segments, for the adapter (or the kernel) to split into MSS-sized datagrams: segmentation offload.
+  //! (Only TCPOverIPv4OverTunFdAdapter splits them; other adapters send a super-segment whole.)
+  size_t max_segment_payload = MAX_PAYLOAD_SIZE;
 };
 
 //! Config for classes derived from FdAdapter
@@ -2,8 +2,10 @@
 
 #include "eventloop.hh"
 #include "file_descriptor.hh"
+#include "loopback_adapter.hh"
 #include "socket.hh"
 #include "tcp_config.hh"
+#include "tcp_over_udp.hh"
 #include "tcp_peer.hh"
 #include "tuntap_adapter.hh"
 
@@ -11,6 +13,7 @@
 #include <cstdint>
 #include <optional>
 #include <thread>
+#include <vector>
 
 //! Multithreaded wrapper around TCPPeer that approximates the Unix sockets API
 template<TCPDatagramAdapter AdaptT>
@@ -56,6 +59,15 @@ public:
   // Return peer address from underlying datagram adapter
   const Address& peer_address() const { return _datagram_adapter.config().destination; }
 
+  //! Serve every ready event per poll (the default) or only one; call before connecting
+  void set_batched_dispatch( bool batched ) { _eventloop.set_batched( batched ); }
+
+  //! Choose how the TCPPeer thread waits for events (see EventLoop::Backend); call before connecting
+  void set_event_backend( EventLoop::Backend backend );
+
+  //! Number of polls made by the TCPPeer thread (read it once the thread has finished)
+  uint64_t poll_count() const { return _eventloop.poll_count(); }
+
 protected:
   //! Adapter to underlying datagram socket (e.g., UDP or IP)
   AdaptT _datagram_adapter;
@@ -76,6 +88,15 @@ private:
   //! Process events while specified condition is true
   void _tcp_loop( const std::function<bool()>& condition );
 
+  //! Submit the writes the adapter has queued, if it queues them
+  void flush_adapter();
+
+  //! Read what has arrived from the adapter (a batch, if it reads in batches) and give it to the TCPPeer
+  void receive_from_adapter();
+
+  //! Segments read by the adapter's latest batch (reused between batches)
+  std::vector<TCPMessage> _inbound_batch {};
+
   //! Main loop of TCPPeer thread
   void _tcp_main();
 
@@ -96,6 +117,8 @@ private:
 
 using TCPOverIPv4MinnowSocket = TCPMinnowSocket<TCPOverIPv4OverTunFdAdapter>;
 using LossyTCPOverIPv4MinnowSocket = TCPMinnowSocket<LossyFdAdapter<TCPOverIPv4OverTunFdAdapter>>;
+using TCPOverUDPMinnowSocket = TCPMinnowSocket<TCPOverUDPAdapter>;
+using LoopbackMinnowSocket = TCPMinnowSocket<LoopbackAdapter>;
 
 //! \class TCPMinnowSocket
 //! This class involves the simultaneous operation of two threads.
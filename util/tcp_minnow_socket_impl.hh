@@ -2,16 +2,16 @@
 
 #include "exception.hh"
 
+#include <algorithm>
 #include <cstddef>
 #include <exception>
 #include <iostream>
+#include <optional>
 #include <stdexcept>
 #include <string>
 #include <sys/socket.h>
 #include <utility>
 
-static constexpr size_t TCP_TICK_MS = 10;
-
 inline uint64_t timestamp_ms()
 {
   static_assert( std::is_same_v<std::chrono::steady_clock::duration, std::chrono::nanoseconds> );
@@ -24,8 +24,24 @@ template<TCPDatagramAdapter AdaptT>
 void TCPMinnowSocket<AdaptT>::_tcp_loop( const std::function<bool()>& condition )
 {
   auto base_time = timestamp_ms();
+  EventLoop::TimerId wakeup {};
   while ( condition() ) {
-    auto ret = _eventloop.wait_next_event( TCP_TICK_MS );
+    // sleep until an event, or until the TCPPeer or the adapter next has work of its own
+    // (an idle connection does not wake up at all)
+    _eventloop.cancel_timer( wakeup );
+    wakeup = {};
+    if ( _tcp.has_value() and _tcp->active() ) {
+      std::optional<uint64_t> deadline = _tcp->next_deadline();
+      if ( const auto adapter_deadline = _datagram_adapter.next_deadline() ) {
+        deadline = std::min( deadline.value_or( adapter_deadline.value() ), adapter_deadline.value() );
+      }
+      if ( deadline.has_value() ) {
+        wakeup = _eventloop.add_timer( deadline.value(), [] {} );
+      }
+    }
+
+    flush_adapter();
+    auto ret = _eventloop.wait_next_event( -1 );
     if ( ret == EventLoop::Result::Exit or _abort ) {
       break;
     }
@@ -36,11 +52,44 @@ void TCPMinnowSocket<AdaptT>::_tcp_loop( const std::function<bool()>& condition
 
     if ( _tcp.value().active() ) {
       const auto next_time = timestamp_ms();
-      _tcp.value().tick( next_time - base_time, [&]( auto x ) { _datagram_adapter.write( x ); } );
+      _tcp.value().tick( next_time - base_time, [&]( auto x ) { _datagram_adapter.write( std::move( x ) ); } );
       _datagram_adapter.tick( next_time - base_time );
       base_time = next_time;
     }
   }
+  flush_adapter();
+}
+
+//! Hand the adapter's queued writes to the kernel (for adapters that queue them)
+template<TCPDatagramAdapter AdaptT>
+void TCPMinnowSocket<AdaptT>::flush_adapter()
+{
+  if constexpr ( requires { _datagram_adapter.flush(); } ) {
+    _datagram_adapter.flush();
+  }
+}
+
+//! With an adapter that reads in batches, one batch gets one reply from the TCPPeer (pushing data and
+//! acknowledging every segment in it), rather than one per segment
+template<TCPDatagramAdapter AdaptT>
+void TCPMinnowSocket<AdaptT>::receive_from_adapter()
+{
+  const auto transmit = [&]( auto x ) { _datagram_adapter.write( std::move( x ) ); };
+  if constexpr ( requires { _datagram_adapter.read_batch( _inbound_batch ); } ) {
+    _inbound_batch.clear();
+    _datagram_adapter.read_batch( _inbound_batch );
+    _tcp->receive_batch( _inbound_batch, transmit );
+  } else {
+    if ( auto seg = _datagram_adapter.read() ) {
+      _tcp->receive( std::move( seg.value() ), transmit );
+    }
+  }
+}
+
+template<TCPDatagramAdapter AdaptT>
+void TCPMinnowSocket<AdaptT>::set_event_backend( const EventLoop::Backend backend )
+{
+  _eventloop.set_backend( backend );
 }
 
 //! \param[in] data_socket_pair is a pair of connected AF_UNIX SOCK_STREAM sockets
@@ -54,6 +103,7 @@ TCPMinnowSocket<AdaptT>::TCPMinnowSocket( std::pair<FileDescriptor, FileDescript
 {
   _thread_data.set_blocking( false );
   set_blocking( false );
+  _eventloop.set_batched( true );
 }
 
 template<TCPDatagramAdapter AdaptT>
@@ -81,9 +131,7 @@ void TCPMinnowSocket<AdaptT>::_initialize_TCP( const TCPConfig& config )
     _datagram_adapter.fd(),
     Direction::In,
     [&] {
-      if ( auto seg = _datagram_adapter.read() ) {
-        _tcp->receive( std::move( seg.value() ), [&]( auto x ) { _datagram_adapter.write( x ); } );
-      }
+      receive_from_adapter();
 
       // debugging output:
       if ( _thread_data.eof() and _tcp.value().sender().sequence_numbers_in_flight() == 0 and not _fully_acked ) {
@@ -116,7 +164,7 @@ void TCPMinnowSocket<AdaptT>::_initialize_TCP( const TCPConfig& config )
                   << " still in flight).\n";
       }
 
-      _tcp->push( [&]( auto x ) { _datagram_adapter.write( x ); } );
+      _tcp->push( [&]( auto x ) { _datagram_adapter.write( std::move( x ) ); } );
     },
     [&] {
       return ( _tcp->active() ) and ( not _outbound_shutdown )
@@ -145,6 +193,7 @@ void TCPMinnowSocket<AdaptT>::_initialize_TCP( const TCPConfig& config )
         const std::string_view buffer = inbound.peek();
         const auto bytes_written = _thread_data.write( buffer );
         inbound.pop( bytes_written );
+        _tcp->send_window_update( [&]( auto x ) { _datagram_adapter.write( std::move( x ) ); } );
       }
 
       if ( inbound.is_finished() or inbound.has_error() ) {
@@ -192,8 +241,9 @@ TCPMinnowSocket<AdaptT>::~TCPMinnowSocket()
   try {
     if ( _tcp_thread.joinable() ) {
       std::cerr << "Warning: unclean shutdown of TCPMinnowSocket\n";
-      // force the other side to exit
+      // force the other side to exit (and wake it up, since it only polls when there is work)
       _abort.store( true );
+      shutdown( SHUT_RDWR );
       _tcp_thread.join();
     }
   } catch ( const std::exception& e ) {
@@ -231,7 +281,7 @@ void TCPMinnowSocket<AdaptT>::connect( const TCPConfig& c_tcp, const FdAdapterCo
     throw std::runtime_error( "TCPPeer not successfully initialized" );
   }
 
-  _tcp->push( [&]( auto x ) { _datagram_adapter.write( x ); } );
+  _tcp->push( [&]( auto x ) { _datagram_adapter.write( std::move( x ) ); } );
 
   if ( _tcp->sender().sequence_numbers_in_flight() != 1 ) {
     throw std::runtime_error( "After TCPConnection::connect(), expected sequence_numbers_in_flight() == 1" );
@@ -1,15 +1,145 @@
 #include "tcp_over_ip.hh"
 
+#include "checksum.hh"
 #include "helpers.hh"
 #include "ipv4_datagram.hh"
 #include "ipv4_header.hh"
 
+#include <algorithm>
 #include <arpa/inet.h>
+#include <stdexcept>
 #include <unistd.h>
 #include <utility>
 
 using namespace std;
 
+namespace {
+
+class Wrap32Serializable : public Wrap32
+{
+public:
+  uint32_t raw_value() const { return raw_value_; }
+};
+
+// Offsets of the fields that TCPHeaderTemplate::fill() patches
+constexpr size_t IP_LENGTH_OFFSET = 2;
+constexpr size_t IP_CHECKSUM_OFFSET = 10;
+constexpr size_t TCP_SEQNO_OFFSET = IPv4Header::LENGTH + 4;
+constexpr size_t TCP_ACKNO_OFFSET = IPv4Header::LENGTH + 8;
+constexpr size_t TCP_FLAGS_OFFSET = IPv4Header::LENGTH + 13;
+constexpr size_t TCP_WINDOW_OFFSET = IPv4Header::LENGTH + 14;
+constexpr size_t TCP_CHECKSUM_OFFSET = IPv4Header::LENGTH + 16;
+
+template<class T>
+void put( span<char> out, const size_t offset, const T value )
+{
+  for ( size_t i = 0; i < sizeof( T ); ++i ) {
+    out[offset + i] = static_cast<char>( value >> ( ( sizeof( T ) - i - 1 ) * 8 ) );
+  }
+}
+
+// Sum of the big-endian 16-bit words of `data` (of even length)
+uint32_t sum_words( string_view data )
+{
+  uint32_t sum = 0;
+  for ( size_t i = 0; i + 1 < data.size(); i += 2 ) {
+    sum += ( static_cast<uint32_t>( static_cast<uint8_t>( data[i] ) ) << 8 ) | static_cast<uint8_t>( data[i + 1] );
+  }
+  return sum;
+}
+
+// The one's complement of the folded sum, as it goes in a checksum field
+uint16_t checksum_of( uint32_t sum )
+{
+  return InternetChecksum { sum }.value();
+}
+
+} // namespace
+
+TCPHeaderTemplate::TCPHeaderTemplate( const FourTuple& tuple ) : _tuple( tuple )
+{
+  IPv4Header ip_header; // (length, identification and checksum are left 0)
+  ip_header.src = tuple.local_address;
+  ip_header.dst = tuple.remote_address;
+  ip_header.len = IPv4Header::LENGTH; // (so that the pseudo-header's sum counts no payload)
+  _pseudo_sum = ip_header.pseudo_checksum();
+  ip_header.len = 0;
+
+  TCPSegment tcp_header; // (seqno, ackno, flags, window and checksum are left 0)
+  tcp_header.message.receiver->ackno.reset();
+  tcp_header.udinfo.src_port = tuple.local_port;
+  tcp_header.udinfo.dst_port = tuple.remote_port;
+
+  Serializer serializer;
+  ip_header.serialize( serializer );
+  tcp_header.serialize( serializer );
+  const string headers = concat( serializer.finish() );
+  ranges::copy( headers, _headers.begin() );
+
+  _ip_sum = sum_words( string_view { headers }.substr( 0, IPv4Header::LENGTH ) );
+  _tcp_sum = sum_words( string_view { headers }.substr( IPv4Header::LENGTH ) );
+}
+
+string_view TCPHeaderTemplate::fill( const TCPMessage& msg, const TCPChecksum checksum )
+{
+  return fill( msg, 0, msg.sender.get().payload.size(), checksum );
+}
+
+string_view TCPHeaderTemplate::fill( const TCPMessage& msg,
+                                     const size_t offset,
+                                     const size_t length,
+                                     const TCPChecksum checksum )
+{
+  const TCPSenderMessage& sender = msg.sender.get();
+  const TCPReceiverMessage& receiver = msg.receiver.get();
+  if ( offset + length > sender.payload.size() ) {
+    throw out_of_range( "TCPHeaderTemplate: piece beyond the end of the payload" );
+  }
+  if ( length > TCPOverIPv4Adapter::MAX_SEGMENT_PAYLOAD ) {
+    throw runtime_error( "TCP segment too large for an IPv4 datagram" );
+  }
+  const string_view payload = string_view { sender.payload }.substr( offset, length );
+  const bool first = offset == 0;
+  const bool last = offset + length == sender.payload.size();
+
+  const auto tcp_length = static_cast<uint16_t>( TCPSegment::HEADER_LENGTH + length );
+  const auto ip_length = static_cast<uint16_t>( IPv4Header::LENGTH + tcp_length );
+  put( _headers, IP_LENGTH_OFFSET, ip_length );
+  put( _headers, IP_CHECKSUM_OFFSET, checksum_of( _ip_sum + ip_length ) );
+
+  const Wrap32 piece_seqno = first ? sender.seqno : sender.seqno + static_cast<uint32_t>( sender.SYN + offset );
+  const uint32_t seqno = Wrap32Serializable { piece_seqno }.raw_value();
+  const uint32_t ackno = Wrap32Serializable { receiver.ackno.value_or( Wrap32 { 0 } ) }.raw_value();
+  const bool reset = sender.RST or receiver.RST;
+  const uint8_t flags = ( receiver.ackno.has_value() ? 0b0001'0000U : 0 ) | ( reset ? 0b0000'0100U : 0 )
+                        | ( sender.SYN and first ? 0b0000'0010U : 0 ) | ( sender.FIN and last ? 0b0000'0001U : 0 );
+  put( _headers, TCP_SEQNO_OFFSET, seqno );
+  put( _headers, TCP_ACKNO_OFFSET, ackno );
+  put( _headers, TCP_FLAGS_OFFSET, flags );
+  put( _headers, TCP_WINDOW_OFFSET, receiver.window_size );
+
+  uint16_t tcp_checksum = 0;
+  if ( checksum == TCPChecksum::Full ) {
+    const uint32_t header_sum = _pseudo_sum + tcp_length + _tcp_sum + ( seqno >> 16 ) + ( seqno & 0xffff )
+                                + ( ackno >> 16 ) + ( ackno & 0xffff ) + flags + receiver.window_size;
+    if ( first and last ) {
+      // (a segment that the TCPSender kept comes with its payload's sum, so a retransmission doesn't sum it again)
+      tcp_checksum
+        = checksum_of( header_sum + ( msg.payload_sum.has_value() ? *msg.payload_sum : sender.payload_sum() ) );
+    } else {
+      InternetChecksum check { header_sum };
+      check.add( payload );
+      tcp_checksum = check.value();
+    }
+  } else {
+    // the folded sum, not yet complemented (see TCPSegment::compute_partial_checksum)
+    tcp_checksum = static_cast<uint16_t>( ~checksum_of( _pseudo_sum + tcp_length ) );
+  }
+  put( _headers, TCP_CHECKSUM_OFFSET, tcp_checksum );
+
+  return { _headers.data(), _headers.size() };
+}
+
 //! \details This function attempts to parse a TCP segment from
 //! the IP datagram's payload.
 //!
@@ -22,7 +152,7 @@ using namespace std;
 //! `_listen` flag and records the source and destination addresses and port numbers
 //! from the TCP header; it uses this information to filter future reads.
 //! \returns a std::optional<TCPSegment> that is empty if the segment was invalid or unrelated
-optional<TCPMessage> TCPOverIPv4Adapter::unwrap_tcp_in_ip( InternetDatagram ip_dgram )
+optional<TCPMessage> TCPOverIPv4Adapter::unwrap_tcp_in_ip( InternetDatagram ip_dgram, const TCPChecksum checksum )
 {
   // is the IPv4 datagram for us?
   // Note: it's valid to bind to address "0" (INADDR_ANY) and reply from actual address contacted
@@ -35,28 +165,23 @@ optional<TCPMessage> TCPOverIPv4Adapter::unwrap_tcp_in_ip( InternetDatagram ip_d
     return {};
   }
 
-  // does the IPv4 datagram claim that its payload is a TCP segment?
-  if ( ip_dgram.header.proto != IPv4Header::PROTO_TCP ) {
-    return {};
-  }
-
-  // is the payload a valid TCP segment?
-  TCPSegment tcp_seg;
-  if ( not parse( tcp_seg, move( ip_dgram.payload ), ip_dgram.header.pseudo_checksum() ) ) {
+  FourTuple tuple;
+  auto msg = unwrap_tcp_in_ip( move( ip_dgram ), tuple, checksum );
+  if ( not msg.has_value() ) {
     return {};
   }
 
   // is the TCP segment for us?
-  if ( tcp_seg.udinfo.dst_port != config().source.port() ) {
+  if ( tuple.local_port != config().source.port() ) {
     return {};
   }
 
   // should we target this source addr/port (and use its destination addr as our source) in reply?
   if ( listening() ) {
-    if ( tcp_seg.message.sender->SYN and not tcp_seg.message.sender->RST ) {
-      config_mutable().source = Address { inet_ntoa( { htobe32( ip_dgram.header.dst ) } ), config().source.port() };
+    if ( msg.value().sender->SYN and not msg.value().sender->RST ) {
+      config_mutable().source = Address { inet_ntoa( { htobe32( tuple.local_address ) } ), config().source.port() };
       config_mutable().destination
-        = Address { inet_ntoa( { htobe32( ip_dgram.header.src ) } ), tcp_seg.udinfo.src_port };
+        = Address { inet_ntoa( { htobe32( tuple.remote_address ) } ), tuple.remote_port };
       set_listening( false );
     } else {
       return {};
@@ -64,31 +189,112 @@ optional<TCPMessage> TCPOverIPv4Adapter::unwrap_tcp_in_ip( InternetDatagram ip_d
   }
 
   // is the TCP segment from our peer?
-  if ( tcp_seg.udinfo.src_port != config().destination.port() ) {
+  if ( tuple.remote_port != config().destination.port() ) {
+    return {};
+  }
+
+  return msg;
+}
+
+//! \details Checks only that the datagram carries a valid TCP segment; the caller decides whether
+//! `tuple` names a connection it knows about.
+//! \returns a std::optional<TCPMessage> that is empty if the datagram did not hold a valid TCP segment
+optional<TCPMessage> TCPOverIPv4Adapter::unwrap_tcp_in_ip( InternetDatagram ip_dgram,
+                                                          FourTuple& tuple,
+                                                          const TCPChecksum checksum )
+{
+  // does the IPv4 datagram claim that its payload is a TCP segment?
+  if ( ip_dgram.header.proto != IPv4Header::PROTO_TCP ) {
+    return {};
+  }
+
+  // is the payload a valid TCP segment?
+  TCPSegment tcp_seg;
+  const bool verify_checksum = checksum == TCPChecksum::Full;
+  if ( not parse( tcp_seg, move( ip_dgram.payload ), ip_dgram.header.pseudo_checksum(), verify_checksum ) ) {
     return {};
   }
 
+  tuple = { .local_address = ip_dgram.header.dst,
+            .remote_address = ip_dgram.header.src,
+            .local_port = tcp_seg.udinfo.dst_port,
+            .remote_port = tcp_seg.udinfo.src_port };
+
   return move( tcp_seg.message );
 }
 
 //! Takes a TCP segment, sets port numbers as necessary, and wraps it in an IPv4 datagram
 //! \param[in] seg is the TCP segment to convert
-InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip( const TCPMessage& msg )
+InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip( const TCPMessage& msg, const TCPChecksum checksum )
+{
+  return wrap_tcp_in_ip( { .local_address = config().source.ipv4_numeric(),
+                           .remote_address = config().destination.ipv4_numeric(),
+                           .local_port = config().source.port(),
+                           .remote_port = config().destination.port() },
+                         msg,
+                         checksum );
+}
+
+TCPHeaderTemplate& TCPOverIPv4Adapter::header_template()
+{
+  const FourTuple tuple { .local_address = config().source.ipv4_numeric(),
+                          .remote_address = config().destination.ipv4_numeric(),
+                          .local_port = config().source.port(),
+                          .remote_port = config().destination.port() };
+  if ( not _header_template.has_value() or _header_template->tuple() != tuple ) {
+    _header_template.emplace( tuple );
+  }
+  return _header_template.value();
+}
+
+string_view TCPOverIPv4Adapter::tcp_ip_headers( const TCPMessage& msg, const TCPChecksum checksum )
+{
+  return header_template().fill( msg, checksum );
+}
+
+void TCPOverIPv4Adapter::split_segment( const TCPMessage& msg,
+                                        const size_t mss,
+                                        const TCPChecksum checksum,
+                                        const DatagramWriter& write_datagram )
+{
+  TCPHeaderTemplate& headers = header_template();
+  const string_view payload = msg.sender.get().payload;
+  if ( payload.size() <= mss ) {
+    write_datagram( headers.fill( msg, checksum ), payload );
+    return;
+  }
+
+  for ( size_t offset = 0; offset < payload.size(); offset += mss ) {
+    const size_t length = min( mss, payload.size() - offset );
+    write_datagram( headers.fill( msg, offset, length, checksum ), payload.substr( offset, length ) );
+  }
+}
+
+InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip( const FourTuple& tuple,
+                                                     const TCPMessage& msg,
+                                                     const TCPChecksum checksum )
 {
   const size_t payload_size = msg.sender->payload.size();
+  if ( payload_size > MAX_SEGMENT_PAYLOAD ) {
+    throw runtime_error( "TCP segment too large for an IPv4 datagram" );
+  }
   TCPSegment seg { .message = { msg.sender.borrow(), msg.receiver.borrow() } };
   // set the port numbers in the TCP segment
-  seg.udinfo.src_port = config().source.port();
-  seg.udinfo.dst_port = config().destination.port();
+  seg.udinfo.src_port = tuple.local_port;
+  seg.udinfo.dst_port = tuple.remote_port;
 
   // create an Internet Datagram and set its addresses and length
   InternetDatagram ip_dgram;
-  ip_dgram.header.src = config().source.ipv4_numeric();
-  ip_dgram.header.dst = config().destination.ipv4_numeric();
+  ip_dgram.header.src = tuple.local_address;
+  ip_dgram.header.dst = tuple.remote_address;
   ip_dgram.header.len = ip_dgram.header.hlen * 4 + 20 /* tcp header len */ + payload_size;
 
   // set payload, calculating TCP checksum using information from IP header
-  seg.compute_checksum( ip_dgram.header.pseudo_checksum() );
+  if ( checksum == TCPChecksum::Full ) {
+    seg.compute_checksum( ip_dgram.header.pseudo_checksum() );
+  } else {
+    seg.compute_partial_checksum( ip_dgram.header.pseudo_checksum() );
+  }
   ip_dgram.header.compute_checksum();
   ip_dgram.payload = serialize( seg );
 
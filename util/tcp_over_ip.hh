@@ -1,16 +1,109 @@
 #pragma once
 
+#include "connection_table.hh"
 #include "fd_adapter.hh"
 #include "ipv4_datagram.hh"
 #include "tcp_segment.hh"
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <optional>
+#include <string_view>
+
+//! How the TCP checksum is handled when wrapping or unwrapping a segment
+enum class TCPChecksum : uint8_t
+{
+  Full,     //!< Computed over the whole segment when wrapping, and verified when unwrapping
+  Offloaded //!< Left partial (the pseudo-header's sum) for the device to complete when wrapping, and taken
+            //!< as verified by the device (or never computed, for a locally sent datagram) when unwrapping
+};
+
+//! \brief The IPv4 and TCP headers of one connection's segments, prebuilt so that sending a segment only
+//! patches in what differs from one segment to the next
+//! \details The template holds the serialized headers with every per-connection field (addresses, ports,
+//! version, TTL, protocol, data offset) in place, along with the sums of those fields' 16-bit words for the
+//! IPv4 header checksum and the TCP checksum (including the pseudo-header's addresses and protocol).
+//! fill() writes the length, seqno, ackno, flags and window, and completes both checksums by adding just
+//! those fields (and, for a full TCP checksum, the payload's sum, which a whole segment that the TCPSender
+//! kept comes with; see TCPMessage::payload_sum) to the precomputed sums. The IPv4 identification stays 0, as
+//! in wrap_tcp_in_ip().
+class TCPHeaderTemplate
+{
+public:
+  static constexpr size_t LENGTH = IPv4Header::LENGTH + TCPSegment::HEADER_LENGTH;
+
+  explicit TCPHeaderTemplate( const FourTuple& tuple );
+
+  //! The connection (with "local" being the sender) whose headers these are
+  const FourTuple& tuple() const { return _tuple; }
+
+  //! \brief The serialized headers for `msg`, to be followed by its payload
+  //! \details Valid until the next call. Throws if the payload is longer than one datagram can hold.
+  std::string_view fill( const TCPMessage& msg, TCPChecksum checksum = TCPChecksum::Full );
+
+  //! \brief The serialized headers for `length` bytes of `msg`'s payload, starting at `offset`, sent as a
+  //! segment of their own (one piece of a super-segment, split in software)
+  //! \details The piece's seqno is `offset` sequence numbers on from the payload's start; only the first
+  //! piece carries a SYN, and only the last a FIN. Valid until the next call.
+  std::string_view fill( const TCPMessage& msg,
+                         size_t offset,
+                         size_t length,
+                         TCPChecksum checksum = TCPChecksum::Full );
+
+private:
+  FourTuple _tuple;
+  std::array<char, LENGTH> _headers {};
+  uint32_t _ip_sum {};     //!< Sum of the IPv4 header's fixed words
+  uint32_t _pseudo_sum {}; //!< Sum of the pseudo-header's addresses and protocol
+  uint32_t _tcp_sum {};    //!< Sum of the TCP header's fixed words (the ports and data offset)
+};
 
 //! \brief A converter from TCP segments to serialized IPv4 datagrams
 class TCPOverIPv4Adapter : public FdAdapterBase
 {
 public:
-  std::optional<TCPMessage> unwrap_tcp_in_ip( InternetDatagram ip_dgram );
+  //! The largest payload of a segment that fits in one IPv4 datagram (a super-segment, with segmentation offload)
+  static constexpr size_t MAX_SEGMENT_PAYLOAD = UINT16_MAX - IPv4Header::LENGTH - TCPSegment::HEADER_LENGTH;
+
+  std::optional<TCPMessage> unwrap_tcp_in_ip( InternetDatagram ip_dgram, TCPChecksum checksum = TCPChecksum::Full );
+
+  InternetDatagram wrap_tcp_in_ip( const TCPMessage& msg, TCPChecksum checksum = TCPChecksum::Full );
+
+  //! \brief The serialized IPv4 and TCP headers for sending `msg` to the peer (the payload follows them)
+  //! \details The same bytes as serializing wrap_tcp_in_ip(), but filled in from a TCPHeaderTemplate,
+  //! which is rebuilt only when the connection's addresses or ports change. Valid until the next call.
+  std::string_view tcp_ip_headers( const TCPMessage& msg, TCPChecksum checksum = TCPChecksum::Full );
+
+  //! Writes one datagram, given its serialized headers and the payload that follows them
+  using DatagramWriter = std::function<void( std::string_view headers, std::string_view payload )>;
+
+  //! \brief Segmentation offload in software: split `msg` into segments of at most `mss` bytes of payload,
+  //! calling `write_datagram` with the headers and payload of each datagram in turn
+  //! \details Each datagram's headers come from the connection's TCPHeaderTemplate (see
+  //! TCPHeaderTemplate::fill), so the seqno and checksums of each piece are patched into prebuilt headers. A
+  //! segment with no more than `mss` bytes of payload is written whole.
+  void split_segment( const TCPMessage& msg,
+                      size_t mss,
+                      TCPChecksum checksum,
+                      const DatagramWriter& write_datagram );
+
+  //! \brief Parse the TCP segment in any IPv4 datagram, whichever connection it belongs to
+  //! \param[out] tuple is set to the segment's connection (with "local" being the datagram's destination)
+  static std::optional<TCPMessage> unwrap_tcp_in_ip( InternetDatagram ip_dgram,
+                                                     FourTuple& tuple,
+                                                     TCPChecksum checksum = TCPChecksum::Full );
+
+  //! \brief Wrap a TCP message in an IPv4 datagram from `tuple`'s local end to its remote end
+  //! \details Throws if the payload is longer than MAX_SEGMENT_PAYLOAD.
+  static InternetDatagram wrap_tcp_in_ip( const FourTuple& tuple,
+                                          const TCPMessage& msg,
+                                          TCPChecksum checksum = TCPChecksum::Full );
+
+private:
+  std::optional<TCPHeaderTemplate> _header_template {};
 
-  InternetDatagram wrap_tcp_in_ip( const TCPMessage& msg );
+  //! The template for the connection's current addresses and ports (rebuilt if they have changed)
+  TCPHeaderTemplate& header_template();
 };
@@ -0,0 +1,100 @@
+#include "tcp_over_udp.hh"
+#include "helpers.hh"
+
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+
+TCPOverUDPAdapter::TCPOverUDPAdapter( UDPSocket&& socket ) : _socket( move( socket ) )
+{
+  _socket.set_blocking( false );
+}
+
+optional<TCPMessage> TCPOverUDPAdapter::parse_datagram( const string_view datagram, const Address& source )
+{
+  // is the datagram from our peer (or, while listening, from anyone)?
+  if ( not listening() and source != config().destination ) {
+    return {};
+  }
+
+  // split the datagram into the TCP header and the payload, so the payload is copied out once
+  const size_t header_end = min<size_t>( datagram.size(), TCPSegment::HEADER_LENGTH );
+  vector<string> strs;
+  strs.reserve( 2 );
+  strs.emplace_back( datagram.substr( 0, header_end ) );
+  strs.emplace_back( datagram.substr( header_end ) );
+
+  TCPSegment tcp_seg;
+  if ( not parse( tcp_seg, move( strs ), 0, false ) ) {
+    return {};
+  }
+
+  // should we reply to this sender?
+  if ( listening() ) {
+    if ( not tcp_seg.message.sender->SYN or tcp_seg.message.sender->RST ) {
+      return {};
+    }
+    config_mutable().destination = source;
+    set_listening( false );
+  }
+
+  return move( tcp_seg.message );
+}
+
+optional<TCPMessage> TCPOverUDPAdapter::read()
+{
+  vector<TCPMessage> segments;
+  read_batch( segments, 1 );
+  if ( segments.empty() ) {
+    return {};
+  }
+  return move( segments.front() );
+}
+
+size_t TCPOverUDPAdapter::read_batch( vector<TCPMessage>& segments, const size_t max_datagrams )
+{
+  if ( _inbound.size() < max_datagrams ) {
+    _inbound.resize( max_datagrams );
+  }
+
+  const size_t received = _socket.recv_batch( span { _inbound }.first( max_datagrams ), _inbound_sources );
+  for ( size_t i = 0; i < received; ++i ) {
+    if ( auto segment = parse_datagram( _inbound[i], _inbound_sources[i] ) ) {
+      segments.push_back( move( segment.value() ) );
+    }
+  }
+  return received;
+}
+
+void TCPOverUDPAdapter::write( const TCPMessage& seg )
+{
+  if ( _outbound_count == DEFAULT_BATCH_SIZE ) {
+    flush();
+  }
+
+  TCPSegment tcp_seg { .message = { seg.sender.borrow(), seg.receiver.borrow() } };
+  tcp_seg.udinfo.src_port = config().source.port();
+  tcp_seg.udinfo.dst_port = config().destination.port();
+
+  // copy the segment into a buffer of its own (the message's payload may not outlive this call)
+  if ( _outbound.size() == _outbound_count ) {
+    _outbound.emplace_back();
+  }
+  string& datagram = _outbound[_outbound_count++];
+  datagram.clear();
+  for ( const auto& buffer : serialize( tcp_seg ) ) {
+    datagram.append( buffer );
+  }
+}
+
+void TCPOverUDPAdapter::flush()
+{
+  if ( _outbound_count == 0 ) {
+    return;
+  }
+
+  _outbound_views.assign( _outbound.begin(), _outbound.begin() + static_cast<ptrdiff_t>( _outbound_count ) );
+  _outbound_count = 0;
+  _socket.sendto_batch( config().destination, _outbound_views ); // (what does not fit is lost, as on a network)
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "address.hh"
+#include "fd_adapter.hh"
+#include "socket.hh"
+#include "tcp_segment.hh"
+#include "tuntap_adapter.hh"
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//! \brief A FD adapter that carries TCP segments in UDP datagrams, so needs no TUN device (or privileges)
+//! \details Each datagram holds one serialized TCPSegment, whose ports are those of config(). Datagrams
+//! are taken only from the UDP address config().destination, or, while listening, from the sender of a
+//! SYN (which then becomes the destination); the kernel has already demultiplexed them by local UDP port.
+//! UDP's checksum covers the segment, so the TCP checksum is neither computed nor verified.
+class TCPOverUDPAdapter : public FdAdapterBase
+{
+private:
+  UDPSocket _socket;
+
+  //! Buffers that datagrams are received into (reused between batches)
+  std::vector<std::string> _inbound {};
+  std::vector<Address> _inbound_sources {};
+
+  //! Serialized segments waiting for flush() (the first _outbound_count of them; the rest are spare buffers)
+  std::vector<std::string> _outbound {};
+  std::vector<std::string_view> _outbound_views {};
+  size_t _outbound_count {};
+
+  //! Parse a datagram from `source`, if it is for this connection
+  std::optional<TCPMessage> parse_datagram( std::string_view datagram, const Address& source );
+
+public:
+  //! \brief Construct from a UDP socket (bound to the local address to use, to listen), which becomes
+  //! non-blocking
+  explicit TCPOverUDPAdapter( UDPSocket&& socket );
+
+  //! Datagrams taken by one read_batch(), and writes queued before flush() sends them, unless asked otherwise
+  static constexpr size_t DEFAULT_BATCH_SIZE = 64;
+
+  //! Attempts to read a datagram carrying a TCP segment related to the current connection
+  std::optional<TCPMessage> read();
+
+  //! \brief Read up to `max_datagrams` datagrams with one [recvmmsg(2)](\ref man2::recvmmsg), and append
+  //! the TCP segments among them (as read() would return them) to `segments`
+  //! \returns the number of datagrams read (including any that were not for this connection)
+  size_t read_batch( std::vector<TCPMessage>& segments, size_t max_datagrams = DEFAULT_BATCH_SIZE );
+
+  //! Serializes a TCP segment into a UDP datagram, and queues it (sending the queue once it is full)
+  void write( const TCPMessage& seg );
+
+  //! Send the queued datagrams to config().destination with one [sendmmsg(2)](\ref man2::sendmmsg)
+  void flush();
+
+  //! Access the underlying UDP socket
+  FileDescriptor& fd() { return _socket; }
+};
+
+static_assert( TCPDatagramAdapter<TCPOverUDPAdapter> );
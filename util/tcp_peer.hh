@@ -1,5 +1,6 @@
 #pragma once
 
+#include "receive_buffer_tuner.hh"
 #include "tcp_config.hh"
 #include "tcp_receiver.hh"
 #include "tcp_receiver_message.hh"
@@ -7,8 +8,10 @@
 #include "tcp_sender.hh"
 #include "tcp_sender_message.hh"
 
+#include <algorithm>
 #include <functional>
 #include <optional>
+#include <span>
 
 class TCPPeer
 {
@@ -18,7 +21,12 @@ class TCPPeer
   }
 
 public:
-  explicit TCPPeer( const TCPConfig& cfg ) : cfg_( cfg ) {}
+  explicit TCPPeer( const TCPConfig& cfg ) : cfg_( cfg )
+  {
+    if ( cfg_.recv_capacity_max > cfg_.recv_capacity ) {
+      tuner_.emplace( cfg_.recv_capacity, cfg_.recv_capacity_max, cfg_.rt_timeout, cfg_.recv_budget );
+    }
+  }
 
   Writer& outbound_writer() { return sender_.writer(); }
   Reader& inbound_reader() { return receiver_.reader(); }
@@ -32,19 +40,59 @@ public:
   {
     cumulative_time_ += t;
     sender_.tick( t, make_send( transmit ) );
+    if ( tuner_ ) {
+      receiver_.set_capacity( tuner_->tick( t,
+                                            receiver_.writer().bytes_pushed(),
+                                            std::as_const( receiver_ ).reader().bytes_popped(),
+                                            advertised_edge_ ) );
+    }
   }
   bool has_ackno() const { return receiver_.send().ackno.has_value(); }
 
+  /* After the application reads from the inbound stream: if the window the peer knows about has
+     nearly closed, and can now open by at least a full segment, tell the peer (instead of leaving it
+     to discover the window with a probe after a retransmission timeout) */
+  void send_window_update( const TransmitFunction& transmit )
+  {
+    if ( not has_ackno() or receiver_.writer().is_closed() ) {
+      return;
+    }
+
+    const uint64_t pushed = receiver_.writer().bytes_pushed();
+    const uint64_t known_window = advertised_edge_ > pushed ? advertised_edge_ - pushed : 0;
+    const uint64_t window = receiver_.send().window_size;
+    if ( window >= 2 * known_window and window >= known_window + TCPConfig::MAX_PAYLOAD_SIZE ) {
+      send( sender_.make_empty_message(), transmit );
+    }
+  }
+
   /* Is the peer still active? */
   bool active() const
   {
     const bool any_errors = receiver_.reader().has_error() or sender_.writer().has_error();
-    const bool sender_active = sender_.sequence_numbers_in_flight() or not sender_.reader().is_finished();
-    const bool receiver_active = not receiver_.writer().is_closed();
     const bool lingering
       = linger_after_streams_finish_ and ( cumulative_time_ < time_of_last_receipt_ + 10UL * cfg_.rt_timeout );
 
-    return ( not any_errors ) and ( sender_active or receiver_active or lingering );
+    return ( not any_errors ) and ( streams_active() or lingering );
+  }
+
+  /* Milliseconds until tick() next has something to do on its own: retransmit, adjust the receive
+     window, or stop lingering (none if the peer is idle until a segment arrives or the app acts) */
+  std::optional<uint64_t> next_deadline() const
+  {
+    if ( not active() ) {
+      return {};
+    }
+
+    std::optional<uint64_t> deadline = sender_.next_deadline();
+    const auto sooner = [&]( uint64_t ms ) { deadline = std::min( deadline.value_or( ms ), ms ); };
+    if ( tuner_ ) {
+      sooner( tuner_->next_deadline() );
+    }
+    if ( not streams_active() ) {
+      sooner( time_of_last_receipt_ + 10UL * cfg_.rt_timeout - cumulative_time_ );
+    }
+    return deadline;
   }
 
   void receive( TCPMessage msg, const TransmitFunction& transmit )
@@ -53,9 +101,51 @@ public:
       return;
     }
 
+    absorb( std::move( msg ) );
+    reply( transmit );
+  }
+
+  /* Receive segments that arrived together (e.g. in one read from the network), then push and send
+     any reply once for the whole batch: one ACK acknowledges all of it */
+  void receive_batch( std::span<TCPMessage> msgs, const TransmitFunction& transmit )
+  {
+    bool any_received = false;
+    while ( not msgs.empty() and active() ) {
+      // Generic receive offload: absorb each run of back-to-back, in-order data segments in one go.
+      const size_t run_length = cfg_.receive_coalescing ? coalescible_run( msgs ) : 1;
+      absorb_run( msgs.first( run_length ) );
+      msgs = msgs.subspan( run_length );
+      any_received = true;
+    }
+
+    if ( any_received ) {
+      reply( transmit );
+    }
+  }
+
+  // Testing interface
+  const TCPReceiver& receiver() const { return receiver_; }
+  const TCPSender& sender() const { return sender_; }
+
+private:
+  TCPConfig cfg_;
+  TCPSender sender_ { ByteStream { cfg_.send_capacity }, cfg_.isn, cfg_.rt_timeout, cfg_.max_segment_payload };
+  TCPReceiver receiver_ { Reassembler { ByteStream { cfg_.recv_capacity } } };
+  std::optional<ReceiveBufferTuner> tuner_ {}; // receive-buffer auto-tuning, if enabled in the TCPConfig
+  uint64_t advertised_edge_ {};                // largest right edge of the window sent to the peer (stream index)
+
+  bool need_send_ {};
+
+  /* Hand a segment to the receiver and sender, noting whether it needs a reply */
+  void absorb( TCPMessage msg )
+  {
     // Record time in case this peer has to linger after streams finish.
     time_of_last_receipt_ = cumulative_time_;
 
+    if ( cfg_.header_prediction and absorb_predicted( msg ) ) {
+      return;
+    }
+
     // If SenderMessage occupies a sequence number, make sure to reply.
     need_send_ |= ( msg.sender->sequence_length() > 0 );
 
@@ -69,7 +159,74 @@ public:
 
     // Give incoming TCPReceiverMessage to sender.
     sender_.receive( msg.receiver );
+  }
+
+  /* Header prediction (after Van Jacobson): in the middle of a bulk transfer, nearly every segment is either
+     the next in-order data, acknowledging nothing new, or a pure ACK of new data, and neither carries a flag
+     or changes the window. Append the data straight to the inbound stream, or trim the retransmission queue,
+     without the general receive path; return false, having done nothing, for any other segment */
+  bool absorb_predicted( TCPMessage& msg )
+  {
+    if ( not receiver_.predicts( msg.sender.get() ) or not sender_.receive_predicted( msg.receiver.get() ) ) {
+      return false;
+    }
+
+    if ( not msg.sender.get().payload.empty() ) {
+      need_send_ = true;
+      receiver_.receive_predicted( msg.sender.release().payload );
+    }
+    return true;
+  }
+
+  /* Absorb a run of segments found by coalescible_run(). With header prediction, the receiver and sender check
+     the run once, then the payloads go to the inbound stream one after another (without copying them into one
+     string). Whatever is left, or all of the run without prediction, is merged into a single segment, so the
+     Reassembler runs once for all of it. */
+  void absorb_run( std::span<TCPMessage> run )
+  {
+    if ( run.size() > 1 and cfg_.header_prediction ) {
+      // (a first segment that can't be predicted may fill the Reassembler's gap, letting the rest be predicted)
+      if ( not receiver_.predicts( run.front().sender.get() ) ) {
+        absorb( std::move( run.front() ) );
+        run = run.subspan( 1 );
+      }
+      run = run.subspan( absorb_predicted_run( run ) );
+    }
+
+    if ( not run.empty() ) {
+      absorb( run.size() == 1 ? std::move( run.front() ) : coalesce( run ) );
+    }
+  }
+
+  /* Header prediction for the longest part of a run that fits in the inbound stream; returns how many segments
+     it absorbed (none, unless at least two) */
+  size_t absorb_predicted_run( std::span<TCPMessage> run )
+  {
+    const uint64_t capacity = receiver_.writer().available_capacity();
+    size_t length = 0;
+    uint64_t run_payload = 0;
+    while ( length < run.size() and not run[length].sender.get().FIN
+            and run_payload + run[length].sender.get().payload.size() <= capacity ) {
+      run_payload += run[length].sender.get().payload.size();
+      ++length;
+    }
+
+    if ( length < 2 or not receiver_.predicts( run.front().sender.get() )
+         or not sender_.receive_predicted( run[length - 1].receiver.get() ) ) {
+      return 0;
+    }
 
+    time_of_last_receipt_ = cumulative_time_;
+    for ( auto& msg : run.first( length ) ) {
+      receiver_.receive_predicted( msg.sender.release().payload );
+    }
+    need_send_ = true;
+    return length;
+  }
+
+  /* Push outbound data, and send an ACK if anything absorbed since the last reply needs one */
+  void reply( const TransmitFunction& transmit )
+  {
     // Send reply if needed.
     push( transmit );
     if ( need_send_ ) {
@@ -82,23 +239,25 @@ public:
     }
   }
 
-  // Testing interface
-  const TCPReceiver& receiver() const { return receiver_; }
-  const TCPSender& sender() const { return sender_; }
-
-private:
-  TCPConfig cfg_;
-  TCPSender sender_ { ByteStream { cfg_.send_capacity }, cfg_.isn, cfg_.rt_timeout };
-  TCPReceiver receiver_ { Reassembler { ByteStream { cfg_.recv_capacity } } };
-
-  bool need_send_ {};
-
   void send( const TCPSenderMessage& sender_message, const TransmitFunction& transmit )
   {
-    transmit( { borrow( sender_message ), receiver_.send() } );
+    TCPReceiverMessage receiver_message = receiver_.send();
+    advertised_edge_
+      = std::max( advertised_edge_, receiver_.writer().bytes_pushed() + receiver_message.window_size );
+    transmit( { .sender = borrow( sender_message ),
+                .receiver = std::move( receiver_message ),
+                .payload_sum = sender_.kept_payload_sum( sender_message ) } );
     need_send_ = false;
   }
 
+  /* Is either stream still carrying data? */
+  bool streams_active() const
+  {
+    const bool sender_active = sender_.sequence_numbers_in_flight() or not sender_.reader().is_finished();
+    const bool receiver_active = not receiver_.writer().is_closed();
+    return sender_active or receiver_active;
+  }
+
   bool linger_after_streams_finish_ { true }; // one peer may need to linger to make sure all closure conditions met
   uint64_t cumulative_time_ {};
   uint64_t time_of_last_receipt_ {};
@@ -9,14 +9,16 @@ using namespace std;
 
 static_assert( !( TCPSegment::HEADER_LENGTH & 0x03 ) ); // header length must be divisible by 4
 
-void TCPSegment::parse( Parser& parser, uint32_t datagram_layer_pseudo_checksum )
+void TCPSegment::parse( Parser& parser, uint32_t datagram_layer_pseudo_checksum, bool verify_checksum )
 {
   /* verify checksum */
-  InternetChecksum check { datagram_layer_pseudo_checksum };
-  check.add( parser.buffer() );
-  if ( check.value() ) {
-    parser.set_error();
-    return;
+  if ( verify_checksum ) {
+    InternetChecksum check { datagram_layer_pseudo_checksum };
+    check.add( parser.buffer() );
+    if ( check.value() ) {
+      parser.set_error();
+      return;
+    }
   }
 
   uint32_t raw32 {};
@@ -58,23 +60,33 @@ void TCPSegment::parse( Parser& parser, uint32_t datagram_layer_pseudo_checksum
   parser.concatenate_all_remaining( message.sender->payload );
 }
 
+namespace {
+
 class Wrap32Serializable : public Wrap32
 {
 public:
   uint32_t raw_value() const { return raw_value_; }
 };
 
+constexpr uint8_t DATA_OFFSET = ( TCPSegment::HEADER_LENGTH >> 2 ) << 4;
+
+uint8_t flags( const TCPMessage& message )
+{
+  const bool reset = message.sender->RST or message.receiver->RST;
+  return ( message.receiver->ackno.has_value() ? 0b0001'0000U : 0 ) | ( reset ? 0b0000'0100U : 0 )
+         | ( message.sender->SYN ? 0b0000'0010U : 0 ) | ( message.sender->FIN ? 0b0000'0001U : 0 );
+}
+
+} // namespace
+
 void TCPSegment::serialize( Serializer& serializer ) const
 {
   serializer.integer( udinfo.src_port );
   serializer.integer( udinfo.dst_port );
   serializer.integer( Wrap32Serializable { message.sender->seqno }.raw_value() );
   serializer.integer( Wrap32Serializable { message.receiver->ackno.value_or( Wrap32 { 0 } ) }.raw_value() );
-  serializer.integer( uint8_t { ( HEADER_LENGTH >> 2 ) << 4 } ); // data offset
-  const bool reset = message.sender->RST or message.receiver->RST;
-  const uint8_t flags = ( message.receiver->ackno.has_value() ? 0b0001'0000U : 0 ) | ( reset ? 0b0000'0100U : 0 )
-                        | ( message.sender->SYN ? 0b0000'0010U : 0 ) | ( message.sender->FIN ? 0b0000'0001U : 0 );
-  serializer.integer( flags );
+  serializer.integer( DATA_OFFSET );
+  serializer.integer( flags( message ) );
   serializer.integer( message.receiver->window_size );
   serializer.integer( udinfo.cksum );
   serializer.integer( uint16_t { 0 } ); // urgent pointer
@@ -83,13 +95,24 @@ void TCPSegment::serialize( Serializer& serializer ) const
 
 void TCPSegment::compute_checksum( uint32_t datagram_layer_pseudo_checksum )
 {
-  udinfo.cksum = 0;
-  Serializer s;
-  serialize( s );
+  // the sum of the header's words (with the checksum field 0), added to that of the payload's, rather than
+  // serializing the segment just to sum it
+  const TCPSenderMessage& sender = message.sender.get();
+  const TCPReceiverMessage& receiver = message.receiver.get();
+  const uint32_t seqno = Wrap32Serializable { sender.seqno }.raw_value();
+  const uint32_t ackno = Wrap32Serializable { receiver.ackno.value_or( Wrap32 { 0 } ) }.raw_value();
+  const uint32_t header_sum = udinfo.src_port + udinfo.dst_port + ( seqno >> 16 ) + ( seqno & 0xffff )
+                              + ( ackno >> 16 ) + ( ackno & 0xffff ) + ( DATA_OFFSET << 8 ) + flags( message )
+                              + receiver.window_size;
+
+  const uint16_t payload_sum = message.payload_sum.has_value() ? *message.payload_sum : sender.payload_sum();
+  udinfo.cksum = InternetChecksum { datagram_layer_pseudo_checksum + header_sum + payload_sum }.value();
+}
 
-  InternetChecksum check { datagram_layer_pseudo_checksum };
-  check.add( s.finish() );
-  udinfo.cksum = check.value();
+void TCPSegment::compute_partial_checksum( uint32_t datagram_layer_pseudo_checksum )
+{
+  // the folded sum, not yet complemented: the device adds the segment's bytes to it, then complements
+  udinfo.cksum = static_cast<uint16_t>( ~InternetChecksum { datagram_layer_pseudo_checksum }.value() );
 }
 
 string TCPSegment::to_string() const
@@ -117,3 +140,50 @@ string TCPSegment::to_string() const
   ss << " src=" << udinfo.src_port << " dst=" << udinfo.dst_port;
   return ss.str();
 }
+
+namespace {
+
+// Can `next` join a run of segments ending with `last`?
+bool continues( const TCPMessage& last, const TCPMessage& next, size_t run_payload, size_t max_payload )
+{
+  const TCPSenderMessage& prev = last.sender.get();
+  const TCPSenderMessage& seg = next.sender.get();
+  return not prev.SYN and not prev.FIN and not prev.RST and not last.receiver.get().RST and not seg.SYN
+         and not seg.RST and not next.receiver.get().RST and not prev.payload.empty() and not seg.payload.empty()
+         and seg.seqno == prev.seqno + static_cast<uint32_t>( prev.payload.size() )
+         and last.receiver.get().ackno == next.receiver.get().ackno
+         and run_payload + seg.payload.size() <= max_payload;
+}
+
+} // namespace
+
+size_t coalescible_run( span<const TCPMessage> msgs, const size_t max_payload )
+{
+  if ( msgs.empty() ) {
+    return 0;
+  }
+
+  size_t length = 1;
+  size_t run_payload = msgs.front().sender.get().payload.size();
+  while ( length < msgs.size() and continues( msgs[length - 1], msgs[length], run_payload, max_payload ) ) {
+    run_payload += msgs[length].sender.get().payload.size();
+    ++length;
+  }
+  return length;
+}
+
+TCPMessage coalesce( span<TCPMessage> run )
+{
+  size_t run_payload = 0;
+  for ( const auto& msg : run ) {
+    run_payload += msg.sender.get().payload.size();
+  }
+
+  TCPSenderMessage merged = run.front().sender.release();
+  merged.payload.reserve( run_payload );
+  for ( const auto& msg : run.subspan( 1 ) ) {
+    merged.payload.append( msg.sender.get().payload );
+  }
+  merged.FIN = run.back().sender.get().FIN;
+  return { move( merged ), move( run.back().receiver ) };
+}
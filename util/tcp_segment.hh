@@ -6,6 +6,10 @@
 #include "tcp_sender_message.hh"
 #include "udinfo.hh"
 
+#include <cstdint>
+#include <optional>
+#include <span>
+
 // A TCPMessage (a concept used only in CS144) models the full
 // messages sent between TCP endpoints, omitting the multiplexing
 // information and checksum.
@@ -13,8 +17,21 @@ struct TCPMessage
 {
   Ref<TCPSenderMessage> sender {};
   Ref<TCPReceiverMessage> receiver {};
+
+  // The sender's payload_sum(), when the TCPSender already has it (set by TCPPeer for the segments it
+  // keeps for retransmission; otherwise the checksum sums the payload)
+  std::optional<uint16_t> payload_sum {};
 };
 
+// Generic receive offload: how many messages at the front of `msgs` (all from one connection) form a run of
+// back-to-back, in-order data segments that can be taken as one? Segments join a run while they carry no SYN or
+// RST, the same ackno, and no FIN before the last of the run, and while the run's payload stays within
+// `max_payload`. (Always at least one, unless `msgs` is empty.)
+size_t coalescible_run( std::span<const TCPMessage> msgs, size_t max_payload = UINT16_MAX );
+
+// Merge such a run into one message: the payloads concatenated, with the last segment's FIN and receiver message
+TCPMessage coalesce( std::span<TCPMessage> run );
+
 // A TCPSegment represents a complete (STD 7 / RFC 9293) TCP segment.
 // It includes a TCPMessage plus the UDP-like information included in the TCP header.
 struct TCPSegment
@@ -22,11 +39,16 @@ struct TCPSegment
   TCPMessage message {};
   UserDatagramInfo udinfo {};
 
-  void parse( Parser& parser, uint32_t datagram_layer_pseudo_checksum );
+  // (with `verify_checksum` false, the checksum is taken as already verified, or as never computed)
+  void parse( Parser& parser, uint32_t datagram_layer_pseudo_checksum, bool verify_checksum = true );
   void serialize( Serializer& serializer ) const;
 
   void compute_checksum( uint32_t datagram_layer_pseudo_checksum );
 
+  // Set the checksum to the pseudo-header's sum alone, for a device that completes it over the segment
+  // (checksum offload)
+  void compute_partial_checksum( uint32_t datagram_layer_pseudo_checksum );
+
   static constexpr uint8_t HEADER_LENGTH = 20; // TCP header length, not including options
 
   // Return a string containing a summary in human-readable format
@@ -1,8 +1,11 @@
 #pragma once
 
+#include "checksum.hh"
 #include "wrapping_integers.hh"
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 
 /*
  * The TCPSenderMessage structure contains the information sent from a TCP sender to its receiver.
@@ -20,6 +23,10 @@
  * 4) The FIN flag. If set, the payload represents the ending of the byte stream.
  *
  * 5) The RST (reset) flag. If set, the stream has suffered an error and the connection should be aborted.
+ *
+ * The TCP checksum needs the sum of the payload's 16-bit words (payload_sum). The TCPSender keeps that sum
+ * with each segment it may retransmit (see TCPMessage::payload_sum), so a retransmission doesn't walk
+ * its payload again.
  */
 
 struct TCPSenderMessage
@@ -34,4 +41,12 @@ struct TCPSenderMessage
 
   // How many sequence numbers does this segment use?
   size_t sequence_length() const { return SYN + payload.size() + FIN; }
+
+  // The sum of the payload's big-endian 16-bit words, folded to 16 bits (not complemented)
+  uint16_t payload_sum() const
+  {
+    InternetChecksum check;
+    check.add( std::string_view { payload } );
+    return static_cast<uint16_t>( ~check.value() );
+  }
 };
@@ -0,0 +1,523 @@
+#include "tcp_stack.hh"
+
+#include "exception.hh"
+#include "helpers.hh"
+#include "ipv4_datagram.hh"
+#include "random.hh"
+#include "tcp_over_ip.hh"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <utility>
+
+using namespace std;
+
+namespace {
+uint64_t timestamp_ms()
+{
+  return chrono::duration_cast<chrono::milliseconds>( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+} // namespace
+
+TCPListener::TCPListener( const TCPConfig& config,
+                          const uint32_t local_address,
+                          const size_t backlog,
+                          const size_t syn_backlog )
+  : config_( config )
+  , local_address_( local_address )
+  , backlog_( backlog )
+  , syn_backlog_( syn_backlog )
+  , rng_( get_random_engine() )
+{}
+
+optional<TCPListener::AcceptedConnection> TCPListener::accept()
+{
+  if ( accept_queue_.empty() ) {
+    return {};
+  }
+
+  AcceptedConnection ret = move( accept_queue_.front() );
+  accept_queue_.pop_front();
+  return ret;
+}
+
+TCPStack::Connection::Connection( const FourTuple& s_tuple, const TCPConfig& config, LocalStreamSocket&& s_data )
+  : tuple( s_tuple ), peer( config ), data( move( s_data ) )
+{}
+
+TCPStack::TCPStack( FileDescriptor&& datagram_fd ) : TCPStack( datagram_fd.duplicate(), move( datagram_fd ) ) {}
+
+TCPStack::TCPStack( FileDescriptor&& inbound_fd, FileDescriptor&& outbound_fd )
+  : inbound_fd_( move( inbound_fd ) )
+  , outbound_fd_( move( outbound_fd ) )
+  , datagram_category_( eventloop_.add_category( "receive TCP segment from the network" ) )
+  , outbound_category_( eventloop_.add_category( "push bytes to TCPPeer" ) )
+  , inbound_category_( eventloop_.add_category( "read bytes from inbound stream" ) )
+  , wakeup_category_( eventloop_.add_category( "wake up TCPStack" ) )
+  , touched_( 1 )
+{
+  inbound_fd_.set_blocking( false );
+  outbound_fd_.set_blocking( false );
+
+  eventloop_.add_rule( datagram_category_, inbound_fd_, Direction::In, [&] {
+    // with an executor, a batch of datagrams gives the workers segments for many connections at once
+    const size_t batch = executor_ != nullptr ? MAX_DATAGRAMS_PER_ROUND : 1;
+    for ( size_t i = 0; i < batch; ++i ) {
+      if ( not read_datagram() ) {
+        break;
+      }
+    }
+  } );
+
+  eventloop_.add_rule(
+    "write datagrams to the network",
+    outbound_fd_,
+    Direction::Out,
+    [&] { write_datagrams(); },
+    [&] { return not outbound_queue_.empty(); } );
+}
+
+// Read and handle one datagram, if there is one to read
+bool TCPStack::read_datagram()
+{
+  vector<string> strs( 3 );
+  strs[0].resize( IPv4Header::LENGTH );
+  strs[1].resize( TCPSegment::HEADER_LENGTH );
+  inbound_fd_.read( strs );
+  if ( strs.empty() ) {
+    return false;
+  }
+
+  InternetDatagram ip_dgram;
+  if ( parse( ip_dgram, move( strs ) ) ) {
+    receive_datagram( move( ip_dgram ) );
+  }
+  return true;
+}
+
+void TCPStack::set_executor( WorkStealingExecutor& executor )
+{
+  if ( connections_.size() > 0 ) {
+    throw runtime_error( "TCPStack: set_executor() called after a connection was opened" );
+  }
+
+  executor_ = &executor;
+  eventloop_.set_executor( &executor );
+  transmitted_.resize( executor.num_workers() + 1 );
+  touched_.resize( executor.num_workers() + 1 );
+}
+
+void TCPStack::write_datagrams()
+{
+  for ( size_t i = 0; i < MAX_DATAGRAMS_PER_ROUND and not outbound_queue_.empty(); ++i ) {
+    if ( outbound_fd_.write( outbound_queue_.front() ) == 0 ) {
+      break;
+    }
+    outbound_queue_.pop_front();
+  }
+}
+
+void TCPStack::transmit( const FourTuple& tuple, const TCPMessage& msg )
+{
+  const InternetDatagram ip_dgram = TCPOverIPv4Adapter::wrap_tcp_in_ip( tuple, msg );
+  const auto buffers = serialize( ip_dgram );
+  if ( executor_ == nullptr and outbound_queue_.empty() and outbound_fd_.write( buffers ) > 0 ) {
+    return;
+  }
+
+  string datagram;
+  for ( const auto& buffer : buffers ) {
+    datagram.append( buffer.get() );
+  }
+  if ( executor_ == nullptr ) {
+    enqueue( move( datagram ) );
+  } else {
+    transmitted_[executor_->worker_index()].push_back( move( datagram ) );
+  }
+}
+
+// Wait for the interface to have room for a datagram, or drop it (TCP will retransmit it) if too many are waiting
+void TCPStack::enqueue( string&& datagram )
+{
+  if ( outbound_queue_.size() >= MAX_OUTBOUND_QUEUE ) {
+    ++datagrams_dropped_;
+    return;
+  }
+  outbound_queue_.push_back( move( datagram ) );
+}
+
+void TCPStack::receive_datagram( InternetDatagram ip_dgram )
+{
+  FourTuple tuple;
+  auto msg = TCPOverIPv4Adapter::unwrap_tcp_in_ip( move( ip_dgram ), tuple );
+  if ( not msg.has_value() ) {
+    return;
+  }
+
+  Connection* connection = connections_.find( tuple );
+  if ( connection == nullptr ) {
+    const TCPSenderMessage& sender = msg.value().sender.get();
+    const auto listener = listeners_.find( tuple.local_port );
+    if ( sender.RST or listener == listeners_.end() or not listener->second->accepts( tuple ) ) {
+      ++segments_dropped_;
+      return;
+    }
+
+    if ( sender.SYN ) {
+      receive_syn( *listener->second, tuple, move( msg.value() ) );
+      return;
+    }
+
+    // Perhaps the ACK that completes a handshake answered with a SYN cookie
+    connection = receive_cookie( *listener->second, tuple, msg.value() );
+    if ( connection == nullptr ) {
+      ++segments_dropped_;
+      return;
+    }
+  }
+
+  if ( executor_ != nullptr ) {
+    // the segment is processed on the connection's strand, and the handshake checked once it has been
+    if ( connection->listener != nullptr ) {
+      handshakes_.push_back( connection );
+    }
+    eventloop_.post( connection->strand, [this, connection, m = move( msg.value() )]() mutable {
+      advance_clock( *connection, timestamp_ms() );
+      connection->peer.receive( move( m ), [&]( auto x ) { transmit( connection->tuple, x ); } );
+      touch( *connection );
+    } );
+    return;
+  }
+
+  // (the peer's clock is brought up to date first, so that it knows when the segment arrived)
+  advance_clock( *connection, timestamp_ms() );
+  connection->peer.receive( move( msg.value() ), [&]( auto x ) { transmit( tuple, x ); } );
+  touch( *connection );
+  check_established( *connection );
+}
+
+// Has the last segment completed a passive open? (While a connection is half-open, the application
+// cannot have written anything, so the only sequence number that can be in flight is the SYN.)
+void TCPStack::check_established( Connection& connection )
+{
+  if ( connection.listener == nullptr or not connection.peer.has_ackno()
+       or connection.peer.sender().sequence_numbers_in_flight() > 0 ) {
+    return;
+  }
+
+  const FourTuple& tuple = connection.tuple;
+  TCPListener& listener = *connection.listener;
+  --listener.half_open_;
+  listener.accept_queue_.push_back(
+    { .socket = move( connection.application_end.value() ),
+      .peer = Address { Address::from_ipv4_numeric( tuple.remote_address ).ip(), tuple.remote_port } } );
+  connection.listener = nullptr;
+  connection.application_end.reset();
+}
+
+// Create a half-open connection in `listener`'s SYN queue
+TCPStack::Connection& TCPStack::open_passive( TCPListener& listener, const FourTuple& tuple, const Wrap32 isn )
+{
+  TCPConfig config = listener.config_;
+  config.isn = isn;
+
+  auto [connection, application_end] = open( tuple, config );
+  connection->listener = &listener;
+  connection->application_end.emplace( move( application_end ) );
+  ++listener.half_open_;
+  return *connection;
+}
+
+// A SYN for a listening port: start a passive open, or answer with a SYN cookie if the SYN queue is full
+void TCPStack::receive_syn( TCPListener& listener, const FourTuple& tuple, TCPMessage msg )
+{
+  if ( listener.accept_queue_.size() >= listener.backlog_ ) {
+    ++listener.syns_dropped_;
+    return;
+  }
+
+  if ( listener.half_open_ < listener.syn_backlog_ ) {
+    Connection& connection = open_passive( listener, tuple, Wrap32 { static_cast<uint32_t>( listener.rng_() ) } );
+    connection.peer.receive( move( msg ), [&]( auto x ) { transmit( tuple, x ); } );
+    touch( connection );
+    return;
+  }
+
+  if ( not listener.syn_cookies_ ) {
+    ++listener.syns_dropped_;
+    return;
+  }
+
+  // Minnow does not parse TCP options, so the cookie records our own (conservative) MSS
+  const Wrap32 peer_isn = msg.sender->seqno;
+  const Wrap32 cookie = listener.cookies_.make( tuple, peer_isn, TCPConfig::MAX_PAYLOAD_SIZE, timestamp_ms() );
+  const auto window_size = static_cast<uint16_t>( min<size_t>( listener.config_.recv_capacity, UINT16_MAX ) );
+  TCPSenderMessage syn_ack { .seqno = cookie, .SYN = true };
+  TCPReceiverMessage ack { .ackno = peer_isn + 1, .window_size = window_size };
+  transmit( tuple, { move( syn_ack ), move( ack ) } );
+  ++listener.cookies_sent_;
+}
+
+// An ACK for a listening port, with no connection: if it acknowledges a valid SYN cookie, rebuild
+// the half-open connection that a SYN would have created
+TCPStack::Connection* TCPStack::receive_cookie( TCPListener& listener,
+                                                const FourTuple& tuple,
+                                                const TCPMessage& msg )
+{
+  const auto& ackno = msg.receiver->ackno;
+  if ( not listener.syn_cookies_ or not ackno.has_value() or listener.accept_queue_.size() >= listener.backlog_ ) {
+    return nullptr;
+  }
+
+  // the ACK's seqno is one past the peer's ISN, and its ackno one past the cookie
+  const Wrap32 peer_isn = msg.sender->seqno + UINT32_MAX;
+  const Wrap32 cookie = ackno.value() + UINT32_MAX;
+  if ( not listener.cookies_.check( tuple, peer_isn, cookie, timestamp_ms() ).has_value() ) {
+    return nullptr;
+  }
+
+  // The SYN/ACK has already been sent, so the replies to the reconstructed SYN are discarded
+  Connection& connection = open_passive( listener, tuple, cookie );
+  connection.peer.receive( { TCPSenderMessage { .seqno = peer_isn, .SYN = true },
+                             TCPReceiverMessage { .window_size = msg.receiver->window_size } },
+                           []( const TCPMessage& /*unused*/ ) {} );
+  ++listener.cookies_accepted_;
+  return &connection;
+}
+
+// Create a connection, and the socket pair that links it to the application
+pair<TCPStack::Connection*, LocalStreamSocket> TCPStack::open( const FourTuple& tuple, const TCPConfig& config )
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM, 0, fds.data() ) );
+  LocalStreamSocket application_end { FileDescriptor { fds[0] } };
+  LocalStreamSocket stack_end { FileDescriptor { fds[1] } };
+  stack_end.set_blocking( false );
+
+  auto [connection, inserted] = connections_.emplace( tuple, tuple, config, move( stack_end ) );
+  if ( not inserted ) {
+    throw runtime_error( "TCPStack: connection from port " + to_string( tuple.local_port ) + " to "
+                         + Address::from_ipv4_numeric( tuple.remote_address ).ip() + ":"
+                         + to_string( tuple.remote_port ) + " already exists" );
+  }
+  connection->last_tick_ms = timestamp_ms();
+
+  if ( executor_ != nullptr ) {
+    connection->strand = make_shared<WorkStealingExecutor::Strand>( *executor_ );
+  }
+  add_rules( *connection );
+  return { connection, move( application_end ) };
+}
+
+// Forget a connection (the stack's end of its socket pair closes, so the application sees EOF)
+void TCPStack::close( const FourTuple& tuple )
+{
+  Connection* const connection = connections_.find( tuple );
+  for ( auto& rule : connection->rules ) {
+    rule.cancel();
+  }
+  eventloop_.cancel_timer( connection->deadline_timer );
+  if ( connection->listener != nullptr ) {
+    --connection->listener->half_open_;
+  }
+  connections_.erase( tuple );
+}
+
+LocalStreamSocket TCPStack::connect( const TCPConfig& tcp_config, const FdAdapterConfig& adapter_config )
+{
+  const FourTuple tuple { .local_address = adapter_config.source.ipv4_numeric(),
+                          .remote_address = adapter_config.destination.ipv4_numeric(),
+                          .local_port = adapter_config.source.port(),
+                          .remote_port = adapter_config.destination.port() };
+
+  auto [connection, application_end] = open( tuple, tcp_config );
+  connection->peer.push( [&]( auto x ) { transmit( tuple, x ); } );
+  touch( *connection ); // (the SYN's retransmission timer has started)
+  return move( application_end );
+}
+
+TCPListener& TCPStack::listen( const TCPConfig& tcp_config,
+                               const Address& address,
+                               const size_t backlog,
+                               const size_t syn_backlog )
+{
+  auto& listener = listeners_[address.port()];
+  if ( listener ) {
+    throw runtime_error( "TCPStack: already listening on port " + to_string( address.port() ) );
+  }
+
+  listener.reset( new TCPListener( tcp_config, address.ipv4_numeric(), backlog, syn_backlog ) );
+  return *listener;
+}
+
+// The same three rules that TCPMinnowSocket uses for its single connection (the first one,
+// reading datagrams, is shared by every connection and installed by the constructor)
+void TCPStack::add_rules( Connection& connection )
+{
+  Connection* const c = &connection;
+
+  // read from the application into the outbound stream
+  c->rules.push_back( eventloop_.add_rule(
+    outbound_category_,
+    c->data,
+    Direction::In,
+    [this, c] {
+      string data;
+      data.resize( c->peer.outbound_writer().available_capacity() );
+      c->data.read( data );
+      c->peer.outbound_writer().push( move( data ) );
+
+      if ( c->data.eof() ) {
+        c->peer.outbound_writer().close();
+        c->outbound_shutdown = true;
+      }
+
+      c->peer.push( [&]( auto x ) { transmit( c->tuple, x ); } );
+      touch( *c );
+    },
+    [c] {
+      return c->peer.active() and not c->outbound_shutdown and c->peer.outbound_writer().available_capacity() > 0;
+    },
+    [this, c] {
+      c->peer.outbound_writer().close();
+      c->outbound_shutdown = true;
+      touch( *c );
+    },
+    [c] { c->peer.outbound_writer().set_error(); } ) );
+
+  // write the inbound stream to the application
+  c->rules.push_back( eventloop_.add_rule(
+    inbound_category_,
+    c->data,
+    Direction::Out,
+    [this, c] {
+      Reader& inbound = c->peer.inbound_reader();
+      if ( inbound.bytes_buffered() ) {
+        inbound.pop( c->data.write( inbound.peek() ) );
+        c->peer.send_window_update( [&]( auto x ) { transmit( c->tuple, x ); } );
+      }
+
+      if ( inbound.is_finished() or inbound.has_error() ) {
+        c->data.shutdown( SHUT_WR );
+        c->inbound_shutdown = true;
+      }
+      touch( *c );
+    },
+    [c] {
+      const Reader& inbound = c->peer.inbound_reader();
+      return inbound.bytes_buffered()
+             or ( ( inbound.is_finished() or inbound.has_error() ) and not c->inbound_shutdown );
+    },
+    [this, c] {
+      c->inbound_shutdown = true;
+      touch( *c );
+    },
+    [c] { c->peer.inbound_reader().set_error(); } ) );
+
+  for ( auto& rule : c->rules ) {
+    rule.set_strand( c->strand );
+  }
+}
+
+// Have tick() look at the connection at the end of this round (from whichever thread handled it)
+void TCPStack::touch( const Connection& connection )
+{
+  touched_[executor_ != nullptr ? executor_->worker_index() : 0].push_back( connection.tuple );
+}
+
+// Advance the connection's clock to `now` (a half-open connection is abandoned, rather than retransmit its
+// SYN/ACK once too often)
+void TCPStack::advance_clock( Connection& connection, const uint64_t now )
+{
+  const uint64_t elapsed = now - connection.last_tick_ms;
+  connection.last_tick_ms = now;
+  if ( elapsed == 0 ) {
+    return;
+  }
+
+  if ( connection.listener != nullptr ) {
+    const TCPSender& sender = connection.peer.sender();
+    connection.peer.tick( elapsed, [&]( auto x ) {
+      if ( sender.consecutive_retransmissions() < TCPListener::MAX_SYN_ACK_RETRIES ) {
+        transmit( connection.tuple, x );
+      }
+    } );
+  } else if ( connection.peer.active() ) {
+    connection.peer.tick( elapsed, [&]( auto x ) { transmit( connection.tuple, x ); } );
+  }
+}
+
+// Advance one connection's clock, and forget it if it has finished, or else set its timer for its next deadline
+void TCPStack::tick_connection( const FourTuple& tuple, const uint64_t now )
+{
+  Connection* const connection = connections_.find( tuple );
+  if ( connection == nullptr or connection->last_round == round_ ) {
+    return; // (already closed, or touched more than once this round)
+  }
+  connection->last_round = round_;
+  ++connections_ticked_;
+  advance_clock( *connection, now );
+
+  const TCPPeer& peer = connection->peer;
+  const bool finished
+    = connection->listener != nullptr
+        ? not peer.active() or peer.sender().consecutive_retransmissions() > TCPListener::MAX_SYN_ACK_RETRIES
+        : not peer.active() and connection->inbound_shutdown;
+  if ( finished ) {
+    close( tuple );
+    return;
+  }
+
+  eventloop_.cancel_timer( connection->deadline_timer );
+  connection->deadline_timer = {};
+  if ( const auto deadline = peer.next_deadline() ) {
+    // (a deadline of 0 is looked at again in the next millisecond, once the clock has moved)
+    connection->deadline_timer = eventloop_.add_timer( max<uint64_t>( deadline.value(), 1 ),
+                                                       [this, tuple] { touched_.back().push_back( tuple ); } );
+  }
+}
+
+// Tick the connections touched this round (by a segment, the application, or their timer); the others
+// have nothing to do until one of those happens
+void TCPStack::tick()
+{
+  const uint64_t now = timestamp_ms();
+  ++round_;
+  for ( auto& tuples : touched_ ) {
+    for ( size_t i = 0; i < tuples.size(); ++i ) {
+      const FourTuple tuple = tuples[i]; // (closing a connection can touch it again, and grow `tuples`)
+      tick_connection( tuple, now );
+    }
+    tuples.clear();
+  }
+}
+
+EventLoop::RuleHandle TCPStack::add_wakeup( FileDescriptor& fd, const function<void()>& callback )
+{
+  return eventloop_.add_rule( wakeup_category_, fd, Direction::In, callback );
+}
+
+EventLoop::Result TCPStack::wait_next_event( const int timeout_ms )
+{
+  // sleep until an event, or until a connection's timer (an idle stack does not wake up)
+  const auto result = eventloop_.wait_next_event( timeout_ms );
+  for ( Connection* connection : handshakes_ ) {
+    check_established( *connection );
+  }
+  handshakes_.clear();
+  tick();
+
+  for ( auto& datagrams : transmitted_ ) {
+    for ( auto& datagram : datagrams ) {
+      enqueue( move( datagram ) );
+    }
+    datagrams.clear();
+  }
+  return result;
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include "connection_table.hh"
+#include "eventloop.hh"
+#include "file_descriptor.hh"
+#include "ipv4_datagram.hh"
+#include "socket.hh"
+#include "syn_cookies.hh"
+#include "tcp_config.hh"
+#include "tcp_peer.hh"
+#include "work_stealing_executor.hh"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <vector>
+
+//! \brief A passive-open endpoint of a TCPStack (see TCPStack::listen)
+//! \details A SYN for the listener's port creates a half-open connection, counted against the
+//! SYN queue, and is answered with a SYN/ACK. When the handshake completes, the connection moves
+//! to the accept queue, where it waits (already able to receive data) for the application to
+//! call accept(). A half-open connection is dropped after MAX_SYN_ACK_RETRIES unanswered
+//! retransmissions of its SYN/ACK.
+//!
+//! While the SYN queue is full (e.g. during a flood of SYNs from spoofed addresses), the listener
+//! answers SYNs with SYN cookies and keeps no state for them; a connection is created only when an
+//! ACK carrying a valid cookie arrives. With SYN cookies disabled, such SYNs are dropped instead.
+//! SYNs are always dropped while the accept queue is full; the peer will retransmit them. A
+//! handshake that completes while the accept queue is full is still queued, so the accept queue
+//! can exceed the backlog by at most the size of the SYN queue.
+class TCPListener
+{
+public:
+  static constexpr unsigned MAX_SYN_ACK_RETRIES = 5; //!< Retransmissions before a half-open connection is dropped
+
+  //! A connection that has completed the three-way handshake
+  struct AcceptedConnection
+  {
+    LocalStreamSocket socket; //!< The application's end of the connection
+    Address peer;             //!< The remote host and port
+  };
+
+  //! Take the oldest established connection off the accept queue, if there is one
+  std::optional<AcceptedConnection> accept();
+
+  //! Answer SYNs with SYN cookies when the SYN queue is full (the default), or drop them
+  void set_syn_cookies( bool enabled ) { syn_cookies_ = enabled; }
+
+  size_t syn_queue_size() const { return half_open_; }              //!< Connections mid-handshake
+  size_t accept_queue_size() const { return accept_queue_.size(); } //!< Connections waiting for accept()
+  uint64_t syns_dropped() const { return syns_dropped_; }           //!< SYNs dropped because a queue was full
+  uint64_t cookies_sent() const { return cookies_sent_; }           //!< SYNs answered with a SYN cookie
+  uint64_t cookies_accepted() const { return cookies_accepted_; }   //!< Connections rebuilt from a cookie
+
+private:
+  friend class TCPStack;
+
+  TCPListener( const TCPConfig& config, uint32_t local_address, size_t backlog, size_t syn_backlog );
+
+  //! Is a connection to `tuple`'s local end for this listener (given that the port matches)?
+  bool accepts( const FourTuple& tuple ) const
+  {
+    return local_address_ == 0 or local_address_ == tuple.local_address;
+  }
+
+  TCPConfig config_;       //!< Configuration for accepted connections (each gets a random ISN)
+  uint32_t local_address_; //!< Address to accept connections on (0 for any)
+  size_t backlog_;         //!< Capacity of the accept queue
+  size_t syn_backlog_;     //!< Capacity of the SYN queue
+
+  size_t half_open_ {};
+  std::deque<AcceptedConnection> accept_queue_ {};
+  uint64_t syns_dropped_ {};
+  std::default_random_engine rng_;
+
+  bool syn_cookies_ { true };
+  SYNCookies cookies_ {};
+  uint64_t cookies_sent_ {};
+  uint64_t cookies_accepted_ {};
+};
+
+//! \brief Many TCP connections sharing one IPv4 datagram interface (e.g. a TUN device)
+//! \details Every inbound datagram is parsed once and dispatched, by its FourTuple, to the TCPPeer
+//! that owns the connection; a SYN that matches no connection goes to the TCPListener for its port.
+//! One EventLoop (and so one thread) drives every connection, unless the stack is given a
+//! WorkStealingExecutor (see set_executor). As with TCPMinnowSocket, the application talks to each
+//! connection through a LocalStreamSocket.
+class TCPStack
+{
+public:
+  static constexpr size_t MAX_DATAGRAMS_PER_ROUND = 64; //!< Datagrams read (or written) per event with an executor
+  static constexpr size_t MAX_OUTBOUND_QUEUE = 4096;    //!< Datagrams waiting for the interface before drops
+
+  //! \param[in] datagram_fd reads and writes whole IPv4 datagrams (a TunFD, or one end of a SOCK_DGRAM socketpair)
+  //! \details The stack makes the fd non-blocking. Datagrams that find the interface full wait in a queue
+  //! (of up to MAX_OUTBOUND_QUEUE) for it to become writable, and are dropped when that is full too.
+  explicit TCPStack( FileDescriptor&& datagram_fd );
+
+  //! Read datagrams from `inbound_fd`, but write them to `outbound_fd` (e.g. behind a ShardedTCPStack dispatcher)
+  TCPStack( FileDescriptor&& inbound_fd, FileDescriptor&& outbound_fd );
+
+  //! \brief Open a connection from `adapter_config.source` to `adapter_config.destination`
+  //! \details The adapter's loss rates are ignored.
+  //! \returns the application's end of the connection
+  LocalStreamSocket connect( const TCPConfig& tcp_config, const FdAdapterConfig& adapter_config );
+
+  //! \brief Accept connections to `address` (whose IP may be "0" to accept on any local address)
+  //! \param[in] backlog is the capacity of the accept queue
+  //! \param[in] syn_backlog is the capacity of the SYN queue (connections mid-handshake)
+  //! \returns the listener, which remains valid for the lifetime of the TCPStack
+  TCPListener& listen( const TCPConfig& tcp_config,
+                       const Address& address,
+                       size_t backlog = 16,
+                       size_t syn_backlog = 128 );
+
+  //! \brief Wait up to `timeout_ms` (-1 for no limit) for an event, and handle it
+  //! \details Each connection has a timer for when it next has work of its own (e.g. a retransmission),
+  //! which also ends the wait, so a thread that drives the stack can pass -1 and sleep for as long as the
+  //! stack is idle. Only the connections that an event touched, or whose timer fired, are ticked.
+  EventLoop::Result wait_next_event( int timeout_ms );
+
+  //! Parse an IPv4 datagram and hand its TCP segment to the connection it belongs to
+  void receive_datagram( InternetDatagram ip_dgram );
+
+  //! \brief Process segments, and move bytes between connections and the application, on `executor`
+  //! \details Each connection gets a WorkStealingExecutor::Strand, so its callbacks still run one at
+  //! a time, but different connections run in parallel on the executor's workers (a few busy
+  //! connections no longer hold up the rest). Demultiplexing, handshakes with listeners, and timers
+  //! stay on the thread that calls wait_next_event(). Must be called before any connection is opened.
+  void set_executor( WorkStealingExecutor& executor );
+
+  //! \brief Call `callback` from wait_next_event() whenever `fd` is readable
+  //! \details This lets another thread wake the thread that drives the stack; the callback must read `fd`.
+  EventLoop::RuleHandle add_wakeup( FileDescriptor& fd, const std::function<void()>& callback );
+
+  size_t connection_count() const { return connections_.size(); } //!< Connections still open
+  uint64_t segments_dropped() const { return segments_dropped_; } //!< Segments for no known connection
+  uint64_t datagrams_dropped() const { return datagrams_dropped_; } //!< Outbound datagrams the interface had no room for
+  uint64_t poll_count() const { return eventloop_.poll_count(); } //!< Waits made by wait_next_event() so far
+  uint64_t connections_ticked() const { return connections_ticked_; } //!< Connection clocks advanced by rounds
+
+  ~TCPStack() = default;
+  TCPStack( const TCPStack& other ) = delete;
+  TCPStack& operator=( const TCPStack& other ) = delete;
+  TCPStack( TCPStack&& other ) = delete;
+  TCPStack& operator=( TCPStack&& other ) = delete;
+
+private:
+  //! State of one connection
+  struct Connection
+  {
+    FourTuple tuple;
+    TCPPeer peer;
+    LocalStreamSocket data; //!< The stack's end of the socket pair shared with the application
+    std::vector<EventLoop::RuleHandle> rules {};
+    std::shared_ptr<WorkStealingExecutor::Strand> strand {}; //!< With an executor: serializes the callbacks
+    bool outbound_shutdown {};
+    bool inbound_shutdown {};
+
+    TCPListener* listener {};                            //!< While half-open: the listener that owns it
+    std::optional<LocalStreamSocket> application_end {}; //!< While half-open: the application's end
+
+    uint64_t last_tick_ms {};             //!< How far the peer's clock has been advanced
+    uint64_t last_round {};               //!< The last round of tick() that handled the connection
+    EventLoop::TimerId deadline_timer {}; //!< Fires at the peer's next deadline
+
+    Connection( const FourTuple& s_tuple, const TCPConfig& config, LocalStreamSocket&& s_data );
+    Connection( const Connection& other ) = delete;
+    Connection& operator=( const Connection& other ) = delete;
+  };
+
+  FileDescriptor inbound_fd_;
+  FileDescriptor outbound_fd_;
+  EventLoop eventloop_ {};
+  ConnectionTable<Connection> connections_ {};
+  std::map<uint16_t, std::unique_ptr<TCPListener>> listeners_ {}; //!< Keyed by local port
+
+  size_t datagram_category_;
+  size_t outbound_category_;
+  size_t inbound_category_;
+  size_t wakeup_category_;
+
+  // tick() visits only the connections touched this round (by a segment, the application, or their timer)
+  std::vector<std::vector<FourTuple>> touched_; //!< Per worker (and, last, this thread)
+  uint64_t round_ {};
+  uint64_t connections_ticked_ {};
+  uint64_t segments_dropped_ {};
+  uint64_t datagrams_dropped_ {};
+
+  // The stack never blocks writing to the network (one full interface would stall every connection).
+  // With an executor, the workers don't write at all (if both ends of a link waited for their workers
+  // while the workers waited for the other end to read, neither would read again): each thread
+  // collects the datagrams it sends, and this thread writes them once outbound_fd_ is writable.
+  WorkStealingExecutor* executor_ {};
+  std::vector<std::vector<std::string>> transmitted_ {}; //!< Per worker (and, last, this thread)
+  std::deque<std::string> outbound_queue_ {};            //!< Waiting for outbound_fd_ to be writable
+  std::vector<Connection*> handshakes_ {};               //!< Half-open connections sent a segment this round
+
+  std::pair<Connection*, LocalStreamSocket> open( const FourTuple& tuple, const TCPConfig& config );
+  void close( const FourTuple& tuple );
+  Connection& open_passive( TCPListener& listener, const FourTuple& tuple, Wrap32 isn );
+  void receive_syn( TCPListener& listener, const FourTuple& tuple, TCPMessage msg );
+  Connection* receive_cookie( TCPListener& listener, const FourTuple& tuple, const TCPMessage& msg );
+  void check_established( Connection& connection );
+  bool read_datagram();
+  void write_datagrams();
+  void enqueue( std::string&& datagram );
+  void transmit( const FourTuple& tuple, const TCPMessage& msg );
+  void add_rules( Connection& connection );
+  void touch( const Connection& connection );
+  void advance_clock( Connection& connection, uint64_t now );
+  void tick_connection( const FourTuple& tuple, uint64_t now );
+  void tick();
+};
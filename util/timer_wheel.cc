@@ -0,0 +1,189 @@
+#include "timer_wheel.hh"
+
+#include <algorithm>
+#include <bit>
+#include <utility>
+
+using namespace std;
+
+TimerWheel::TimerId TimerWheel::add( const uint64_t deadline_ms, Callback callback )
+{
+  const TimerId id = next_id_++;
+  auto [it, inserted]
+    = timers_.emplace( id, Timer { .deadline = max( deadline_ms, now_ ), .callback = move( callback ) } );
+  place( id, it->second );
+  return id;
+}
+
+bool TimerWheel::cancel( const TimerId id )
+{
+  const auto it = timers_.find( id );
+  if ( it == timers_.end() ) {
+    return false;
+  }
+
+  const Timer& timer = it->second;
+  if ( timer.level == OVERFLOW ) {
+    overflow_.erase( timer.position );
+    const auto block = overflow_blocks_.find( timer.deadline >> TOP_BITS << TOP_BITS );
+    if ( --block->second == 0 ) {
+      overflow_blocks_.erase( block );
+    }
+  } else {
+    auto& slot = levels_[timer.level].slots[timer.slot];
+    slot.erase( timer.position );
+    if ( slot.empty() ) {
+      levels_[timer.level].occupied &= ~( uint64_t { 1 } << timer.slot );
+    }
+  }
+  timers_.erase( it );
+  return true;
+}
+
+// A timer goes on the lowest level where its deadline and now_ agree on every digit above that
+// level's own; its slot is the deadline's digit at that level
+void TimerWheel::place( const TimerId id, Timer& timer )
+{
+  for ( unsigned level = 0; level < LEVELS; ++level ) {
+    const unsigned above = SLOT_BITS * ( level + 1 );
+    if ( ( timer.deadline >> above ) == ( now_ >> above ) ) {
+      timer.level = level;
+      timer.slot = ( timer.deadline >> ( SLOT_BITS * level ) ) & ( SLOTS - 1 );
+      auto& slot = levels_[level].slots[timer.slot];
+      timer.position = slot.insert( slot.end(), id );
+      levels_[level].occupied |= uint64_t { 1 } << timer.slot;
+      return;
+    }
+  }
+
+  timer.level = OVERFLOW;
+  timer.position = overflow_.insert( overflow_.end(), id );
+  ++overflow_blocks_[timer.deadline >> TOP_BITS << TOP_BITS];
+}
+
+vector<TimerWheel::TimerId> TimerWheel::take( const unsigned level, const unsigned slot )
+{
+  auto& list = level == OVERFLOW ? overflow_ : levels_[level].slots[slot];
+  vector<TimerId> ids { list.begin(), list.end() };
+  list.clear();
+  if ( level == OVERFLOW ) {
+    overflow_blocks_.clear();
+  } else {
+    levels_[level].occupied &= ~( uint64_t { 1 } << slot );
+  }
+  return ids;
+}
+
+// Slots before now_'s own digit at each level are always empty (they were cascaded or fired when
+// the time passed them), as are the slots of now_'s own digit above level 0 (a timer in that
+// range belongs on a lower level)
+optional<uint64_t> TimerWheel::next_slot_start() const
+{
+  optional<uint64_t> earliest;
+  for ( unsigned level = 0; level < LEVELS; ++level ) {
+    const unsigned shift = SLOT_BITS * level;
+    const unsigned digit = ( now_ >> shift ) & ( SLOTS - 1 );
+    const unsigned first = level == 0 ? digit : digit + 1;
+    if ( first >= SLOTS ) {
+      continue;
+    }
+
+    const uint64_t candidates = levels_[level].occupied >> first << first;
+    if ( candidates == 0 ) {
+      continue;
+    }
+
+    const uint64_t span_start = now_ >> ( shift + SLOT_BITS ) << ( shift + SLOT_BITS );
+    const auto slot = static_cast<uint64_t>( countr_zero( candidates ) );
+    const uint64_t start = span_start + ( slot << shift );
+    earliest = min( earliest.value_or( start ), start );
+  }
+
+  if ( not overflow_blocks_.empty() ) {
+    const uint64_t start = overflow_blocks_.begin()->first;
+    earliest = min( earliest.value_or( start ), start );
+  }
+
+  return earliest;
+}
+
+optional<uint64_t> TimerWheel::next_deadline() const
+{
+  const optional<uint64_t> start = next_slot_start();
+  if ( not start.has_value() ) {
+    return {};
+  }
+
+  // the earliest non-empty slot holds the earliest deadline, but above level 0 it spans many
+  // milliseconds, so look at its timers
+  optional<uint64_t> earliest;
+  for ( unsigned level = 0; level <= LEVELS; ++level ) {
+    const unsigned shift = SLOT_BITS * level;
+    if ( level < LEVELS and ( start.value() >> shift ) >> SLOT_BITS != ( now_ >> shift ) >> SLOT_BITS ) {
+      continue;
+    }
+    const unsigned slot = level < LEVELS ? ( start.value() >> shift ) & ( SLOTS - 1 ) : 0;
+    const auto& list = level == OVERFLOW ? overflow_ : levels_[level].slots[slot];
+    for ( const TimerId id : list ) {
+      const uint64_t deadline = timers_.at( id ).deadline;
+      if ( deadline >= start.value() ) {
+        earliest = min( earliest.value_or( deadline ), deadline );
+      }
+    }
+    if ( earliest.has_value() ) {
+      break;
+    }
+  }
+
+  return max( earliest.value_or( start.value() ), now_ );
+}
+
+size_t TimerWheel::advance( const uint64_t now_ms )
+{
+  size_t fired = 0;
+
+  while ( true ) {
+    // jump to the start of the next slot that needs attention, if it is due
+    const optional<uint64_t> start = next_slot_start();
+    if ( not start.has_value() or start.value() > now_ms ) {
+      break;
+    }
+    now_ = max( now_, start.value() );
+
+    // cascade every slot (and overflowed timer) that starts now, from the top down
+    for ( unsigned level = LEVELS; level > 0; --level ) {
+      const unsigned shift = SLOT_BITS * level;
+      if ( ( now_ & ( ( uint64_t { 1 } << shift ) - 1 ) ) != 0 ) {
+        continue;
+      }
+      const unsigned slot = level < LEVELS ? ( now_ >> shift ) & ( SLOTS - 1 ) : 0;
+      if ( level < LEVELS and ( levels_[level].occupied & ( uint64_t { 1 } << slot ) ) == 0 ) {
+        continue;
+      }
+
+      for ( const TimerId id : take( level, slot ) ) {
+        place( id, timers_.at( id ) );
+      }
+    }
+
+    // fire the timers due now, in the order they were filed (one at a time, since a callback may
+    // cancel a timer in this slot, or add one to it)
+    const unsigned slot = now_ & ( SLOTS - 1 );
+    auto& due = levels_[0].slots[slot];
+    while ( not due.empty() ) {
+      const auto it = timers_.find( due.front() );
+      due.pop_front();
+      if ( due.empty() ) {
+        levels_[0].occupied &= ~( uint64_t { 1 } << slot );
+      }
+
+      Callback callback = move( it->second.callback );
+      timers_.erase( it );
+      ++fired;
+      callback();
+    }
+  }
+
+  now_ = max( now_, now_ms );
+  return fired;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+//! \brief One-shot timers with millisecond resolution, kept in a hierarchical timing wheel
+//! \details Level 0 has 64 slots of 1 ms, level 1 has 64 slots of 64 ms, and so on up to level
+//! 5 (slots of about 12 days). A timer sits at the lowest level whose slot width still separates
+//! its deadline from the current time; when the current time reaches the start of a slot above
+//! level 0, the slot's timers cascade down to finer slots. Adding and cancelling a timer are O(1),
+//! and so is finding the next slot that needs attention (one bitmap per level), so advance() can
+//! jump straight over idle stretches instead of stepping through every millisecond.
+class TimerWheel
+{
+public:
+  using TimerId = uint64_t; //!< Never 0, so 0 can mean "no timer"
+  using Callback = std::function<void()>;
+
+  //! \param[in] now_ms is the current time (any monotonic millisecond clock)
+  explicit TimerWheel( uint64_t now_ms ) : now_( now_ms ) {}
+
+  //! Call `callback` from the first advance() to reach `deadline_ms` (or right away, if that has passed)
+  TimerId add( uint64_t deadline_ms, Callback callback );
+
+  //! Forget a timer that has not fired yet. Returns whether there was such a timer.
+  bool cancel( TimerId id );
+
+  //! \brief Move the current time to `now_ms`, calling the callback of every timer that is due
+  //! \details Timers fire in deadline order. A callback may add or cancel timers (a timer it adds
+  //! that is already due fires in this same call). Returns the number of timers that fired.
+  size_t advance( uint64_t now_ms );
+
+  //! The earliest deadline of any timer (a deadline in the past is reported as the current time)
+  std::optional<uint64_t> next_deadline() const;
+
+  size_t size() const { return timers_.size(); }
+  bool empty() const { return timers_.empty(); }
+  uint64_t now() const { return now_; }
+
+private:
+  static constexpr unsigned SLOT_BITS = 6;
+  static constexpr unsigned SLOTS = 1U << SLOT_BITS;
+  static constexpr unsigned LEVELS = 6;
+  static constexpr unsigned OVERFLOW = LEVELS; //!< "Level" of timers beyond the top level's reach
+  static constexpr unsigned TOP_BITS = SLOT_BITS * LEVELS; //!< Log2 of the span the levels cover together
+
+  struct Timer
+  {
+    uint64_t deadline {};
+    Callback callback {};
+    unsigned level {}; //!< Or OVERFLOW
+    unsigned slot {};
+    std::list<TimerId>::iterator position {}; //!< Where the timer is in its slot's list
+  };
+
+  struct Level
+  {
+    std::array<std::list<TimerId>, SLOTS> slots {};
+    uint64_t occupied {}; //!< Bit i is set if slots[i] is not empty
+  };
+
+  uint64_t now_;
+  TimerId next_id_ { 1 };
+  std::unordered_map<TimerId, Timer> timers_ {};
+  std::array<Level, LEVELS> levels_ {};
+  std::list<TimerId> overflow_ {}; //!< Timers due after the top level's current span
+  std::map<uint64_t, size_t> overflow_blocks_ {}; //!< How many overflowed timers fall in each top-level span
+
+  //! File a timer under the slot its deadline falls into, as seen from now_
+  void place( TimerId id, Timer& timer );
+
+  //! Take every timer out of one slot (or the overflow list)
+  std::vector<TimerId> take( unsigned level, unsigned slot );
+
+  //! The time at which the earliest non-empty slot starts (and must be cascaded or fired)
+  std::optional<uint64_t> next_slot_start() const;
+};
@@ -1,5 +1,6 @@
 #include "tun.hh"
 #include "exception.hh"
+#include "virtio_net_header.hh"
 
 #include <cstring>
 #include <fcntl.h>
@@ -14,20 +15,29 @@ using namespace std;
 //! \param[in] devname is the name of the TUN or TAP device, specified at its creation.
 //! \param[in] is_tun is `true` for a TUN device (expects IP datagrams), or `false` for a TAP device (expects
 //! Ethernet frames)
+//! \param[in] multi_queue attaches a new queue of a device created with `multi_queue`, so that several
+//! threads can each read and write their own queue (the kernel steers each flow to one queue)
+//! \param[in] offload opens the device with `IFF_VNET_HDR`, so that each datagram (or frame) read or written
+//! is preceded by a `virtio_net_hdr`, and enables checksum and TCP/IPv4 segmentation offload: the kernel
+//! then completes the TCP checksums of datagrams written with `VIRTIO_NET_HDR_F_NEEDS_CSUM` and splits
+//! those written with a `gso_type`, and in turn hands over TCP super-packets (up to 64 KiB, with
+//! the `gso_size` of the segments they stand for) whose checksums it has verified or left partial
 //!
 //! To create a TUN device, you should already have run
 //!
 //!     ip tuntap add mode tun user `username` name `devname`
 //!
-//! as root before calling this function.
+//! (adding `multi_queue` for a multi-queue device) as root before calling this function.
 
-TunTapFD::TunTapFD( const string& devname, const bool is_tun )
+TunTapFD::TunTapFD( const string& devname, const bool is_tun, const bool multi_queue, const bool offload )
   : FileDescriptor( ::CheckSystemCall( "open", open( CLONEDEV, O_RDWR | O_CLOEXEC ) ) )
 {
   struct ifreq tun_req
   {};
 
-  tun_req.ifr_flags = static_cast<int16_t>( ( is_tun ? IFF_TUN : IFF_TAP ) | IFF_NO_PI ); // no packetinfo
+  tun_req.ifr_flags = static_cast<int16_t>( ( is_tun ? IFF_TUN : IFF_TAP ) | IFF_NO_PI // no packetinfo
+                                            | ( multi_queue ? IFF_MULTI_QUEUE : 0 )
+                                            | ( offload ? IFF_VNET_HDR : 0 ) );
 
   // copy devname to ifr_name, making sure to null terminate
 
@@ -35,4 +45,11 @@ TunTapFD::TunTapFD( const string& devname, const bool is_tun )
   tun_req.ifr_name[IFNAMSIZ - 1] = '\0';
 
   CheckSystemCall( "ioctl", ioctl( fd_num(), TUNSETIFF, static_cast<void*>( &tun_req ) ) );
+
+  if ( offload ) {
+    const int header_size = VirtioNetHeader::LENGTH;
+    CheckSystemCall( "ioctl", ioctl( fd_num(), TUNSETVNETHDRSZ, &header_size ) );
+    const auto offloads = static_cast<unsigned long>( TUN_F_CSUM | TUN_F_TSO4 );
+    CheckSystemCall( "ioctl", ioctl( fd_num(), TUNSETOFFLOAD, offloads ) );
+  }
 }
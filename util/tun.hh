@@ -10,7 +10,7 @@ class TunTapFD : public FileDescriptor
 public:
   //! Open an existing persistent [TUN or TAP
   //! device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-  explicit TunTapFD( const std::string& devname, bool is_tun );
+  explicit TunTapFD( const std::string& devname, bool is_tun, bool multi_queue = false, bool offload = false );
 };
 
 //! A FileDescriptor to a [Linux TUN](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
@@ -18,7 +18,12 @@ class TunFD : public TunTapFD
 {
 public:
   //! Open an existing persistent [TUN device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-  explicit TunFD( const std::string& devname ) : TunTapFD( devname, true ) {}
+  //! With `multi_queue`, each TunFD opened on the device is another of its queues. With `offload`, each
+  //! datagram read or written is preceded by a `virtio_net_hdr`, and TCP/IPv4 datagrams may be
+  //! super-packets of up to 64 KiB with partial checksums (see TCPOverIPv4OverTunFdAdapter::use_virtio_net_header).
+  explicit TunFD( const std::string& devname, bool multi_queue = false, bool offload = false )
+    : TunTapFD( devname, true, multi_queue, offload )
+  {}
 };
 
 //! A FileDescriptor to a [Linux TAP](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
@@ -1,25 +1,262 @@
 #include "tuntap_adapter.hh"
+#include "exception.hh"
 #include "helpers.hh"
+#include "io_uring.hh"
+#include "virtio_net_header.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
 
 using namespace std;
 
-optional<TCPMessage> TCPOverIPv4OverTunFdAdapter::read()
+namespace {
+constexpr size_t DATAGRAM_BUFFER_SIZE = 16384; // room for each datagram read (as FileDescriptor::read allows)
+constexpr uint64_t READ_TAG = uint64_t { 1 } << 32;
+constexpr uint64_t WRITE_TAG = uint64_t { 2 } << 32;
+constexpr uint16_t TCP_CHECKSUM_OFFSET = 16; // (within the TCP header)
+} // namespace
+
+// The first `depth` buffers are for reads, each always posted except while its datagram is being
+// parsed; the next `depth` are for queued writes
+struct TCPOverIPv4OverTunFdAdapter::Ring
+{
+  IoUring uring;
+  unsigned depth;
+  size_t buffer_size;
+  vector<char> buffers;
+  vector<unsigned> free_writes {};
+
+  Ring( const unsigned s_depth, const size_t s_buffer_size )
+    : uring( s_depth * 2 ), depth( s_depth ), buffer_size( s_buffer_size ), buffers( buffer_size * s_depth * 2 )
+  {
+    const iovec registered { buffers.data(), buffers.size() };
+    uring.register_buffers( { &registered, 1 } );
+    for ( unsigned i = 0; i < depth; ++i ) {
+      free_writes.push_back( i );
+    }
+  }
+
+  span<char> buffer( const unsigned index )
+  {
+    return { &buffers.at( index * buffer_size ), buffer_size };
+  }
+
+  void post_read( const int fd, const unsigned slot )
+  {
+    uring.prepare_read_fixed( fd, buffer( slot ), 0, READ_TAG | slot );
+  }
+};
+
+TCPOverIPv4OverTunFdAdapter::TCPOverIPv4OverTunFdAdapter( FileDescriptor&& tun ) : _tun( move( tun ) ), _ring()
+{
+  _tun.set_blocking( false );
+}
+
+TCPOverIPv4OverTunFdAdapter::~TCPOverIPv4OverTunFdAdapter() = default;
+TCPOverIPv4OverTunFdAdapter::TCPOverIPv4OverTunFdAdapter( TCPOverIPv4OverTunFdAdapter&& other ) noexcept = default;
+TCPOverIPv4OverTunFdAdapter& TCPOverIPv4OverTunFdAdapter::operator=( TCPOverIPv4OverTunFdAdapter&& other ) noexcept
+  = default;
+
+bool TCPOverIPv4OverTunFdAdapter::use_io_uring( const unsigned depth )
+{
+  if ( not IoUring::available() ) {
+    return false;
+  }
+
+  _ring = make_unique<Ring>( depth, datagram_buffer_size() );
+  for ( unsigned slot = 0; slot < depth; ++slot ) {
+    _ring->post_read( _tun.fd_num(), slot );
+  }
+  _ring->uring.submit();
+  return true;
+}
+
+void TCPOverIPv4OverTunFdAdapter::use_virtio_net_header( const uint16_t mss )
+{
+  if ( _ring ) {
+    throw runtime_error( "use_virtio_net_header() must come before use_io_uring()" );
+  }
+  _offload_mss = mss;
+}
+
+size_t TCPOverIPv4OverTunFdAdapter::datagram_buffer_size() const
+{
+  return _offload_mss.has_value() ? VirtioNetHeader::LENGTH + UINT16_MAX : DATAGRAM_BUFFER_SIZE;
+}
+
+FileDescriptor& TCPOverIPv4OverTunFdAdapter::fd()
 {
-  vector<string> strs( 3 );
-  strs[0].resize( IPv4Header::LENGTH );
-  strs[1].resize( TCPSegment::HEADER_LENGTH );
-  _tun.read( strs );
+  if ( _ring ) {
+    return _ring->uring;
+  }
+  return _tun;
+}
+
+optional<TCPMessage> TCPOverIPv4OverTunFdAdapter::parse_datagram( string_view datagram )
+{
+  // with offload, the kernel says whether it has verified the TCP checksum (or left it partial, for a
+  // datagram sent from this host)
+  TCPChecksum checksum = TCPChecksum::Full;
+  if ( _offload_mss.has_value() ) {
+    VirtioNetHeader header;
+    if ( not header.parse( datagram ) ) {
+      return {};
+    }
+    if ( header.flags & ( VirtioNetHeader::F_NEEDS_CSUM | VirtioNetHeader::F_DATA_VALID ) ) {
+      checksum = TCPChecksum::Offloaded;
+    }
+    datagram.remove_prefix( VirtioNetHeader::LENGTH );
+  }
+
+  // split the datagram as a readv into header-sized buffers would
+  const size_t header_end = min<size_t>( datagram.size(), IPv4Header::LENGTH );
+  const size_t tcp_header_end = min<size_t>( datagram.size(), header_end + TCPSegment::HEADER_LENGTH );
+  vector<string> strs;
+  strs.reserve( 3 );
+  strs.emplace_back( datagram.substr( 0, header_end ) );
+  strs.emplace_back( datagram.substr( header_end, tcp_header_end - header_end ) );
+  strs.emplace_back( datagram.substr( tcp_header_end ) );
 
   InternetDatagram ip_dgram;
   if ( parse( ip_dgram, move( strs ) ) ) {
-    return unwrap_tcp_in_ip( move( ip_dgram ) );
+    return unwrap_tcp_in_ip( move( ip_dgram ), checksum );
   }
   return {};
 }
 
+bool TCPOverIPv4OverTunFdAdapter::read_datagram( optional<TCPMessage>& segment, const bool collect )
+{
+  segment.reset();
+
+  if ( not _ring ) {
+    _read_buffer.resize( datagram_buffer_size() );
+    _tun.read( _read_buffer );
+    if ( _read_buffer.empty() ) {
+      return false; // (nothing waiting on the non-blocking fd)
+    }
+    segment = parse_datagram( _read_buffer );
+    return true;
+  }
+
+  // take completions until one is a datagram (each write's completion frees its buffer)
+  if ( collect and not _ring->uring.peek().has_value() ) {
+    _ring->uring.collect();
+  }
+  while ( const auto completion = _ring->uring.pop() ) {
+    const auto slot = static_cast<unsigned>( completion->user_data & UINT32_MAX );
+    if ( ( completion->user_data & ~uint64_t { UINT32_MAX } ) == WRITE_TAG ) {
+      _ring->free_writes.push_back( slot - _ring->depth );
+      if ( completion->result < 0 ) {
+        throw unix_error( "write (io_uring)", -completion->result );
+      }
+      continue;
+    }
+
+    if ( completion->result < 0 ) {
+      throw unix_error( "read (io_uring)", -completion->result );
+    }
+
+    // parse (copying out of the buffer), then read into the buffer again
+    segment = parse_datagram( { _ring->buffer( slot ).data(), static_cast<size_t>( completion->result ) } );
+    _ring->post_read( _tun.fd_num(), slot );
+    return true;
+  }
+  return false;
+}
+
+optional<TCPMessage> TCPOverIPv4OverTunFdAdapter::read()
+{
+  optional<TCPMessage> segment;
+  read_datagram( segment, true );
+  return segment;
+}
+
+size_t TCPOverIPv4OverTunFdAdapter::read_batch( vector<TCPMessage>& segments, const size_t max_datagrams )
+{
+  size_t count = 0;
+  optional<TCPMessage> segment;
+  while ( count < max_datagrams and read_datagram( segment, count == 0 ) ) {
+    ++count;
+    if ( segment.has_value() ) {
+      segments.push_back( move( segment.value() ) );
+    }
+  }
+  return count;
+}
+
 void TCPOverIPv4OverTunFdAdapter::write( const TCPMessage& seg )
 {
-  _tun.write( serialize( wrap_tcp_in_ip( seg ) ) );
+  // without offload, a super-segment is split here, into datagrams of MSS-sized segments
+  if ( not _offload_mss.has_value() ) {
+    split_segment( seg,
+                   TCPConfig::MAX_PAYLOAD_SIZE,
+                   TCPChecksum::Full,
+                   [&]( string_view headers, string_view payload ) { write_datagram( { headers, payload } ); } );
+    return;
+  }
+
+  // with offload, the kernel completes the checksum, and splits a segment longer than the MSS
+  VirtioNetHeader header { .flags = VirtioNetHeader::F_NEEDS_CSUM,
+                           .csum_start = IPv4Header::LENGTH,
+                           .csum_offset = TCP_CHECKSUM_OFFSET };
+  if ( seg.sender->payload.size() > _offload_mss.value() ) {
+    header.gso_type = VirtioNetHeader::GSO_TCPV4;
+    header.gso_size = _offload_mss.value();
+    header.hdr_len = IPv4Header::LENGTH + TCPSegment::HEADER_LENGTH;
+  }
+  const string virtio_net_header = header.serialize();
+  write_datagram( { virtio_net_header, tcp_ip_headers( seg, TCPChecksum::Offloaded ), seg.sender->payload } );
+}
+
+void TCPOverIPv4OverTunFdAdapter::write_datagram( const vector<string_view>& buffers )
+{
+  if ( not _ring ) {
+    _tun.write( buffers );
+    return;
+  }
+
+  size_t size = 0;
+  for ( const auto x : buffers ) {
+    size += x.size();
+  }
+  if ( _ring->free_writes.empty() ) {
+    flush();
+  }
+  if ( _ring->free_writes.empty() or size > _ring->buffer_size ) {
+    flush(); // (so the datagrams still go out in order)
+    _tun.write( buffers );
+    return;
+  }
+
+  const unsigned slot = _ring->depth + _ring->free_writes.back();
+  _ring->free_writes.pop_back();
+  const span<char> buffer = _ring->buffer( slot );
+  size_t copied = 0;
+  for ( const auto x : buffers ) {
+    memcpy( &buffer[copied], x.data(), x.size() );
+    copied += x.size();
+  }
+  _ring->uring.prepare_write_fixed( _tun.fd_num(), buffer.first( size ), 0, WRITE_TAG | slot );
+}
+
+void TCPOverIPv4OverTunFdAdapter::flush()
+{
+  if ( not _ring ) {
+    return;
+  }
+
+  _ring->uring.submit();
+
+  // writes to a TUN device complete during the submission: free their buffers now, unless a
+  // datagram's completion is ahead of them (read() will free them then)
+  while ( const auto completion = _ring->uring.peek() ) {
+    if ( ( completion->user_data & ~uint64_t { UINT32_MAX } ) != WRITE_TAG or completion->result < 0 ) {
+      break;
+    }
+    _ring->uring.pop();
+    _ring->free_writes.push_back( static_cast<unsigned>( completion->user_data & UINT32_MAX ) - _ring->depth );
+  }
 }
 
 //! Specialize LossyFdAdapter to TCPOverIPv4OverTunFdAdapter
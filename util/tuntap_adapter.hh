@@ -1,12 +1,19 @@
 #pragma once
 
 #include "lossy_fd_adapter.hh"
+#include "tcp_config.hh"
 #include "tcp_over_ip.hh"
 #include "tcp_segment.hh"
 #include "tun.hh"
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <optional>
+#include <string>
+#include <string_view>
 #include <utility>
+#include <vector>
 
 template<class T>
 concept TCPDatagramAdapter = requires( T a, TCPMessage seg ) {
@@ -19,26 +26,91 @@ concept TCPDatagramAdapter = requires( T a, TCPMessage seg ) {
 class TCPOverIPv4OverTunFdAdapter : public TCPOverIPv4Adapter
 {
 private:
-  TunFD _tun;
+  FileDescriptor _tun;
+
+  //! With io_uring: the ring, and the registered buffers of its reads and writes
+  struct Ring;
+  std::unique_ptr<Ring> _ring;
+
+  //! Without io_uring: the buffer each datagram is read into (copied out as it is parsed)
+  std::string _read_buffer {};
+
+  //! With a virtio-net header (see use_virtio_net_header): the size the kernel splits super-segments into
+  std::optional<uint16_t> _offload_mss {};
+
+  //! Room for each datagram read (a super-packet, with a virtio-net header)
+  size_t datagram_buffer_size() const;
+
+  //! Parse an IPv4 datagram read from the TUN device (split into header, TCP header, and payload)
+  std::optional<TCPMessage> parse_datagram( std::string_view datagram );
+
+  //! \brief Take the next datagram, if one has arrived, into `segment` (left empty if it is not for us)
+  //! \details With io_uring and `collect`, first asks the kernel for completions if none are waiting.
+  //! \returns false if no datagram was waiting
+  bool read_datagram( std::optional<TCPMessage>& segment, bool collect );
+
+  //! Write one datagram, given as the buffers to concatenate (or, with io_uring, queue the write)
+  void write_datagram( const std::vector<std::string_view>& buffers );
 
 public:
-  //! Construct from a TunFD
-  explicit TCPOverIPv4OverTunFdAdapter( TunFD&& tun ) : _tun( std::move( tun ) ) {}
+  //! \brief Construct from a TunFD (or any fd that reads and writes whole IPv4 datagrams, such as one
+  //! end of a SOCK_DGRAM socketpair), which becomes non-blocking
+  explicit TCPOverIPv4OverTunFdAdapter( FileDescriptor&& tun );
+
+  ~TCPOverIPv4OverTunFdAdapter();
+  TCPOverIPv4OverTunFdAdapter( TCPOverIPv4OverTunFdAdapter&& other ) noexcept;
+  TCPOverIPv4OverTunFdAdapter& operator=( TCPOverIPv4OverTunFdAdapter&& other ) noexcept;
+  TCPOverIPv4OverTunFdAdapter( const TCPOverIPv4OverTunFdAdapter& other ) = delete;
+  TCPOverIPv4OverTunFdAdapter& operator=( const TCPOverIPv4OverTunFdAdapter& other ) = delete;
+
+  //! Datagrams read ahead on the TUN device with io_uring (see use_io_uring)
+  static constexpr unsigned DEFAULT_RING_DEPTH = 64;
+
+  //! \brief Read and write the TUN device through an io_uring, instead of with a read(2) or write(2) per datagram
+  //! \details Keeps `depth` reads posted on the device, each into its own registered buffer, and queues
+  //! writes (copied into registered buffers) until flush(), so that one io_uring_enter(2) submits a batch
+  //! of writes and re-posts the buffers of every datagram read since. fd() becomes the ring, which is
+  //! readable while completions are waiting. Returns false, and keeps reading and writing the device
+  //! directly, where io_uring is unavailable.
+  bool use_io_uring( unsigned depth = DEFAULT_RING_DEPTH );
+
+  //! \brief Read and write a `virtio_net_hdr` before each datagram, as on a TunFD opened with `offload`
+  //! \details Writes then leave the TCP checksum for the kernel to complete, and a segment with more than
+  //! `mss` bytes of payload goes out as one super-segment for the kernel to split. Reads take super-packets
+  //! of up to 64 KiB, and skip verifying checksums the kernel has verified (or left partial). Call before
+  //! use_io_uring().
+  void use_virtio_net_header( uint16_t mss = TCPConfig::MAX_PAYLOAD_SIZE );
 
   //! Attempts to read and parse an IPv4 datagram containing a TCP segment related to the current connection
   std::optional<TCPMessage> read();
 
-  //! Creates an IPv4 datagram from a TCP segment and writes it to the TUN device
+  //! Datagrams taken by one read_batch() unless asked otherwise
+  static constexpr size_t DEFAULT_BATCH_SIZE = 64;
+
+  //! \brief Read up to `max_datagrams` datagrams, stopping early once none is waiting, and append the
+  //! TCP segments among them (as read() would return them) to `segments`
+  //! \details Each datagram is read into the same buffer, with the payload copied out at its exact size.
+  //! With io_uring, takes the completions already collected (asking the kernel only if there are none).
+  //! \returns the number of datagrams read (including any that were not for this connection)
+  size_t read_batch( std::vector<TCPMessage>& segments, size_t max_datagrams = DEFAULT_BATCH_SIZE );
+
+  //! \brief Creates an IPv4 datagram from a TCP segment and writes it to the TUN device (or, with io_uring,
+  //! queues the write)
+  //! \details A super-segment (see TCPConfig::max_segment_payload) goes to the kernel to split, with a
+  //! virtio-net header, or is split here into datagrams of TCPConfig::MAX_PAYLOAD_SIZE bytes of payload each.
   void write( const TCPMessage& seg );
 
+  //! With io_uring: submit the queued writes, and re-post the buffers of the datagrams read so far
+  void flush();
+
   //! Access the underlying TUN device
-  explicit operator TunFD&() { return _tun; }
+  explicit operator FileDescriptor&() { return _tun; }
 
   //! Access the underlying TUN device
-  explicit operator const TunFD&() const { return _tun; }
+  explicit operator const FileDescriptor&() const { return _tun; }
 
-  //! Access underlying file descriptor
-  FileDescriptor& fd() { return _tun; }
+  //! Access underlying file descriptor (the ring, with io_uring)
+  FileDescriptor& fd();
 };
 
 static_assert( TCPDatagramAdapter<TCPOverIPv4OverTunFdAdapter> );
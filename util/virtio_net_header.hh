@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// The virtio-net header that precedes each datagram on a TUN device opened with IFF_VNET_HDR (describing
+// checksum and segmentation offload). Its fields are little-endian, as the kernel has them on a
+// little-endian host. (Mirrors `struct virtio_net_hdr`, whose header does not compile as C++.)
+struct VirtioNetHeader
+{
+  static constexpr uint8_t LENGTH = 10; // header length in bytes
+
+  static constexpr uint8_t F_NEEDS_CSUM = 1; // checksum to be completed from csum_start, stored at csum_offset
+  static constexpr uint8_t F_DATA_VALID = 2; // checksum already verified
+
+  static constexpr uint8_t GSO_NONE = 0;   // not a super-packet
+  static constexpr uint8_t GSO_TCPV4 = 1;  // a TCP/IPv4 super-packet of gso_size segments
+  static constexpr uint8_t GSO_ECN = 0x80; // (flag) the segments carry ECN's CWR
+
+  uint8_t flags = 0;
+  uint8_t gso_type = GSO_NONE;
+  uint16_t hdr_len = 0;     // length of the headers to copy onto each segment
+  uint16_t gso_size = 0;    // payload of each segment
+  uint16_t csum_start = 0;  // where the checksum starts
+  uint16_t csum_offset = 0; // where to store it, from csum_start
+
+  // Parse the header at the start of `datagram` (returns false if it is too short)
+  bool parse( std::string_view datagram )
+  {
+    if ( datagram.size() < LENGTH ) {
+      return false;
+    }
+    const auto u16 = [&]( size_t at ) {
+      return static_cast<uint16_t>( static_cast<uint8_t>( datagram[at] )
+                                    | static_cast<uint8_t>( datagram[at + 1] ) << 8 );
+    };
+    flags = static_cast<uint8_t>( datagram[0] );
+    gso_type = static_cast<uint8_t>( datagram[1] );
+    hdr_len = u16( 2 );
+    gso_size = u16( 4 );
+    csum_start = u16( 6 );
+    csum_offset = u16( 8 );
+    return true;
+  }
+
+  std::string serialize() const
+  {
+    std::string out;
+    out.reserve( LENGTH );
+    out.push_back( static_cast<char>( flags ) );
+    out.push_back( static_cast<char>( gso_type ) );
+    for ( const uint16_t field : { hdr_len, gso_size, csum_start, csum_offset } ) {
+      out.push_back( static_cast<char>( field & 0xff ) );
+      out.push_back( static_cast<char>( field >> 8 ) );
+    }
+    return out;
+  }
+};
@@ -0,0 +1,176 @@
+#include "work_stealing_executor.hh"
+
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+namespace {
+thread_local const WorkStealingExecutor* current_executor = nullptr; // the pool the calling thread works for
+thread_local size_t current_worker = 0;                              // and its index in that pool
+} // namespace
+
+void WorkStealingExecutor::Strand::post( Task task )
+{
+  {
+    const lock_guard lock { mutex_ };
+    tasks_.push_back( move( task ) );
+    if ( scheduled_ ) {
+      return;
+    }
+    scheduled_ = true;
+  }
+  executor_.post( [this] { drain(); } );
+}
+
+void WorkStealingExecutor::Strand::drain()
+{
+  while ( true ) {
+    Task task;
+    {
+      const lock_guard lock { mutex_ };
+      if ( tasks_.empty() ) {
+        scheduled_ = false;
+        return;
+      }
+      task = move( tasks_.front() );
+      tasks_.pop_front();
+    }
+
+    try {
+      task();
+    } catch ( ... ) {
+      // let the exception reach wait_idle(), but keep running the tasks behind this one
+      const lock_guard lock { mutex_ };
+      scheduled_ = not tasks_.empty();
+      if ( scheduled_ ) {
+        executor_.post( [this] { drain(); } );
+      }
+      throw;
+    }
+  }
+}
+
+WorkStealingExecutor::WorkStealingExecutor( const size_t num_workers )
+{
+  if ( num_workers == 0 ) {
+    throw runtime_error( "WorkStealingExecutor: needs at least one worker" );
+  }
+
+  for ( size_t i = 0; i < num_workers; ++i ) {
+    workers_.push_back( make_unique<Worker>() );
+  }
+  for ( size_t i = 0; i < num_workers; ++i ) {
+    workers_[i]->thread = thread( &WorkStealingExecutor::run_worker, this, i );
+  }
+}
+
+WorkStealingExecutor::~WorkStealingExecutor()
+{
+  {
+    const lock_guard lock { mutex_ };
+    stopping_ = true;
+  }
+  work_available_.notify_all();
+
+  for ( auto& worker : workers_ ) {
+    worker->thread.join();
+  }
+}
+
+size_t WorkStealingExecutor::worker_index() const
+{
+  return current_executor == this ? current_worker : workers_.size();
+}
+
+void WorkStealingExecutor::post( Task task )
+{
+  const size_t index = worker_index() < workers_.size() ? worker_index() : next_worker_++ % workers_.size();
+
+  // count the task before any worker can find it, so that `queued_` never goes below zero
+  {
+    const lock_guard lock { mutex_ };
+    ++queued_;
+    ++unfinished_;
+  }
+  {
+    const lock_guard lock { workers_[index]->mutex };
+    workers_[index]->tasks.push_back( move( task ) );
+  }
+  work_available_.notify_one();
+}
+
+// Take the newest task from our own deque, or else steal the oldest task from another worker's
+bool WorkStealingExecutor::take( const size_t index, Task& task )
+{
+  bool stolen = false;
+  for ( size_t i = 0; i < workers_.size() and not task; ++i ) {
+    Worker& victim = *workers_[( index + i ) % workers_.size()];
+    const lock_guard lock { victim.mutex };
+    if ( victim.tasks.empty() ) {
+      continue;
+    }
+    if ( i == 0 ) {
+      task = move( victim.tasks.back() );
+      victim.tasks.pop_back();
+    } else {
+      task = move( victim.tasks.front() );
+      victim.tasks.pop_front();
+      stolen = true;
+    }
+  }
+
+  if ( not task ) {
+    return false;
+  }
+
+  tasks_stolen_ += stolen;
+  const lock_guard lock { mutex_ };
+  --queued_;
+  return true;
+}
+
+// The main loop of a worker thread
+void WorkStealingExecutor::run_worker( const size_t index )
+{
+  current_executor = this;
+  current_worker = index;
+
+  while ( true ) {
+    Task task;
+    if ( take( index, task ) ) {
+      exception_ptr error;
+      try {
+        task();
+      } catch ( ... ) {
+        error = current_exception();
+      }
+      task = nullptr; // destroy the task's captures before counting it as finished
+      ++tasks_run_;
+
+      const lock_guard lock { mutex_ };
+      if ( error and not exception_ ) {
+        exception_ = error;
+      }
+      if ( --unfinished_ == 0 ) {
+        idle_.notify_all();
+      }
+      continue;
+    }
+
+    unique_lock lock { mutex_ };
+    work_available_.wait( lock, [&] { return queued_ > 0 or stopping_; } );
+    if ( queued_ == 0 and stopping_ ) {
+      return;
+    }
+  }
+}
+
+void WorkStealingExecutor::wait_idle()
+{
+  unique_lock lock { mutex_ };
+  idle_.wait( lock, [&] { return unfinished_ == 0; } );
+  if ( exception_ ) {
+    rethrow_exception( exchange( exception_, nullptr ) );
+  }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! \brief A pool of worker threads that balance work among themselves by stealing
+//! \details Each worker owns a deque of tasks. A task posted by a worker goes on the back of that
+//! worker's own deque, and the worker takes its next task from the back too (the most recently
+//! posted task is the one whose data is most likely still in cache). Tasks posted by any other
+//! thread are dealt round-robin. A worker whose deque is empty steals from the front of another
+//! worker's deque, so a burst of work posted to one worker spreads to every idle core.
+class WorkStealingExecutor
+{
+public:
+  using Task = std::function<void()>;
+
+  //! \brief Tasks that run one at a time, in the order they were posted, on any of the workers
+  //! \details A strand keeps the state it guards (e.g. one connection) free of data races without
+  //! a lock: while the strand has tasks, exactly one of them is queued on the executor, and it
+  //! runs the strand's tasks back to back before giving the worker up.
+  class Strand
+  {
+  public:
+    explicit Strand( WorkStealingExecutor& executor ) : executor_( executor ) {}
+
+    //! Run `task` after every task posted to this strand before it
+    void post( Task task );
+
+    Strand( const Strand& other ) = delete;
+    Strand& operator=( const Strand& other ) = delete;
+    Strand( Strand&& other ) = delete;
+    Strand& operator=( Strand&& other ) = delete;
+    ~Strand() = default;
+
+  private:
+    WorkStealingExecutor& executor_;
+    std::mutex mutex_ {};
+    std::deque<Task> tasks_ {};
+    bool scheduled_ {}; //!< Is a task that drains `tasks_` queued or running on the executor?
+
+    void drain();
+  };
+
+  //! Start `num_workers` worker threads (at least one)
+  explicit WorkStealingExecutor( size_t num_workers );
+
+  //! Finish every task that has been posted, then stop and join the workers
+  ~WorkStealingExecutor();
+
+  //! Run `task` on some worker
+  void post( Task task );
+
+  //! \brief Wait until every posted task (including tasks posted by tasks) has finished
+  //! \details If any of them threw, the first exception is rethrown here.
+  void wait_idle();
+
+  size_t num_workers() const { return workers_.size(); }
+
+  //! The index of the calling worker thread, or num_workers() if the caller is not one of the workers
+  size_t worker_index() const;
+
+  uint64_t tasks_run() const { return tasks_run_; }         //!< Tasks finished so far
+  uint64_t tasks_stolen() const { return tasks_stolen_; }   //!< Tasks taken from another worker's deque
+
+  WorkStealingExecutor( const WorkStealingExecutor& other ) = delete;
+  WorkStealingExecutor& operator=( const WorkStealingExecutor& other ) = delete;
+  WorkStealingExecutor( WorkStealingExecutor&& other ) = delete;
+  WorkStealingExecutor& operator=( WorkStealingExecutor&& other ) = delete;
+
+private:
+  struct Worker
+  {
+    std::mutex mutex {};
+    std::deque<Task> tasks {};
+    std::thread thread {};
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers_ {};
+  std::atomic<size_t> next_worker_ {}; //!< Round-robin position for tasks posted from outside the pool
+
+  std::mutex mutex_ {};
+  std::condition_variable work_available_ {}; //!< Signalled when a task is posted (or the pool stops)
+  std::condition_variable idle_ {};           //!< Signalled when the last unfinished task finishes
+  size_t queued_ {};                          //!< Tasks waiting in some deque (guarded by `mutex_`)
+  size_t unfinished_ {};                      //!< Tasks posted but not finished (guarded by `mutex_`)
+  bool stopping_ {};                          //!< Guarded by `mutex_`
+  std::exception_ptr exception_ {};           //!< First exception thrown by a task (guarded by `mutex_`)
+
+  std::atomic<uint64_t> tasks_run_ {};
+  std::atomic<uint64_t> tasks_stolen_ {};
+
+  void run_worker( size_t index );
+  bool take( size_t index, Task& task );
+};